@@ -0,0 +1,764 @@
+/*
+ * Quantum Encryption Device (QED) - Benchmarks
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "../include/quantum_encryption.h"
+#include "../src/quantum_internal.h"
+
+#ifdef __GLIBC__
+// Counts heap allocations made anywhere in the process, library included
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long bench_allocations = 0;
+
+void *malloc(size_t size) {
+    bench_allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    bench_allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    bench_allocations++;
+    return __libc_realloc(ptr, size);
+}
+#define BENCH_COUNTS_ALLOCATIONS 1
+#else
+static unsigned long bench_allocations = 0;
+#define BENCH_COUNTS_ALLOCATIONS 0
+#endif
+
+// Messages per batch call and the minimum time spent on each measurement
+#define BENCH_BATCH 256
+#define BENCH_MIN_SECONDS 0.5
+
+// Size of the file the file benchmarks encrypt and decrypt
+#define BENCH_FILE_MB 128
+
+// Items per pool loop, and the outer and inner sizes of the nested loop
+#define BENCH_POOL_ITEMS 1024
+#define BENCH_POOL_OUTER 16
+#define BENCH_POOL_INNER 64
+
+// Simulated round trip of the loopback channel transport
+#define BENCH_CHANNEL_LATENCY_MS 100
+
+// Data pushed through the socket pair per stream throughput measurement
+#define BENCH_STREAM_MB 256
+
+static const size_t sign_sizes[] = {64, 128, 256, 512, 1024};
+static const size_t small_sizes[] = {16, 64, 256, 1024};
+static const char *const hash_engines[] = {"avx512", "sha-ni", "avx2", "sse4.1", "openssl"};
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// User plus system CPU time of the whole process
+static double bench_cpu_seconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static double bench_sign_single(const qed_hardware_sig_t *hw_sig, uint8_t *data, size_t size) {
+    uint8_t signature[QED_SIGNATURE_LENGTH];
+    double start = bench_now(), elapsed;
+    uint64_t count = 0;
+    size_t i;
+    
+    do {
+        for (i = 0; i < BENCH_BATCH; i++) {
+            qed_generate_quantum_signature(hw_sig, data + i * size, size, signature);
+        }
+        count += BENCH_BATCH;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    
+    return count / elapsed;
+}
+
+static double bench_sign_batch(const qed_hardware_sig_t *hw_sig, uint8_t *data, size_t size,
+                               uint8_t *signatures) {
+    const uint8_t *messages[BENCH_BATCH];
+    size_t lengths[BENCH_BATCH];
+    double start, elapsed;
+    uint64_t count = 0;
+    size_t i;
+    
+    for (i = 0; i < BENCH_BATCH; i++) {
+        messages[i] = data + i * size;
+        lengths[i] = size;
+    }
+    
+    start = bench_now();
+    do {
+        qed_generate_quantum_signatures(hw_sig, messages, lengths, BENCH_BATCH, signatures);
+        count += BENCH_BATCH;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    
+    return count / elapsed;
+}
+
+static int bench_sign(qed_device_t *device) {
+    size_t max_size = sign_sizes[sizeof(sign_sizes) / sizeof(sign_sizes[0]) - 1];
+    uint8_t *data = malloc(BENCH_BATCH * max_size);
+    uint8_t *signatures = malloc(BENCH_BATCH * QED_SIGNATURE_LENGTH);
+    size_t s, e;
+    
+    if (!data || !signatures) {
+        free(data);
+        free(signatures);
+        return 1;
+    }
+    
+    for (s = 0; s < BENCH_BATCH * max_size; s++) {
+        data[s] = (uint8_t)(s * 131 + 7);
+    }
+    
+    printf("Quantum signatures/sec (batches of %d):\n", BENCH_BATCH);
+    printf("  %-10s", "engine");
+    for (s = 0; s < sizeof(sign_sizes) / sizeof(sign_sizes[0]); s++) {
+        printf(" %9zu B", sign_sizes[s]);
+    }
+    printf("\n");
+    
+    printf("  %-10s", "single");
+    for (s = 0; s < sizeof(sign_sizes) / sizeof(sign_sizes[0]); s++) {
+        printf(" %11.0f", bench_sign_single(&device->hardware_sig, data, sign_sizes[s]));
+    }
+    printf("\n");
+    
+    for (e = 0; e < sizeof(hash_engines) / sizeof(hash_engines[0]); e++) {
+        if (qed_set_hash_engine(hash_engines[e]) != QED_SUCCESS) {
+            printf("  %-10s (not supported on this CPU)\n", hash_engines[e]);
+            continue;
+        }
+        printf("  %-10s", hash_engines[e]);
+        for (s = 0; s < sizeof(sign_sizes) / sizeof(sign_sizes[0]); s++) {
+            printf(" %11.0f", bench_sign_batch(&device->hardware_sig, data, sign_sizes[s],
+                                               signatures));
+        }
+        printf("\n");
+    }
+    
+    qed_set_hash_engine(NULL);
+    printf("  default engine: %s\n", qed_get_hash_engine());
+    
+    free(data);
+    free(signatures);
+    return 0;
+}
+
+// Encrypt + decrypt round trips through the allocating or the caller-buffer API
+static double bench_small_round_trip(qed_device_t *device, const uint8_t *plaintext, size_t size,
+                                     bool into, double *allocations) {
+    uint8_t ciphertext[QED_CIPHERTEXT_MAX(1024)];
+    uint8_t decrypted[QED_CIPHERTEXT_MAX(1024)];
+    double start = bench_now(), elapsed;
+    unsigned long allocations_start = bench_allocations;
+    uint64_t count = 0;
+    size_t i;
+    
+    do {
+        for (i = 0; i < BENCH_BATCH; i++) {
+            if (into) {
+                size_t ciphertext_len, decrypted_len;
+                qed_quantum_encrypt_into(device, "bench", plaintext, size, ciphertext,
+                                         sizeof(ciphertext), &ciphertext_len);
+                qed_quantum_decrypt_into(device, "bench", ciphertext, ciphertext_len, decrypted,
+                                         sizeof(decrypted), &decrypted_len);
+            } else {
+                uint8_t *sealed = NULL, *opened = NULL;
+                size_t sealed_len, opened_len;
+                qed_quantum_encrypt(device, "bench", plaintext, size, &sealed, &sealed_len);
+                qed_quantum_decrypt(device, "bench", sealed, sealed_len, &opened, &opened_len);
+                free(sealed);
+                free(opened);
+            }
+        }
+        count += BENCH_BATCH;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    
+    *allocations = (double)(bench_allocations - allocations_start) / count;
+    return elapsed * 1e9 / count;
+}
+
+static int bench_small(qed_device_t *device) {
+    uint8_t plaintext[1024];
+    uint8_t key[QED_KEY_LENGTH];
+    double allocations;
+    size_t s;
+    int into;
+    
+    for (s = 0; s < sizeof(plaintext); s++) {
+        plaintext[s] = (uint8_t)(s * 131 + 7);
+    }
+    
+    // Derive the key up front so the loops only see cache hits
+    if (qed_generate_quantum_key(device, "bench", key, sizeof(key)) != QED_SUCCESS) {
+        return 1;
+    }
+    
+    printf("Encrypt + decrypt round trip (ns, heap allocations per round trip):\n");
+    for (into = 0; into <= 1; into++) {
+        printf("  %-22s", into ? "caller buffers" : "allocating API");
+        for (s = 0; s < sizeof(small_sizes) / sizeof(small_sizes[0]); s++) {
+            double ns = bench_small_round_trip(device, plaintext, small_sizes[s], into != 0,
+                                               &allocations);
+            if (BENCH_COUNTS_ALLOCATIONS) {
+                printf("  %4zu B: %7.0f ns %4.1f", small_sizes[s], ns, allocations);
+            } else {
+                printf("  %4zu B: %7.0f ns", small_sizes[s], ns);
+            }
+        }
+        printf("\n");
+    }
+    
+    return 0;
+}
+
+// The file operations report every call on stdout; hide that while timing
+static int bench_mute(void) {
+    int saved, null_fd;
+    
+    fflush(stdout);
+    saved = dup(STDOUT_FILENO);
+    null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    return saved;
+}
+
+static void bench_unmute(int saved) {
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+// CPU seconds per GB of input for one file operation, with the input cached
+typedef qed_result_t (*bench_file_fn)(qed_device_t *device, const char *key_id,
+                                      const char *input_path, const char *output_path);
+
+static double bench_file_cpu(qed_device_t *device, bench_file_fn fn, const char *input,
+                             const char *output, size_t size) {
+    double start = bench_now(), cpu_start = bench_cpu_seconds();
+    uint64_t bytes = 0;
+    int saved, runs = 0;
+    
+    saved = bench_mute();
+    do {
+        if (fn(device, "bench", input, output) != QED_SUCCESS) {
+            bench_unmute(saved);
+            return -1;
+        }
+        bytes += size;
+        runs++;
+    } while (runs < 3 || bench_now() - start < BENCH_MIN_SECONDS);
+    bench_unmute(saved);
+    
+    return (bench_cpu_seconds() - cpu_start) * 1e9 / bytes;
+}
+
+static qed_result_t bench_encrypt_chunked(qed_device_t *device, const char *key_id,
+                                          const char *input_path, const char *output_path) {
+    return qed_encrypt_file_chunked(device, key_id, input_path, output_path, 0);
+}
+
+static int bench_file(qed_device_t *device) {
+    static const struct {
+        const char *name;
+        bool mmap_input;
+        qed_huge_pages_t huge_pages;
+    } modes[] = {
+        {"stdio", false, QED_HUGE_PAGES_NONE},
+        {"stdio, huge pages", false, QED_HUGE_PAGES_TRANSPARENT},
+        {"mmap", true, QED_HUGE_PAGES_NONE}
+    };
+    size_t size = (size_t)BENCH_FILE_MB * 1024 * 1024;
+    char dir[] = "/tmp/qed-bench-XXXXXX";
+    char plain[64], sealed[64], opened[64];
+    uint8_t key[QED_KEY_LENGTH];
+    uint8_t *data;
+    FILE *file;
+    size_t i;
+    int m, status = 0;
+    
+    if (!mkdtemp(dir)) {
+        return 1;
+    }
+    snprintf(plain, sizeof(plain), "%s/plain", dir);
+    snprintf(sealed, sizeof(sealed), "%s/sealed", dir);
+    snprintf(opened, sizeof(opened), "%s/opened", dir);
+    
+    data = malloc(size);
+    file = fopen(plain, "wb");
+    if (!data || !file) {
+        free(data);
+        if (file) {
+            fclose(file);
+        }
+        rmdir(dir);
+        return 1;
+    }
+    for (i = 0; i < size; i++) {
+        data[i] = (uint8_t)(i * 131 + (i >> 12));
+    }
+    fwrite(data, 1, size, file);
+    fclose(file);
+    free(data);
+    
+    // Derive the key up front so the loops only see cache hits
+    qed_generate_quantum_key(device, "bench", key, sizeof(key));
+    
+    printf("Whole-file CPU time per GB (%d MiB input, page cache warm):\n", BENCH_FILE_MB);
+    printf("  %-18s %12s %12s %12s\n", "input", "encrypt", "decrypt", "chunked");
+    for (m = 0; m < (int)(sizeof(modes) / sizeof(modes[0])) && status == 0; m++) {
+        double encrypt, decrypt, chunked;
+        
+        qed_set_mmap_input(device, modes[m].mmap_input);
+        qed_set_huge_pages(device, modes[m].huge_pages);
+        encrypt = bench_file_cpu(device, qed_encrypt_file, plain, sealed, size);
+        decrypt = bench_file_cpu(device, qed_decrypt_file, sealed, opened, size);
+        chunked = bench_file_cpu(device, bench_encrypt_chunked, plain, sealed, size);
+        if (encrypt < 0 || decrypt < 0 || chunked < 0) {
+            status = 1;
+            break;
+        }
+        printf("  %-18s %10.3f s %10.3f s %10.3f s\n", modes[m].name, encrypt, decrypt,
+               chunked);
+    }
+    qed_set_mmap_input(device, false);
+    qed_set_huge_pages(device, QED_HUGE_PAGES_NONE);
+    
+    unlink(plain);
+    unlink(sealed);
+    unlink(opened);
+    rmdir(dir);
+    return status;
+}
+
+// A CPU-bound item costing 1 to 8 units, so a static split would leave
+// threads idle and stealing has to even it out
+static void bench_pool_item(void *ctx, size_t index) {
+    volatile uint64_t *sink = ctx;
+    uint64_t x = index + 1;
+    size_t i, rounds = 4096 * (index % 8 + 1);
+    
+    for (i = 0; i < rounds; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    *sink += x & 1;
+}
+
+static void bench_pool_nested(void *ctx, size_t index) {
+    (void)index;
+    qed_parallel_for(BENCH_POOL_INNER, bench_pool_item, ctx);
+}
+
+static void bench_pool_empty(void *ctx, size_t index) {
+    (void)ctx;
+    (void)index;
+}
+
+// Items per second of a flat or nested loop with the pool at its size
+static double bench_pool_rate(qed_parallel_fn fn, size_t count, size_t items) {
+    volatile uint64_t sink = 0;
+    double start = bench_now(), elapsed;
+    uint64_t done = 0;
+    
+    do {
+        qed_parallel_for(count, fn, (void *)&sink);
+        done += items;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    
+    return done / elapsed;
+}
+
+// Microseconds per empty 64-item loop on the pool
+static double bench_pool_dispatch(void) {
+    double start = bench_now(), elapsed;
+    uint64_t calls = 0;
+    
+    do {
+        qed_parallel_for(64, bench_pool_empty, NULL);
+        calls++;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    
+    return elapsed * 1e6 / calls;
+}
+
+static void* bench_spawn_thread(void *arg) {
+    return arg;
+}
+
+// The same with threads - 1 threads created and joined per call, as a
+// scheduler without a persistent pool would
+static double bench_spawn_dispatch(size_t threads) {
+    pthread_t spawned[64];
+    double start = bench_now(), elapsed;
+    uint64_t calls = 0;
+    size_t i;
+    
+    do {
+        for (i = 1; i < threads; i++) {
+            pthread_create(&spawned[i], NULL, bench_spawn_thread, NULL);
+        }
+        for (i = 1; i < threads; i++) {
+            pthread_join(spawned[i], NULL);
+        }
+        calls++;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    
+    return elapsed * 1e6 / calls;
+}
+
+static const size_t channel_counts[] = {1, 10, 100, 500};
+
+// Wall time to establish count channels through the manager
+static double bench_channel_setup(qed_device_t *device, size_t count) {
+    qed_channel_transport_t transport;
+    qed_channel_manager_t *manager;
+    char partner_id[32];
+    double start;
+    size_t i;
+    
+    if (qed_channel_loopback_transport(&transport, BENCH_CHANNEL_LATENCY_MS) != QED_SUCCESS ||
+        qed_channel_manager_create(device, "bench", &transport, NULL, NULL, &manager) != QED_SUCCESS) {
+        return -1;
+    }
+    
+    start = bench_now();
+    for (i = 0; i < count; i++) {
+        snprintf(partner_id, sizeof(partner_id), "peer-%zu", i);
+        qed_channel_establish(manager, partner_id);
+    }
+    qed_channel_wait(manager, -1);
+    start = bench_now() - start;
+    
+    qed_channel_manager_destroy(manager);
+    return start;
+}
+
+static int bench_channel(qed_device_t *device) {
+    uint8_t key[QED_KEY_LENGTH];
+    double start, blocking;
+    size_t i;
+    int saved;
+    
+    saved = bench_mute();
+    start = bench_now();
+    qed_create_quantum_channel(device, "peer", key, sizeof(key));
+    blocking = bench_now() - start;
+    bench_unmute(saved);
+    
+    printf("Channel setup with %d ms exchanges (loopback transport):\n",
+           BENCH_CHANNEL_LATENCY_MS);
+    printf("  %-8s %14s %14s\n", "channels", "blocking", "manager");
+    for (i = 0; i < sizeof(channel_counts) / sizeof(channel_counts[0]); i++) {
+        double managed = bench_channel_setup(device, channel_counts[i]);
+        
+        if (managed < 0) {
+            return 1;
+        }
+        printf("  %-8zu %12.3f s %12.3f s\n", channel_counts[i], blocking * channel_counts[i],
+               managed);
+    }
+    printf("  (blocking: one measured qed_create_quantum_channel() call times the count)\n");
+    
+    return 0;
+}
+
+static int bench_pool(qed_device_t *device) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = cpus > 0 ? (size_t)cpus * 2 : 2;
+    double flat_base = 0, nested_base = 0;
+    size_t threads;
+    
+    if (max_threads > 64) {
+        max_threads = 64;
+    }
+    
+    printf("Work-stealing pool scalability (%ld online CPUs, uneven items):\n", cpus);
+    printf("  %-8s %14s %8s %14s %8s %12s %12s\n", "threads", "flat items/s", "speedup",
+           "nested items/s", "speedup", "dispatch", "spawn");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        double flat, nested, dispatch, spawn;
+        
+        if (qed_set_concurrency(device, threads, false) != QED_SUCCESS) {
+            return 1;
+        }
+        flat = bench_pool_rate(bench_pool_item, BENCH_POOL_ITEMS, BENCH_POOL_ITEMS);
+        nested = bench_pool_rate(bench_pool_nested, BENCH_POOL_OUTER,
+                                 BENCH_POOL_OUTER * BENCH_POOL_INNER);
+        dispatch = bench_pool_dispatch();
+        spawn = bench_spawn_dispatch(threads);
+        if (threads == 1) {
+            flat_base = flat;
+            nested_base = nested;
+        }
+        printf("  %-8zu %14.0f %7.2fx %14.0f %7.2fx %9.2f us %9.2f us\n", threads, flat,
+               flat / flat_base, nested, nested / nested_base, dispatch, spawn);
+    }
+    qed_set_concurrency(device, 0, false);
+    
+    return 0;
+}
+
+static const size_t stream_record_sizes[] = {1024, 16 * 1024, 64 * 1024, 256 * 1024};
+
+typedef struct {
+    qed_device_t *device;
+    int fd;
+    size_t record_size;
+    uint8_t *buffer;
+    size_t length;
+    qed_result_t result;
+} bench_stream_peer_t;
+
+// Sends BENCH_STREAM_MB in writes of length bytes, then closes the stream
+static void* bench_stream_sender(void *arg) {
+    bench_stream_peer_t *peer = arg;
+    uint8_t key[QED_KEY_LENGTH] = {0};
+    size_t remaining = (size_t)BENCH_STREAM_MB * 1024 * 1024;
+    qed_stream_t *stream;
+    
+    peer->result = qed_stream_open(peer->device, peer->fd, key, peer->record_size, 0, &stream);
+    if (peer->result != QED_SUCCESS) {
+        return NULL;
+    }
+    while (remaining > 0 && peer->result == QED_SUCCESS) {
+        size_t take = remaining < peer->length ? remaining : peer->length;
+        
+        peer->result = qed_stream_write(stream, peer->buffer, take);
+        remaining -= take;
+    }
+    qed_stream_close(stream);
+    return NULL;
+}
+
+// Returns every record it receives until the other side closes
+static void* bench_stream_echo(void *arg) {
+    bench_stream_peer_t *peer = arg;
+    uint8_t key[QED_KEY_LENGTH] = {0};
+    qed_stream_t *stream;
+    size_t received;
+    
+    peer->result = qed_stream_open(peer->device, peer->fd, key, peer->record_size, 0, &stream);
+    if (peer->result != QED_SUCCESS) {
+        return NULL;
+    }
+    while ((peer->result = qed_stream_read(stream, peer->buffer, peer->length,
+                                           &received)) == QED_SUCCESS && received > 0) {
+        peer->result = qed_stream_write(stream, peer->buffer, received);
+        if (peer->result != QED_SUCCESS) {
+            break;
+        }
+    }
+    qed_stream_close(stream);
+    return NULL;
+}
+
+// MB/s from a sender thread to a reader through a socket pair
+static double bench_stream_throughput(qed_device_t *device, size_t record_size,
+                                      uint8_t *send_buffer, uint8_t *receive_buffer,
+                                      size_t length) {
+    bench_stream_peer_t peer = {device, -1, record_size, send_buffer, length, QED_SUCCESS};
+    uint8_t key[QED_KEY_LENGTH] = {0};
+    size_t received, total = 0;
+    qed_stream_t *stream;
+    pthread_t sender;
+    double start;
+    int fds[2];
+    
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return -1;
+    }
+    peer.fd = fds[0];
+    if (qed_stream_open(device, fds[1], key, record_size, 0, &stream) != QED_SUCCESS) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    
+    start = bench_now();
+    pthread_create(&sender, NULL, bench_stream_sender, &peer);
+    while (qed_stream_read(stream, receive_buffer, length, &received) == QED_SUCCESS &&
+           received > 0) {
+        total += received;
+    }
+    pthread_join(sender, NULL);
+    start = bench_now() - start;
+    
+    qed_stream_close(stream);
+    close(fds[0]);
+    close(fds[1]);
+    if (peer.result != QED_SUCCESS || total != (size_t)BENCH_STREAM_MB * 1024 * 1024) {
+        return -1;
+    }
+    return BENCH_STREAM_MB / start;
+}
+
+// Microseconds for one record to cross the stream, from echoed round trips
+static double bench_stream_latency(qed_device_t *device, size_t record_size,
+                                   uint8_t *send_buffer, uint8_t *receive_buffer) {
+    bench_stream_peer_t peer = {device, -1, record_size, receive_buffer, record_size, QED_SUCCESS};
+    uint8_t key[QED_KEY_LENGTH] = {0};
+    unsigned long trips = 0;
+    qed_stream_t *stream;
+    pthread_t echo;
+    double start, elapsed = 0;
+    size_t received;
+    int fds[2];
+    
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return -1;
+    }
+    peer.fd = fds[0];
+    if (qed_stream_open(device, fds[1], key, record_size, 0, &stream) != QED_SUCCESS) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    pthread_create(&echo, NULL, bench_stream_echo, &peer);
+    
+    start = bench_now();
+    do {
+        size_t got = 0;
+        
+        if (qed_stream_write(stream, send_buffer, record_size) != QED_SUCCESS) {
+            break;
+        }
+        while (got < record_size &&
+               qed_stream_read(stream, send_buffer, record_size, &received) == QED_SUCCESS &&
+               received > 0) {
+            got += received;
+        }
+        trips++;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    
+    qed_stream_close(stream);
+    pthread_join(echo, NULL);
+    close(fds[0]);
+    close(fds[1]);
+    return peer.result == QED_SUCCESS && trips > 0 ? elapsed * 1e6 / trips / 2 : -1;
+}
+
+static int bench_stream(qed_device_t *device) {
+    size_t length = 1024 * 1024;
+    uint8_t *send_buffer = malloc(length);
+    uint8_t *receive_buffer = malloc(length);
+    size_t i;
+    
+    if (!send_buffer || !receive_buffer) {
+        free(send_buffer);
+        free(receive_buffer);
+        return 1;
+    }
+    memset(send_buffer, 0xA5, length);
+    
+    printf("Encrypted stream over a socket pair (%d MB in 1 MiB writes):\n", BENCH_STREAM_MB);
+    printf("  %-8s %12s %16s\n", "record", "MB/s", "record latency");
+    for (i = 0; i < sizeof(stream_record_sizes) / sizeof(stream_record_sizes[0]); i++) {
+        double rate = bench_stream_throughput(device, stream_record_sizes[i], send_buffer,
+                                              receive_buffer, length);
+        double latency = bench_stream_latency(device, stream_record_sizes[i], send_buffer,
+                                              receive_buffer);
+        
+        if (rate < 0 || latency < 0) {
+            free(send_buffer);
+            free(receive_buffer);
+            return 1;
+        }
+        printf("  %-8zu %12.1f %13.2f us\n", stream_record_sizes[i], rate, latency);
+    }
+    printf("  (latency: half of a write, echo and read round trip)\n");
+    
+    free(send_buffer);
+    free(receive_buffer);
+    return 0;
+}
+
+static void bench_usage(const char *program_name) {
+    printf("Usage: %s MODE\n\n", program_name);
+    printf("Modes:\n");
+    printf("  sign    Single vs batched quantum signatures per hash engine\n");
+    printf("  small   Small-message round trips and their heap allocations\n");
+    printf("  file    Whole-file CPU time per GB: stdio vs mapped input, huge pages\n");
+    printf("  pool    Thread pool scaling and per-loop dispatch cost vs spawning threads\n");
+    printf("  channel Blocking vs concurrent channel setup for 1 to 500 partners\n");
+    printf("  stream  Encrypted stream MB/s and per-record latency over a socket pair\n");
+}
+
+int main(int argc, char *argv[]) {
+    qed_device_t device;
+    int status;
+    
+    if (argc != 2) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+    
+    // The same keys on every host unless the caller names another profile
+    setenv("QED_HARDWARE_PROFILE", "reference", 0);
+    
+    if (qed_init(&device) != QED_SUCCESS) {
+        fprintf(stderr, "❌ Failed to initialize quantum device\n");
+        return 1;
+    }
+    
+    if (strcmp(argv[1], "sign") == 0) {
+        status = bench_sign(&device);
+    } else if (strcmp(argv[1], "small") == 0) {
+        status = bench_small(&device);
+    } else if (strcmp(argv[1], "file") == 0) {
+        status = bench_file(&device);
+    } else if (strcmp(argv[1], "pool") == 0) {
+        status = bench_pool(&device);
+    } else if (strcmp(argv[1], "channel") == 0) {
+        status = bench_channel(&device);
+    } else if (strcmp(argv[1], "stream") == 0) {
+        status = bench_stream(&device);
+    } else {
+        bench_usage(argv[0]);
+        status = 1;
+    }
+    
+    qed_cleanup(&device);
+    return status;
+}
@@ -0,0 +1,142 @@
+/*
+ * Quantum Encryption Device (QED) - C++ Interface Benchmark
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+// Round trips through qed.hpp against the C API on the same device: the
+// in-place C calls the wrapper compiles down to, and the allocating calls
+// a hand-written wrapper would copy out of
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "../include/qed.hpp"
+
+namespace {
+
+// Minimum time spent on each measurement, repeated this many times
+constexpr double bench_min_seconds = 0.3;
+constexpr int bench_repeats = 3;
+
+constexpr std::size_t bench_sizes[] = {64, 1024, 64 * 1024, 1024 * 1024};
+
+using bench_device = qed::Device;
+
+double bench_now() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best of bench_repeats runs of fn, in ns per call
+template <class Fn>
+double bench_ns(Fn &&fn) {
+    double best = 0;
+
+    for (int repeat = 0; repeat < bench_repeats; repeat++) {
+        double start = bench_now(), elapsed;
+        std::uint64_t count = 0;
+
+        do {
+            for (int i = 0; i < 16; i++) {
+                fn();
+            }
+            count += 16;
+            elapsed = bench_now() - start;
+        } while (elapsed < bench_min_seconds);
+
+        double ns = elapsed * 1e9 / count;
+        if (repeat == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+int bench_round_trips() {
+    bench_device device;
+    qed_device_t *c_device = device.native_handle();
+    std::vector<std::byte> plaintext(bench_sizes[std::size(bench_sizes) - 1]);
+    std::vector<std::byte> sealed, opened;
+    std::vector<std::byte> c_sealed(bench_device::ciphertext_size(plaintext.size()));
+    std::vector<std::byte> c_opened(plaintext.size());
+    std::uint8_t key[QED_KEY_LENGTH];
+
+    for (std::size_t i = 0; i < plaintext.size(); i++) {
+        plaintext[i] = static_cast<std::byte>(i * 131 + 7);
+    }
+
+    // Derive the key up front so the loops only see cache hits
+    if (qed_generate_quantum_key(c_device, "bench", key, sizeof(key)) != QED_SUCCESS) {
+        return 1;
+    }
+
+    std::printf("Encrypt + decrypt round trip, AES-256-GCM (ns):\n");
+    std::printf("  %10s %14s %14s %14s %10s\n", "Size", "C allocating", "C in place",
+                "C++ qed.hpp", "C++ vs C");
+
+    for (std::size_t size : bench_sizes) {
+        std::span<const std::byte> message(plaintext.data(), size);
+        auto *in = reinterpret_cast<const std::uint8_t*>(plaintext.data());
+
+        double allocating = bench_ns([&] {
+            std::uint8_t *ciphertext = nullptr, *decrypted = nullptr;
+            std::size_t ciphertext_len, decrypted_len;
+
+            qed_quantum_encrypt(c_device, "bench", in, size, &ciphertext, &ciphertext_len);
+            qed_quantum_decrypt(c_device, "bench", ciphertext, ciphertext_len,
+                                &decrypted, &decrypted_len);
+            std::free(ciphertext);
+            std::free(decrypted);
+        });
+
+        double in_place = bench_ns([&] {
+            auto *ciphertext = reinterpret_cast<std::uint8_t*>(c_sealed.data());
+            auto *decrypted = reinterpret_cast<std::uint8_t*>(c_opened.data());
+            std::size_t ciphertext_len, decrypted_len;
+
+            qed_quantum_encrypt_into(c_device, "bench", in, size, ciphertext, c_sealed.size(),
+                                     &ciphertext_len);
+            qed_quantum_decrypt_into(c_device, "bench", ciphertext, ciphertext_len, decrypted,
+                                     c_opened.size(), &decrypted_len);
+        });
+
+        double wrapped = bench_ns([&] {
+            auto ciphertext = device.encrypt("bench", message, sealed);
+            device.decrypt("bench", ciphertext, opened);
+        });
+
+        std::printf("  %8zu B %14.0f %14.0f %14.0f %+9.1f%%\n", size, allocating, in_place,
+                    wrapped, (wrapped / in_place - 1) * 100);
+    }
+
+    // The wrapper's output must match what the C API decrypts
+    auto ciphertext = device.encrypt("bench", plaintext, sealed);
+    auto decrypted = device.decrypt("bench", ciphertext, opened);
+    if (decrypted.size() != plaintext.size() ||
+        std::memcmp(decrypted.data(), plaintext.data(), plaintext.size()) != 0) {
+        std::fprintf(stderr, "❌ Round trip through qed.hpp failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main() {
+    // The same keys on every host unless the caller names another profile
+    setenv("QED_HARDWARE_PROFILE", "reference", 0);
+
+    try {
+        return bench_round_trips();
+    } catch (const qed::error &e) {
+        std::fprintf(stderr, "❌ %s\n", e.what());
+        return 1;
+    }
+}
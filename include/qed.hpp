@@ -0,0 +1,277 @@
+#ifndef QED_HPP
+#define QED_HPP
+
+/*
+ * Quantum Encryption Device (QED) - C++ Interface
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Header-only C++20 wrapper over the C API. A device is configured by its
+ * cipher, MAC and key-length policies, fixed at compile time, so output
+ * sizes are constant expressions and every call is a direct call into the
+ * in-place C functions: results are written straight into caller spans or
+ * reusable buffers, never into a temporary that is then copied.
+ *
+ *   qed::Device device;                           // AES-256-GCM, quantum MAC
+ *   std::vector<std::byte> buffer;
+ *   auto sealed = device.encrypt("key", message, buffer);
+ *
+ * Failures throw qed::error carrying the qed_result_t.
+ */
+
+#if __cplusplus < 202002L
+#error "qed.hpp requires C++20"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "quantum_encryption.h"
+
+namespace qed {
+
+class error : public std::runtime_error {
+public:
+    explicit error(qed_result_t code)
+        : std::runtime_error(qed_get_error_string(code)), code_(code) {}
+
+    qed_result_t code() const noexcept { return code_; }
+
+private:
+    qed_result_t code_;
+};
+
+namespace cipher {
+
+struct aes_256_gcm {
+    static constexpr qed_cipher_t id = QED_CIPHER_AES_256_GCM;
+    static constexpr bool aead = true;
+};
+
+struct chacha20_poly1305 {
+    static constexpr qed_cipher_t id = QED_CIPHER_CHACHA20_POLY1305;
+    static constexpr bool aead = true;
+};
+
+// The original format
+struct aes_256_cbc {
+    static constexpr qed_cipher_t id = QED_CIPHER_AES_256_CBC;
+    static constexpr bool aead = false;
+};
+
+} // namespace cipher
+
+namespace mac {
+
+struct quantum {
+    static constexpr qed_mac_t id = QED_MAC_QUANTUM;
+};
+
+struct hmac_sha256 {
+    static constexpr qed_mac_t id = QED_MAC_HMAC_SHA256;
+};
+
+} // namespace mac
+
+// Keys are derived at QED_KEY_LENGTH bytes; other lengths do not compile
+template <std::size_t Bits>
+struct key_bits {
+    static_assert(Bits == QED_KEY_LENGTH * 8, "QED derives 256-bit keys only");
+    static constexpr std::size_t bytes = Bits / 8;
+};
+
+namespace detail {
+
+inline void check(qed_result_t result) {
+    if (result != QED_SUCCESS) [[unlikely]] {
+        throw error(result);
+    }
+}
+
+inline const uint8_t* bytes(std::span<const std::byte> span) noexcept {
+    return reinterpret_cast<const uint8_t*>(span.data());
+}
+
+inline uint8_t* bytes(std::span<std::byte> span) noexcept {
+    return reinterpret_cast<uint8_t*>(span.data());
+}
+
+} // namespace detail
+
+template <class Cipher = cipher::aes_256_gcm, class Mac = mac::quantum,
+          class Key = key_bits<256>>
+class basic_device {
+public:
+    using cipher_type = Cipher;
+    using mac_type = Mac;
+    using key_type = Key;
+
+    // Everything but CBC with the quantum signature needs the versioned header
+    static constexpr bool versioned =
+        Cipher::aead || !std::is_same_v<Mac, mac::quantum>;
+    static constexpr std::size_t header_size = versioned ? 16 : 0;
+    static constexpr std::size_t record_overhead = QED_SIGNATURE_LENGTH + 16;
+
+    // Exact size of the ciphertext of a plaintext_len byte message
+    static constexpr std::size_t ciphertext_size(std::size_t plaintext_len) noexcept {
+        return header_size + record_overhead +
+               (Cipher::aead ? plaintext_len + 16 : (plaintext_len / 16 + 1) * 16);
+    }
+
+    // Output decrypt() needs for a ciphertext of this configuration; CBC
+    // needs room for the padding it strips
+    static constexpr std::size_t plaintext_capacity(std::size_t ciphertext_len) noexcept {
+        constexpr std::size_t overhead = header_size + record_overhead + (Cipher::aead ? 16 : 0);
+        return ciphertext_len > overhead ? ciphertext_len - overhead : 0;
+    }
+
+    basic_device() : device_(new qed_device_t()) {
+        detail::check(qed_init(device_.get()));
+        configure_initialized();
+    }
+
+    // Derives keys from a fixed hardware profile (see qed_init_with_profile)
+    explicit basic_device(const qed_hardware_sig_t &profile) : device_(new qed_device_t()) {
+        detail::check(qed_init_with_profile(device_.get(), &profile));
+        configure_initialized();
+    }
+
+    basic_device(basic_device &&) noexcept = default;
+    basic_device& operator=(basic_device &&other) noexcept {
+        if (this != &other) {
+            release();
+            device_ = std::move(other.device_);
+        }
+        return *this;
+    }
+    basic_device(const basic_device &) = delete;
+    basic_device& operator=(const basic_device &) = delete;
+
+    ~basic_device() { release(); }
+
+    qed_device_t* native_handle() noexcept { return device_.get(); }
+
+    // Encrypts into out, which needs ciphertext_size(plaintext.size())
+    // bytes; returns the part of out written
+    std::span<std::byte> encrypt(const char *key_id, std::span<const std::byte> plaintext,
+                                 std::span<std::byte> out) {
+        std::size_t written = 0;
+
+        detail::check(qed_quantum_encrypt_into(device_.get(), key_id, detail::bytes(plaintext),
+                                               plaintext.size(), detail::bytes(out), out.size(),
+                                               &written));
+        return out.first(written);
+    }
+
+    // As above, growing buffer when needed; it is never shrunk, so a buffer
+    // reused across calls stops allocating once it fits the largest message.
+    // Settings changed through native_handle() (compression, say) may need
+    // more than ciphertext_size(); the size the library asks for is then
+    // allocated once.
+    std::span<std::byte> encrypt(const char *key_id, std::span<const std::byte> plaintext,
+                                 std::vector<std::byte> &buffer) {
+        std::size_t written = 0;
+        qed_result_t result;
+
+        grow(buffer, ciphertext_size(plaintext.size()));
+        result = qed_quantum_encrypt_into(device_.get(), key_id, detail::bytes(plaintext),
+                                          plaintext.size(),
+                                          reinterpret_cast<uint8_t*>(buffer.data()),
+                                          buffer.size(), &written);
+        if (result == QED_ERROR_INVALID_INPUT && written > buffer.size()) [[unlikely]] {
+            grow(buffer, written);
+            return encrypt(key_id, plaintext, std::span<std::byte>(buffer));
+        }
+        detail::check(result);
+        return std::span<std::byte>(buffer).first(written);
+    }
+
+    // Decrypts into out, which needs plaintext_capacity(ciphertext.size())
+    // bytes for data from this configuration; returns the part written
+    std::span<std::byte> decrypt(const char *key_id, std::span<const std::byte> ciphertext,
+                                 std::span<std::byte> out) {
+        std::size_t written = 0;
+
+        detail::check(qed_quantum_decrypt_into(device_.get(), key_id, detail::bytes(ciphertext),
+                                               ciphertext.size(), detail::bytes(out), out.size(),
+                                               &written));
+        return out.first(written);
+    }
+
+    // As above, growing buffer when needed. Ciphertext from another
+    // configuration (compressed, say) may need more than this one's
+    // plaintext_capacity(), and is handled the same way.
+    std::span<std::byte> decrypt(const char *key_id, std::span<const std::byte> ciphertext,
+                                 std::vector<std::byte> &buffer) {
+        std::size_t written = 0;
+        qed_result_t result;
+
+        grow(buffer, plaintext_capacity(ciphertext.size()));
+        result = qed_quantum_decrypt_into(device_.get(), key_id, detail::bytes(ciphertext),
+                                          ciphertext.size(),
+                                          reinterpret_cast<uint8_t*>(buffer.data()),
+                                          buffer.size(), &written);
+        if (result == QED_ERROR_INVALID_INPUT && written > buffer.size()) [[unlikely]] {
+            grow(buffer, written);
+            return decrypt(key_id, ciphertext, std::span<std::byte>(buffer));
+        }
+        detail::check(result);
+        return std::span<std::byte>(buffer).first(written);
+    }
+
+    void encrypt_file(const char *key_id, const char *input_path, const char *output_path) {
+        detail::check(qed_encrypt_file(device_.get(), key_id, input_path, output_path));
+    }
+
+    void decrypt_file(const char *key_id, const char *input_path, const char *output_path) {
+        detail::check(qed_decrypt_file(device_.get(), key_id, input_path, output_path));
+    }
+
+private:
+    void configure() {
+        detail::check(qed_set_cipher(device_.get(), Cipher::id));
+        detail::check(qed_set_mac(device_.get(), Mac::id));
+    }
+
+    // The destructor does not run when a constructor throws, so a device
+    // that initialised but failed to configure is cleaned up here
+    void configure_initialized() {
+        try {
+            configure();
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    void release() noexcept {
+        if (device_) {
+            qed_cleanup(device_.get());
+            device_.reset();
+        }
+    }
+
+    static void grow(std::vector<std::byte> &buffer, std::size_t size) {
+        if (buffer.size() < size) {
+            buffer.resize(size);
+        }
+    }
+
+    std::unique_ptr<qed_device_t> device_;
+};
+
+using Device = basic_device<>;
+
+} // namespace qed
+
+#endif // QED_HPP
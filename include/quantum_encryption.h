@@ -5,6 +5,10 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
  * Quantum Encryption Device (QED) - C Implementation
  * 
@@ -22,6 +26,11 @@
 #define QED_MAX_KEY_ID_LENGTH 256
 #define QED_MAX_KEYS 1024
 
+// Seekable chunked file format
+#define QED_CHUNK_SIZE_DEFAULT (64 * 1024)
+#define QED_CHUNK_SIZE_MIN 4096
+#define QED_CHUNK_SIZE_MAX (64 * 1024 * 1024)
+
 // Hardware resonance constants
 #define QED_RESONANCE_BASE 1174000
 #define QED_MASS_INCREASE 0.17
@@ -38,7 +47,8 @@ typedef enum {
     QED_ERROR_SIGNATURE_MISMATCH = -6,
     QED_ERROR_KEY_NOT_FOUND = -7,
     QED_ERROR_INVALID_INPUT = -8,
-    QED_ERROR_KEY_LIMIT_REACHED = -9
+    QED_ERROR_KEY_LIMIT_REACHED = -9,
+    QED_ERROR_TIMEOUT = -10
 } qed_result_t;
 
 // Hardware signature structure
@@ -50,19 +60,115 @@ typedef struct {
     char quantum_noise[QED_QUANTUM_NOISE_LENGTH + 1];
 } qed_hardware_sig_t;
 
+// Precomputed keyed-MAC and subkey states, built on first use of a key (internal)
+struct qed_mac_state;
+struct qed_subkey_state;
+
 // Quantum key structure
 typedef struct {
     char key_id[QED_MAX_KEY_ID_LENGTH];
     uint8_t key_data[QED_KEY_LENGTH];
     bool in_use;
+    uint32_t id_hash;                   // qed_key_id_hash(key_id), for tracing
+    struct qed_mac_state *mac_state;
+    struct qed_subkey_state *subkey_state;
 } qed_quantum_key_t;
 
+// Instrumented pipeline stages (see qed_get_stats)
+typedef enum {
+    QED_STAGE_HARDWARE_INIT = 0,
+    QED_STAGE_KEY_LOOKUP,
+    QED_STAGE_RESONANCE,
+    QED_STAGE_CIPHER,
+    QED_STAGE_MAC,
+    QED_STAGE_FILE_READ,
+    QED_STAGE_FILE_WRITE,
+    QED_STAGE_SECURE_WIPE,
+    QED_STAGE_COMPRESS,
+    QED_STAGE_COUNT
+} qed_stage_t;
+
+// Per-stage counters aggregated across all threads
+typedef struct {
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t bytes;
+} qed_stage_stats_t;
+
+typedef struct {
+    qed_stage_stats_t stages[QED_STAGE_COUNT];
+    uint64_t key_hits;
+    uint64_t key_misses;
+} qed_stats_t;
+
+// Operations with latency histograms (see qed_get_latency_percentile)
+typedef enum {
+    QED_OP_ENCRYPT = 0,
+    QED_OP_DECRYPT,
+    QED_OP_KEY_DERIVE,
+    QED_OP_FILE_ENCRYPT,
+    QED_OP_FILE_DECRYPT,
+    QED_OP_FILE_VERIFY,
+    QED_OP_FILE_REKEY,
+    QED_OP_COUNT
+} qed_op_t;
+
+// Working memory held by one operation type, or by the whole library
+typedef struct {
+    uint64_t current_bytes;
+    uint64_t peak_bytes;
+    uint64_t allocations;
+} qed_memory_usage_t;
+
+typedef struct {
+    qed_memory_usage_t ops[QED_OP_COUNT];
+    qed_memory_usage_t total;           // includes memory outside any operation
+} qed_memory_stats_t;
+
+// Optional compression stage in front of the cipher
+typedef enum {
+    QED_COMPRESSION_NONE = 0,
+    QED_COMPRESSION_ZLIB = 1
+} qed_compression_t;
+
+// Signature used by the versioned formats
+typedef enum {
+    QED_MAC_QUANTUM = 0,        // SHA-256(data || key || quantum noise)
+    QED_MAC_HMAC_SHA256 = 1     // HMAC-SHA-256 keyed by key and quantum noise
+} qed_mac_t;
+
+// Cipher backends; qed_init() picks AES-256-GCM when the CPU has AES-NI and
+// PCLMUL and ChaCha20-Poly1305 otherwise. The versioned formats record the
+// choice, so any host can decrypt any of them.
+typedef enum {
+    QED_CIPHER_AES_256_CBC = 0,         // original format
+    QED_CIPHER_AES_256_GCM = 1,
+    QED_CIPHER_CHACHA20_POLY1305 = 2
+} qed_cipher_t;
+
+// Page size requested for large working buffers (see qed_set_huge_pages)
+typedef enum {
+    QED_HUGE_PAGES_NONE = 0,
+    QED_HUGE_PAGES_TRANSPARENT = 1,     // madvise(MADV_HUGEPAGE)
+    QED_HUGE_PAGES_EXPLICIT = 2         // MAP_HUGETLB, else transparent
+} qed_huge_pages_t;
+
 // Main Quantum Encryption Device structure
 typedef struct {
     qed_hardware_sig_t hardware_sig;
     qed_quantum_key_t quantum_keys[QED_MAX_KEYS];
     size_t key_count;
     bool initialized;
+    uint8_t compression;
+    int compression_level;
+    uint8_t mac;
+    uint8_t cipher;
+    bool subkeys;
+    bool direct_io;
+    bool sparse;
+    bool mmap_input;
+    uint8_t huge_pages;
+    uint64_t memory_budget;
 } qed_device_t;
 
 // Core functions
@@ -74,12 +180,30 @@ qed_result_t qed_detect_cpu_frequency(double *frequency);
 qed_result_t qed_detect_ram_signature(qed_hardware_sig_t *hw_sig);
 qed_result_t qed_measure_quantum_noise(qed_hardware_sig_t *hw_sig);
 
+// Hardware profiles: fixed CPU frequency and RAM figures that stand in for
+// the running machine, so keys derive identically on every host. Only
+// cpu_frequency, ram_total and ram_available are read; the RAM signature
+// and quantum noise follow from them. A profile is either a built-in name
+// (see qed_hardware_profile_name) or a file of "field = value" lines as
+// written by qed_save_hardware_profile. qed_init() uses the profile named
+// by the QED_HARDWARE_PROFILE environment variable when it is set.
+qed_result_t qed_init_with_profile(qed_device_t *device, const qed_hardware_sig_t *profile);
+qed_result_t qed_load_hardware_profile(const char *name_or_path, qed_hardware_sig_t *profile);
+qed_result_t qed_save_hardware_profile(const qed_hardware_sig_t *profile, const char *path);
+
+// Built-in profile names by index; NULL past the last
+const char* qed_hardware_profile_name(size_t index);
+
 // Key generation and management
 qed_result_t qed_generate_quantum_key(qed_device_t *device, const char *key_id, 
                                       uint8_t *key_out, size_t key_length);
 qed_result_t qed_quantum_wipe(qed_device_t *device, const char *key_id);
 qed_result_t qed_quantum_wipe_all(qed_device_t *device);
 
+// Derives every listed key not yet cached in parallel and inserts them in
+// one batch; fails without changes if they would exceed QED_MAX_KEYS
+qed_result_t qed_prewarm_keys(qed_device_t *device, const char *const *key_ids, size_t count);
+
 // Hardware resonance generation
 qed_result_t qed_generate_hardware_resonance(const qed_hardware_sig_t *hw_sig, 
                                            uint8_t *resonance_data, size_t length);
@@ -93,6 +217,27 @@ qed_result_t qed_quantum_decrypt(qed_device_t *device, const char *key_id,
                                 const uint8_t *ciphertext, size_t ciphertext_len,
                                 uint8_t **plaintext, size_t *plaintext_len);
 
+// Caller-supplied output. ciphertext needs QED_CIPHERTEXT_MAX(plaintext_len)
+// bytes, or exactly the result's size without compression; plaintext needs
+// ciphertext_len - 48 bytes, less the header and tag of an AEAD buffer,
+// unless the buffer was compressed. When capacity is too small the call
+// returns QED_ERROR_INVALID_INPUT and the length argument holds the size
+// needed. Without compression the result is written in place at any size,
+// and small messages make no heap allocations.
+// The bound covers CBC padding as well as the 16-byte AEAD tag.
+#define QED_CIPHERTEXT_MAX(plaintext_len) \
+    (16 + QED_SUBKEY_SALT_LENGTH + QED_SIGNATURE_LENGTH + 16 + ((plaintext_len) / 16 + 2) * 16)
+
+qed_result_t qed_quantum_encrypt_into(qed_device_t *device, const char *key_id,
+                                     const uint8_t *plaintext, size_t plaintext_len,
+                                     uint8_t *ciphertext, size_t capacity,
+                                     size_t *ciphertext_len);
+
+qed_result_t qed_quantum_decrypt_into(qed_device_t *device, const char *key_id,
+                                     const uint8_t *ciphertext, size_t ciphertext_len,
+                                     uint8_t *plaintext, size_t capacity,
+                                     size_t *plaintext_len);
+
 // File operations
 qed_result_t qed_encrypt_file(qed_device_t *device, const char *key_id,
                              const char *input_path, const char *output_path);
@@ -100,6 +245,156 @@ qed_result_t qed_encrypt_file(qed_device_t *device, const char *key_id,
 qed_result_t qed_decrypt_file(qed_device_t *device, const char *key_id,
                              const char *input_path, const char *output_path);
 
+// Re-encrypts a file from old_key_id to new_key_id without writing any
+// plaintext. Chunked files stream through memory a batch of chunks at a
+// time, opened and resealed in parallel, keeping their chunk size and
+// holes; whole-file inputs of any version are decrypted in memory. The
+// output takes the device's cipher, signature, compression and subkey
+// settings, so the same call upgrades older formats. Key IDs do not enter
+// key derivation: the output gets fresh IVs and salts but the same key
+// material, and still opens under old_key_id. This is not key rotation.
+qed_result_t qed_rekey_file(qed_device_t *device, const char *old_key_id,
+                            const char *new_key_id, const char *input_path,
+                            const char *output_path);
+
+// Compression (level 1-9, 0 for the library default)
+qed_result_t qed_set_compression(qed_device_t *device, qed_compression_t compression,
+                                 int level);
+
+// Signature mode for newly written data (the versioned formats record it)
+qed_result_t qed_set_mac(qed_device_t *device, qed_mac_t mac);
+
+// Cipher for newly written data, and the backend this CPU would pick
+qed_result_t qed_set_cipher(qed_device_t *device, qed_cipher_t cipher);
+qed_cipher_t qed_detect_cipher(void);
+const char* qed_cipher_name(qed_cipher_t cipher);
+
+// Per-file subkeys: when enabled, each new file or buffer is encrypted with
+// HKDF(device key, random salt) and carries the salt in its header; the
+// subkey itself is never stored
+#define QED_SUBKEY_SALT_LENGTH 16
+
+qed_result_t qed_set_subkeys(qed_device_t *device, bool enabled);
+qed_result_t qed_derive_subkey(qed_device_t *device, const char *key_id,
+                               const uint8_t *salt, uint8_t *subkey);
+
+// Output files are written to a temporary file and renamed into place, with
+// page cache dropped behind the writer; direct I/O bypasses the cache
+// entirely where the filesystem supports O_DIRECT
+qed_result_t qed_set_direct_io(qed_device_t *device, bool enabled);
+
+// Sparse files: chunked encryption finds the source's holes with
+// SEEK_DATA/SEEK_HOLE, seals only the data around them and records a hole
+// map; decryption recreates the holes. qed_encrypt_file() switches to the
+// chunked format while this is enabled.
+qed_result_t qed_set_sparse(qed_device_t *device, bool enabled);
+
+// Whole-file encryption and decryption map the input and feed the cipher
+// straight from the mapped pages instead of reading it through stdio. The
+// input must not be truncated while the call runs.
+qed_result_t qed_set_mmap_input(qed_device_t *device, bool enabled);
+
+// Large internal buffers (2 MiB and up) on transparent or reserved huge pages
+qed_result_t qed_set_huge_pages(qed_device_t *device, qed_huge_pages_t huge_pages);
+
+// Working memory a file operation may plan for (0 for no limit). Whole-file
+// encryption that would exceed it writes the chunked format instead, whole-
+// file decryption fails with QED_ERROR_MEMORY before reading anything, and
+// chunked operations shrink their batches to fit.
+qed_result_t qed_set_memory_budget(qed_device_t *device, uint64_t bytes);
+
+// Threads used for parallel work (0 for one per CPU), optionally pinned one
+// per CPU. The work-stealing pool is shared by every device in the process,
+// so the setting applies to all of them; it must not change while another
+// thread is inside a library call.
+qed_result_t qed_set_concurrency(qed_device_t *device, size_t threads, bool pin);
+
+// Seekable chunked files (independently authenticated chunks + index footer)
+qed_result_t qed_encrypt_file_chunked(qed_device_t *device, const char *key_id,
+                                     const char *input_path, const char *output_path,
+                                     size_t chunk_size);
+
+qed_result_t qed_decrypt_range(qed_device_t *device, const char *key_id,
+                              const char *path, uint64_t offset, size_t length,
+                              uint8_t *out);
+
+bool qed_is_chunked_file(const char *path);
+
+// Incremental re-encryption (reseals only chunks that changed since the
+// last run, tracked in a signed "<output>.qmf" manifest)
+typedef struct {
+    uint64_t chunks_total;
+    uint64_t chunks_rewritten;
+    uint64_t bytes_written;
+} qed_incremental_stats_t;
+
+qed_result_t qed_encrypt_file_incremental(qed_device_t *device, const char *key_id,
+                                         const char *input_path, const char *output_path,
+                                         size_t chunk_size, qed_incremental_stats_t *stats);
+
+// Integrity verification (checks signatures only; nothing is decrypted or
+// written, and memory use does not grow with file size)
+typedef struct {
+    qed_result_t result;
+    uint64_t bytes;
+    double seconds;
+} qed_verify_result_t;
+
+qed_result_t qed_verify_file(qed_device_t *device, const char *key_id, const char *path);
+
+// Verifies many files in parallel, one result per path
+qed_result_t qed_verify_files(qed_device_t *device, const char *key_id,
+                             const char *const *paths, size_t count,
+                             qed_verify_result_t *results);
+
+// Batch processing: many encrypt/decrypt/rekey jobs on one initialised device
+typedef enum {
+    QED_BATCH_ENCRYPT = 0,
+    QED_BATCH_DECRYPT = 1,
+    QED_BATCH_REKEY = 2
+} qed_batch_op_t;
+
+typedef struct {
+    qed_batch_op_t op;
+    const char *key_id;
+    const char *input_path;
+    const char *output_path;
+    const char *new_key_id;     // QED_BATCH_REKEY only
+} qed_batch_job_t;
+
+typedef struct {
+    qed_result_t result;
+    uint64_t bytes;
+    double seconds;
+} qed_batch_result_t;
+
+// Called once per finished job, one call at a time
+typedef void (*qed_batch_progress_fn)(void *ctx, size_t done, size_t count,
+                                      const qed_batch_job_t *job,
+                                      const qed_batch_result_t *result);
+
+// Runs jobs on at most workers threads (0 means one per CPU), smallest
+// input first. Every key is derived before the workers start. A non-zero
+// chunk_size encrypts into the chunked format. progress may be NULL.
+qed_result_t qed_run_batch(qed_device_t *device, const qed_batch_job_t *jobs, size_t count,
+                          size_t workers, size_t chunk_size,
+                          qed_batch_progress_fn progress, void *progress_ctx,
+                          qed_batch_result_t *results);
+
+// Encrypted archives: a directory tree in one file with a sealed table of
+// contents. Regular files and directories are stored with their mode and
+// mtime; symbolic links and special files are skipped.
+qed_result_t qed_archive_pack(qed_device_t *device, const char *key_id,
+                              const char *input_dir, const char *output_path);
+
+qed_result_t qed_archive_unpack(qed_device_t *device, const char *key_id,
+                                const char *archive_path, const char *output_dir);
+
+// Decrypts one file from an archive, reading only its own records
+qed_result_t qed_archive_extract(qed_device_t *device, const char *key_id,
+                                 const char *archive_path, const char *entry_name,
+                                 const char *output_path);
+
 // Signature functions
 qed_result_t qed_generate_quantum_signature(const qed_hardware_sig_t *hw_sig,
                                           const uint8_t *data, size_t data_len,
@@ -109,17 +404,168 @@ qed_result_t qed_verify_quantum_signature(const qed_hardware_sig_t *hw_sig,
                                         const uint8_t *data, size_t data_len,
                                         const uint8_t *signature);
 
-// Quantum channel (entanglement simulation)
+// Batched signatures: signatures holds count * QED_SIGNATURE_LENGTH bytes.
+// Verification returns QED_ERROR_SIGNATURE_MISMATCH if any message fails;
+// results (optional) receives the outcome for each message. If hashing
+// fails, both return that error and nothing is compared.
+qed_result_t qed_generate_quantum_signatures(const qed_hardware_sig_t *hw_sig,
+                                           const uint8_t *const *data, const size_t *data_len,
+                                           size_t count, uint8_t *signatures);
+
+qed_result_t qed_verify_quantum_signatures(const qed_hardware_sig_t *hw_sig,
+                                         const uint8_t *const *data, const size_t *data_len,
+                                         size_t count, const uint8_t *signatures,
+                                         qed_result_t *results);
+
+// SHA-256 engine used by the batched signatures ("sha-ni", "avx512", "avx2",
+// "sse4.1" or "openssl"); NULL restores automatic selection
+const char* qed_get_hash_engine(void);
+qed_result_t qed_set_hash_engine(const char *name);
+
+// Keyed signatures (HMAC-SHA-256 with per-key precomputed pad states)
+qed_result_t qed_generate_keyed_signature(qed_device_t *device, const char *key_id,
+                                         const uint8_t *data, size_t data_len,
+                                         uint8_t *signature);
+
+qed_result_t qed_verify_keyed_signature(qed_device_t *device, const char *key_id,
+                                       const uint8_t *data, size_t data_len,
+                                       const uint8_t *signature);
+
+// Quantum channel (entanglement simulation); blocks for the exchange, see
+// the channel manager below for establishing many channels at once
 qed_result_t qed_create_quantum_channel(qed_device_t *device, 
                                        const char *partner_device_id,
                                        uint8_t *channel_key, size_t key_length);
 
+// Asynchronous channel manager. qed_channel_establish() only starts an
+// exchange through the transport and returns; exchanges to many partners
+// overlap, so N channels take about as long as one. Channel keys are
+// cached by partner ID, and each completion is reported to the callback
+// or, without one, queued for qed_channel_poll().
+#define QED_CHANNEL_NONCE_LENGTH 32
+
+typedef struct qed_channel_manager qed_channel_manager_t;
+
+typedef struct {
+    char partner_id[QED_MAX_KEY_ID_LENGTH];
+    qed_result_t result;
+    uint8_t key[QED_KEY_LENGTH];        // valid when result is QED_SUCCESS
+} qed_channel_event_t;
+
+// Runs on the thread that completed the exchange (a transport thread, or
+// the caller for a cached partner); it must not destroy the manager
+typedef void (*qed_channel_callback_t)(void *ctx, const qed_channel_event_t *event);
+
+// exchange() sends the local nonce to the partner without blocking and
+// later calls qed_channel_deliver() with ticket exactly once, from any
+// thread, with the partner's nonce or an error. destroy (optional) runs
+// when the manager is destroyed.
+typedef struct {
+    qed_result_t (*exchange)(void *ctx, qed_channel_manager_t *manager, uint64_t ticket,
+                             const char *partner_id, const uint8_t *nonce);
+    void (*destroy)(void *ctx);
+    void *ctx;
+} qed_channel_transport_t;
+
+// In-process stand-in for testing: answers every exchange after latency_ms
+// from one timer thread, with a nonce derived from the partner ID
+qed_result_t qed_channel_loopback_transport(qed_channel_transport_t *transport,
+                                            unsigned latency_ms);
+
+// local_id names this end to its partners. The key is derived from the
+// device's hardware resonance, so both ends of an exchange agree on it
+// only if their devices were initialised from the same hardware profile. The manager takes ownership of the transport;
+// destroying it waits for exchanges in flight and wipes the cached keys.
+qed_result_t qed_channel_manager_create(qed_device_t *device, const char *local_id,
+                                        const qed_channel_transport_t *transport,
+                                        qed_channel_callback_t callback, void *callback_ctx,
+                                        qed_channel_manager_t **manager);
+void qed_channel_manager_destroy(qed_channel_manager_t *manager);
+
+// Starts an exchange unless the partner is cached (reported at once) or
+// already in flight (reported when that one completes)
+qed_result_t qed_channel_establish(qed_channel_manager_t *manager, const char *partner_id);
+qed_result_t qed_channel_deliver(qed_channel_manager_t *manager, uint64_t ticket,
+                                 qed_result_t status, const uint8_t *partner_nonce);
+
+// Moves up to max queued completions into events and returns how many
+size_t qed_channel_poll(qed_channel_manager_t *manager, qed_channel_event_t *events, size_t max);
+
+// Waits until no exchange is in flight; timeout_ms < 0 waits forever.
+// Returns QED_ERROR_TIMEOUT if some are still in flight then.
+qed_result_t qed_channel_wait(qed_channel_manager_t *manager, int timeout_ms);
+
+// Copies the cached key for partner_id; QED_ERROR_KEY_NOT_FOUND if it has
+// not been established
+qed_result_t qed_channel_lookup(qed_channel_manager_t *manager, const char *partner_id,
+                                uint8_t *key);
+
+// Encrypted streams over a socket or other bidirectional file descriptor.
+// Data is sent as authenticated records of at most record_size bytes
+// (smaller for latency, larger for throughput) under traffic keys derived
+// from key (a channel key or a device key) and both ends' random salts,
+// one key per direction; each is ratcheted forward every rekey_bytes. Each
+// write is sealed and sent with one writev(), and reads decrypt straight
+// into the caller's buffer. The fd stays owned by the caller.
+#define QED_STREAM_RECORD_DEFAULT (16 * 1024)
+#define QED_STREAM_RECORD_MAX (1024 * 1024)
+#define QED_STREAM_REKEY_DEFAULT (1ULL << 30)
+
+typedef struct qed_stream qed_stream_t;
+
+// record_size and rekey_bytes of 0 select the defaults. Opening sends this
+// end's salt; the first read or write waits for the peer's.
+qed_result_t qed_stream_open(qed_device_t *device, int fd, const uint8_t *key,
+                             size_t record_size, uint64_t rekey_bytes, qed_stream_t **stream);
+qed_result_t qed_stream_write(qed_stream_t *stream, const void *data, size_t length);
+
+// Returns at least one byte unless the peer closed the stream, in which
+// case *received is 0. A stream cut short without the peer's close, or
+// any tampered record, fails with QED_ERROR_DECRYPTION.
+qed_result_t qed_stream_read(qed_stream_t *stream, void *buffer, size_t capacity,
+                             size_t *received);
+
+// Sends the end-of-stream record once the peer's salt has arrived, then
+// frees
+qed_result_t qed_stream_close(qed_stream_t *stream);
+
 // Utility functions
 const char* qed_get_error_string(qed_result_t result);
 void qed_print_hardware_info(const qed_hardware_sig_t *hw_sig);
 void qed_secure_zero(void *ptr, size_t len);
 
+// Performance statistics (disabled by default)
+void qed_enable_stats(bool enabled);
+bool qed_stats_enabled(void);
+qed_result_t qed_get_stats(qed_stats_t *stats);
+void qed_reset_stats(void);
+const char* qed_get_stage_name(qed_stage_t stage);
+void qed_print_stats(const qed_stats_t *stats, double elapsed_seconds);
+
+// Latency histograms (recorded while statistics are enabled)
+const char* qed_get_op_name(qed_op_t op);
+uint64_t qed_get_latency_count(qed_op_t op);
+uint64_t qed_get_latency_percentile(qed_op_t op, double percentile);
+void qed_print_latency_report(void);
+
+// Working memory accounting (always on). Buffers that grow with the data
+// are charged to the operation that allocates them; buffers returned to the
+// caller stop counting once returned. Resetting sets peaks to the current
+// usage and clears allocation counts.
+qed_result_t qed_get_memory_stats(qed_memory_stats_t *stats);
+void qed_reset_memory_stats(void);
+void qed_print_memory_stats(const qed_memory_stats_t *stats);
+
+// Trace export (Chrome trace-event JSON)
+qed_result_t qed_trace_start(size_t max_events);
+void qed_trace_stop(void);
+qed_result_t qed_trace_dump(const char *path);
+
 // CLI interface
 int qed_cli_main(int argc, char *argv[]);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // QUANTUM_ENCRYPTION_H
\ No newline at end of file
@@ -6,8 +6,8 @@ License:        Proprietary Commercial Software
 URL:            https://github.com/americosimoes/qed-quantum-encryption
 Source0:        qed-eval-2.0.0.tar.gz
 
-BuildRequires:  gcc, openssl-devel
-Requires:       openssl
+BuildRequires:  gcc, openssl-devel, zlib-devel
+Requires:       openssl, zlib
 
 %description
 The Quantum Encryption Device (QED) - 30-Day Evaluation Version.
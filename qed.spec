@@ -10,7 +10,9 @@ Source0:        %{name}-%{version}.tar.gz
 BuildRequires:  gcc
 BuildRequires:  make
 BuildRequires:  openssl-devel
+BuildRequires:  zlib-devel
 Requires:       openssl
+Requires:       zlib
 
 %description
 The Quantum Encryption Device (QED) is a revolutionary cryptographic system 
@@ -0,0 +1,1019 @@
+/*
+ * Quantum Encryption Device (QED) - Encrypted Archives
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Archive layout (all integers little-endian):
+ *
+ *   header   48 bytes   "QEDA", version, cipher, mac, flags, chunk size,
+ *                       random archive id at offset 24
+ *   entries  records    signature || IV || ciphertext; each file's data is
+ *                       split into chunk-size records stored back to back
+ *   toc      1 record   sealed table of contents
+ *   footer   24 bytes   toc offset (u64), toc record length (u64),
+ *                       entry count (u32), "QEDT"
+ *
+ * The table of contents starts with the entry count (u64), followed by one
+ * entry per file or directory: first record offset (u64), size (u64),
+ * mode (u32), mtime (i64), name length (u16) and the relative name.
+ *
+ * Record signatures cover the header, the entry number, the chunk number
+ * and the plaintext length, so records cannot be moved between entries or
+ * archives. The table of contents is sealed as entry number 2^64 - 1 with
+ * length 0 (its own record authenticates the length) and binds every name
+ * to its entry number, size and offset; with the record lengths fixed by
+ * the cipher, one entry can be located and checked without reading any
+ * other. Empty files and directories have no records.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/rand.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#define QED_ARCHIVE_MAGIC "QEDA"
+#define QED_ARCHIVE_TOC_MAGIC "QEDT"
+#define QED_ARCHIVE_VERSION 1
+#define QED_ARCHIVE_HEADER_SIZE 48
+#define QED_ARCHIVE_FOOTER_SIZE 24
+#define QED_ARCHIVE_AAD_SIZE (QED_ARCHIVE_HEADER_SIZE + 20)
+#define QED_ARCHIVE_ENTRY_SIZE 30
+#define QED_ARCHIVE_NAME_MAX 4095
+#define QED_ARCHIVE_FLAG_SUBKEY 0x01
+
+// Entry number the table of contents is sealed under
+#define QED_ARCHIVE_TOC_ENTRY UINT64_MAX
+
+// Upper bound on plaintext held in flight while packing
+#define QED_ARCHIVE_BATCH_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t mode;
+    int64_t mtime;
+    const char *name;
+    size_t name_len;
+} qed_archive_entry_t;
+
+typedef struct {
+    int fd;
+    uint8_t header[QED_ARCHIVE_HEADER_SIZE];
+    uint8_t cipher;
+    uint8_t mac;
+    size_t chunk_size;
+    uint64_t toc_offset;
+    uint8_t *toc;
+    qed_archive_entry_t *entries;
+    uint64_t entry_count;
+} qed_archive_reader_t;
+
+typedef struct {
+    const qed_hardware_sig_t *hw_sig;
+    const uint8_t *key;
+    const qed_mac_state_t *mac;
+    uint8_t cipher;
+    const uint8_t *header;
+    size_t chunk_size;
+    uint8_t *plain;
+    size_t *plain_lens;
+    uint64_t *entry_numbers;
+    uint64_t *chunk_numbers;
+    uint8_t *records;
+    size_t *record_lens;
+    qed_result_t *results;
+} qed_archive_batch_t;
+
+typedef struct {
+    qed_device_t *device;
+    qed_archive_batch_t batch;
+    size_t batch_size;
+    size_t pending;
+    qed_output_t output;
+    bool output_open;
+    uint64_t offset;
+    uint64_t entry_count;
+    uint64_t bytes;
+    uint8_t *toc;
+    size_t toc_len;
+    size_t toc_capacity;
+    // Identities of the archive in progress and any old one it replaces
+    dev_t own_dev[2];
+    ino_t own_ino[2];
+    size_t own_count;
+} qed_archive_writer_t;
+
+typedef struct {
+    const qed_archive_reader_t *reader;
+    const qed_device_t *device;
+    const uint8_t *key;
+    const qed_mac_state_t *mac;
+    const char *output_dir;
+    qed_result_t *results;
+} qed_archive_unpack_t;
+
+static size_t qed_archive_aad(const uint8_t *header, uint64_t entry, uint64_t chunk,
+                              uint32_t plain_len, uint8_t *aad) {
+    memcpy(aad, header, QED_ARCHIVE_HEADER_SIZE);
+    qed_put_le64(aad + QED_ARCHIVE_HEADER_SIZE, entry);
+    qed_put_le64(aad + QED_ARCHIVE_HEADER_SIZE + 8, chunk);
+    qed_put_le32(aad + QED_ARCHIVE_HEADER_SIZE + 16, plain_len);
+    return QED_ARCHIVE_AAD_SIZE;
+}
+
+static qed_result_t qed_archive_key(qed_device_t *device, const char *key_id,
+                                    const uint8_t *header, uint8_t *key) {
+    return qed_file_key(device, key_id, (header[7] & QED_ARCHIVE_FLAG_SUBKEY) ?
+                        header + 24 : NULL, key);
+}
+
+// Names are relative, '/'-separated and free of empty, "." and ".." parts
+static bool qed_archive_name_valid(const char *name, size_t name_len) {
+    size_t start = 0, i;
+    
+    if (name_len == 0 || name_len > QED_ARCHIVE_NAME_MAX || memchr(name, '\0', name_len)) {
+        return false;
+    }
+    
+    for (i = 0; i <= name_len; i++) {
+        if (i == name_len || name[i] == '/') {
+            size_t part = i - start;
+            if (part == 0 || (part == 1 && name[start] == '.') ||
+                (part == 2 && name[start] == '.' && name[start + 1] == '.')) {
+                return false;
+            }
+            start = i + 1;
+        }
+    }
+    return true;
+}
+
+/* Packing */
+
+static void qed_archive_seal_worker(void *ctx, size_t slot) {
+    qed_archive_batch_t *batch = ctx;
+    uint8_t aad[QED_ARCHIVE_AAD_SIZE];
+    size_t aad_len;
+    
+    aad_len = qed_archive_aad(batch->header, batch->entry_numbers[slot],
+                              batch->chunk_numbers[slot], (uint32_t)batch->plain_lens[slot], aad);
+    batch->results[slot] = qed_seal_record(batch->hw_sig, batch->key, batch->mac, batch->cipher,
+                                           aad, aad_len,
+                                           batch->plain + slot * batch->chunk_size,
+                                           batch->plain_lens[slot],
+                                           batch->records +
+                                               slot * QED_CHUNKED_RECORD_MAX(batch->chunk_size),
+                                           &batch->record_lens[slot]);
+}
+
+// Seals the queued records in parallel and appends them in order
+static qed_result_t qed_archive_flush(qed_archive_writer_t *writer) {
+    qed_archive_batch_t *batch = &writer->batch;
+    size_t slot;
+    
+    qed_parallel_for(writer->pending, qed_archive_seal_worker, batch);
+    
+    for (slot = 0; slot < writer->pending; slot++) {
+        const uint8_t *record = batch->records + slot * QED_CHUNKED_RECORD_MAX(batch->chunk_size);
+        size_t record_len = batch->record_lens[slot];
+        
+        if (batch->results[slot] != QED_SUCCESS) {
+            return batch->results[slot];
+        }
+        
+        // Readers locate records from their lengths alone
+        if (record_len != qed_record_length(batch->cipher, batch->plain_lens[slot])) {
+            return QED_ERROR_ENCRYPTION;
+        }
+        
+        QED_STAGE_BEGIN(write_start);
+        QED_PROBE(file__write__start);
+        if (qed_output_write(&writer->output, record, record_len) != QED_SUCCESS) {
+            return QED_ERROR_FILE_IO;
+        }
+        QED_STAGE_END(QED_STAGE_FILE_WRITE, write_start, record_len);
+        QED_PROBE1(file__write__done, record_len);
+    }
+    
+    writer->pending = 0;
+    return QED_SUCCESS;
+}
+
+static qed_result_t qed_archive_add_toc(qed_archive_writer_t *writer, const char *name,
+                                        const struct stat *st) {
+    size_t name_len = strlen(name);
+    uint8_t *entry;
+    
+    if (!qed_archive_name_valid(name, name_len) || writer->entry_count >= UINT32_MAX) {
+        printf("❌ Error: Cannot archive '%s'.\n", name);
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (writer->toc_len + QED_ARCHIVE_ENTRY_SIZE + name_len > writer->toc_capacity) {
+        size_t capacity = writer->toc_capacity * 2 + QED_ARCHIVE_ENTRY_SIZE + name_len;
+        uint8_t *grown = realloc(writer->toc, capacity);
+        if (!grown) {
+            return QED_ERROR_MEMORY;
+        }
+        writer->toc = grown;
+        writer->toc_capacity = capacity;
+    }
+    
+    entry = writer->toc + writer->toc_len;
+    qed_put_le64(entry, writer->offset);
+    qed_put_le64(entry + 8, S_ISREG(st->st_mode) ? (uint64_t)st->st_size : 0);
+    qed_put_le32(entry + 16, (uint32_t)st->st_mode);
+    qed_put_le64(entry + 20, (uint64_t)(int64_t)st->st_mtime);
+    entry[28] = (uint8_t)name_len;
+    entry[29] = (uint8_t)(name_len >> 8);
+    memcpy(entry + QED_ARCHIVE_ENTRY_SIZE, name, name_len);
+    writer->toc_len += QED_ARCHIVE_ENTRY_SIZE + name_len;
+    writer->entry_count++;
+    return QED_SUCCESS;
+}
+
+// Queues a file's data as records; the file must not change size meanwhile
+static qed_result_t qed_archive_add_file(qed_archive_writer_t *writer, const char *path,
+                                         uint64_t size) {
+    qed_archive_batch_t *batch = &writer->batch;
+    uint64_t entry = writer->entry_count - 1;
+    uint64_t chunk = 0;
+    qed_result_t result = QED_SUCCESS;
+    FILE *input;
+    
+    if (size == 0) {
+        return QED_SUCCESS;
+    }
+    
+    input = fopen(path, "rb");
+    if (!input) {
+        printf("❌ Error: Cannot read '%s'.\n", path);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    while (size > 0) {
+        size_t plain_len = size < batch->chunk_size ? (size_t)size : batch->chunk_size;
+        size_t slot = writer->pending;
+        
+        QED_STAGE_BEGIN(read_start);
+        QED_PROBE(file__read__start);
+        if (fread(batch->plain + slot * batch->chunk_size, 1, plain_len, input) != plain_len) {
+            printf("❌ Error: '%s' changed while it was being archived.\n", path);
+            result = QED_ERROR_FILE_IO;
+            break;
+        }
+        QED_STAGE_END(QED_STAGE_FILE_READ, read_start, plain_len);
+        QED_PROBE1(file__read__done, plain_len);
+        
+        batch->plain_lens[slot] = plain_len;
+        batch->entry_numbers[slot] = entry;
+        batch->chunk_numbers[slot] = chunk++;
+        writer->offset += qed_record_length(batch->cipher, plain_len);
+        writer->bytes += plain_len;
+        size -= plain_len;
+        
+        if (++writer->pending == writer->batch_size) {
+            result = qed_archive_flush(writer);
+            if (result != QED_SUCCESS) {
+                break;
+            }
+        }
+    }
+    
+    fclose(input);
+    return result;
+}
+
+// Records a file the walk must not pack into the archive
+static void qed_archive_skip(qed_archive_writer_t *writer, const struct stat *st) {
+    writer->own_dev[writer->own_count] = st->st_dev;
+    writer->own_ino[writer->own_count] = st->st_ino;
+    writer->own_count++;
+}
+
+static bool qed_archive_is_own(const qed_archive_writer_t *writer, const struct stat *st) {
+    size_t i;
+    
+    for (i = 0; i < writer->own_count; i++) {
+        if (writer->own_dev[i] == st->st_dev && writer->own_ino[i] == st->st_ino) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Adds the entries under dir_path (named relative to the archive root),
+// sorted by name so the same tree always packs the same way
+static qed_result_t qed_archive_walk(qed_archive_writer_t *writer, const char *dir_path,
+                                     const char *prefix) {
+    struct dirent **names = NULL;
+    qed_result_t result = QED_SUCCESS;
+    int count, i;
+    
+    count = scandir(dir_path, &names, NULL, alphasort);
+    if (count < 0) {
+        printf("❌ Error: Cannot read directory '%s'.\n", dir_path);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    for (i = 0; i < count; i++) {
+        const char *base = names[i]->d_name;
+        char *path = NULL, *name = NULL;
+        struct stat st;
+        
+        if (result != QED_SUCCESS || strcmp(base, ".") == 0 || strcmp(base, "..") == 0) {
+            free(names[i]);
+            continue;
+        }
+        
+        path = malloc(strlen(dir_path) + strlen(base) + 2);
+        name = malloc(strlen(prefix) + strlen(base) + 2);
+        if (!path || !name) {
+            result = QED_ERROR_MEMORY;
+        } else {
+            sprintf(path, "%s/%s", dir_path, base);
+            sprintf(name, "%s%s%s", prefix, *prefix ? "/" : "", base);
+            
+            // Symbolic links, devices and the archive itself (old or in
+            // progress) are skipped
+            if (lstat(path, &st) != 0) {
+                result = QED_ERROR_FILE_IO;
+            } else if (S_ISDIR(st.st_mode)) {
+                result = qed_archive_add_toc(writer, name, &st);
+                if (result == QED_SUCCESS) {
+                    result = qed_archive_walk(writer, path, name);
+                }
+            } else if (S_ISREG(st.st_mode) && !qed_archive_is_own(writer, &st)) {
+                result = qed_archive_add_toc(writer, name, &st);
+                if (result == QED_SUCCESS) {
+                    result = qed_archive_add_file(writer, path, (uint64_t)st.st_size);
+                }
+            }
+        }
+        
+        free(path);
+        free(name);
+        free(names[i]);
+    }
+    
+    free(names);
+    return result;
+}
+
+qed_result_t qed_archive_pack(qed_device_t *device, const char *key_id,
+                              const char *input_dir, const char *output_path) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    uint8_t header[QED_ARCHIVE_HEADER_SIZE];
+    uint8_t footer[QED_ARCHIVE_FOOTER_SIZE];
+    uint8_t aad[QED_ARCHIVE_AAD_SIZE];
+    uint8_t *toc_record = NULL;
+    size_t toc_record_len = 0;
+    qed_archive_writer_t writer;
+    qed_archive_batch_t *batch = &writer.batch;
+    size_t chunk_size = QED_CHUNK_SIZE_DEFAULT;
+    struct stat st;
+    qed_result_t result;
+    
+    if (!device || !key_id || !input_dir || !output_path) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (stat(input_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        printf("❌ Error: Input directory '%s' does not exist.\n", input_dir);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_FILE_ENCRYPT);
+    QED_OP_BEGIN(op_start);
+    
+    result = qed_generate_quantum_key(device, key_id, quantum_key, QED_KEY_LENGTH);
+    if (result != QED_SUCCESS) {
+        printf("❌ Archive packing failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    memset(header, 0, sizeof(header));
+    memcpy(header, QED_ARCHIVE_MAGIC, 4);
+    header[4] = QED_ARCHIVE_VERSION;
+    header[5] = device->cipher;
+    header[6] = device->mac;
+    header[7] = device->subkeys ? QED_ARCHIVE_FLAG_SUBKEY : 0;
+    qed_put_le32(header + 8, (uint32_t)chunk_size);
+    
+    memset(&writer, 0, sizeof(writer));
+    writer.device = device;
+    writer.offset = sizeof(header);
+    writer.batch_size = 2 * qed_parallel_workers();
+    if (writer.batch_size > QED_ARCHIVE_BATCH_BYTES / chunk_size) {
+        writer.batch_size = QED_ARCHIVE_BATCH_BYTES / chunk_size;
+    }
+    // Under a memory budget each slot holds a plaintext chunk and its record
+    if (device->memory_budget) {
+        uint64_t slot_bytes = chunk_size + QED_CHUNKED_RECORD_MAX(chunk_size);
+        
+        if (writer.batch_size > device->memory_budget / slot_bytes) {
+            writer.batch_size = (size_t)(device->memory_budget / slot_bytes);
+        }
+        if (writer.batch_size == 0) {
+            writer.batch_size = 1;
+        }
+    }
+    
+    batch->hw_sig = &device->hardware_sig;
+    batch->key = quantum_key;
+    batch->cipher = device->cipher;
+    batch->header = header;
+    batch->chunk_size = chunk_size;
+    batch->plain = qed_buffer_alloc(device, writer.batch_size * chunk_size);
+    batch->plain_lens = calloc(writer.batch_size, sizeof(size_t));
+    batch->entry_numbers = calloc(writer.batch_size, sizeof(uint64_t));
+    batch->chunk_numbers = calloc(writer.batch_size, sizeof(uint64_t));
+    batch->records = qed_buffer_alloc(device, writer.batch_size * QED_CHUNKED_RECORD_MAX(chunk_size));
+    batch->record_lens = calloc(writer.batch_size, sizeof(size_t));
+    batch->results = calloc(writer.batch_size, sizeof(qed_result_t));
+    writer.toc_capacity = 4096;
+    writer.toc = malloc(writer.toc_capacity);
+    
+    if (!batch->plain || !batch->plain_lens || !batch->entry_numbers || !batch->chunk_numbers ||
+        !batch->records || !batch->record_lens || !batch->results || !writer.toc) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    if (device->mac == QED_MAC_HMAC_SHA256) {
+        result = qed_get_mac_state(device, key_id, &batch->mac);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+    }
+    
+    if (RAND_bytes(header + 24, 16) != 1) {
+        result = QED_ERROR_ENCRYPTION;
+        goto cleanup;
+    }
+    
+    // The random archive id doubles as the subkey salt
+    result = qed_archive_key(device, key_id, header, quantum_key);
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    // The entry count leads the table of contents
+    writer.toc_len = 8;
+    
+    result = qed_output_open(&writer.output, device, output_path, 0);
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    writer.output_open = true;
+    
+    // The walk compares each file's lstat() against these, so the archive
+    // and the one it replaces are identified once rather than per file
+    if (fstat(writer.output.fd, &st) != 0) {
+        result = QED_ERROR_FILE_IO;
+        goto cleanup;
+    }
+    qed_archive_skip(&writer, &st);
+    if (stat(output_path, &st) == 0) {
+        qed_archive_skip(&writer, &st);
+    }
+    
+    result = qed_output_write(&writer.output, header, sizeof(header));
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    result = qed_archive_walk(&writer, input_dir, "");
+    if (result == QED_SUCCESS && writer.pending > 0) {
+        result = qed_archive_flush(&writer);
+    }
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    // Table of contents and footer
+    qed_put_le64(writer.toc, writer.entry_count);
+    toc_record = malloc(writer.toc_len + QED_RECORD_OVERHEAD + 16);
+    if (!toc_record) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    qed_archive_aad(header, QED_ARCHIVE_TOC_ENTRY, 0, 0, aad);
+    result = qed_seal_record(&device->hardware_sig, quantum_key, batch->mac, device->cipher,
+                             aad, sizeof(aad), writer.toc, writer.toc_len,
+                             toc_record, &toc_record_len);
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    memset(footer, 0, sizeof(footer));
+    qed_put_le64(footer, writer.offset);
+    qed_put_le64(footer + 8, toc_record_len);
+    qed_put_le32(footer + 16, (uint32_t)writer.entry_count);
+    memcpy(footer + 20, QED_ARCHIVE_TOC_MAGIC, 4);
+    
+    result = qed_output_write(&writer.output, toc_record, toc_record_len);
+    if (result == QED_SUCCESS) {
+        result = qed_output_write(&writer.output, footer, sizeof(footer));
+    }
+
+cleanup:
+    if (writer.output_open && result == QED_SUCCESS) {
+        result = qed_output_commit(&writer.output);
+    } else if (writer.output_open) {
+        qed_output_abort(&writer.output);
+    }
+    if (batch->plain) {
+        qed_secure_zero(batch->plain, writer.batch_size * chunk_size);
+        qed_buffer_free(batch->plain, writer.batch_size * chunk_size);
+    }
+    free(batch->plain_lens);
+    free(batch->entry_numbers);
+    free(batch->chunk_numbers);
+    qed_buffer_free(batch->records, writer.batch_size * QED_CHUNKED_RECORD_MAX(chunk_size));
+    free(batch->record_lens);
+    free(batch->results);
+    free(writer.toc);
+    free(toc_record);
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    
+    if (result != QED_SUCCESS) {
+        printf("❌ Archive packing failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    QED_OP_END(QED_OP_FILE_ENCRYPT, op_start, writer.bytes);
+    printf("🔒 Archive packed successfully: %s (%lu entries)\n", output_path,
+           writer.entry_count);
+    return QED_SUCCESS;
+}
+
+/* Reading */
+
+static void qed_archive_close(qed_archive_reader_t *reader) {
+    if (reader->fd >= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+    free(reader->entries);
+    free(reader->toc);
+    reader->entries = NULL;
+    reader->toc = NULL;
+}
+
+// Splits the table of contents into entries and checks that every entry's
+// records lie between the header and the table of contents, in order
+static qed_result_t qed_archive_parse_toc(qed_archive_reader_t *reader, size_t toc_len,
+                                          uint32_t footer_count) {
+    uint64_t offset = QED_ARCHIVE_HEADER_SIZE;
+    size_t pos = 8;
+    uint64_t i;
+    
+    if (toc_len < 8) {
+        return QED_ERROR_SIGNATURE_MISMATCH;
+    }
+    
+    reader->entry_count = qed_get_le64(reader->toc);
+    if (reader->entry_count != footer_count ||
+        reader->entry_count > (toc_len - 8) / QED_ARCHIVE_ENTRY_SIZE) {
+        return QED_ERROR_SIGNATURE_MISMATCH;
+    }
+    
+    reader->entries = calloc(reader->entry_count ? reader->entry_count : 1,
+                             sizeof(qed_archive_entry_t));
+    if (!reader->entries) {
+        return QED_ERROR_MEMORY;
+    }
+    
+    for (i = 0; i < reader->entry_count; i++) {
+        qed_archive_entry_t *entry = &reader->entries[i];
+        const uint8_t *raw = reader->toc + pos;
+        uint64_t full_chunks, tail, stored;
+        
+        if (toc_len - pos < QED_ARCHIVE_ENTRY_SIZE) {
+            return QED_ERROR_SIGNATURE_MISMATCH;
+        }
+        
+        entry->offset = qed_get_le64(raw);
+        entry->size = qed_get_le64(raw + 8);
+        entry->mode = qed_get_le32(raw + 16);
+        entry->mtime = (int64_t)qed_get_le64(raw + 20);
+        entry->name_len = (size_t)raw[28] | ((size_t)raw[29] << 8);
+        entry->name = (const char *)raw + QED_ARCHIVE_ENTRY_SIZE;
+        pos += QED_ARCHIVE_ENTRY_SIZE;
+        
+        if (toc_len - pos < entry->name_len ||
+            !qed_archive_name_valid(entry->name, entry->name_len) ||
+            (!S_ISREG(entry->mode) && !S_ISDIR(entry->mode)) ||
+            (S_ISDIR(entry->mode) && entry->size != 0)) {
+            return QED_ERROR_SIGNATURE_MISMATCH;
+        }
+        pos += entry->name_len;
+        
+        // Records are never shorter than their plaintext, so checking the
+        // size first keeps the stored length from overflowing
+        if (entry->offset != offset || entry->size > reader->toc_offset - offset) {
+            return QED_ERROR_SIGNATURE_MISMATCH;
+        }
+        
+        full_chunks = entry->size / reader->chunk_size;
+        tail = entry->size % reader->chunk_size;
+        stored = full_chunks * qed_record_length(reader->cipher, reader->chunk_size) +
+                 (tail ? qed_record_length(reader->cipher, (size_t)tail) : 0);
+        
+        if (stored > reader->toc_offset - offset) {
+            return QED_ERROR_SIGNATURE_MISMATCH;
+        }
+        offset += stored;
+    }
+    
+    if (pos != toc_len || offset != reader->toc_offset) {
+        return QED_ERROR_SIGNATURE_MISMATCH;
+    }
+    
+    return QED_SUCCESS;
+}
+
+// Opens the archive, derives its key and checks its table of contents
+static qed_result_t qed_archive_open(qed_device_t *device, const char *key_id, const char *path,
+                                     qed_archive_reader_t *reader, uint8_t *key,
+                                     const qed_mac_state_t **mac) {
+    uint8_t footer[QED_ARCHIVE_FOOTER_SIZE];
+    uint8_t aad[QED_ARCHIVE_AAD_SIZE];
+    uint8_t *toc_record;
+    uint64_t toc_record_len;
+    size_t toc_len;
+    struct stat st;
+    qed_result_t result;
+    
+    memset(reader, 0, sizeof(qed_archive_reader_t));
+    *mac = NULL;
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        printf("❌ Error: Archive '%s' does not exist.\n", path);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    if (fstat(reader->fd, &st) != 0 ||
+        (uint64_t)st.st_size < QED_ARCHIVE_HEADER_SIZE + QED_ARCHIVE_FOOTER_SIZE ||
+        qed_pread_full(reader->fd, reader->header, QED_ARCHIVE_HEADER_SIZE, 0) != QED_SUCCESS ||
+        qed_pread_full(reader->fd, footer, sizeof(footer),
+                       (uint64_t)st.st_size - QED_ARCHIVE_FOOTER_SIZE) != QED_SUCCESS) {
+        qed_archive_close(reader);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    reader->cipher = reader->header[5];
+    reader->mac = reader->header[6];
+    reader->chunk_size = qed_get_le32(reader->header + 8);
+    reader->toc_offset = qed_get_le64(footer);
+    toc_record_len = qed_get_le64(footer + 8);
+    
+    if (memcmp(reader->header, QED_ARCHIVE_MAGIC, 4) != 0 ||
+        reader->header[4] != QED_ARCHIVE_VERSION ||
+        !qed_cipher_valid(reader->cipher) || reader->mac > QED_MAC_HMAC_SHA256 ||
+        (reader->header[7] & ~QED_ARCHIVE_FLAG_SUBKEY) != 0 ||
+        reader->chunk_size < QED_CHUNK_SIZE_MIN || reader->chunk_size > QED_CHUNK_SIZE_MAX ||
+        memcmp(footer + 20, QED_ARCHIVE_TOC_MAGIC, 4) != 0 ||
+        reader->toc_offset < QED_ARCHIVE_HEADER_SIZE ||
+        toc_record_len < QED_RECORD_OVERHEAD || toc_record_len > INT32_MAX ||
+        reader->toc_offset + toc_record_len != (uint64_t)st.st_size - QED_ARCHIVE_FOOTER_SIZE) {
+        qed_archive_close(reader);
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    result = qed_archive_key(device, key_id, reader->header, key);
+    if (result == QED_SUCCESS && reader->mac == QED_MAC_HMAC_SHA256) {
+        result = qed_get_mac_state(device, key_id, mac);
+    }
+    if (result != QED_SUCCESS) {
+        qed_archive_close(reader);
+        return result;
+    }
+    
+    toc_record = malloc((size_t)toc_record_len);
+    reader->toc = malloc((size_t)toc_record_len);
+    if (!toc_record || !reader->toc) {
+        free(toc_record);
+        qed_archive_close(reader);
+        return QED_ERROR_MEMORY;
+    }
+    
+    result = qed_pread_full(reader->fd, toc_record, (size_t)toc_record_len, reader->toc_offset);
+    if (result == QED_SUCCESS) {
+        qed_archive_aad(reader->header, QED_ARCHIVE_TOC_ENTRY, 0, 0, aad);
+        result = qed_open_record(&device->hardware_sig, key, *mac, reader->cipher,
+                                 aad, sizeof(aad), toc_record, (size_t)toc_record_len,
+                                 reader->toc, &toc_len);
+    }
+    free(toc_record);
+    
+    if (result == QED_SUCCESS) {
+        result = qed_archive_parse_toc(reader, toc_len, qed_get_le32(footer + 16));
+    }
+    if (result != QED_SUCCESS) {
+        qed_archive_close(reader);
+        return result;
+    }
+    
+    return QED_SUCCESS;
+}
+
+// Decrypts one entry's records into output; record and plain hold
+// QED_CHUNKED_RECORD_MAX(chunk_size) bytes
+static qed_result_t qed_archive_read_entry(const qed_archive_reader_t *reader,
+                                           const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                                           const qed_mac_state_t *mac, uint64_t number,
+                                           qed_output_t *output, uint8_t *record, uint8_t *plain) {
+    const qed_archive_entry_t *entry = &reader->entries[number];
+    uint8_t aad[QED_ARCHIVE_AAD_SIZE];
+    uint64_t offset = entry->offset;
+    uint64_t remaining = entry->size;
+    uint64_t chunk = 0;
+    qed_result_t result;
+    
+    while (remaining > 0) {
+        size_t expected = remaining < reader->chunk_size ? (size_t)remaining : reader->chunk_size;
+        size_t record_len = qed_record_length(reader->cipher, expected);
+        size_t plain_len;
+        
+        QED_STAGE_BEGIN(read_start);
+        QED_PROBE(file__read__start);
+        result = qed_pread_full(reader->fd, record, record_len, offset);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        QED_STAGE_END(QED_STAGE_FILE_READ, read_start, record_len);
+        QED_PROBE1(file__read__done, record_len);
+        
+        qed_archive_aad(reader->header, number, chunk, (uint32_t)expected, aad);
+        result = qed_open_record(hw_sig, key, mac, reader->cipher, aad, sizeof(aad),
+                                 record, record_len, plain, &plain_len);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        if (plain_len != expected) {
+            return QED_ERROR_SIGNATURE_MISMATCH;
+        }
+        
+        QED_STAGE_BEGIN(write_start);
+        QED_PROBE(file__write__start);
+        result = qed_output_write(output, plain, plain_len);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        QED_STAGE_END(QED_STAGE_FILE_WRITE, write_start, plain_len);
+        QED_PROBE1(file__write__done, plain_len);
+        
+        offset += record_len;
+        remaining -= expected;
+        chunk++;
+    }
+    
+    return QED_SUCCESS;
+}
+
+// Writes one regular entry to path through a temporary file, so a failure
+// leaves an existing file at path untouched
+static qed_result_t qed_archive_extract_to(const qed_archive_reader_t *reader,
+                                           const qed_device_t *device, const uint8_t *key,
+                                           const qed_mac_state_t *mac, uint64_t number,
+                                           const char *path) {
+    const qed_archive_entry_t *entry = &reader->entries[number];
+    uint8_t *record, *plain;
+    qed_output_t output;
+    qed_result_t result;
+    
+    record = qed_mem_alloc(QED_CHUNKED_RECORD_MAX(reader->chunk_size));
+    plain = qed_mem_alloc(QED_CHUNKED_RECORD_MAX(reader->chunk_size));
+    if (!record || !plain) {
+        qed_mem_free(record, QED_CHUNKED_RECORD_MAX(reader->chunk_size));
+        qed_mem_free(plain, QED_CHUNKED_RECORD_MAX(reader->chunk_size));
+        return QED_ERROR_MEMORY;
+    }
+    
+    result = qed_output_open(&output, device, path, entry->size);
+    if (result == QED_SUCCESS) {
+        result = qed_archive_read_entry(reader, &device->hardware_sig, key, mac, number,
+                                        &output, record, plain);
+        if (result == QED_SUCCESS) {
+            qed_output_stamp(&output, entry->mode, entry->mtime);
+            result = qed_output_commit(&output);
+        } else {
+            // Do not leave verified-so-far plaintext behind
+            qed_output_abort(&output);
+        }
+    }
+    
+    qed_secure_zero(plain, QED_CHUNKED_RECORD_MAX(reader->chunk_size));
+    qed_mem_free(plain, QED_CHUNKED_RECORD_MAX(reader->chunk_size));
+    qed_mem_free(record, QED_CHUNKED_RECORD_MAX(reader->chunk_size));
+    return result;
+}
+
+static char* qed_archive_join(const char *dir, const qed_archive_entry_t *entry) {
+    char *path = malloc(strlen(dir) + entry->name_len + 2);
+    
+    if (path) {
+        sprintf(path, "%s/%.*s", dir, (int)entry->name_len, entry->name);
+    }
+    return path;
+}
+
+static void qed_archive_unpack_worker(void *ctx, size_t index) {
+    qed_archive_unpack_t *unpack = ctx;
+    const qed_archive_entry_t *entry = &unpack->reader->entries[index];
+    char *path;
+    
+    if (!S_ISREG(entry->mode)) {
+        return;
+    }
+    
+    path = qed_archive_join(unpack->output_dir, entry);
+    unpack->results[index] = path ?
+        qed_archive_extract_to(unpack->reader, unpack->device, unpack->key, unpack->mac,
+                               index, path) :
+        QED_ERROR_MEMORY;
+    free(path);
+}
+
+qed_result_t qed_archive_unpack(qed_device_t *device, const char *key_id,
+                                const char *archive_path, const char *output_dir) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    const qed_mac_state_t *mac;
+    qed_archive_reader_t reader;
+    qed_archive_unpack_t unpack;
+    uint64_t bytes = 0, i;
+    qed_result_t result;
+    
+    if (!device || !key_id || !archive_path || !output_dir) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_FILE_DECRYPT);
+    QED_OP_BEGIN(op_start);
+    
+    result = qed_archive_open(device, key_id, archive_path, &reader, quantum_key, &mac);
+    if (result != QED_SUCCESS) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        printf("❌ Archive unpacking failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    unpack.results = calloc(reader.entry_count ? reader.entry_count : 1, sizeof(qed_result_t));
+    if (!unpack.results) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    if (mkdir(output_dir, 0755) != 0 && errno != EEXIST) {
+        result = QED_ERROR_FILE_IO;
+        goto cleanup;
+    }
+    
+    // Directories come before their contents in the table of contents, so
+    // creating them in order gives every file its parent
+    for (i = 0; i < reader.entry_count; i++) {
+        char *path;
+        
+        if (!S_ISDIR(reader.entries[i].mode)) {
+            continue;
+        }
+        path = qed_archive_join(output_dir, &reader.entries[i]);
+        if (!path) {
+            result = QED_ERROR_MEMORY;
+            goto cleanup;
+        }
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            printf("❌ Error: Cannot create directory '%s'.\n", path);
+            free(path);
+            result = QED_ERROR_FILE_IO;
+            goto cleanup;
+        }
+        free(path);
+    }
+    
+    // Entries are independent, so files are decrypted in parallel
+    unpack.reader = &reader;
+    unpack.device = device;
+    unpack.key = quantum_key;
+    unpack.mac = mac;
+    unpack.output_dir = output_dir;
+    qed_parallel_for((size_t)reader.entry_count, qed_archive_unpack_worker, &unpack);
+    
+    for (i = 0; i < reader.entry_count; i++) {
+        if (unpack.results[i] != QED_SUCCESS) {
+            printf("❌ Error: Cannot extract '%.*s'.\n", (int)reader.entries[i].name_len,
+                   reader.entries[i].name);
+            if (result == QED_SUCCESS) {
+                result = unpack.results[i];
+            }
+        }
+        bytes += reader.entries[i].size;
+    }
+    
+    // Directory times last, since creating their files updated them
+    for (i = reader.entry_count; result == QED_SUCCESS && i-- > 0;) {
+        struct timespec times[2];
+        char *path;
+        
+        if (!S_ISDIR(reader.entries[i].mode)) {
+            continue;
+        }
+        path = qed_archive_join(output_dir, &reader.entries[i]);
+        if (path) {
+            times[0].tv_sec = reader.entries[i].mtime;
+            times[0].tv_nsec = 0;
+            times[1] = times[0];
+            chmod(path, reader.entries[i].mode & 07777);
+            utimensat(AT_FDCWD, path, times, 0);
+            free(path);
+        }
+    }
+
+cleanup:
+    free(unpack.results);
+    qed_archive_close(&reader);
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    
+    if (result != QED_SUCCESS) {
+        printf("❌ Archive unpacking failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    QED_OP_END(QED_OP_FILE_DECRYPT, op_start, bytes);
+    printf("📨 Archive unpacked successfully: %s (%lu entries)\n", output_dir,
+           reader.entry_count);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_archive_extract(qed_device_t *device, const char *key_id,
+                                 const char *archive_path, const char *entry_name,
+                                 const char *output_path) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    const qed_mac_state_t *mac;
+    qed_archive_reader_t reader;
+    size_t name_len;
+    uint64_t i;
+    qed_result_t result;
+    
+    if (!device || !key_id || !archive_path || !entry_name || !output_path) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_FILE_DECRYPT);
+    QED_OP_BEGIN(op_start);
+    
+    result = qed_archive_open(device, key_id, archive_path, &reader, quantum_key, &mac);
+    if (result != QED_SUCCESS) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        printf("❌ Entry extraction failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    // Only the named entry's records are read
+    name_len = strlen(entry_name);
+    result = QED_ERROR_KEY_NOT_FOUND;
+    for (i = 0; i < reader.entry_count; i++) {
+        const qed_archive_entry_t *entry = &reader.entries[i];
+        
+        if (S_ISREG(entry->mode) && entry->name_len == name_len &&
+            memcmp(entry->name, entry_name, name_len) == 0) {
+            result = qed_archive_extract_to(&reader, device, quantum_key, mac,
+                                            i, output_path);
+            break;
+        }
+    }
+    
+    if (i == reader.entry_count) {
+        printf("❌ Error: No entry '%s' in archive '%s'.\n", entry_name, archive_path);
+    }
+    
+    if (result == QED_SUCCESS) {
+        QED_OP_END(QED_OP_FILE_DECRYPT, op_start, reader.entries[i].size);
+    }
+    qed_archive_close(&reader);
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    
+    if (result != QED_SUCCESS) {
+        printf("❌ Entry extraction failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    printf("📨 Entry extracted successfully: %s\n", output_path);
+    return QED_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/*
+ * Quantum Encryption Device (QED) - Batch Processing
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+typedef struct {
+    uint64_t size;
+    size_t index;
+} qed_batch_order_t;
+
+typedef struct {
+    qed_device_t *device;
+    const qed_batch_job_t *jobs;
+    const qed_batch_order_t *order;
+    size_t count;
+    size_t chunk_size;
+    qed_batch_result_t *results;
+    qed_batch_progress_fn progress;
+    void *progress_ctx;
+    pthread_mutex_t progress_lock;
+    size_t done;
+} qed_batch_t;
+
+static double qed_batch_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int qed_batch_order_compare(const void *a, const void *b) {
+    const qed_batch_order_t *left = a;
+    const qed_batch_order_t *right = b;
+    
+    if (left->size != right->size) {
+        return left->size < right->size ? -1 : 1;
+    }
+    return left->index < right->index ? -1 : (left->index > right->index);
+}
+
+static void qed_batch_worker(void *ctx, size_t position) {
+    qed_batch_t *batch = ctx;
+    size_t index = batch->order[position].index;
+    const qed_batch_job_t *job = &batch->jobs[index];
+    qed_batch_result_t *entry = &batch->results[index];
+    double start = qed_batch_now();
+    
+    if (job->op == QED_BATCH_REKEY) {
+        entry->result = qed_rekey_file(batch->device, job->key_id, job->new_key_id,
+                                       job->input_path, job->output_path);
+    } else if (job->op == QED_BATCH_DECRYPT) {
+        entry->result = qed_decrypt_file(batch->device, job->key_id, job->input_path,
+                                         job->output_path);
+    } else if (batch->chunk_size) {
+        entry->result = qed_encrypt_file_chunked(batch->device, job->key_id, job->input_path,
+                                                 job->output_path, batch->chunk_size);
+    } else {
+        entry->result = qed_encrypt_file(batch->device, job->key_id, job->input_path,
+                                         job->output_path);
+    }
+    
+    entry->bytes = entry->result == QED_SUCCESS ? batch->order[position].size : 0;
+    entry->seconds = qed_batch_now() - start;
+    
+    if (batch->progress) {
+        pthread_mutex_lock(&batch->progress_lock);
+        batch->done++;
+        batch->progress(batch->progress_ctx, batch->done, batch->count, job, entry);
+        pthread_mutex_unlock(&batch->progress_lock);
+    }
+}
+
+qed_result_t qed_run_batch(qed_device_t *device, const qed_batch_job_t *jobs, size_t count,
+                          size_t workers, size_t chunk_size,
+                          qed_batch_progress_fn progress, void *progress_ctx,
+                          qed_batch_result_t *results) {
+    const qed_mac_state_t *mac;
+    const qed_subkey_state_t *subkey;
+    qed_batch_order_t *order;
+    const char **key_ids;
+    size_t key_count = 0;
+    qed_batch_t batch;
+    struct stat st;
+    qed_result_t result;
+    size_t i;
+    
+    if (!device || (!jobs && count > 0) || (!results && count > 0)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!jobs[i].key_id || !jobs[i].input_path || !jobs[i].output_path ||
+            (jobs[i].op != QED_BATCH_ENCRYPT && jobs[i].op != QED_BATCH_DECRYPT &&
+             jobs[i].op != QED_BATCH_REKEY) ||
+            (jobs[i].op == QED_BATCH_REKEY && !jobs[i].new_key_id)) {
+            return QED_ERROR_INVALID_INPUT;
+        }
+    }
+    
+    if (count == 0) {
+        return QED_SUCCESS;
+    }
+    
+    order = malloc(count * sizeof(qed_batch_order_t));
+    key_ids = malloc(2 * count * sizeof(char *));
+    if (!order || !key_ids) {
+        free(order);
+        free(key_ids);
+        return QED_ERROR_MEMORY;
+    }
+    
+    // Workers share the device, so every key and keyed state is created
+    // here and the workers only read the cache
+    for (i = 0; i < count; i++) {
+        key_ids[key_count++] = jobs[i].key_id;
+        if (jobs[i].op == QED_BATCH_REKEY) {
+            key_ids[key_count++] = jobs[i].new_key_id;
+        }
+    }
+    result = qed_prewarm_keys(device, key_ids, key_count);
+    for (i = 0; i < key_count && result == QED_SUCCESS; i++) {
+        result = qed_get_mac_state(device, key_ids[i], &mac);
+        if (result == QED_SUCCESS) {
+            result = qed_get_subkey_state(device, key_ids[i], &subkey);
+        }
+    }
+    free(key_ids);
+    if (result != QED_SUCCESS) {
+        free(order);
+        return result;
+    }
+    
+    // Small files go first so that no core idles behind one large file
+    // while short jobs are still queued; missing inputs sort first and
+    // fail straight away
+    for (i = 0; i < count; i++) {
+        order[i].size = stat(jobs[i].input_path, &st) == 0 ? (uint64_t)st.st_size : 0;
+        order[i].index = i;
+    }
+    qsort(order, count, sizeof(qed_batch_order_t), qed_batch_order_compare);
+    
+    batch.device = device;
+    batch.jobs = jobs;
+    batch.order = order;
+    batch.count = count;
+    batch.chunk_size = chunk_size;
+    batch.results = results;
+    batch.progress = progress;
+    batch.progress_ctx = progress_ctx;
+    batch.done = 0;
+    pthread_mutex_init(&batch.progress_lock, NULL);
+    
+    qed_parallel_for_workers(count, workers, qed_batch_worker, &batch);
+    
+    pthread_mutex_destroy(&batch.progress_lock);
+    free(order);
+    return QED_SUCCESS;
+}
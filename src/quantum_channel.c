@@ -0,0 +1,635 @@
+/*
+ * Quantum Encryption Device (QED) - Asynchronous Channel Manager
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * qed_create_quantum_channel() waits out the partner exchange on the
+ * caller's thread, so channels to many partners are set up one after the
+ * other. The manager instead hands each exchange to a transport and
+ * returns; the transport reports the partner's nonce whenever it arrives,
+ * so all exchanges are in flight at once.
+ *
+ * Each exchange sends a fresh random nonce, and the channel key is
+ *
+ *   HMAC-SHA-256(resonance, "QED channel" || lower ID || 0 || higher ID || 0 ||
+ *                lower nonce || higher nonce)
+ *
+ * over the two endpoint IDs and the two nonces, each pair in lexicographic
+ * order. The resonance is the device's hardware resonance, computed once
+ * per manager, and is the only secret in the derivation: nonces and IDs
+ * cross the transport in the clear. Both ends therefore derive the same key
+ * only when their devices share a hardware profile (qed_init_with_profile()
+ * or QED_HARDWARE_PROFILE); ends on different profiles complete the
+ * exchange with different keys, and anyone without the profile cannot
+ * derive either. Keys are
+ * kept in an open-addressing table by partner ID, so asking for a partner
+ * again is answered from the cache and duplicate requests while one is in
+ * flight share it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#define QED_CHANNEL_INFO "QED channel"
+#define QED_CHANNEL_LOOPBACK_INFO "QED loopback"
+#define QED_CHANNEL_INITIAL_SLOTS 64
+
+typedef enum {
+    QED_CHANNEL_PENDING = 0,
+    QED_CHANNEL_READY,
+    QED_CHANNEL_FAILED
+} qed_channel_state_t;
+
+typedef struct {
+    char partner_id[QED_MAX_KEY_ID_LENGTH];
+    uint8_t nonce[QED_CHANNEL_NONCE_LENGTH];
+    uint8_t key[QED_KEY_LENGTH];
+    uint64_t ticket;
+    uint8_t state;
+} qed_channel_entry_t;
+
+struct qed_channel_manager {
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    qed_channel_transport_t transport;
+    qed_channel_callback_t callback;
+    void *callback_ctx;
+    char local_id[QED_MAX_KEY_ID_LENGTH];
+    uint8_t resonance[QED_KEY_LENGTH];
+    
+    // Entries in arrival order; index holds entry number + 1, 0 for free
+    qed_channel_entry_t *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+    uint32_t *index;
+    size_t index_size;
+    
+    // Completions waiting for qed_channel_poll() when there is no callback
+    qed_channel_event_t *events;
+    size_t event_count;
+    size_t event_capacity;
+    
+    size_t pending;
+    uint32_t sequence;
+};
+
+// FNV-1a
+static uint32_t qed_channel_hash(const char *partner_id) {
+    uint32_t hash = 2166136261u;
+    
+    while (*partner_id) {
+        hash ^= (uint8_t)*partner_id++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Slot of partner_id in the index: its entry's, or the free one it would take
+static size_t qed_channel_slot(const qed_channel_manager_t *manager, const char *partner_id) {
+    size_t mask = manager->index_size - 1;
+    size_t slot = qed_channel_hash(partner_id) & mask;
+    
+    while (manager->index[slot] != 0 &&
+           strcmp(manager->entries[manager->index[slot] - 1].partner_id, partner_id) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Doubles the index once it is half full
+static qed_result_t qed_channel_grow_index(qed_channel_manager_t *manager) {
+    uint32_t *old_index = manager->index;
+    size_t old_size = manager->index_size;
+    size_t i;
+    
+    if ((manager->entry_count + 1) * 2 <= manager->index_size) {
+        return QED_SUCCESS;
+    }
+    
+    manager->index = calloc(old_size * 2, sizeof(uint32_t));
+    if (!manager->index) {
+        manager->index = old_index;
+        return QED_ERROR_MEMORY;
+    }
+    manager->index_size = old_size * 2;
+    
+    for (i = 0; i < old_size; i++) {
+        if (old_index[i] != 0) {
+            const char *partner_id = manager->entries[old_index[i] - 1].partner_id;
+            manager->index[qed_channel_slot(manager, partner_id)] = old_index[i];
+        }
+    }
+    free(old_index);
+    return QED_SUCCESS;
+}
+
+static qed_channel_entry_t* qed_channel_add(qed_channel_manager_t *manager,
+                                            const char *partner_id) {
+    qed_channel_entry_t *entry;
+    
+    if (qed_channel_grow_index(manager) != QED_SUCCESS) {
+        return NULL;
+    }
+    if (manager->entry_count == manager->entry_capacity) {
+        size_t capacity = manager->entry_capacity ? manager->entry_capacity * 2
+                                                  : QED_CHANNEL_INITIAL_SLOTS;
+        qed_channel_entry_t *grown = realloc(manager->entries,
+                                             capacity * sizeof(qed_channel_entry_t));
+        if (!grown) {
+            return NULL;
+        }
+        manager->entries = grown;
+        manager->entry_capacity = capacity;
+    }
+    
+    entry = &manager->entries[manager->entry_count++];
+    memset(entry, 0, sizeof(qed_channel_entry_t));
+    strncpy(entry->partner_id, partner_id, QED_MAX_KEY_ID_LENGTH - 1);
+    manager->index[qed_channel_slot(manager, entry->partner_id)] = (uint32_t)manager->entry_count;
+    return entry;
+}
+
+// Queues or hands over one completion and, for an exchange, retires it.
+// Called with the lock held; returns with it released.
+static void qed_channel_report(qed_channel_manager_t *manager, qed_channel_event_t *event,
+                               bool exchange) {
+    if (!manager->callback) {
+        if (manager->event_count == manager->event_capacity) {
+            size_t capacity = manager->event_capacity ? manager->event_capacity * 2
+                                                      : QED_CHANNEL_INITIAL_SLOTS;
+            qed_channel_event_t *grown = realloc(manager->events,
+                                                 capacity * sizeof(qed_channel_event_t));
+            if (grown) {
+                manager->events = grown;
+                manager->event_capacity = capacity;
+            }
+        }
+        // A completion that cannot be queued is still visible through
+        // qed_channel_lookup()
+        if (manager->event_count < manager->event_capacity) {
+            manager->events[manager->event_count++] = *event;
+        }
+    }
+    pthread_mutex_unlock(&manager->lock);
+    
+    if (manager->callback) {
+        manager->callback(manager->callback_ctx, event);
+    }
+    qed_secure_zero(event->key, sizeof(event->key));
+    
+    // Retire the exchange only after its callback, so qed_channel_wait()
+    // and qed_channel_manager_destroy() never return under one
+    if (exchange) {
+        pthread_mutex_lock(&manager->lock);
+        if (--manager->pending == 0) {
+            pthread_cond_broadcast(&manager->idle);
+        }
+        pthread_mutex_unlock(&manager->lock);
+    }
+}
+
+static void qed_channel_derive(const qed_channel_manager_t *manager,
+                               const qed_channel_entry_t *entry, const uint8_t *partner_nonce,
+                               uint8_t *key) {
+    uint8_t message[sizeof(QED_CHANNEL_INFO) + 2 * QED_MAX_KEY_ID_LENGTH +
+                    2 * QED_CHANNEL_NONCE_LENGTH];
+    bool local_first = strcmp(manager->local_id, entry->partner_id) < 0;
+    const char *ids[2] = { manager->local_id, entry->partner_id };
+    const uint8_t *nonces[2] = { entry->nonce, partner_nonce };
+    size_t length = 0;
+    unsigned int key_length = QED_KEY_LENGTH;
+    int i;
+    
+    memcpy(message, QED_CHANNEL_INFO, sizeof(QED_CHANNEL_INFO) - 1);
+    length += sizeof(QED_CHANNEL_INFO) - 1;
+    for (i = 0; i < 2; i++) {
+        const char *id = ids[local_first ? i : 1 - i];
+        size_t id_length = strlen(id) + 1;
+        
+        memcpy(message + length, id, id_length);
+        length += id_length;
+    }
+    
+    local_first = memcmp(entry->nonce, partner_nonce, QED_CHANNEL_NONCE_LENGTH) < 0;
+    for (i = 0; i < 2; i++) {
+        memcpy(message + length, nonces[local_first ? i : 1 - i], QED_CHANNEL_NONCE_LENGTH);
+        length += QED_CHANNEL_NONCE_LENGTH;
+    }
+    
+    HMAC(EVP_sha256(), manager->resonance, sizeof(manager->resonance), message, length,
+         key, &key_length);
+}
+
+qed_result_t qed_channel_manager_create(qed_device_t *device, const char *local_id,
+                                        const qed_channel_transport_t *transport,
+                                        qed_channel_callback_t callback, void *callback_ctx,
+                                        qed_channel_manager_t **manager) {
+    qed_channel_manager_t *created;
+    qed_result_t result;
+    
+    if (!device || !local_id || !*local_id || strlen(local_id) >= QED_MAX_KEY_ID_LENGTH ||
+        !transport || !transport->exchange || !manager) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    if (!device->initialized) {
+        return QED_ERROR_HARDWARE;
+    }
+    
+    created = calloc(1, sizeof(qed_channel_manager_t));
+    if (!created) {
+        return QED_ERROR_MEMORY;
+    }
+    created->index = calloc(QED_CHANNEL_INITIAL_SLOTS, sizeof(uint32_t));
+    if (!created->index) {
+        free(created);
+        return QED_ERROR_MEMORY;
+    }
+    created->index_size = QED_CHANNEL_INITIAL_SLOTS;
+    strcpy(created->local_id, local_id);
+    
+    result = qed_generate_hardware_resonance(&device->hardware_sig, created->resonance,
+                                             sizeof(created->resonance));
+    if (result != QED_SUCCESS) {
+        free(created->index);
+        free(created);
+        return result;
+    }
+    
+    pthread_mutex_init(&created->lock, NULL);
+    pthread_cond_init(&created->idle, NULL);
+    created->transport = *transport;
+    created->callback = callback;
+    created->callback_ctx = callback_ctx;
+    
+    *manager = created;
+    return QED_SUCCESS;
+}
+
+void qed_channel_manager_destroy(qed_channel_manager_t *manager) {
+    if (!manager) {
+        return;
+    }
+    
+    qed_channel_wait(manager, -1);
+    if (manager->transport.destroy) {
+        manager->transport.destroy(manager->transport.ctx);
+    }
+    
+    pthread_mutex_destroy(&manager->lock);
+    pthread_cond_destroy(&manager->idle);
+    if (manager->entries) {
+        qed_secure_zero(manager->entries, manager->entry_capacity * sizeof(qed_channel_entry_t));
+    }
+    if (manager->events) {
+        qed_secure_zero(manager->events, manager->event_capacity * sizeof(qed_channel_event_t));
+    }
+    free(manager->entries);
+    free(manager->events);
+    free(manager->index);
+    qed_secure_zero(manager, sizeof(qed_channel_manager_t));
+    free(manager);
+}
+
+qed_result_t qed_channel_establish(qed_channel_manager_t *manager, const char *partner_id) {
+    qed_channel_entry_t *entry;
+    qed_channel_event_t event;
+    uint8_t nonce[QED_CHANNEL_NONCE_LENGTH];
+    uint64_t ticket;
+    qed_result_t result;
+    size_t slot;
+    
+    if (!manager || !partner_id || !*partner_id ||
+        strlen(partner_id) >= QED_MAX_KEY_ID_LENGTH) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    pthread_mutex_lock(&manager->lock);
+    slot = qed_channel_slot(manager, partner_id);
+    entry = manager->index[slot] ? &manager->entries[manager->index[slot] - 1] : NULL;
+    
+    if (entry && entry->state == QED_CHANNEL_PENDING) {
+        pthread_mutex_unlock(&manager->lock);
+        return QED_SUCCESS;
+    }
+    if (entry && entry->state == QED_CHANNEL_READY) {
+        memset(&event, 0, sizeof(event));
+        strcpy(event.partner_id, entry->partner_id);
+        event.result = QED_SUCCESS;
+        memcpy(event.key, entry->key, QED_KEY_LENGTH);
+        qed_channel_report(manager, &event, false);
+        return QED_SUCCESS;
+    }
+    
+    if (!entry) {
+        entry = qed_channel_add(manager, partner_id);
+        if (!entry) {
+            pthread_mutex_unlock(&manager->lock);
+            return QED_ERROR_MEMORY;
+        }
+    }
+    if (RAND_bytes(entry->nonce, QED_CHANNEL_NONCE_LENGTH) != 1) {
+        entry->state = QED_CHANNEL_FAILED;
+        pthread_mutex_unlock(&manager->lock);
+        return QED_ERROR_ENCRYPTION;
+    }
+    
+    // The ticket names the entry and this attempt, so a late answer to an
+    // earlier, failed attempt is ignored
+    ticket = ((uint64_t)++manager->sequence << 32) | (uint64_t)(entry - manager->entries);
+    entry->ticket = ticket;
+    entry->state = QED_CHANNEL_PENDING;
+    memcpy(nonce, entry->nonce, sizeof(nonce));
+    manager->pending++;
+    pthread_mutex_unlock(&manager->lock);
+    
+    result = manager->transport.exchange(manager->transport.ctx, manager, ticket, partner_id,
+                                         nonce);
+    if (result != QED_SUCCESS) {
+        qed_channel_deliver(manager, ticket, result, NULL);
+    }
+    return result;
+}
+
+qed_result_t qed_channel_deliver(qed_channel_manager_t *manager, uint64_t ticket,
+                                 qed_result_t status, const uint8_t *partner_nonce) {
+    qed_channel_entry_t *entry;
+    qed_channel_event_t event;
+    size_t number = (size_t)(ticket & 0xffffffffu);
+    
+    if (!manager || (status == QED_SUCCESS && !partner_nonce)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    pthread_mutex_lock(&manager->lock);
+    if (number >= manager->entry_count || manager->entries[number].ticket != ticket ||
+        manager->entries[number].state != QED_CHANNEL_PENDING) {
+        pthread_mutex_unlock(&manager->lock);
+        return QED_ERROR_INVALID_INPUT;
+    }
+    entry = &manager->entries[number];
+    
+    memset(&event, 0, sizeof(event));
+    strcpy(event.partner_id, entry->partner_id);
+    event.result = status;
+    if (status == QED_SUCCESS) {
+        qed_channel_derive(manager, entry, partner_nonce, entry->key);
+        memcpy(event.key, entry->key, QED_KEY_LENGTH);
+        entry->state = QED_CHANNEL_READY;
+    } else {
+        entry->state = QED_CHANNEL_FAILED;
+    }
+    qed_secure_zero(entry->nonce, sizeof(entry->nonce));
+    
+    qed_channel_report(manager, &event, true);
+    return QED_SUCCESS;
+}
+
+size_t qed_channel_poll(qed_channel_manager_t *manager, qed_channel_event_t *events, size_t max) {
+    size_t count;
+    
+    if (!manager || !events) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&manager->lock);
+    count = manager->event_count < max ? manager->event_count : max;
+    memcpy(events, manager->events, count * sizeof(qed_channel_event_t));
+    memmove(manager->events, manager->events + count,
+            (manager->event_count - count) * sizeof(qed_channel_event_t));
+    manager->event_count -= count;
+    qed_secure_zero(manager->events + manager->event_count, count * sizeof(qed_channel_event_t));
+    pthread_mutex_unlock(&manager->lock);
+    
+    return count;
+}
+
+qed_result_t qed_channel_wait(qed_channel_manager_t *manager, int timeout_ms) {
+    struct timespec deadline;
+    qed_result_t result = QED_SUCCESS;
+    
+    if (!manager) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    
+    pthread_mutex_lock(&manager->lock);
+    while (manager->pending > 0) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&manager->idle, &manager->lock);
+        } else if (pthread_cond_timedwait(&manager->idle, &manager->lock, &deadline) == ETIMEDOUT) {
+            result = manager->pending > 0 ? QED_ERROR_TIMEOUT : QED_SUCCESS;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&manager->lock);
+    
+    return result;
+}
+
+qed_result_t qed_channel_lookup(qed_channel_manager_t *manager, const char *partner_id,
+                                uint8_t *key) {
+    qed_result_t result = QED_ERROR_KEY_NOT_FOUND;
+    size_t slot;
+    
+    if (!manager || !partner_id || !key) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    pthread_mutex_lock(&manager->lock);
+    slot = qed_channel_slot(manager, partner_id);
+    if (manager->index[slot] != 0 &&
+        manager->entries[manager->index[slot] - 1].state == QED_CHANNEL_READY) {
+        memcpy(key, manager->entries[manager->index[slot] - 1].key, QED_KEY_LENGTH);
+        result = QED_SUCCESS;
+    }
+    pthread_mutex_unlock(&manager->lock);
+    
+    return result;
+}
+
+/*
+ * Loopback transport: answers are queued in arrival order, which with a
+ * fixed latency is also deadline order, and one timer thread delivers each
+ * when it falls due.
+ */
+
+typedef struct qed_loopback_reply {
+    struct qed_loopback_reply *next;
+    qed_channel_manager_t *manager;
+    uint64_t ticket;
+    struct timespec due;
+    uint8_t nonce[QED_CHANNEL_NONCE_LENGTH];
+} qed_loopback_reply_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    bool started;
+    bool stopping;
+    unsigned latency_ms;
+    qed_loopback_reply_t *head;
+    qed_loopback_reply_t *tail;
+} qed_loopback_t;
+
+static bool qed_loopback_due(const struct timespec *due) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > due->tv_sec ||
+           (now.tv_sec == due->tv_sec && now.tv_nsec >= due->tv_nsec);
+}
+
+static void* qed_loopback_main(void *arg) {
+    qed_loopback_t *loopback = arg;
+    
+    pthread_mutex_lock(&loopback->lock);
+    for (;;) {
+        qed_loopback_reply_t *reply = loopback->head;
+        
+        if (!reply) {
+            if (loopback->stopping) {
+                break;
+            }
+            pthread_cond_wait(&loopback->wake, &loopback->lock);
+            continue;
+        }
+        if (!qed_loopback_due(&reply->due)) {
+            pthread_cond_timedwait(&loopback->wake, &loopback->lock, &reply->due);
+            continue;
+        }
+        
+        loopback->head = reply->next;
+        if (!loopback->head) {
+            loopback->tail = NULL;
+        }
+        pthread_mutex_unlock(&loopback->lock);
+        
+        qed_channel_deliver(reply->manager, reply->ticket, QED_SUCCESS, reply->nonce);
+        qed_secure_zero(reply, sizeof(qed_loopback_reply_t));
+        free(reply);
+        
+        pthread_mutex_lock(&loopback->lock);
+    }
+    pthread_mutex_unlock(&loopback->lock);
+    
+    return NULL;
+}
+
+static qed_result_t qed_loopback_exchange(void *ctx, qed_channel_manager_t *manager,
+                                          uint64_t ticket, const char *partner_id,
+                                          const uint8_t *nonce) {
+    qed_loopback_t *loopback = ctx;
+    qed_loopback_reply_t *reply;
+    qed_sha256_ctx_t sha;
+    uint8_t digest[QED_SIGNATURE_LENGTH];
+    
+    reply = calloc(1, sizeof(qed_loopback_reply_t));
+    if (!reply) {
+        return QED_ERROR_MEMORY;
+    }
+    reply->manager = manager;
+    reply->ticket = ticket;
+    
+    // The partner's nonce is a function of its ID and ours
+    qed_sha256_init(&sha);
+    qed_sha256_update(&sha, QED_CHANNEL_LOOPBACK_INFO, sizeof(QED_CHANNEL_LOOPBACK_INFO) - 1);
+    qed_sha256_update(&sha, partner_id, strlen(partner_id));
+    qed_sha256_update(&sha, nonce, QED_CHANNEL_NONCE_LENGTH);
+    qed_sha256_final(&sha, digest);
+    memcpy(reply->nonce, digest, QED_CHANNEL_NONCE_LENGTH);
+    
+    clock_gettime(CLOCK_MONOTONIC, &reply->due);
+    reply->due.tv_sec += loopback->latency_ms / 1000;
+    reply->due.tv_nsec += (long)(loopback->latency_ms % 1000) * 1000000L;
+    if (reply->due.tv_nsec >= 1000000000L) {
+        reply->due.tv_sec++;
+        reply->due.tv_nsec -= 1000000000L;
+    }
+    
+    pthread_mutex_lock(&loopback->lock);
+    if (!loopback->started) {
+        if (pthread_create(&loopback->thread, NULL, qed_loopback_main, loopback) != 0) {
+            pthread_mutex_unlock(&loopback->lock);
+            free(reply);
+            return QED_ERROR_HARDWARE;
+        }
+        loopback->started = true;
+    }
+    if (loopback->tail) {
+        loopback->tail->next = reply;
+    } else {
+        loopback->head = reply;
+    }
+    loopback->tail = reply;
+    pthread_cond_signal(&loopback->wake);
+    pthread_mutex_unlock(&loopback->lock);
+    
+    return QED_SUCCESS;
+}
+
+static void qed_loopback_destroy(void *ctx) {
+    qed_loopback_t *loopback = ctx;
+    
+    pthread_mutex_lock(&loopback->lock);
+    loopback->stopping = true;
+    pthread_cond_signal(&loopback->wake);
+    pthread_mutex_unlock(&loopback->lock);
+    
+    if (loopback->started) {
+        pthread_join(loopback->thread, NULL);
+    }
+    pthread_mutex_destroy(&loopback->lock);
+    pthread_cond_destroy(&loopback->wake);
+    free(loopback);
+}
+
+qed_result_t qed_channel_loopback_transport(qed_channel_transport_t *transport,
+                                            unsigned latency_ms) {
+    qed_loopback_t *loopback;
+    pthread_condattr_t attr;
+    
+    if (!transport) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    loopback = calloc(1, sizeof(qed_loopback_t));
+    if (!loopback) {
+        return QED_ERROR_MEMORY;
+    }
+    pthread_mutex_init(&loopback->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&loopback->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    loopback->latency_ms = latency_ms;
+    
+    transport->exchange = qed_loopback_exchange;
+    transport->destroy = qed_loopback_destroy;
+    transport->ctx = loopback;
+    return QED_SUCCESS;
+}
@@ -0,0 +1,1393 @@
+/*
+ * Quantum Encryption Device (QED) - Seekable Chunked Files
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * File layout (all integers little-endian):
+ *
+ *   header   48 bytes   "QEDS", version, cipher, mac, flags, chunk size,
+ *                       compression, plaintext size, random file id
+ *   chunks   N records  signature || IV || ciphertext, one per chunk
+ *   index    N x 16     record offset (u64), record length (u32),
+ *                       plaintext length (u32)
+ *   footer   24 bytes   index offset (u64), chunk count (u64), "QEDI"
+ *
+ * Every record signature covers the header (except the plaintext size),
+ * the chunk number, the plaintext length and whether the chunk is the last
+ * one, so records cannot be reordered, truncated or spliced between files.
+ * Leaving the size out lets an in-place update grow or shrink a file
+ * without resealing unchanged chunks. Version 1 files signed the full
+ * header and no final marker; they remain readable.
+ *
+ * The index itself is not signed: a forged entry only points at a record
+ * that then fails verification, and a range read touches just the index
+ * entries it needs.
+ *
+ * When the header names a compression method, each chunk's sealed payload
+ * starts with one byte giving the method actually used for that chunk, so
+ * incompressible chunks are stored raw.
+ *
+ * Sparse files (header flag QED_CHUNKED_FLAG_SPARSE) leave out every chunk
+ * that lies wholly inside a hole of the source. Their index entries hold
+ * zero offsets and lengths, and a hole map record between the last chunk
+ * and the index lists them as (first chunk u64, count u64) runs after a
+ * u64 run count. The footer's last four bytes give the map's record
+ * length. The map is sealed like a chunk numbered UINT64_MAX whose
+ * plaintext length is the record length, and a reader trusts only chunks
+ * it names to be holes, never a zeroed index entry.
+ *
+ * Incremental files (header flag QED_CHUNKED_FLAG_GENERATIONS) keep the
+ * records of unchanged chunks from earlier runs. Each run stores a new
+ * generation in header bytes 40..43, and every chunk signs, in place of
+ * those bytes, the generation it was sealed in, so a record left over
+ * from an earlier version no longer verifies once its chunk is resealed.
+ * A generation table record, sealed and placed like the hole map, gives
+ * the run's generation (u32) and then each chunk's (u32).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <openssl/rand.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+// Upper bound on plaintext held in flight by one encryption batch
+#define QED_CHUNKED_BATCH_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+    const qed_hardware_sig_t *hw_sig;
+    const uint8_t *key;
+    const qed_mac_state_t *mac;
+    uint8_t cipher;
+    const uint8_t *header;
+    qed_compression_t compression;
+    int compression_level;
+    size_t chunk_size;
+    uint64_t chunk_count;
+    size_t slots;
+    size_t plain_stride;
+    uint64_t *chunk_numbers;
+    uint8_t *plain;
+    size_t *plain_lens;
+    uint8_t *scratch;
+    uint8_t *records;
+    size_t *record_lens;
+    qed_result_t *results;
+    // Re-keying: the file chunks are read from and its key
+    qed_chunked_reader_t *source;
+    const uint8_t *source_key;
+    const qed_mac_state_t *source_mac;
+} qed_chunk_batch_t;
+
+size_t qed_chunked_aad(const uint8_t *header, uint64_t index, uint32_t plain_len,
+                       bool final, uint32_t generation, uint8_t *aad) {
+    memcpy(aad, header, QED_CHUNKED_HEADER_SIZE);
+    qed_put_le64(aad + QED_CHUNKED_HEADER_SIZE, index);
+    qed_put_le32(aad + QED_CHUNKED_HEADER_SIZE + 8, plain_len);
+    
+    if (header[4] == 1) {
+        return QED_CHUNKED_HEADER_SIZE + 12;
+    }
+    
+    // Chunks leave the size out so incremental runs can keep them; the
+    // hole map binds it, since a trailing hole has no record whose length
+    // would. The generation table binds the run's generation the same way.
+    if (index != QED_CHUNKED_MAP_INDEX) {
+        memset(aad + 16, 0, 8);
+        if (header[7] & QED_CHUNKED_FLAG_GENERATIONS) {
+            qed_put_le32(aad + 40, generation);
+        }
+    }
+    aad[QED_CHUNKED_HEADER_SIZE + 12] = final ? 1 : 0;
+    return QED_CHUNKED_AAD_SIZE;
+}
+
+// Compresses and seals one chunk of a batch; runs on worker threads
+static void qed_chunk_seal_worker(void *ctx, size_t slot) {
+    qed_chunk_batch_t *batch = ctx;
+    const uint8_t *plain = batch->plain + slot * batch->plain_stride;
+    size_t plain_len = batch->plain_lens[slot];
+    uint8_t *record = batch->records + slot * QED_CHUNKED_RECORD_MAX(batch->chunk_size);
+    uint8_t aad[QED_CHUNKED_AAD_SIZE];
+    const uint8_t *payload = plain;
+    size_t payload_len = plain_len;
+    size_t aad_len;
+    
+    if (batch->compression != QED_COMPRESSION_NONE) {
+        uint8_t *scratch = batch->scratch + slot * (batch->chunk_size + 1);
+        qed_compression_t used;
+        size_t compressed_len;
+        
+        // Only worth storing compressed when it saves at least one byte
+        batch->results[slot] = qed_compress_payload(batch->compression, batch->compression_level,
+                                                    plain, plain_len, scratch + 1,
+                                                    plain_len > 1 ? plain_len - 1 : 0,
+                                                    &compressed_len, &used);
+        if (batch->results[slot] != QED_SUCCESS) {
+            return;
+        }
+        
+        scratch[0] = (uint8_t)used;
+        if (used == QED_COMPRESSION_NONE) {
+            memcpy(scratch + 1, plain, plain_len);
+            compressed_len = plain_len;
+        }
+        payload = scratch;
+        payload_len = compressed_len + 1;
+    }
+    
+    aad_len = qed_chunked_aad(batch->header, batch->chunk_numbers[slot], (uint32_t)plain_len,
+                              batch->chunk_numbers[slot] + 1 == batch->chunk_count, 0, aad);
+    batch->results[slot] = qed_seal_record(batch->hw_sig, batch->key, batch->mac, batch->cipher,
+                                           aad, aad_len,
+                                           payload, payload_len, record,
+                                           &batch->record_lens[slot]);
+}
+
+// Plaintext length of one chunk; only the last may be short
+static size_t qed_chunk_plain_len(uint64_t plaintext_size, size_t chunk_size, uint64_t chunk) {
+    uint64_t rest = plaintext_size - chunk * chunk_size;
+    
+    return rest < chunk_size ? (size_t)rest : chunk_size;
+}
+
+// Total record length of count uncompressed chunks starting at first
+static uint64_t qed_chunk_records_length(uint8_t cipher, size_t chunk_size,
+                                         uint64_t plaintext_size, uint64_t first,
+                                         uint64_t count) {
+    uint64_t chunk_count = (plaintext_size + chunk_size - 1) / chunk_size;
+    uint64_t length = 0;
+    
+    if (count > 0 && first + count == chunk_count && plaintext_size % chunk_size) {
+        length = qed_record_length(cipher, (size_t)(plaintext_size % chunk_size));
+        count--;
+    }
+    return length + count * qed_record_length(cipher, chunk_size);
+}
+
+// Finds the chunks lying wholly inside holes of fd as (first chunk, count)
+// runs. Returns the number of runs, storing at most capacity of them; a
+// filesystem without SEEK_DATA reports none. Moves the file offset.
+static size_t qed_chunked_scan_holes(int fd, uint64_t size, size_t chunk_size,
+                                     uint64_t *holes, size_t capacity) {
+    uint64_t chunk_count = (size + chunk_size - 1) / chunk_size;
+    uint64_t position = 0;
+    size_t runs = 0;
+    
+    while (position < size) {
+        off_t data = lseek(fd, (off_t)position, SEEK_DATA);
+        uint64_t hole_end, first, end;
+        
+        if (data < 0 && errno != ENXIO) {
+            break;
+        }
+        // ENXIO: nothing but hole up to the end of the file
+        hole_end = data < 0 || (uint64_t)data > size ? size : (uint64_t)data;
+        
+        // A hole only covers the chunks that start and end inside it; the
+        // last chunk ends at the end of the file
+        first = (position + chunk_size - 1) / chunk_size;
+        end = hole_end == size ? chunk_count : hole_end / chunk_size;
+        if (first < end) {
+            if (runs < capacity) {
+                holes[2 * runs] = first;
+                holes[2 * runs + 1] = end - first;
+            }
+            runs++;
+        }
+        
+        if (hole_end == size) {
+            break;
+        }
+        data = lseek(fd, data, SEEK_HOLE);
+        if (data < 0) {
+            break;
+        }
+        position = (uint64_t)data;
+    }
+    
+    return runs;
+}
+
+// Opens one chunk of the source file and reseals it under the new key
+static void qed_chunk_rekey_worker(void *ctx, size_t slot) {
+    qed_chunk_batch_t *batch = ctx;
+    
+    // The record slot is free until the chunk is resealed into it
+    batch->results[slot] = qed_chunked_read_chunk(batch->source, batch->hw_sig,
+                                                  batch->source_key, batch->source_mac,
+                                                  batch->chunk_numbers[slot],
+                                                  batch->records + slot *
+                                                      QED_CHUNKED_RECORD_MAX(batch->chunk_size),
+                                                  batch->plain + slot * batch->plain_stride,
+                                                  &batch->plain_lens[slot]);
+    if (batch->results[slot] == QED_SUCCESS) {
+        qed_chunk_seal_worker(ctx, slot);
+    }
+}
+
+bool qed_is_chunked_file(const char *path) {
+    uint8_t magic[4];
+    bool chunked = false;
+    FILE *file;
+    
+    if (!path) {
+        return false;
+    }
+    
+    file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    
+    // Both the header and the footer magic must match; a legacy file starts
+    // with a random signature and could carry the header magic by chance
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        memcmp(magic, QED_CHUNKED_MAGIC, 4) == 0 &&
+        fseeko(file, -(off_t)QED_CHUNKED_FOOTER_SIZE + 16, SEEK_END) == 0 &&
+        fread(magic, 1, sizeof(magic), file) == sizeof(magic)) {
+        chunked = memcmp(magic, QED_CHUNKED_INDEX_MAGIC, 4) == 0;
+    }
+    
+    fclose(file);
+    return chunked;
+}
+
+qed_result_t qed_chunked_open(const char *path, qed_chunked_reader_t *reader) {
+    uint8_t footer[QED_CHUNKED_FOOTER_SIZE];
+    struct stat st;
+    uint64_t expected_count;
+    
+    if (!path || !reader) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    memset(reader, 0, sizeof(qed_chunked_reader_t));
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        return QED_ERROR_FILE_IO;
+    }
+    
+    if (fstat(reader->fd, &st) != 0 ||
+        (uint64_t)st.st_size < QED_CHUNKED_HEADER_SIZE + QED_CHUNKED_FOOTER_SIZE ||
+        qed_pread_full(reader->fd, reader->header, QED_CHUNKED_HEADER_SIZE, 0) != QED_SUCCESS ||
+        qed_pread_full(reader->fd, footer, sizeof(footer),
+                       (uint64_t)st.st_size - QED_CHUNKED_FOOTER_SIZE) != QED_SUCCESS) {
+        qed_chunked_close(reader);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    if (memcmp(reader->header, QED_CHUNKED_MAGIC, 4) != 0 ||
+        reader->header[4] < 1 || reader->header[4] > QED_CHUNKED_VERSION ||
+        !qed_cipher_valid(reader->header[5]) ||
+        (reader->header[7] & ~(QED_CHUNKED_FLAG_SUBKEY | QED_CHUNKED_FLAG_SPARSE |
+                               QED_CHUNKED_FLAG_GENERATIONS)) != 0 ||
+        ((reader->header[7] & QED_CHUNKED_FLAG_SPARSE) &&
+            (reader->header[7] & QED_CHUNKED_FLAG_GENERATIONS)) ||
+        reader->header[6] > QED_MAC_HMAC_SHA256 ||
+        reader->header[12] > QED_COMPRESSION_ZLIB ||
+        memcmp(footer + 16, QED_CHUNKED_INDEX_MAGIC, 4) != 0) {
+        qed_chunked_close(reader);
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    reader->chunk_size = qed_get_le32(reader->header + 8);
+    reader->cipher = reader->header[5];
+    reader->mac = reader->header[6];
+    reader->compression = reader->header[12];
+    reader->plaintext_size = qed_get_le64(reader->header + 16);
+    reader->index_offset = qed_get_le64(footer);
+    reader->chunk_count = qed_get_le64(footer + 8);
+    if (reader->header[7] & (QED_CHUNKED_FLAG_SPARSE | QED_CHUNKED_FLAG_GENERATIONS)) {
+        reader->map_len = qed_get_le32(footer + 20);
+    }
+    
+    expected_count = reader->chunk_size ?
+        (reader->plaintext_size + reader->chunk_size - 1) / reader->chunk_size : 0;
+    
+    if (reader->chunk_size < QED_CHUNK_SIZE_MIN || reader->chunk_size > QED_CHUNK_SIZE_MAX ||
+        reader->chunk_count != expected_count ||
+        reader->index_offset < QED_CHUNKED_HEADER_SIZE + (uint64_t)reader->map_len ||
+        ((reader->header[7] & (QED_CHUNKED_FLAG_SPARSE | QED_CHUNKED_FLAG_GENERATIONS)) &&
+            reader->map_len < QED_RECORD_OVERHEAD) ||
+        reader->index_offset + reader->chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE !=
+            (uint64_t)st.st_size - QED_CHUNKED_FOOTER_SIZE) {
+        qed_chunked_close(reader);
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    return QED_SUCCESS;
+}
+
+void qed_chunked_close(qed_chunked_reader_t *reader) {
+    if (!reader) {
+        return;
+    }
+    
+    if (reader->fd >= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+    if (reader->holes) {
+        qed_mem_free(reader->holes, reader->hole_runs * 2 * sizeof(uint64_t));
+        reader->holes = NULL;
+        reader->hole_runs = 0;
+    }
+    if (reader->generations) {
+        qed_mem_free(reader->generations, reader->chunk_count * sizeof(uint32_t));
+        reader->generations = NULL;
+    }
+}
+
+// Checks an incremental file's generation table: the header's generation,
+// then one per chunk, none of them newer than the run that wrote it
+static qed_result_t qed_chunked_parse_generations(qed_chunked_reader_t *reader,
+                                                  const uint8_t *payload, size_t payload_len) {
+    uint32_t generation = qed_get_le32(reader->header + 40);
+    uint64_t i;
+    
+    if (payload_len != 4 + reader->chunk_count * 4 || generation == 0 ||
+        qed_get_le32(payload) != generation) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    reader->generations = qed_mem_alloc(reader->chunk_count * sizeof(uint32_t));
+    if (!reader->generations) {
+        return QED_ERROR_MEMORY;
+    }
+    
+    for (i = 0; i < reader->chunk_count; i++) {
+        reader->generations[i] = qed_get_le32(payload + 4 + i * 4);
+        if (reader->generations[i] == 0 || reader->generations[i] > generation) {
+            qed_mem_free(reader->generations, reader->chunk_count * sizeof(uint32_t));
+            reader->generations = NULL;
+            return QED_ERROR_INVALID_INPUT;
+        }
+    }
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_chunked_load_map(qed_chunked_reader_t *reader,
+                                  const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                                  const qed_mac_state_t *mac) {
+    uint8_t aad[QED_CHUNKED_AAD_SIZE];
+    uint8_t *record, *payload;
+    size_t payload_len, aad_len, i;
+    uint64_t runs, previous_end = 0;
+    qed_result_t result;
+    
+    if (!reader || !hw_sig || !key) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (!(reader->header[7] & (QED_CHUNKED_FLAG_SPARSE | QED_CHUNKED_FLAG_GENERATIONS)) ||
+        reader->holes || reader->generations) {
+        return QED_SUCCESS;
+    }
+    
+    record = qed_mem_alloc(reader->map_len);
+    payload = qed_mem_alloc(reader->map_len);
+    if (!record || !payload) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    result = qed_pread_full(reader->fd, record, reader->map_len,
+                            reader->index_offset - reader->map_len);
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    aad_len = qed_chunked_aad(reader->header, QED_CHUNKED_MAP_INDEX, reader->map_len,
+                              true, 0, aad);
+    result = qed_open_record(hw_sig, key, mac, reader->cipher, aad, aad_len, record,
+                             reader->map_len, payload, &payload_len);
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    if (reader->header[7] & QED_CHUNKED_FLAG_GENERATIONS) {
+        result = qed_chunked_parse_generations(reader, payload, payload_len);
+        goto cleanup;
+    }
+    
+    // Runs must be non-empty, in order, apart and inside the file
+    runs = payload_len >= 8 ? qed_get_le64(payload) : 0;
+    if (runs == 0 || runs > reader->chunk_count || runs > (payload_len - 8) / 16 ||
+        payload_len != 8 + runs * 16) {
+        result = QED_ERROR_INVALID_INPUT;
+        goto cleanup;
+    }
+    
+    reader->holes = qed_mem_alloc((size_t)runs * 2 * sizeof(uint64_t));
+    if (!reader->holes) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
+    }
+    reader->hole_runs = (size_t)runs;
+    
+    for (i = 0; i < reader->hole_runs; i++) {
+        uint64_t first = qed_get_le64(payload + 8 + i * 16);
+        uint64_t count = qed_get_le64(payload + 16 + i * 16);
+        
+        if (count == 0 || first < previous_end || first >= reader->chunk_count ||
+            count > reader->chunk_count - first) {
+            result = QED_ERROR_INVALID_INPUT;
+            break;
+        }
+        reader->holes[2 * i] = first;
+        reader->holes[2 * i + 1] = count;
+        previous_end = first + count;
+    }
+    
+    if (result != QED_SUCCESS) {
+        qed_mem_free(reader->holes, reader->hole_runs * 2 * sizeof(uint64_t));
+        reader->holes = NULL;
+        reader->hole_runs = 0;
+    }
+
+cleanup:
+    qed_mem_free(payload, reader->map_len);
+    qed_mem_free(record, reader->map_len);
+    return result;
+}
+
+bool qed_chunked_is_hole(const qed_chunked_reader_t *reader, uint64_t index) {
+    size_t low = 0, high;
+    
+    if (!reader || !reader->holes) {
+        return false;
+    }
+    
+    // Last run starting at or before index
+    high = reader->hole_runs;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        
+        if (reader->holes[2 * middle] <= index) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    
+    return reader->holes[2 * low] <= index &&
+           index - reader->holes[2 * low] < reader->holes[2 * low + 1];
+}
+
+qed_result_t qed_chunked_mac_state(qed_device_t *device, const char *key_id,
+                                   const qed_chunked_reader_t *reader,
+                                   const qed_mac_state_t **mac) {
+    *mac = NULL;
+    if (reader->mac == QED_MAC_HMAC_SHA256) {
+        return qed_get_mac_state(device, key_id, mac);
+    }
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_chunked_file_key(qed_device_t *device, const char *key_id,
+                                  const qed_chunked_reader_t *reader, uint8_t *key) {
+    return qed_file_key(device, key_id, (reader->header[7] & QED_CHUNKED_FLAG_SUBKEY) ?
+                        reader->header + 24 : NULL, key);
+}
+
+qed_result_t qed_chunked_fetch_record(qed_chunked_reader_t *reader, uint64_t index,
+                                      uint8_t *record, size_t *record_len,
+                                      uint8_t *aad, size_t *aad_len) {
+    uint8_t entry[QED_CHUNKED_INDEX_ENTRY_SIZE];
+    uint64_t record_offset;
+    uint32_t length, expected_len;
+    qed_result_t result;
+    
+    if (!reader || !record || !record_len || !aad || !aad_len ||
+        index >= reader->chunk_count ||
+        ((reader->header[7] & QED_CHUNKED_FLAG_GENERATIONS) && !reader->generations)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    expected_len = (uint32_t)(index + 1 < reader->chunk_count ?
+        reader->chunk_size :
+        reader->plaintext_size - index * reader->chunk_size);
+    
+    QED_STAGE_BEGIN(read_start);
+    QED_PROBE(file__read__start);
+    result = qed_pread_full(reader->fd, entry, sizeof(entry),
+                            reader->index_offset + index * QED_CHUNKED_INDEX_ENTRY_SIZE);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    record_offset = qed_get_le64(entry);
+    length = qed_get_le32(entry + 8);
+    
+    if (qed_get_le32(entry + 12) != expected_len ||
+        length > QED_CHUNKED_RECORD_MAX(reader->chunk_size) ||
+        record_offset < QED_CHUNKED_HEADER_SIZE ||
+        record_offset + length > reader->index_offset - reader->map_len) {
+        return QED_ERROR_SIGNATURE_MISMATCH;
+    }
+    
+    result = qed_pread_full(reader->fd, record, length, record_offset);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    QED_STAGE_END(QED_STAGE_FILE_READ, read_start, length);
+    QED_PROBE1(file__read__done, length);
+    
+    *record_len = length;
+    *aad_len = qed_chunked_aad(reader->header, index, expected_len,
+                               index + 1 == reader->chunk_count,
+                               reader->generations ? reader->generations[index] : 0, aad);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_chunked_read_chunk(qed_chunked_reader_t *reader,
+                                    const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                                    const qed_mac_state_t *mac, uint64_t index, uint8_t *record, uint8_t *plain,
+                                    size_t *plain_len) {
+    uint8_t aad[QED_CHUNKED_AAD_SIZE];
+    size_t record_len, aad_len, expected_len;
+    qed_result_t result;
+    
+    if (!reader || !hw_sig || !key || !record || !plain || !plain_len) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (qed_chunked_is_hole(reader, index)) {
+        *plain_len = qed_chunk_plain_len(reader->plaintext_size, reader->chunk_size, index);
+        memset(plain, 0, *plain_len);
+        return QED_SUCCESS;
+    }
+    
+    result = qed_chunked_fetch_record(reader, index, record, &record_len, aad, &aad_len);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    expected_len = (size_t)(index + 1 < reader->chunk_count ?
+        reader->chunk_size :
+        reader->plaintext_size - index * reader->chunk_size);
+    
+    result = qed_open_record(hw_sig, key, mac, reader->cipher, aad, aad_len, record, record_len,
+                             plain, plain_len);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    if (reader->compression != QED_COMPRESSION_NONE) {
+        if (*plain_len == 0) {
+            return QED_ERROR_DECRYPTION;
+        }
+        
+        if (plain[0] == QED_COMPRESSION_NONE) {
+            memmove(plain, plain + 1, *plain_len - 1);
+            *plain_len -= 1;
+        } else {
+            // The record buffer is free again and large enough for a chunk
+            result = qed_decompress_payload((qed_compression_t)plain[0], plain + 1,
+                                            *plain_len - 1, record, expected_len);
+            if (result != QED_SUCCESS) {
+                return result;
+            }
+            memcpy(plain, record, expected_len);
+            *plain_len = expected_len;
+        }
+    }
+    
+    if (*plain_len != expected_len) {
+        return QED_ERROR_SIGNATURE_MISMATCH;
+    }
+    
+    return QED_SUCCESS;
+}
+
+// Working memory of one batch slot: its plaintext, sealed record and
+// compression scratch
+static size_t qed_chunk_slot_bytes(const qed_chunk_batch_t *batch) {
+    return batch->plain_stride + QED_CHUNKED_RECORD_MAX(batch->chunk_size) +
+           (batch->compression != QED_COMPRESSION_NONE ? batch->chunk_size + 1 : 0);
+}
+
+// Sizes the batch and allocates its buffers; chunk_size, plain_stride and
+// compression must be set
+static qed_result_t qed_chunk_batch_alloc(qed_chunk_batch_t *batch, const qed_device_t *device) {
+    size_t slots = 2 * qed_parallel_workers();
+    
+    if (slots > QED_CHUNKED_BATCH_BYTES / batch->chunk_size) {
+        slots = QED_CHUNKED_BATCH_BYTES / batch->chunk_size;
+    }
+    // A memory budget shrinks the batch to what it can hold
+    if (device->memory_budget && slots > device->memory_budget / qed_chunk_slot_bytes(batch)) {
+        slots = (size_t)(device->memory_budget / qed_chunk_slot_bytes(batch));
+    }
+    if (slots == 0) {
+        slots = 1;
+    }
+    
+    batch->slots = slots;
+    batch->chunk_numbers = calloc(slots, sizeof(uint64_t));
+    batch->plain = qed_buffer_alloc(device, slots * batch->plain_stride);
+    batch->plain_lens = calloc(slots, sizeof(size_t));
+    batch->records = qed_buffer_alloc(device, slots * QED_CHUNKED_RECORD_MAX(batch->chunk_size));
+    batch->record_lens = calloc(slots, sizeof(size_t));
+    batch->results = calloc(slots, sizeof(qed_result_t));
+    if (batch->compression != QED_COMPRESSION_NONE) {
+        batch->scratch = qed_buffer_alloc(device, slots * (batch->chunk_size + 1));
+    }
+    
+    if (!batch->chunk_numbers || !batch->plain || !batch->plain_lens || !batch->records ||
+        !batch->record_lens || !batch->results ||
+        (batch->compression != QED_COMPRESSION_NONE && !batch->scratch)) {
+        return QED_ERROR_MEMORY;
+    }
+    return QED_SUCCESS;
+}
+
+static void qed_chunk_batch_release(qed_chunk_batch_t *batch) {
+    if (batch->plain) {
+        qed_secure_zero(batch->plain, batch->slots * batch->plain_stride);
+        qed_buffer_free(batch->plain, batch->slots * batch->plain_stride);
+    }
+    if (batch->scratch) {
+        qed_secure_zero(batch->scratch, batch->slots * (batch->chunk_size + 1));
+        qed_buffer_free(batch->scratch, batch->slots * (batch->chunk_size + 1));
+    }
+    // Re-keying decompresses through the record slots
+    if (batch->records && batch->source) {
+        qed_secure_zero(batch->records, batch->slots * QED_CHUNKED_RECORD_MAX(batch->chunk_size));
+    }
+    free(batch->chunk_numbers);
+    free(batch->plain_lens);
+    qed_buffer_free(batch->records, batch->slots * QED_CHUNKED_RECORD_MAX(batch->chunk_size));
+    free(batch->record_lens);
+    free(batch->results);
+}
+
+// Writes count sealed chunks in order and fills in their index entries
+static qed_result_t qed_chunk_batch_write(const qed_chunk_batch_t *batch, size_t count,
+                                          qed_output_t *output, uint8_t *index,
+                                          uint64_t *offset) {
+    size_t slot;
+    qed_result_t result;
+    
+    for (slot = 0; slot < count; slot++) {
+        const uint8_t *record = batch->records + slot * QED_CHUNKED_RECORD_MAX(batch->chunk_size);
+        size_t record_len = batch->record_lens[slot];
+        uint8_t *entry = index + batch->chunk_numbers[slot] * QED_CHUNKED_INDEX_ENTRY_SIZE;
+        
+        if (batch->results[slot] != QED_SUCCESS) {
+            return batch->results[slot];
+        }
+        
+        QED_STAGE_BEGIN(write_start);
+        QED_PROBE(file__write__start);
+        result = qed_output_write(output, record, record_len);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        QED_STAGE_END(QED_STAGE_FILE_WRITE, write_start, record_len);
+        QED_PROBE1(file__write__done, record_len);
+        
+        qed_put_le64(entry, *offset);
+        qed_put_le32(entry + 8, (uint32_t)record_len);
+        qed_put_le32(entry + 12, (uint32_t)batch->plain_lens[slot]);
+        *offset += record_len;
+    }
+    
+    return QED_SUCCESS;
+}
+
+// Writes the hole map (when there are holes), the index and the footer.
+// Hole chunks get index entries holding only their plaintext length.
+static qed_result_t qed_chunked_write_tail(const qed_chunk_batch_t *batch, qed_output_t *output,
+                                           const uint64_t *holes, size_t hole_runs,
+                                           uint8_t *index, uint64_t offset) {
+    uint8_t footer[QED_CHUNKED_FOOTER_SIZE];
+    uint64_t plaintext_size = qed_get_le64(batch->header + 16);
+    qed_result_t result;
+    
+    memset(footer, 0, sizeof(footer));
+    
+    if (hole_runs > 0) {
+        uint8_t aad[QED_CHUNKED_AAD_SIZE];
+        size_t map_len = 8 + hole_runs * 16;
+        size_t expected_len = qed_record_length(batch->cipher, map_len);
+        uint8_t *map = qed_mem_alloc(map_len);
+        uint8_t *record = qed_mem_alloc(expected_len + 16);
+        size_t aad_len, record_len, run;
+        uint64_t chunk;
+        
+        if (!map || !record) {
+            qed_mem_free(map, map_len);
+            qed_mem_free(record, expected_len + 16);
+            return QED_ERROR_MEMORY;
+        }
+        
+        qed_put_le64(map, hole_runs);
+        for (run = 0; run < hole_runs; run++) {
+            qed_put_le64(map + 8 + run * 16, holes[2 * run]);
+            qed_put_le64(map + 16 + run * 16, holes[2 * run + 1]);
+            
+            for (chunk = holes[2 * run]; chunk < holes[2 * run] + holes[2 * run + 1]; chunk++) {
+                uint8_t *entry = index + chunk * QED_CHUNKED_INDEX_ENTRY_SIZE;
+                
+                memset(entry, 0, 12);
+                qed_put_le32(entry + 12, (uint32_t)qed_chunk_plain_len(plaintext_size,
+                                                                       batch->chunk_size, chunk));
+            }
+        }
+        
+        aad_len = qed_chunked_aad(batch->header, QED_CHUNKED_MAP_INDEX,
+                                  (uint32_t)expected_len, true, 0, aad);
+        result = qed_seal_record(batch->hw_sig, batch->key, batch->mac, batch->cipher, aad,
+                                 aad_len, map, map_len, record, &record_len);
+        if (result == QED_SUCCESS && record_len != expected_len) {
+            result = QED_ERROR_ENCRYPTION;
+        }
+        if (result == QED_SUCCESS) {
+            result = qed_output_write(output, record, record_len);
+        }
+        qed_mem_free(map, map_len);
+        qed_mem_free(record, expected_len + 16);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        
+        qed_put_le32(footer + 20, (uint32_t)record_len);
+        offset += record_len;
+    }
+    
+    qed_put_le64(footer, offset);
+    qed_put_le64(footer + 8, batch->chunk_count);
+    memcpy(footer + 16, QED_CHUNKED_INDEX_MAGIC, 4);
+    
+    result = qed_output_write(output, index, batch->chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE);
+    if (result == QED_SUCCESS) {
+        result = qed_output_write(output, footer, sizeof(footer));
+    }
+    return result;
+}
+
+// Length of an uncompressed file, whose record lengths are all known
+// before the first chunk is sealed
+static uint64_t qed_chunked_file_length(uint8_t cipher, size_t chunk_size,
+                                        uint64_t plaintext_size, const uint64_t *holes,
+                                        size_t hole_runs) {
+    uint64_t chunk_count = (plaintext_size + chunk_size - 1) / chunk_size;
+    uint64_t length = QED_CHUNKED_HEADER_SIZE +
+        qed_chunk_records_length(cipher, chunk_size, plaintext_size, 0, chunk_count) +
+        chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE + QED_CHUNKED_FOOTER_SIZE;
+    size_t run;
+    
+    for (run = 0; run < hole_runs; run++) {
+        length -= qed_chunk_records_length(cipher, chunk_size, plaintext_size,
+                                           holes[2 * run], holes[2 * run + 1]);
+    }
+    if (hole_runs > 0) {
+        length += qed_record_length(cipher, 8 + hole_runs * 16);
+    }
+    return length;
+}
+
+// Header of a new file in the device's cipher, signature and compression
+// settings, and the key its chunks are sealed with. The random file id
+// doubles as the subkey salt.
+static qed_result_t qed_chunked_new_file(qed_device_t *device, const char *key_id,
+                                         size_t chunk_size, uint64_t plaintext_size,
+                                         uint8_t *header, uint8_t *key) {
+    qed_result_t result;
+    
+    result = qed_generate_quantum_key(device, key_id, key, QED_KEY_LENGTH);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    memset(header, 0, QED_CHUNKED_HEADER_SIZE);
+    memcpy(header, QED_CHUNKED_MAGIC, 4);
+    header[4] = QED_CHUNKED_VERSION;
+    header[5] = device->cipher;
+    header[6] = device->mac;
+    qed_put_le32(header + 8, (uint32_t)chunk_size);
+    header[12] = device->compression;
+    qed_put_le64(header + 16, plaintext_size);
+    if (device->subkeys) {
+        header[7] = QED_CHUNKED_FLAG_SUBKEY;
+    }
+    
+    if (RAND_bytes(header + 24, 16) != 1) {
+        return QED_ERROR_ENCRYPTION;
+    }
+    if (device->subkeys) {
+        return qed_file_key(device, key_id, header + 24, key);
+    }
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_encrypt_file_chunked(qed_device_t *device, const char *key_id,
+                                     const char *input_path, const char *output_path,
+                                     size_t chunk_size) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    uint8_t header[QED_CHUNKED_HEADER_SIZE];
+    qed_chunk_batch_t batch;
+    size_t hole_runs = 0, run = 0;
+    uint8_t *index = NULL;
+    uint64_t *holes = NULL;
+    FILE *input = NULL;
+    qed_output_t output;
+    bool output_open = false;
+    struct stat st;
+    uint64_t plaintext_size, chunk_count, offset, size_hint = 0, hole_chunks = 0, chunk;
+    qed_result_t result;
+    
+    if (!device || !key_id || !input_path || !output_path) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (chunk_size == 0) {
+        chunk_size = QED_CHUNK_SIZE_DEFAULT;
+    }
+    
+    if (chunk_size < QED_CHUNK_SIZE_MIN || chunk_size > QED_CHUNK_SIZE_MAX ||
+        chunk_size % 16 != 0) {
+        printf("❌ Error: Chunk size must be a multiple of 16 between %d and %d bytes.\n",
+               QED_CHUNK_SIZE_MIN, QED_CHUNK_SIZE_MAX);
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (stat(input_path, &st) != 0) {
+        printf("❌ Error: Input file '%s' does not exist.\n", input_path);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    if (qed_paths_are_same(input_path, output_path)) {
+        printf("❌ Error: Output file cannot be the same as input file.\n");
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_FILE_ENCRYPT);
+    QED_OP_BEGIN(op_start);
+    
+    plaintext_size = (uint64_t)st.st_size;
+    chunk_count = (plaintext_size + chunk_size - 1) / chunk_size;
+    
+    result = qed_chunked_new_file(device, key_id, chunk_size, plaintext_size, header,
+                                  quantum_key);
+    if (result != QED_SUCCESS) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        printf("❌ File encryption failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    // Chunks are read in batches, compressed and sealed in parallel, then
+    // written back in order
+    memset(&batch, 0, sizeof(batch));
+    batch.hw_sig = &device->hardware_sig;
+    batch.key = quantum_key;
+    batch.cipher = device->cipher;
+    batch.header = header;
+    batch.compression = (qed_compression_t)device->compression;
+    batch.compression_level = device->compression_level;
+    batch.chunk_size = chunk_size;
+    batch.chunk_count = chunk_count;
+    batch.plain_stride = chunk_size;
+    if (device->mac == QED_MAC_HMAC_SHA256) {
+        result = qed_get_mac_state(device, key_id, &batch.mac);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+    }
+    
+    result = qed_chunk_batch_alloc(&batch, device);
+    index = qed_mem_alloc(chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE);
+    if (result == QED_SUCCESS && !index) {
+        result = QED_ERROR_MEMORY;
+    }
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    input = fopen(input_path, "rb");
+    if (!input) {
+        result = QED_ERROR_FILE_IO;
+        goto cleanup;
+    }
+    
+    // Count the holes, then record them; a count that changed in between
+    // means the file is being written to
+    if (device->sparse) {
+        hole_runs = qed_chunked_scan_holes(fileno(input), plaintext_size, chunk_size, NULL, 0);
+        if (fseeko(input, 0, SEEK_SET) != 0) {
+            result = QED_ERROR_FILE_IO;
+            goto cleanup;
+        }
+    }
+    if (hole_runs > (UINT32_MAX - QED_RECORD_OVERHEAD - 24) / 16) {
+        result = QED_ERROR_INVALID_INPUT;
+        goto cleanup;
+    }
+    if (hole_runs > 0) {
+        holes = qed_mem_alloc(hole_runs * 2 * sizeof(uint64_t));
+        if (!holes) {
+            result = QED_ERROR_MEMORY;
+            goto cleanup;
+        }
+        
+        if (qed_chunked_scan_holes(fileno(input), plaintext_size, chunk_size, holes,
+                                   hole_runs) != hole_runs ||
+            fseeko(input, 0, SEEK_SET) != 0) {
+            printf("❌ Error: Input file '%s' changed while it was being read.\n", input_path);
+            result = QED_ERROR_FILE_IO;
+            goto cleanup;
+        }
+        
+        for (run = 0; run < hole_runs; run++) {
+            hole_chunks += holes[2 * run + 1];
+        }
+        run = 0;
+        header[7] |= QED_CHUNKED_FLAG_SPARSE;
+    }
+    
+    if (batch.compression == QED_COMPRESSION_NONE) {
+        size_hint = qed_chunked_file_length(device->cipher, chunk_size, plaintext_size, holes,
+                                            hole_runs);
+    }
+    
+    result = qed_output_open(&output, device, output_path, size_hint);
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    output_open = true;
+    
+    result = qed_output_write(&output, header, sizeof(header));
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    offset = sizeof(header);
+    
+    chunk = 0;
+    while (chunk < chunk_count) {
+        size_t count = 0;
+        uint64_t bytes_read = 0;
+        
+        QED_STAGE_BEGIN(read_start);
+        QED_PROBE(file__read__start);
+        while (count < batch.slots && chunk < chunk_count) {
+            size_t plain_len;
+            
+            // Hole chunks are neither read nor sealed
+            if (run < hole_runs && chunk == holes[2 * run]) {
+                chunk += holes[2 * run + 1];
+                run++;
+                if (chunk < chunk_count &&
+                    fseeko(input, (off_t)(chunk * chunk_size), SEEK_SET) != 0) {
+                    result = QED_ERROR_FILE_IO;
+                    goto cleanup;
+                }
+                continue;
+            }
+            
+            plain_len = qed_chunk_plain_len(plaintext_size, chunk_size, chunk);
+            if (fread(batch.plain + count * chunk_size, 1, plain_len, input) != plain_len) {
+                result = QED_ERROR_FILE_IO;
+                goto cleanup;
+            }
+            batch.chunk_numbers[count] = chunk;
+            batch.plain_lens[count] = plain_len;
+            bytes_read += plain_len;
+            count++;
+            chunk++;
+        }
+        QED_STAGE_END(QED_STAGE_FILE_READ, read_start, bytes_read);
+        QED_PROBE1(file__read__done, bytes_read);
+        
+        qed_parallel_for(count, qed_chunk_seal_worker, &batch);
+        
+        result = qed_chunk_batch_write(&batch, count, &output, index, &offset);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+    }
+    
+    result = qed_chunked_write_tail(&batch, &output, holes, hole_runs, index, offset);
+
+cleanup:
+    if (input) {
+        fclose(input);
+    }
+    if (output_open && result == QED_SUCCESS) {
+        result = qed_output_commit(&output);
+    } else if (output_open) {
+        qed_output_abort(&output);
+    }
+    qed_chunk_batch_release(&batch);
+    qed_mem_free(index, chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE);
+    qed_mem_free(holes, hole_runs * 2 * sizeof(uint64_t));
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    
+    if (result != QED_SUCCESS) {
+        printf("❌ File encryption failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    QED_OP_END(QED_OP_FILE_ENCRYPT, op_start, plaintext_size);
+    if (hole_chunks > 0) {
+        printf("🔒 File encrypted successfully: %s (%lu chunks, %lu in holes)\n", output_path,
+               chunk_count, hole_chunks);
+    } else {
+        printf("🔒 File encrypted successfully: %s (%lu chunks)\n", output_path, chunk_count);
+    }
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_decrypt_range(qed_device_t *device, const char *key_id,
+                              const char *path, uint64_t offset, size_t length,
+                              uint8_t *out) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    const qed_mac_state_t *mac = NULL;
+    qed_chunked_reader_t reader;
+    uint8_t *record = NULL;
+    uint8_t *plain = NULL;
+    uint64_t first, last, i;
+    size_t copied = 0;
+    qed_result_t result;
+    
+    if (!device || !key_id || !path || (!out && length > 0)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    result = qed_chunked_open(path, &reader);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    if (offset > reader.plaintext_size || length > reader.plaintext_size - offset) {
+        qed_chunked_close(&reader);
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (length == 0) {
+        qed_chunked_close(&reader);
+        return QED_SUCCESS;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_DECRYPT);
+    QED_OP_BEGIN(op_start);
+    
+    result = qed_chunked_file_key(device, key_id, &reader, quantum_key);
+    if (result != QED_SUCCESS) {
+        qed_chunked_close(&reader);
+        return result;
+    }
+    
+    result = qed_chunked_mac_state(device, key_id, &reader, &mac);
+    if (result == QED_SUCCESS) {
+        result = qed_chunked_load_map(&reader, &device->hardware_sig, quantum_key, mac);
+    }
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    record = qed_mem_alloc(QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    plain = qed_mem_alloc(QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    if (!record || !plain) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    first = offset / reader.chunk_size;
+    last = (offset + length - 1) / reader.chunk_size;
+    
+    for (i = first; i <= last; i++) {
+        uint64_t chunk_start = i * reader.chunk_size;
+        size_t plain_len, skip, take;
+        
+        result = qed_chunked_read_chunk(&reader, &device->hardware_sig, quantum_key, mac, i,
+                                        record, plain, &plain_len);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+        
+        skip = offset + copied > chunk_start ? (size_t)(offset + copied - chunk_start) : 0;
+        take = plain_len - skip;
+        if (take > length - copied) {
+            take = length - copied;
+        }
+        
+        memcpy(out + copied, plain + skip, take);
+        copied += take;
+    }
+    
+    result = QED_SUCCESS;
+
+cleanup:
+    qed_chunked_close(&reader);
+    if (plain) {
+        qed_secure_zero(plain, QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+        qed_mem_free(plain, QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    }
+    qed_mem_free(record, QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    
+    if (result != QED_SUCCESS) {
+        // Never hand out a partially decrypted range
+        qed_secure_zero(out, length);
+        return result;
+    }
+    
+    QED_OP_END(QED_OP_DECRYPT, op_start, length);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_decrypt_file_chunked(qed_device_t *device, const char *key_id,
+                                      const char *input_path, const char *output_path) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    const qed_mac_state_t *mac = NULL;
+    qed_chunked_reader_t reader;
+    uint8_t *record = NULL;
+    uint8_t *plain = NULL;
+    qed_output_t output;
+    bool output_open = false;
+    uint64_t i;
+    qed_result_t result;
+    
+    result = qed_chunked_open(input_path, &reader);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_FILE_DECRYPT);
+    QED_OP_BEGIN(op_start);
+    
+    result = qed_chunked_file_key(device, key_id, &reader, quantum_key);
+    if (result != QED_SUCCESS) {
+        qed_chunked_close(&reader);
+        return result;
+    }
+    
+    result = qed_chunked_mac_state(device, key_id, &reader, &mac);
+    if (result == QED_SUCCESS) {
+        result = qed_chunked_load_map(&reader, &device->hardware_sig, quantum_key, mac);
+    }
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    record = qed_mem_alloc(QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    plain = qed_mem_alloc(QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    if (!record || !plain) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    // Reserving the whole size would allocate the holes
+    result = qed_output_open(&output, device, output_path,
+                             reader.holes ? 0 : reader.plaintext_size);
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    output_open = true;
+    
+    for (i = 0; i < reader.chunk_count; i++) {
+        size_t plain_len;
+        
+        if (qed_chunked_is_hole(&reader, i)) {
+            result = qed_output_skip(&output, qed_chunk_plain_len(reader.plaintext_size,
+                                                                  reader.chunk_size, i));
+            if (result != QED_SUCCESS) {
+                goto cleanup;
+            }
+            continue;
+        }
+        
+        result = qed_chunked_read_chunk(&reader, &device->hardware_sig, quantum_key, mac, i,
+                                        record, plain, &plain_len);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+        
+        QED_STAGE_BEGIN(write_start);
+        QED_PROBE(file__write__start);
+        result = qed_output_write(&output, plain, plain_len);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+        QED_STAGE_END(QED_STAGE_FILE_WRITE, write_start, plain_len);
+        QED_PROBE1(file__write__done, plain_len);
+    }
+
+cleanup:
+    qed_chunked_close(&reader);
+    if (output_open && result == QED_SUCCESS) {
+        result = qed_output_commit(&output);
+    } else if (output_open) {
+        // Do not leave verified-so-far plaintext behind
+        qed_output_abort(&output);
+    }
+    if (plain) {
+        qed_secure_zero(plain, QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+        qed_mem_free(plain, QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    }
+    qed_mem_free(record, QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    
+    if (result == QED_SUCCESS) {
+        QED_OP_END(QED_OP_FILE_DECRYPT, op_start, reader.plaintext_size);
+    }
+    return result;
+}
+
+qed_result_t qed_rekey_file_chunked(qed_device_t *device, const char *old_key_id,
+                                    const char *new_key_id, const char *input_path,
+                                    const char *output_path) {
+    uint8_t old_key[QED_KEY_LENGTH];
+    uint8_t new_key[QED_KEY_LENGTH];
+    uint8_t header[QED_CHUNKED_HEADER_SIZE];
+    const qed_mac_state_t *old_mac = NULL;
+    qed_chunked_reader_t reader;
+    qed_chunk_batch_t batch;
+    uint8_t *index = NULL;
+    qed_output_t output;
+    bool output_open = false;
+    uint64_t offset, size_hint = 0, chunk = 0;
+    size_t run = 0;
+    qed_result_t result;
+    
+    result = qed_chunked_open(input_path, &reader);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_FILE_REKEY);
+    QED_OP_BEGIN(op_start);
+    
+    memset(&batch, 0, sizeof(batch));
+    memset(new_key, 0, sizeof(new_key));
+    
+    // The new file keeps the chunk size and holes; everything else follows
+    // the device
+    result = qed_chunked_file_key(device, old_key_id, &reader, old_key);
+    if (result == QED_SUCCESS) {
+        result = qed_chunked_mac_state(device, old_key_id, &reader, &old_mac);
+    }
+    if (result == QED_SUCCESS) {
+        result = qed_chunked_load_map(&reader, &device->hardware_sig, old_key, old_mac);
+    }
+    if (result == QED_SUCCESS) {
+        result = qed_chunked_new_file(device, new_key_id, reader.chunk_size,
+                                      reader.plaintext_size, header, new_key);
+    }
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    if (reader.holes) {
+        header[7] |= QED_CHUNKED_FLAG_SPARSE;
+    }
+    
+    // Each batch is read, opened and resealed in parallel, then written in
+    // order; plaintext only ever sits in the batch buffers
+    batch.hw_sig = &device->hardware_sig;
+    batch.key = new_key;
+    batch.cipher = device->cipher;
+    batch.header = header;
+    batch.compression = (qed_compression_t)device->compression;
+    batch.compression_level = device->compression_level;
+    batch.chunk_size = reader.chunk_size;
+    batch.chunk_count = reader.chunk_count;
+    batch.plain_stride = QED_CHUNKED_RECORD_MAX(reader.chunk_size);
+    batch.source = &reader;
+    batch.source_key = old_key;
+    batch.source_mac = old_mac;
+    if (device->mac == QED_MAC_HMAC_SHA256) {
+        result = qed_get_mac_state(device, new_key_id, &batch.mac);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+    }
+    
+    result = qed_chunk_batch_alloc(&batch, device);
+    index = qed_mem_alloc(reader.chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE);
+    if (result == QED_SUCCESS && !index) {
+        result = QED_ERROR_MEMORY;
+    }
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    if (batch.compression == QED_COMPRESSION_NONE) {
+        size_hint = qed_chunked_file_length(device->cipher, reader.chunk_size,
+                                            reader.plaintext_size, reader.holes,
+                                            reader.hole_runs);
+    }
+    
+    result = qed_output_open(&output, device, output_path, size_hint);
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    output_open = true;
+    
+    result = qed_output_write(&output, header, sizeof(header));
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    offset = sizeof(header);
+    
+    while (chunk < reader.chunk_count) {
+        size_t count = 0;
+        
+        while (count < batch.slots && chunk < reader.chunk_count) {
+            if (run < reader.hole_runs && chunk == reader.holes[2 * run]) {
+                chunk += reader.holes[2 * run + 1];
+                run++;
+                continue;
+            }
+            batch.chunk_numbers[count++] = chunk++;
+        }
+        
+        qed_parallel_for(count, qed_chunk_rekey_worker, &batch);
+        
+        result = qed_chunk_batch_write(&batch, count, &output, index, &offset);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+    }
+    
+    result = qed_chunked_write_tail(&batch, &output, reader.holes, reader.hole_runs, index,
+                                    offset);
+
+cleanup:
+    if (output_open && result == QED_SUCCESS) {
+        result = qed_output_commit(&output);
+    } else if (output_open) {
+        qed_output_abort(&output);
+    }
+    qed_chunk_batch_release(&batch);
+    qed_mem_free(index, reader.chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE);
+    qed_chunked_close(&reader);
+    qed_secure_zero(old_key, sizeof(old_key));
+    qed_secure_zero(new_key, sizeof(new_key));
+    
+    if (result == QED_SUCCESS) {
+        QED_OP_END(QED_OP_FILE_REKEY, op_start, reader.plaintext_size);
+    }
+    return result;
+}
+
+qed_result_t qed_set_sparse(qed_device_t *device, bool enabled) {
+    if (!device) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    device->sparse = enabled;
+    return QED_SUCCESS;
+}
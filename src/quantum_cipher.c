@@ -0,0 +1,327 @@
+/*
+ * Quantum Encryption Device (QED) - Cipher Backends
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Backend table indexed by qed_cipher_t. qed_init() picks AES-256-GCM when
+ * the CPU has AES and carry-less multiply instructions, and
+ * ChaCha20-Poly1305 otherwise, which runs several times faster than
+ * table-driven AES on such hosts. AES-256-CBC remains for the original
+ * format.
+ *
+ * The AEAD backends use the first 12 bytes of the 16-byte IV field as the
+ * nonce and append their 16-byte tag, so a record never grows beyond the
+ * CBC padding allowance of QED_RECORD_OVERHEAD.
+ *
+ * Each thread keeps one context per backend and direction. A context is
+ * re-keyed with a NULL cipher, which keeps the provider state, so no fetch
+ * or allocation happens. After each use it is re-keyed with zeros so the
+ * expanded key does not linger. IVs come from a per-thread pool refilled by
+ * one RAND_bytes() call per 64 records. A used IV is wiped from the pool,
+ * and a forked child discards its copy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#define QED_CIPHER_COUNT 3
+
+// IVs drawn per RAND_bytes() call; each draw costs more than sealing 16 bytes
+#define QED_CIPHER_IV_POOL (64 * QED_IV_LENGTH)
+
+typedef struct {
+    const char *name;
+    const EVP_CIPHER *(*evp)(void);
+    bool aead;
+} qed_cipher_backend_t;
+
+static const qed_cipher_backend_t cipher_backends[QED_CIPHER_COUNT] = {
+    [QED_CIPHER_AES_256_CBC] = { "AES-256-CBC", EVP_aes_256_cbc, false },
+    [QED_CIPHER_AES_256_GCM] = { "AES-256-GCM", EVP_aes_256_gcm, true },
+    [QED_CIPHER_CHACHA20_POLY1305] = { "ChaCha20-Poly1305", EVP_chacha20_poly1305, true }
+};
+
+typedef struct {
+    EVP_CIPHER_CTX *ctx[QED_CIPHER_COUNT][2];
+    uint8_t iv_pool[QED_CIPHER_IV_POOL];
+    size_t iv_used;
+} qed_cipher_thread_t;
+
+static pthread_key_t cipher_thread_key;
+static pthread_once_t cipher_thread_once = PTHREAD_ONCE_INIT;
+
+static const uint8_t cipher_zero_key[QED_KEY_LENGTH];
+
+static void qed_cipher_thread_free(void *ptr) {
+    qed_cipher_thread_t *thread = ptr;
+    int c, e;
+    
+    for (c = 0; c < QED_CIPHER_COUNT; c++) {
+        for (e = 0; e < 2; e++) {
+            EVP_CIPHER_CTX_free(thread->ctx[c][e]);
+        }
+    }
+    qed_secure_zero(thread, sizeof(*thread));
+    free(thread);
+}
+
+// A forked child must not hand out the IVs its parent still holds
+static void qed_cipher_atfork_child(void) {
+    qed_cipher_thread_t *thread = pthread_getspecific(cipher_thread_key);
+    
+    if (thread) {
+        qed_secure_zero(thread->iv_pool, sizeof(thread->iv_pool));
+        thread->iv_used = sizeof(thread->iv_pool);
+    }
+}
+
+static void qed_cipher_thread_init(void) {
+    pthread_key_create(&cipher_thread_key, qed_cipher_thread_free);
+    pthread_atfork(NULL, NULL, qed_cipher_atfork_child);
+}
+
+static qed_cipher_thread_t* qed_cipher_thread(void) {
+    qed_cipher_thread_t *thread;
+    
+    pthread_once(&cipher_thread_once, qed_cipher_thread_init);
+    thread = pthread_getspecific(cipher_thread_key);
+    if (thread) {
+        return thread;
+    }
+    
+    thread = calloc(1, sizeof(qed_cipher_thread_t));
+    if (!thread) {
+        return NULL;
+    }
+    
+    thread->iv_used = sizeof(thread->iv_pool);
+    if (pthread_setspecific(cipher_thread_key, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+// The calling thread's context for a backend, keyed with zeros on creation
+static EVP_CIPHER_CTX* qed_cipher_ctx(uint8_t cipher, int encrypt) {
+    qed_cipher_thread_t *thread = qed_cipher_thread();
+    EVP_CIPHER_CTX *ctx;
+    
+    if (!thread) {
+        return NULL;
+    }
+    
+    ctx = thread->ctx[cipher][encrypt];
+    if (ctx) {
+        return ctx;
+    }
+    
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx || EVP_CipherInit_ex(ctx, cipher_backends[cipher].evp(), NULL,
+                                  cipher_zero_key, NULL, encrypt) != 1) {
+        EVP_CIPHER_CTX_free(ctx);
+        return NULL;
+    }
+    
+    thread->ctx[cipher][encrypt] = ctx;
+    return ctx;
+}
+
+bool qed_cipher_valid(uint8_t cipher) {
+    return cipher < QED_CIPHER_COUNT;
+}
+
+const char* qed_cipher_name(qed_cipher_t cipher) {
+    return qed_cipher_valid((uint8_t)cipher) ? cipher_backends[cipher].name : "unknown";
+}
+
+static bool qed_cpu_has_fast_aes(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul");
+#elif defined(__aarch64__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    return (hwcap & HWCAP_AES) && (hwcap & HWCAP_PMULL);
+#else
+    return false;
+#endif
+}
+
+qed_cipher_t qed_detect_cipher(void) {
+    return qed_cpu_has_fast_aes() ? QED_CIPHER_AES_256_GCM : QED_CIPHER_CHACHA20_POLY1305;
+}
+
+qed_result_t qed_set_cipher(qed_device_t *device, qed_cipher_t cipher) {
+    if (!device || !qed_cipher_valid((uint8_t)cipher)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    device->cipher = (uint8_t)cipher;
+    return QED_SUCCESS;
+}
+
+void qed_cpu_features(char *buffer, size_t size) {
+    struct {
+        const char *name;
+        bool present;
+    } features[8];
+    size_t count = 0, used = 0, i;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    features[count].name = "aes-ni";
+    features[count++].present = __builtin_cpu_supports("aes");
+    features[count].name = "pclmul";
+    features[count++].present = __builtin_cpu_supports("pclmul");
+    features[count].name = "sha-ni";
+    features[count++].present = __builtin_cpu_supports("sha");
+    features[count].name = "sse4.1";
+    features[count++].present = __builtin_cpu_supports("sse4.1");
+    features[count].name = "avx2";
+    features[count++].present = __builtin_cpu_supports("avx2");
+    features[count].name = "avx512f";
+    features[count++].present = __builtin_cpu_supports("avx512f");
+#elif defined(__aarch64__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    features[count].name = "aes";
+    features[count++].present = (hwcap & HWCAP_AES) != 0;
+    features[count].name = "pmull";
+    features[count++].present = (hwcap & HWCAP_PMULL) != 0;
+    features[count].name = "sha2";
+    features[count++].present = (hwcap & HWCAP_SHA2) != 0;
+#endif
+
+    buffer[0] = '\0';
+    for (i = 0; i < count && used < size; i++) {
+        if (features[i].present) {
+            used += snprintf(buffer + used, size - used, "%s%s", used ? " " : "",
+                             features[i].name);
+        }
+    }
+    if (used == 0) {
+        snprintf(buffer, size, "none detected");
+    }
+}
+
+qed_result_t qed_cipher_iv(uint8_t *iv) {
+    qed_cipher_thread_t *thread = qed_cipher_thread();
+    
+    if (!thread) {
+        return RAND_bytes(iv, QED_IV_LENGTH) == 1 ? QED_SUCCESS : QED_ERROR_ENCRYPTION;
+    }
+    
+    if (thread->iv_used == sizeof(thread->iv_pool)) {
+        if (RAND_bytes(thread->iv_pool, sizeof(thread->iv_pool)) != 1) {
+            return QED_ERROR_ENCRYPTION;
+        }
+        thread->iv_used = 0;
+    }
+    
+    memcpy(iv, thread->iv_pool + thread->iv_used, QED_IV_LENGTH);
+    qed_secure_zero(thread->iv_pool + thread->iv_used, QED_IV_LENGTH);
+    thread->iv_used += QED_IV_LENGTH;
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_cipher_encrypt(uint8_t cipher, const uint8_t *key, const uint8_t *iv,
+                                const uint8_t *aad, size_t aad_len,
+                                const uint8_t *plain, size_t plain_len,
+                                uint8_t *out, size_t *out_len) {
+    EVP_CIPHER_CTX *ctx;
+    bool aead;
+    int len = 0, final_len = 0, aad_out;
+    int ok;
+    
+    if (!qed_cipher_valid(cipher) || plain_len > INT32_MAX || aad_len > INT32_MAX) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    ctx = qed_cipher_ctx(cipher, 1);
+    if (!ctx) {
+        return QED_ERROR_ENCRYPTION;
+    }
+    aead = cipher_backends[cipher].aead;
+    
+    ok = EVP_EncryptInit_ex(ctx, NULL, NULL, key, iv) == 1;
+    if (ok && aead && aad_len > 0) {
+        ok = EVP_EncryptUpdate(ctx, NULL, &aad_out, aad, (int)aad_len) == 1;
+    }
+    ok = ok &&
+         EVP_EncryptUpdate(ctx, out, &len, plain, (int)plain_len) == 1 &&
+         EVP_EncryptFinal_ex(ctx, out + len, &final_len) == 1;
+    if (ok && aead) {
+        ok = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, QED_AEAD_TAG_LENGTH,
+                                 out + len + final_len) == 1;
+        final_len += QED_AEAD_TAG_LENGTH;
+    }
+    EVP_EncryptInit_ex(ctx, NULL, NULL, cipher_zero_key, NULL);
+    
+    if (!ok) {
+        return QED_ERROR_ENCRYPTION;
+    }
+    
+    *out_len = (size_t)(len + final_len);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_cipher_decrypt(uint8_t cipher, const uint8_t *key, const uint8_t *iv,
+                                const uint8_t *aad, size_t aad_len,
+                                const uint8_t *in, size_t in_len,
+                                uint8_t *plain, size_t *plain_len) {
+    EVP_CIPHER_CTX *ctx;
+    bool aead;
+    int len = 0, final_len = 0, aad_out;
+    int ok;
+    
+    if (!qed_cipher_valid(cipher) || in_len > INT32_MAX || aad_len > INT32_MAX) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    aead = cipher_backends[cipher].aead;
+    if (aead) {
+        if (in_len < QED_AEAD_TAG_LENGTH) {
+            return QED_ERROR_DECRYPTION;
+        }
+        in_len -= QED_AEAD_TAG_LENGTH;
+    }
+    
+    ctx = qed_cipher_ctx(cipher, 0);
+    if (!ctx) {
+        return QED_ERROR_DECRYPTION;
+    }
+    
+    ok = EVP_DecryptInit_ex(ctx, NULL, NULL, key, iv) == 1;
+    if (ok && aead) {
+        ok = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, QED_AEAD_TAG_LENGTH,
+                                 (void *)(in + in_len)) == 1 &&
+             (aad_len == 0 || EVP_DecryptUpdate(ctx, NULL, &aad_out, aad, (int)aad_len) == 1);
+    }
+    ok = ok &&
+         EVP_DecryptUpdate(ctx, plain, &len, in, (int)in_len) == 1 &&
+         EVP_DecryptFinal_ex(ctx, plain + len, &final_len) == 1;
+    EVP_DecryptInit_ex(ctx, NULL, NULL, cipher_zero_key, NULL);
+    
+    if (!ok) {
+        return QED_ERROR_DECRYPTION;
+    }
+    
+    *plain_len = (size_t)(len + final_len);
+    return QED_SUCCESS;
+}
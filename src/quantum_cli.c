@@ -11,8 +11,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "../include/quantum_encryption.h"
 #include "../include/quantum_evaluation.h"
 
@@ -31,14 +36,58 @@ static void print_usage(const char *program_name) {
     printf("  -w, --wipe [KEY_ID]     Wipe quantum key (or all keys if no ID)\n");
     printf("  -i, --info              Show hardware information\n");
     printf("  -t, --interactive       Interactive mode\n");
+    printf("      --compress[=LEVEL]  Compress before encrypting (zlib, level 1-9)\n");
+    printf("      --mac NAME          Signature for new data: quantum (default) or hmac\n");
+    printf("      --prewarm FILE      Derive the key IDs listed in FILE (one per line) up front\n");
+    printf("      --cipher NAME       Cipher for new data: auto (default), aes-gcm, chacha20 or aes-cbc\n");
+    printf("      --per-file-keys     Seal each new file under its own salted subkey\n");
+    printf("      --direct-io         Write output files with O_DIRECT, bypassing the page cache\n");
+    printf("      --mmap              Map input files instead of reading them through stdio\n");
+    printf("      --huge-pages[=MODE] Huge pages for large buffers: transparent (default) or explicit\n");
+    printf("      --memory-budget SIZE Cap working memory (K, M or G suffix); larger files are\n");
+    printf("                          encrypted chunked and whole-file decryption fails fast\n");
+    printf("      --threads N         Threads for parallel work (default: one per CPU)\n");
+    printf("      --pin-threads       Pin worker threads one per CPU\n");
+    printf("      --chunked           Encrypt into the seekable chunked format\n");
+    printf("      --chunk-size BYTES  Chunk size for --chunked (default: %d)\n", QED_CHUNK_SIZE_DEFAULT);
+    printf("      --sparse            Encrypt chunked, leaving out the input's holes\n");
+    printf("      --incremental       Re-encrypt only chunks changed since the last run\n");
+    printf("      --verify FILE...    Check signatures only; JSON report to --output or stdout\n");
+    printf("      --range OFF:LEN     Decrypt only LEN bytes at OFF of a chunked file\n");
+    printf("      --batch FILE        Run the jobs in FILE, one \"OP KEY INPUT OUTPUT\" per line\n");
+    printf("      --encrypt-dir DIR   Encrypt every file under DIR into the --output directory\n");
+    printf("      --decrypt-dir DIR   Decrypt every file under DIR into the --output directory\n");
+    printf("      --rekey FILE        Re-encrypt FILE from --key to --new-key without plaintext on disk\n");
+    printf("      --rekey-dir DIR     Re-encrypt every file under DIR into the --output directory\n");
+    printf("      --new-key ID        Key ID files are re-encrypted to\n");
+    printf("      --jobs N            Worker threads for batch runs (default: one per CPU)\n");
+    printf("      --pack DIR          Pack DIR into the --output archive\n");
+    printf("      --unpack ARCHIVE    Unpack ARCHIVE into the --output directory\n");
+    printf("      --entry NAME        With --unpack, extract only NAME to --output\n");
+    printf("      --profile NAME|FILE Derive keys from a fixed hardware profile instead of this\n");
+    printf("                          machine (reference, laptop, workstation, server, ci or a file)\n");
+    printf("      --save-profile FILE Write this machine's hardware profile to FILE\n");
+    printf("      --stats             Print per-stage statistics, latency percentiles and memory use\n");
+    printf("      --trace FILE        Write a Chrome trace-event JSON file\n");
     printf("  -h, --help              Show this help message\n");
     printf("  -v, --version           Show version information\n\n");
     
     printf("Examples:\n");
     printf("  %s --encrypt document.pdf --output document.qed\n", program_name);
     printf("  %s --decrypt document.qed --output document.pdf --key mykey\n", program_name);
+    printf("  %s --encrypt disk.img --output disk.qed --chunked\n", program_name);
+    printf("  %s --encrypt disk.img --output disk.qed --incremental\n", program_name);
+    printf("  %s --encrypt vm.raw --output vm.qed --sparse\n", program_name);
+    printf("  %s --rekey-dir vault --output vault-2026 --key old --new-key new --jobs 16\n",
+           program_name);
+    printf("  %s --decrypt disk.qed --output part.bin --range 1048576:4096\n", program_name);
+    printf("  %s --verify archive/*.qed --output report.json\n", program_name);
+    printf("  %s --encrypt-dir photos --output backup --jobs 8\n", program_name);
+    printf("  %s --pack project --output project.qeda\n", program_name);
+    printf("  %s --unpack project.qeda --entry src/main.c --output main.c\n", program_name);
     printf("  %s --interactive\n", program_name);
     printf("  %s --info\n", program_name);
+    printf("  %s --profile reference --encrypt golden.bin --output golden.qed\n", program_name);
 }
 
 static void print_version() {
@@ -47,6 +96,552 @@ static void print_version() {
     printf("Hardware-Dependent Cryptographic System Based on Physical Resonance\n");
 }
 
+// Long-only options
+enum {
+    OPT_STATS = 256,
+    OPT_TRACE,
+    OPT_CHUNKED,
+    OPT_CHUNK_SIZE,
+    OPT_RANGE,
+    OPT_COMPRESS,
+    OPT_INCREMENTAL,
+    OPT_VERIFY,
+    OPT_MAC,
+    OPT_CIPHER,
+    OPT_PREWARM,
+    OPT_PER_FILE_KEYS,
+    OPT_DIRECT_IO,
+    OPT_MMAP,
+    OPT_HUGE_PAGES,
+    OPT_THREADS,
+    OPT_PIN_THREADS,
+    OPT_BATCH,
+    OPT_ENCRYPT_DIR,
+    OPT_DECRYPT_DIR,
+    OPT_REKEY,
+    OPT_REKEY_DIR,
+    OPT_NEW_KEY,
+    OPT_JOBS,
+    OPT_PACK,
+    OPT_UNPACK,
+    OPT_ENTRY,
+    OPT_PROFILE,
+    OPT_SAVE_PROFILE,
+    OPT_MEMORY_BUDGET,
+    OPT_SPARSE
+};
+
+static double get_wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Parses a byte count with an optional K, M or G (binary) suffix
+static bool parse_size(const char *text, uint64_t *bytes) {
+    const char *units = "KMG";
+    const char *unit;
+    unsigned long long value;
+    char *end;
+    
+    if (!text || *text == '-') {
+        return false;
+    }
+    value = strtoull(text, &end, 0);
+    if (end == text) {
+        return false;
+    }
+    if (*end && (unit = strchr(units, toupper((unsigned char)*end))) != NULL) {
+        value <<= 10 * (unit - units + 1);
+        end++;
+    }
+    if (*end == 'B' || *end == 'b') {
+        end++;
+    }
+    if (*end != '\0') {
+        return false;
+    }
+    *bytes = value;
+    return true;
+}
+
+static int run_range_decrypt(qed_device_t *device, const char *key_id,
+                             const char *input_file, const char *range,
+                             const char *output_file) {
+    unsigned long long offset, length;
+    uint8_t *buffer;
+    char *end;
+    FILE *output;
+    qed_result_t result;
+    
+    offset = strtoull(range, &end, 0);
+    if (end == range || *end != ':') {
+        printf("❌ Error: Range must be given as OFFSET:LENGTH.\n");
+        return 1;
+    }
+    length = strtoull(end + 1, &end, 0);
+    if (*end != '\0' || length == 0 || length > SIZE_MAX) {
+        printf("❌ Error: Range must be given as OFFSET:LENGTH.\n");
+        return 1;
+    }
+    
+    buffer = malloc((size_t)length);
+    if (!buffer) {
+        printf("❌ Range decryption failed: %s\n", qed_get_error_string(QED_ERROR_MEMORY));
+        return 1;
+    }
+    
+    result = qed_decrypt_range(device, key_id, input_file, offset, (size_t)length, buffer);
+    if (result != QED_SUCCESS) {
+        printf("❌ Range decryption failed: %s\n", qed_get_error_string(result));
+        free(buffer);
+        return 1;
+    }
+    
+    output = fopen(output_file, "wb");
+    if (!output || fwrite(buffer, 1, (size_t)length, output) != length) {
+        printf("❌ Range decryption failed: %s\n", qed_get_error_string(QED_ERROR_FILE_IO));
+        if (output) {
+            fclose(output);
+        }
+        qed_secure_zero(buffer, (size_t)length);
+        free(buffer);
+        return 1;
+    }
+    fclose(output);
+    
+    qed_secure_zero(buffer, (size_t)length);
+    free(buffer);
+    printf("📨 Decrypted %llu bytes at offset %llu: %s\n", length, offset, output_file);
+    return 0;
+}
+
+static void print_json_string(FILE *output, const char *text) {
+    const unsigned char *p;
+    
+    fputc('"', output);
+    for (p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(output, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(output, "\\u%04x", *p);
+        } else {
+            fputc(*p, output);
+        }
+    }
+    fputc('"', output);
+}
+
+// Writes one JSON object per file followed by a summary line
+static int run_verify(qed_device_t *device, const char *key_id, const char *const *paths,
+                      size_t count, const char *report_file) {
+    qed_verify_result_t *results;
+    FILE *report = stdout;
+    uint64_t total_bytes = 0;
+    size_t failed = 0;
+    double start, elapsed;
+    size_t i;
+    qed_result_t result;
+    
+    results = calloc(count ? count : 1, sizeof(qed_verify_result_t));
+    if (!results) {
+        printf("❌ Verification failed: %s\n", qed_get_error_string(QED_ERROR_MEMORY));
+        return 1;
+    }
+    
+    if (report_file) {
+        report = fopen(report_file, "w");
+        if (!report) {
+            printf("❌ Cannot write report: %s\n", report_file);
+            free(results);
+            return 1;
+        }
+    }
+    
+    start = get_wall_seconds();
+    result = qed_verify_files(device, key_id, paths, count, results);
+    elapsed = get_wall_seconds() - start;
+    if (result != QED_SUCCESS) {
+        printf("❌ Verification failed: %s\n", qed_get_error_string(result));
+        if (report_file) {
+            fclose(report);
+        }
+        free(results);
+        return 1;
+    }
+    
+    for (i = 0; i < count; i++) {
+        fprintf(report, "{\"path\":");
+        print_json_string(report, paths[i]);
+        fprintf(report, ",\"status\":\"%s\",\"error\":", results[i].result == QED_SUCCESS ? "ok" : "failed");
+        print_json_string(report, results[i].result == QED_SUCCESS ? "" :
+                          qed_get_error_string(results[i].result));
+        fprintf(report, ",\"bytes\":%lu,\"seconds\":%.6f}\n", results[i].bytes, results[i].seconds);
+        
+        total_bytes += results[i].bytes;
+        if (results[i].result != QED_SUCCESS) {
+            failed++;
+        }
+    }
+    
+    fprintf(report, "{\"summary\":{\"files\":%zu,\"ok\":%zu,\"failed\":%zu,\"bytes\":%lu,"
+            "\"seconds\":%.6f,\"mb_per_second\":%.2f}}\n", count, count - failed, failed,
+            total_bytes, elapsed, elapsed > 0 ? total_bytes / elapsed / (1024.0 * 1024.0) : 0.0);
+    
+    if (report_file) {
+        fclose(report);
+        printf("%s Verified %zu files, %zu failed: %s\n", failed ? "❌" : "✅", count, failed,
+               report_file);
+    }
+    
+    free(results);
+    return failed ? 1 : 0;
+}
+
+// Reads one key ID per line; blank lines and lines starting with '#' are skipped
+static int run_prewarm(qed_device_t *device, const char *list_file) {
+    char line[QED_MAX_KEY_ID_LENGTH + 2];
+    char **ids = NULL;
+    size_t count = 0, capacity = 0;
+    double start;
+    FILE *input;
+    qed_result_t result = QED_SUCCESS;
+    size_t i;
+    
+    input = fopen(list_file, "r");
+    if (!input) {
+        printf("❌ Cannot read key list: %s\n", list_file);
+        return 1;
+    }
+    
+    while (fgets(line, sizeof(line), input)) {
+        size_t len = strcspn(line, "\r\n");
+        
+        if (line[len] == '\0' && !feof(input)) {
+            printf("❌ Key ID too long in %s (limit %d characters)\n", list_file,
+                   QED_MAX_KEY_ID_LENGTH - 1);
+            result = QED_ERROR_INVALID_INPUT;
+            break;
+        }
+        line[len] = '\0';
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+        
+        if (count == capacity) {
+            char **grown = realloc(ids, (capacity ? capacity * 2 : 64) * sizeof(char *));
+            if (!grown) {
+                result = QED_ERROR_MEMORY;
+                break;
+            }
+            ids = grown;
+            capacity = capacity ? capacity * 2 : 64;
+        }
+        ids[count] = strdup(line);
+        if (!ids[count]) {
+            result = QED_ERROR_MEMORY;
+            break;
+        }
+        count++;
+    }
+    fclose(input);
+    
+    if (result == QED_SUCCESS) {
+        start = get_wall_seconds();
+        result = qed_prewarm_keys(device, (const char *const *)ids, count);
+        if (result == QED_SUCCESS) {
+            printf("⚡ Key store warm in %.1f ms (%zu keys cached)\n",
+                   (get_wall_seconds() - start) * 1000.0, device->key_count);
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        free(ids[i]);
+    }
+    free(ids);
+    
+    if (result != QED_SUCCESS) {
+        printf("❌ Key pre-warming failed: %s\n", qed_get_error_string(result));
+        return 1;
+    }
+    return 0;
+}
+
+// Growable list of batch jobs; the strings are owned by the list
+typedef struct {
+    qed_batch_job_t *jobs;
+    size_t count;
+    size_t capacity;
+} batch_list_t;
+
+static int add_batch_job(batch_list_t *list, qed_batch_op_t op, const char *key_id,
+                         const char *new_key_id, const char *input_path,
+                         const char *output_path) {
+    qed_batch_job_t *job;
+    
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        qed_batch_job_t *grown = realloc(list->jobs, capacity * sizeof(qed_batch_job_t));
+        if (!grown) {
+            return -1;
+        }
+        list->jobs = grown;
+        list->capacity = capacity;
+    }
+    
+    job = &list->jobs[list->count];
+    job->op = op;
+    job->key_id = strdup(key_id);
+    job->input_path = strdup(input_path);
+    job->output_path = strdup(output_path);
+    job->new_key_id = new_key_id ? strdup(new_key_id) : NULL;
+    if (!job->key_id || !job->input_path || !job->output_path ||
+        (new_key_id && !job->new_key_id)) {
+        free((char *)job->key_id);
+        free((char *)job->input_path);
+        free((char *)job->output_path);
+        free((char *)job->new_key_id);
+        return -1;
+    }
+    list->count++;
+    return 0;
+}
+
+static void free_batch_list(batch_list_t *list) {
+    size_t i;
+    
+    for (i = 0; i < list->count; i++) {
+        free((char *)list->jobs[i].key_id);
+        free((char *)list->jobs[i].input_path);
+        free((char *)list->jobs[i].output_path);
+        free((char *)list->jobs[i].new_key_id);
+    }
+    free(list->jobs);
+    memset(list, 0, sizeof(*list));
+}
+
+// Manifest lines are "OP KEY INPUT OUTPUT" separated by whitespace, where OP
+// is encrypt (e) or decrypt (d) and KEY "-" means the --key value, or
+// "rekey OLD_KEY NEW_KEY INPUT OUTPUT" where NEW_KEY "-" means --new-key;
+// blank lines and lines starting with '#' are skipped
+static int load_batch_manifest(batch_list_t *list, const char *manifest_file,
+                               const char *default_key, const char *default_new_key) {
+    char line[3 * 4096];
+    char op[16], key_id[QED_MAX_KEY_ID_LENGTH], new_key_id[QED_MAX_KEY_ID_LENGTH];
+    char input_path[4096], output_path[4096];
+    size_t line_number = 0;
+    FILE *input;
+    int result = 0;
+    
+    input = fopen(manifest_file, "r");
+    if (!input) {
+        printf("❌ Cannot read manifest: %s\n", manifest_file);
+        return 1;
+    }
+    
+    while (fgets(line, sizeof(line), input)) {
+        char *text = line + strspn(line, " \t");
+        char extra;
+        qed_batch_op_t batch_op;
+        
+        line_number++;
+        text[strcspn(text, "\r\n")] = '\0';
+        if (text[0] == '\0' || text[0] == '#') {
+            continue;
+        }
+        
+        if (sscanf(text, "%15s", op) == 1 && strcmp(op, "rekey") == 0) {
+            if (sscanf(text, "%15s %255s %255s %4095s %4095s %c", op, key_id, new_key_id,
+                       input_path, output_path, &extra) != 5) {
+                printf("❌ %s:%zu: expected rekey OLD_KEY NEW_KEY INPUT OUTPUT\n",
+                       manifest_file, line_number);
+                result = 1;
+                break;
+            }
+            if (strcmp(new_key_id, "-") == 0 && !default_new_key) {
+                printf("❌ %s:%zu: NEW_KEY '-' needs --new-key\n", manifest_file, line_number);
+                result = 1;
+                break;
+            }
+            batch_op = QED_BATCH_REKEY;
+        } else if (sscanf(text, "%15s %255s %4095s %4095s %c", op, key_id, input_path,
+                          output_path, &extra) != 4) {
+            printf("❌ %s:%zu: expected OP KEY INPUT OUTPUT\n", manifest_file, line_number);
+            result = 1;
+            break;
+        } else if (strcmp(op, "encrypt") == 0 || strcmp(op, "e") == 0) {
+            batch_op = QED_BATCH_ENCRYPT;
+        } else if (strcmp(op, "decrypt") == 0 || strcmp(op, "d") == 0) {
+            batch_op = QED_BATCH_DECRYPT;
+        } else {
+            printf("❌ %s:%zu: unknown operation '%s' (use encrypt, decrypt or rekey)\n",
+                   manifest_file, line_number, op);
+            result = 1;
+            break;
+        }
+        
+        if (add_batch_job(list, batch_op, strcmp(key_id, "-") == 0 ? default_key : key_id,
+                          batch_op != QED_BATCH_REKEY ? NULL :
+                              strcmp(new_key_id, "-") == 0 ? default_new_key : new_key_id,
+                          input_path, output_path) != 0) {
+            printf("❌ Error: Out of memory.\n");
+            result = 1;
+            break;
+        }
+    }
+    
+    fclose(input);
+    return result;
+}
+
+// Adds every regular file under input_dir, mirroring the tree under
+// output_dir. Encryption appends ".qed"; decryption strips it (or appends
+// ".out" when it is missing); re-keying keeps the name. Symbolic links are
+// not followed, and an output directory inside the input tree is skipped
+// (output_root is NULL on the first call).
+static int walk_batch_dir(batch_list_t *list, qed_batch_op_t op, const char *key_id,
+                          const char *new_key_id, const char *input_dir,
+                          const char *output_dir, const struct stat *output_root) {
+    struct dirent *entry;
+    struct stat st, root;
+    DIR *dir;
+    int result = 0;
+    
+    if (mkdir(output_dir, 0755) != 0 && errno != EEXIST) {
+        printf("❌ Cannot create directory: %s\n", output_dir);
+        return 1;
+    }
+    
+    if (!output_root) {
+        if (stat(output_dir, &root) != 0) {
+            printf("❌ Cannot create directory: %s\n", output_dir);
+            return 1;
+        }
+        output_root = &root;
+    }
+    
+    dir = opendir(input_dir);
+    if (!dir) {
+        printf("❌ Cannot read directory: %s\n", input_dir);
+        return 1;
+    }
+    
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        size_t name_len = strlen(entry->d_name);
+        char *input_path, *output_path;
+        
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        
+        input_path = malloc(strlen(input_dir) + name_len + 2);
+        output_path = malloc(strlen(output_dir) + name_len + 6);
+        if (!input_path || !output_path) {
+            free(input_path);
+            free(output_path);
+            printf("❌ Error: Out of memory.\n");
+            result = 1;
+            break;
+        }
+        sprintf(input_path, "%s/%s", input_dir, entry->d_name);
+        sprintf(output_path, "%s/%s", output_dir, entry->d_name);
+        
+        if (lstat(input_path, &st) != 0) {
+            printf("⚠️  Warning: Skipping unreadable entry: %s\n", input_path);
+        } else if (S_ISDIR(st.st_mode)) {
+            if (st.st_dev != output_root->st_dev || st.st_ino != output_root->st_ino) {
+                result = walk_batch_dir(list, op, key_id, new_key_id, input_path,
+                                        output_path, output_root);
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            char *suffix = output_path + strlen(output_path);
+            
+            if (op == QED_BATCH_ENCRYPT) {
+                strcpy(suffix, ".qed");
+            } else if (op == QED_BATCH_DECRYPT && name_len > 4 &&
+                       strcmp(suffix - 4, ".qed") == 0) {
+                suffix[-4] = '\0';
+            } else if (op == QED_BATCH_DECRYPT) {
+                strcpy(suffix, ".out");
+            }
+            if (add_batch_job(list, op, key_id, new_key_id, input_path, output_path) != 0) {
+                printf("❌ Error: Out of memory.\n");
+                result = 1;
+            }
+        }
+        
+        free(input_path);
+        free(output_path);
+    }
+    
+    closedir(dir);
+    return result;
+}
+
+static void print_batch_progress(void *ctx, size_t done, size_t count,
+                                 const qed_batch_job_t *job, const qed_batch_result_t *result) {
+    (void)ctx;
+    
+    if (result->result == QED_SUCCESS) {
+        printf("📦 [%zu/%zu] ✅ %s (%.1f KB, %.1f ms)\n", done, count, job->input_path,
+               result->bytes / 1024.0, result->seconds * 1000.0);
+    } else {
+        printf("📦 [%zu/%zu] ❌ %s: %s\n", done, count, job->input_path,
+               qed_get_error_string(result->result));
+    }
+    fflush(stdout);
+}
+
+// Runs the list on one device and prints a throughput and failure summary
+static int run_batch(qed_device_t *device, const batch_list_t *list, size_t workers,
+                     size_t chunk_size) {
+    qed_batch_result_t *results;
+    uint64_t total_bytes = 0;
+    size_t failed = 0;
+    double start, elapsed;
+    qed_result_t result;
+    size_t i;
+    
+    results = calloc(list->count ? list->count : 1, sizeof(qed_batch_result_t));
+    if (!results) {
+        printf("❌ Batch failed: %s\n", qed_get_error_string(QED_ERROR_MEMORY));
+        return 1;
+    }
+    
+    start = get_wall_seconds();
+    result = qed_run_batch(device, list->jobs, list->count, workers, chunk_size,
+                           print_batch_progress, NULL, results);
+    elapsed = get_wall_seconds() - start;
+    if (result != QED_SUCCESS) {
+        printf("❌ Batch failed: %s\n", qed_get_error_string(result));
+        free(results);
+        return 1;
+    }
+    
+    for (i = 0; i < list->count; i++) {
+        total_bytes += results[i].bytes;
+        if (results[i].result != QED_SUCCESS) {
+            failed++;
+        }
+    }
+    
+    printf("\n📦 Batch complete: %zu files, %zu ok, %zu failed\n", list->count,
+           list->count - failed, failed);
+    printf("⚡ %.1f MB in %.2f s (%.1f MB/s, %.1f files/s)\n",
+           total_bytes / (1024.0 * 1024.0), elapsed,
+           elapsed > 0 ? total_bytes / elapsed / (1024.0 * 1024.0) : 0.0,
+           elapsed > 0 ? list->count / elapsed : 0.0);
+    for (i = 0; i < list->count; i++) {
+        if (results[i].result != QED_SUCCESS) {
+            printf("❌ %s: %s\n", list->jobs[i].input_path,
+                   qed_get_error_string(results[i].result));
+        }
+    }
+    
+    free(results);
+    return failed ? 1 : 0;
+}
+
 static char* get_user_input(const char *prompt, char *buffer, size_t buffer_size) {
     printf("%s", prompt);
     fflush(stdout);
@@ -180,11 +775,45 @@ int qed_cli_main(int argc, char *argv[]) {
     char *encrypt_file = NULL;
     char *decrypt_file = NULL;
     char *output_file = NULL;
+    char *rekey_file = NULL;
     char *key_id = "default";
+    char *new_key_id = NULL;
     char *wipe_key = NULL;
     bool show_info = false;
     bool interactive = false;
     bool wipe_all = false;
+    bool show_stats = false;
+    char *trace_file = NULL;
+    char *range = NULL;
+    bool chunked = false;
+    size_t chunk_size = 0;
+    bool incremental = false;
+    const char **verify_paths = NULL;
+    size_t verify_count = 0;
+    int exit_code = 0;
+    bool compress = false;
+    int compress_level = 0;
+    char *mac_name = NULL;
+    char *cipher_name = NULL;
+    char *prewarm_file = NULL;
+    bool per_file_keys = false;
+    bool direct_io = false;
+    bool sparse = false;
+    bool mmap_input = false;
+    char *huge_pages = NULL;
+    char *threads = NULL;
+    bool pin_threads = false;
+    char *batch_file = NULL;
+    char *batch_dir = NULL;
+    qed_batch_op_t batch_dir_op = QED_BATCH_ENCRYPT;
+    size_t batch_workers = 0;
+    char *pack_dir = NULL;
+    char *unpack_file = NULL;
+    char *entry_name = NULL;
+    char *profile_name = NULL;
+    char *save_profile = NULL;
+    char *memory_budget = NULL;
+    double start_time = 0.0;
     
     static struct option long_options[] = {
         {"encrypt",     required_argument, 0, 'e'},
@@ -194,6 +823,37 @@ int qed_cli_main(int argc, char *argv[]) {
         {"wipe",        optional_argument, 0, 'w'},
         {"info",        no_argument,       0, 'i'},
         {"interactive", no_argument,       0, 't'},
+        {"stats",       no_argument,       0, OPT_STATS},
+        {"trace",       required_argument, 0, OPT_TRACE},
+        {"chunked",     no_argument,       0, OPT_CHUNKED},
+        {"chunk-size",  required_argument, 0, OPT_CHUNK_SIZE},
+        {"sparse",      no_argument,       0, OPT_SPARSE},
+        {"range",       required_argument, 0, OPT_RANGE},
+        {"compress",    optional_argument, 0, OPT_COMPRESS},
+        {"incremental", no_argument,       0, OPT_INCREMENTAL},
+        {"verify",      required_argument, 0, OPT_VERIFY},
+        {"mac",         required_argument, 0, OPT_MAC},
+        {"cipher",      required_argument, 0, OPT_CIPHER},
+        {"prewarm",     required_argument, 0, OPT_PREWARM},
+        {"per-file-keys", no_argument,     0, OPT_PER_FILE_KEYS},
+        {"direct-io",   no_argument,       0, OPT_DIRECT_IO},
+        {"mmap",        no_argument,       0, OPT_MMAP},
+        {"huge-pages",  optional_argument, 0, OPT_HUGE_PAGES},
+        {"memory-budget", required_argument, 0, OPT_MEMORY_BUDGET},
+        {"threads",     required_argument, 0, OPT_THREADS},
+        {"pin-threads", no_argument,       0, OPT_PIN_THREADS},
+        {"batch",       required_argument, 0, OPT_BATCH},
+        {"encrypt-dir", required_argument, 0, OPT_ENCRYPT_DIR},
+        {"decrypt-dir", required_argument, 0, OPT_DECRYPT_DIR},
+        {"rekey",       required_argument, 0, OPT_REKEY},
+        {"rekey-dir",   required_argument, 0, OPT_REKEY_DIR},
+        {"new-key",     required_argument, 0, OPT_NEW_KEY},
+        {"jobs",        required_argument, 0, OPT_JOBS},
+        {"pack",        required_argument, 0, OPT_PACK},
+        {"unpack",      required_argument, 0, OPT_UNPACK},
+        {"entry",       required_argument, 0, OPT_ENTRY},
+        {"profile",     required_argument, 0, OPT_PROFILE},
+        {"save-profile", required_argument, 0, OPT_SAVE_PROFILE},
         {"help",        no_argument,       0, 'h'},
         {"version",     no_argument,       0, 'v'},
         {0, 0, 0, 0}
@@ -227,6 +887,110 @@ int qed_cli_main(int argc, char *argv[]) {
             case 't':
                 interactive = true;
                 break;
+            case OPT_STATS:
+                show_stats = true;
+                break;
+            case OPT_TRACE:
+                trace_file = optarg;
+                break;
+            case OPT_CHUNKED:
+                chunked = true;
+                break;
+            case OPT_CHUNK_SIZE:
+                chunk_size = (size_t)strtoull(optarg, NULL, 0);
+                chunked = true;
+                break;
+            case OPT_SPARSE:
+                sparse = true;
+                chunked = true;
+                break;
+            case OPT_RANGE:
+                range = optarg;
+                break;
+            case OPT_COMPRESS:
+                compress = true;
+                compress_level = optarg ? atoi(optarg) : 0;
+                break;
+            case OPT_MAC:
+                mac_name = optarg;
+                break;
+            case OPT_CIPHER:
+                cipher_name = optarg;
+                break;
+            case OPT_PREWARM:
+                prewarm_file = optarg;
+                break;
+            case OPT_PER_FILE_KEYS:
+                per_file_keys = true;
+                break;
+            case OPT_DIRECT_IO:
+                direct_io = true;
+                break;
+            case OPT_MMAP:
+                mmap_input = true;
+                break;
+            case OPT_HUGE_PAGES:
+                huge_pages = optarg ? optarg : "transparent";
+                break;
+            case OPT_MEMORY_BUDGET:
+                memory_budget = optarg;
+                break;
+            case OPT_THREADS:
+                threads = optarg;
+                break;
+            case OPT_PIN_THREADS:
+                pin_threads = true;
+                break;
+            case OPT_BATCH:
+                batch_file = optarg;
+                break;
+            case OPT_ENCRYPT_DIR:
+            case OPT_DECRYPT_DIR:
+                batch_dir = optarg;
+                batch_dir_op = opt == OPT_ENCRYPT_DIR ? QED_BATCH_ENCRYPT : QED_BATCH_DECRYPT;
+                break;
+            case OPT_REKEY:
+                rekey_file = optarg;
+                break;
+            case OPT_REKEY_DIR:
+                batch_dir = optarg;
+                batch_dir_op = QED_BATCH_REKEY;
+                break;
+            case OPT_NEW_KEY:
+                new_key_id = optarg;
+                break;
+            case OPT_JOBS:
+                batch_workers = (size_t)strtoull(optarg, NULL, 0);
+                break;
+            case OPT_PACK:
+                pack_dir = optarg;
+                break;
+            case OPT_UNPACK:
+                unpack_file = optarg;
+                break;
+            case OPT_ENTRY:
+                entry_name = optarg;
+                break;
+            case OPT_PROFILE:
+                profile_name = optarg;
+                break;
+            case OPT_SAVE_PROFILE:
+                save_profile = optarg;
+                break;
+            case OPT_INCREMENTAL:
+                incremental = true;
+                break;
+            case OPT_VERIFY: {
+                const char **paths = realloc(verify_paths, (verify_count + 1) * sizeof(char *));
+                if (!paths) {
+                    printf("❌ Error: Out of memory.\n");
+                    free(verify_paths);
+                    return 1;
+                }
+                verify_paths = paths;
+                verify_paths[verify_count++] = optarg;
+                break;
+            }
             case 'v':
                 print_version();
                 return 0;
@@ -245,19 +1009,147 @@ int qed_cli_main(int argc, char *argv[]) {
     // Show evaluation notice
     QED_EVAL_NOTICE();
     
-    // Initialize device
-    result = qed_init(&device);
+    if (show_stats) {
+        qed_enable_stats(true);
+        start_time = get_wall_seconds();
+    }
+    
+    if (trace_file) {
+        result = qed_trace_start(0);
+        if (result != QED_SUCCESS) {
+            printf("❌ Failed to start tracing: %s\n", qed_get_error_string(result));
+            return 1;
+        }
+    }
+    
+    // Initialize device, from a fixed hardware profile if one was named
+    if (profile_name) {
+        qed_hardware_sig_t profile;
+        
+        result = qed_load_hardware_profile(profile_name, &profile);
+        if (result != QED_SUCCESS) {
+            printf("❌ Cannot load hardware profile '%s': %s\n", profile_name,
+                   qed_get_error_string(result));
+            return 1;
+        }
+        printf("🧪 Hardware profile: %s\n", profile_name);
+        result = qed_init_with_profile(&device, &profile);
+    } else {
+        result = qed_init(&device);
+    }
     if (result != QED_SUCCESS) {
         printf("❌ Failed to initialize Quantum Encryption Device: %s\n", 
                qed_get_error_string(result));
         return 1;
     }
     
+    if (compress) {
+        result = qed_set_compression(&device, QED_COMPRESSION_ZLIB, compress_level);
+        if (result != QED_SUCCESS) {
+            printf("❌ Invalid compression level: %s\n", qed_get_error_string(result));
+            qed_cleanup(&device);
+            return 1;
+        }
+    }
+    
+    if (mac_name) {
+        if (strcmp(mac_name, "hmac") == 0) {
+            result = qed_set_mac(&device, QED_MAC_HMAC_SHA256);
+        } else if (strcmp(mac_name, "quantum") == 0) {
+            result = qed_set_mac(&device, QED_MAC_QUANTUM);
+        } else {
+            result = QED_ERROR_INVALID_INPUT;
+        }
+        if (result != QED_SUCCESS) {
+            printf("❌ Unknown signature mode '%s' (use quantum or hmac)\n", mac_name);
+            qed_cleanup(&device);
+            return 1;
+        }
+    }
+    
+    if (cipher_name) {
+        if (strcmp(cipher_name, "auto") == 0) {
+            result = qed_set_cipher(&device, qed_detect_cipher());
+        } else if (strcmp(cipher_name, "aes-gcm") == 0) {
+            result = qed_set_cipher(&device, QED_CIPHER_AES_256_GCM);
+        } else if (strcmp(cipher_name, "chacha20") == 0) {
+            result = qed_set_cipher(&device, QED_CIPHER_CHACHA20_POLY1305);
+        } else if (strcmp(cipher_name, "aes-cbc") == 0) {
+            result = qed_set_cipher(&device, QED_CIPHER_AES_256_CBC);
+        } else {
+            result = QED_ERROR_INVALID_INPUT;
+        }
+        if (result != QED_SUCCESS) {
+            printf("❌ Unknown cipher '%s' (use auto, aes-gcm, chacha20 or aes-cbc)\n", cipher_name);
+            qed_cleanup(&device);
+            return 1;
+        }
+    }
+    
+    if (per_file_keys) {
+        qed_set_subkeys(&device, true);
+    }
+    
+    if (direct_io) {
+        qed_set_direct_io(&device, true);
+    }
+    
+    if (sparse) {
+        qed_set_sparse(&device, true);
+    }
+    
+    if (mmap_input) {
+        qed_set_mmap_input(&device, true);
+    }
+    
+    if (huge_pages) {
+        if (strcmp(huge_pages, "transparent") == 0) {
+            qed_set_huge_pages(&device, QED_HUGE_PAGES_TRANSPARENT);
+        } else if (strcmp(huge_pages, "explicit") == 0) {
+            qed_set_huge_pages(&device, QED_HUGE_PAGES_EXPLICIT);
+        } else {
+            printf("❌ Unknown huge page mode '%s' (use transparent or explicit)\n", huge_pages);
+            qed_cleanup(&device);
+            return 1;
+        }
+    }
+    
+    if (memory_budget) {
+        uint64_t budget;
+        
+        if (!parse_size(memory_budget, &budget) || budget == 0) {
+            printf("❌ Invalid memory budget '%s'\n", memory_budget);
+            qed_cleanup(&device);
+            return 1;
+        }
+        qed_set_memory_budget(&device, budget);
+    }
+    
+    if (threads || pin_threads) {
+        size_t count = threads ? (size_t)strtoull(threads, NULL, 0) : 0;
+        
+        if (qed_set_concurrency(&device, count, pin_threads) != QED_SUCCESS) {
+            printf("❌ Invalid thread count '%s'\n", threads);
+            qed_cleanup(&device);
+            return 1;
+        }
+    }
+    
     // Handle commands
     if (show_info) {
         qed_print_hardware_info(&device.hardware_sig);
     }
     
+    if (save_profile) {
+        result = qed_save_hardware_profile(&device.hardware_sig, save_profile);
+        if (result != QED_SUCCESS) {
+            printf("❌ Error saving hardware profile: %s\n", qed_get_error_string(result));
+            exit_code = 1;
+        } else {
+            printf("💾 Hardware profile saved: %s\n", save_profile);
+        }
+    }
+    
     if (wipe_all) {
         if (get_user_confirmation("Are you sure you want to wipe ALL quantum keys?")) {
             result = qed_quantum_wipe_all(&device);
@@ -272,6 +1164,12 @@ int qed_cli_main(int argc, char *argv[]) {
         }
     }
     
+    // Derive listed keys before any request needs them
+    if (prewarm_file && run_prewarm(&device, prewarm_file) != 0) {
+        qed_cleanup(&device);
+        return 1;
+    }
+    
     if (encrypt_file) {
         if (!output_file) {
             printf("❌ Error: Output file must be specified for encryption.\n");
@@ -282,7 +1180,22 @@ int qed_cli_main(int argc, char *argv[]) {
         // Check evaluation license before encryption
         QED_EVAL_CHECK();
         
-        result = qed_encrypt_file(&device, key_id, encrypt_file, output_file);
+        if (incremental) {
+            qed_incremental_stats_t incremental_stats;
+            
+            result = qed_encrypt_file_incremental(&device, key_id, encrypt_file, output_file,
+                                                  chunk_size, &incremental_stats);
+            if (result == QED_SUCCESS && show_stats) {
+                printf("📊 Incremental: %lu of %lu chunks rewritten, %lu bytes written\n",
+                       incremental_stats.chunks_rewritten, incremental_stats.chunks_total,
+                       incremental_stats.bytes_written);
+            }
+        } else if (chunked) {
+            result = qed_encrypt_file_chunked(&device, key_id, encrypt_file, output_file,
+                                              chunk_size);
+        } else {
+            result = qed_encrypt_file(&device, key_id, encrypt_file, output_file);
+        }
         if (result == QED_SUCCESS) {
             printf("✅ Check the encrypted file: %s\n", output_file);
         }
@@ -298,10 +1211,91 @@ int qed_cli_main(int argc, char *argv[]) {
         // Check evaluation license before decryption
         QED_EVAL_CHECK();
         
-        result = qed_decrypt_file(&device, key_id, decrypt_file, output_file);
+        if (range) {
+            run_range_decrypt(&device, key_id, decrypt_file, range, output_file);
+        } else {
+            result = qed_decrypt_file(&device, key_id, decrypt_file, output_file);
+            if (result == QED_SUCCESS) {
+                printf("✅ Check the decrypted file: %s\n", output_file);
+            }
+        }
+    }
+    
+    if (rekey_file) {
+        if (!output_file || !new_key_id) {
+            printf("❌ Error: Re-keying needs --output and --new-key.\n");
+            qed_cleanup(&device);
+            return 1;
+        }
+        
+        // Check evaluation license before re-keying
+        QED_EVAL_CHECK();
+        
+        result = qed_rekey_file(&device, key_id, new_key_id, rekey_file, output_file);
         if (result == QED_SUCCESS) {
-            printf("✅ Check the decrypted file: %s\n", output_file);
+            printf("✅ Check the re-keyed file: %s\n", output_file);
+        } else {
+            exit_code = 1;
+        }
+    }
+    
+    if (batch_file || batch_dir) {
+        batch_list_t batch = { NULL, 0, 0 };
+        
+        // Check evaluation license before batch processing
+        QED_EVAL_CHECK();
+        
+        if (batch_dir && !output_file) {
+            printf("❌ Error: Output directory must be specified with --output.\n");
+            exit_code = 1;
+        } else if (batch_dir && batch_dir_op == QED_BATCH_REKEY && !new_key_id) {
+            printf("❌ Error: Re-keying needs --new-key.\n");
+            exit_code = 1;
+        } else if ((batch_file &&
+                    load_batch_manifest(&batch, batch_file, key_id, new_key_id) != 0) ||
+                   (batch_dir && walk_batch_dir(&batch, batch_dir_op, key_id, new_key_id,
+                                                batch_dir, output_file, NULL) != 0)) {
+            exit_code = 1;
+        } else {
+            exit_code = run_batch(&device, &batch, batch_workers,
+                                  chunked ? (chunk_size ? chunk_size : QED_CHUNK_SIZE_DEFAULT) : 0);
         }
+        free_batch_list(&batch);
+    }
+    
+    if (pack_dir || unpack_file) {
+        // Check evaluation license before archive processing
+        QED_EVAL_CHECK();
+        
+        if (!output_file) {
+            printf("❌ Error: Output path must be specified with --output.\n");
+            result = QED_ERROR_INVALID_INPUT;
+        } else if (pack_dir) {
+            result = qed_archive_pack(&device, key_id, pack_dir, output_file);
+        } else if (entry_name) {
+            result = qed_archive_extract(&device, key_id, unpack_file, entry_name, output_file);
+        } else {
+            result = qed_archive_unpack(&device, key_id, unpack_file, output_file);
+        }
+        if (result != QED_SUCCESS) {
+            exit_code = 1;
+        }
+    }
+    
+    if (verify_paths) {
+        // Remaining operands are further files to verify
+        while (optind < argc) {
+            const char **paths = realloc(verify_paths, (verify_count + 1) * sizeof(char *));
+            if (!paths) {
+                printf("❌ Error: Out of memory.\n");
+                break;
+            }
+            verify_paths = paths;
+            verify_paths[verify_count++] = argv[optind++];
+        }
+        
+        exit_code = run_verify(&device, key_id, verify_paths, verify_count, output_file);
+        free(verify_paths);
     }
     
     if (interactive) {
@@ -309,13 +1303,38 @@ int qed_cli_main(int argc, char *argv[]) {
     }
     
     // If no specific command was given, run interactive mode
-    if (!show_info && !wipe_all && !wipe_key && !encrypt_file && !decrypt_file && !interactive) {
+    if (!show_info && !wipe_all && !wipe_key && !encrypt_file && !decrypt_file && !interactive &&
+        !verify_count && !batch_file && !batch_dir && !pack_dir && !unpack_file &&
+        !save_profile && !rekey_file) {
         run_interactive_mode(&device);
     }
     
+    if (show_stats) {
+        qed_stats_t stats;
+        if (qed_get_stats(&stats) == QED_SUCCESS) {
+            qed_print_stats(&stats, get_wall_seconds() - start_time);
+        }
+        qed_print_latency_report();
+        
+        qed_memory_stats_t memory;
+        if (qed_get_memory_stats(&memory) == QED_SUCCESS) {
+            qed_print_memory_stats(&memory);
+        }
+    }
+    
+    if (trace_file) {
+        qed_trace_stop();
+        result = qed_trace_dump(trace_file);
+        if (result != QED_SUCCESS) {
+            printf("❌ Failed to write trace: %s\n", qed_get_error_string(result));
+        } else {
+            printf("📈 Trace written: %s\n", trace_file);
+        }
+    }
+    
     // Cleanup
     qed_cleanup(&device);
-    return 0;
+    return exit_code;
 }
 
 // Main function for standalone executable
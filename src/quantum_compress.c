@@ -0,0 +1,136 @@
+/*
+ * Quantum Encryption Device (QED) - Compression Stage
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
+#include "quantum_internal.h"
+
+// Data above this many bits of entropy per byte is stored as-is
+#define QED_ENTROPY_BYPASS_BITS 7.5
+// Bytes sampled for the entropy estimate
+#define QED_ENTROPY_SAMPLE_SIZE 16384
+
+qed_result_t qed_set_compression(qed_device_t *device, qed_compression_t compression,
+                                 int level) {
+    if (!device) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (compression != QED_COMPRESSION_NONE && compression != QED_COMPRESSION_ZLIB) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (level == 0) {
+        level = Z_DEFAULT_COMPRESSION;
+    } else if (level < 1 || level > 9) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    device->compression = (uint8_t)compression;
+    device->compression_level = level;
+    return QED_SUCCESS;
+}
+
+double qed_estimate_entropy(const uint8_t *data, size_t length) {
+    uint32_t counts[256];
+    size_t stride, sampled = 0;
+    double entropy = 0.0;
+    size_t i;
+    
+    if (!data || length == 0) {
+        return 0.0;
+    }
+    
+    memset(counts, 0, sizeof(counts));
+    
+    // Sample evenly across the buffer in 64-byte runs so a compressible
+    // header in front of compressed data does not skew the estimate
+    stride = length > QED_ENTROPY_SAMPLE_SIZE ? length / (QED_ENTROPY_SAMPLE_SIZE / 64) : 64;
+    for (i = 0; i < length; i += stride) {
+        size_t run = length - i < 64 ? length - i : 64;
+        size_t j;
+        for (j = 0; j < run; j++) {
+            counts[data[i + j]]++;
+        }
+        sampled += run;
+    }
+    
+    for (i = 0; i < 256; i++) {
+        if (counts[i]) {
+            double p = (double)counts[i] / sampled;
+            entropy -= p * log2(p);
+        }
+    }
+    
+    return entropy;
+}
+
+size_t qed_compress_bound(size_t length) {
+    return (size_t)compressBound((uLong)length);
+}
+
+qed_result_t qed_compress_payload(qed_compression_t compression, int level,
+                                  const uint8_t *input, size_t input_len,
+                                  uint8_t *output, size_t output_cap, size_t *output_len,
+                                  qed_compression_t *used) {
+    uLongf compressed_len = (uLongf)output_cap;
+    
+    if (!input || !output || !output_len || !used) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    *used = QED_COMPRESSION_NONE;
+    *output_len = 0;
+    
+    if (compression == QED_COMPRESSION_NONE || input_len == 0 ||
+        qed_estimate_entropy(input, input_len) > QED_ENTROPY_BYPASS_BITS) {
+        return QED_SUCCESS;
+    }
+    
+    QED_STAGE_BEGIN(stage_start);
+    if (compress2(output, &compressed_len, input, (uLong)input_len, level) != Z_OK) {
+        // Output did not fit, so compression would not have paid off anyway
+        return QED_SUCCESS;
+    }
+    QED_STAGE_END(QED_STAGE_COMPRESS, stage_start, input_len);
+    
+    if (compressed_len < input_len) {
+        *used = QED_COMPRESSION_ZLIB;
+        *output_len = (size_t)compressed_len;
+    }
+    
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_decompress_payload(qed_compression_t compression,
+                                    const uint8_t *input, size_t input_len,
+                                    uint8_t *output, size_t expected_len) {
+    uLongf output_len = (uLongf)expected_len;
+    
+    if (!input || !output) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (compression != QED_COMPRESSION_ZLIB) {
+        return QED_ERROR_DECRYPTION;
+    }
+    
+    QED_STAGE_BEGIN(stage_start);
+    if (uncompress(output, &output_len, input, (uLong)input_len) != Z_OK ||
+        output_len != expected_len) {
+        return QED_ERROR_DECRYPTION;
+    }
+    QED_STAGE_END(QED_STAGE_COMPRESS, stage_start, expected_len);
+    
+    return QED_SUCCESS;
+}
@@ -19,6 +19,7 @@
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 #include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
 
 // Global device instance for thread safety
 static qed_device_t *global_device = NULL;
@@ -34,11 +35,12 @@ static const char* error_strings[] = {
     "Signature mismatch",              // QED_ERROR_SIGNATURE_MISMATCH
     "Key not found",                   // QED_ERROR_KEY_NOT_FOUND
     "Invalid input",                   // QED_ERROR_INVALID_INPUT
-    "Key limit reached"                // QED_ERROR_KEY_LIMIT_REACHED
+    "Key limit reached",               // QED_ERROR_KEY_LIMIT_REACHED
+    "Operation timed out"              // QED_ERROR_TIMEOUT
 };
 
 const char* qed_get_error_string(qed_result_t result) {
-    if (result >= 0 || result < -9) {
+    if (result >= 0 || result < QED_ERROR_TIMEOUT) {
         return "Unknown error";
     }
     return error_strings[-result];
@@ -46,9 +48,14 @@ const char* qed_get_error_string(qed_result_t result) {
 
 void qed_secure_zero(void *ptr, size_t len) {
     volatile uint8_t *p = (volatile uint8_t *)ptr;
-    while (len--) {
+    size_t remaining = len;
+    QED_STAGE_BEGIN(stage_start);
+    
+    while (remaining--) {
         *p++ = 0;
     }
+    
+    QED_STAGE_END(QED_STAGE_SECURE_WIPE, stage_start, len);
 }
 
 qed_result_t qed_detect_cpu_frequency(double *frequency) {
@@ -91,8 +98,6 @@ qed_result_t qed_detect_cpu_frequency(double *frequency) {
 
 qed_result_t qed_detect_ram_signature(qed_hardware_sig_t *hw_sig) {
     struct sysinfo info;
-    char signature_input[256];
-    unsigned char hash[SHA256_DIGEST_LENGTH];
     
     if (!hw_sig) {
         return QED_ERROR_INVALID_INPUT;
@@ -105,6 +110,13 @@ qed_result_t qed_detect_ram_signature(qed_hardware_sig_t *hw_sig) {
     hw_sig->ram_total = info.totalram;
     hw_sig->ram_available = info.freeram;
     
+    return qed_hash_ram_signature(hw_sig);
+}
+
+qed_result_t qed_hash_ram_signature(qed_hardware_sig_t *hw_sig) {
+    char signature_input[256];
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    
     // Create signature string
     snprintf(signature_input, sizeof(signature_input), "%lu%lu", 
              hw_sig->ram_total, hw_sig->ram_available);
@@ -170,6 +182,8 @@ qed_result_t qed_generate_hardware_resonance(const qed_hardware_sig_t *hw_sig,
         return QED_ERROR_INVALID_INPUT;
     }
     
+    QED_STAGE_BEGIN(stage_start);
+    
     // Fixed time based on RAM signature for consistency
     fixed_t = hw_sig->ram_signature / 1e9;
     
@@ -189,50 +203,25 @@ qed_result_t qed_generate_hardware_resonance(const qed_hardware_sig_t *hw_sig,
         resonance_data[i] = (uint8_t)resonance_value;
     }
     
+    QED_STAGE_END(QED_STAGE_RESONANCE, stage_start, length);
     return QED_SUCCESS;
 }
 
-qed_result_t qed_generate_quantum_key(qed_device_t *device, const char *key_id, 
-                                      uint8_t *key_out, size_t key_length) {
-    size_t i;
+// Derives the key material for one key: SHA-256(resonance || quantum noise)
+static qed_result_t qed_derive_key(const qed_hardware_sig_t *hw_sig, size_t key_length,
+                                   unsigned char *final_hash) {
     uint8_t *raw_key = NULL;
     unsigned char hash_input[1024];
-    unsigned char final_hash[SHA256_DIGEST_LENGTH];
     size_t hash_input_len = 0;
+    qed_result_t result;
     
-    if (!device || !key_id || !key_out || key_length == 0) {
-        return QED_ERROR_INVALID_INPUT;
-    }
-    
-    if (!device->initialized) {
-        return QED_ERROR_HARDWARE;
-    }
-    
-    // Check if key already exists
-    for (i = 0; i < device->key_count; i++) {
-        if (device->quantum_keys[i].in_use && 
-            strcmp(device->quantum_keys[i].key_id, key_id) == 0) {
-            // Key exists, return it
-            memcpy(key_out, device->quantum_keys[i].key_data, 
-                   key_length > QED_KEY_LENGTH ? QED_KEY_LENGTH : key_length);
-            return QED_SUCCESS;
-        }
-    }
-    
-    // Check if we can add more keys
-    if (device->key_count >= QED_MAX_KEYS) {
-        return QED_ERROR_KEY_LIMIT_REACHED;
-    }
-    
-    // Generate new key
     raw_key = malloc(key_length * 2);
     if (!raw_key) {
         return QED_ERROR_MEMORY;
     }
     
     // Generate hardware resonance
-    qed_result_t result = qed_generate_hardware_resonance(&device->hardware_sig, 
-                                                         raw_key, key_length * 2);
+    result = qed_generate_hardware_resonance(hw_sig, raw_key, key_length * 2);
     if (result != QED_SUCCESS) {
         free(raw_key);
         return result;
@@ -243,34 +232,110 @@ qed_result_t qed_generate_quantum_key(qed_device_t *device, const char *key_id,
     hash_input_len = key_length * 2;
     
     // Append quantum noise
-    size_t noise_len = strlen(device->hardware_sig.quantum_noise);
-    memcpy(hash_input + hash_input_len, device->hardware_sig.quantum_noise, noise_len);
+    size_t noise_len = strlen(hw_sig->quantum_noise);
+    memcpy(hash_input + hash_input_len, hw_sig->quantum_noise, noise_len);
     hash_input_len += noise_len;
     
     // Generate final key hash
     if (!SHA256(hash_input, hash_input_len, final_hash)) {
-        free(raw_key);
+        result = QED_ERROR_HARDWARE;
+    }
+    
+    // Secure cleanup
+    qed_secure_zero(raw_key, key_length * 2);
+    qed_secure_zero(hash_input, sizeof(hash_input));
+    free(raw_key);
+    
+    return result;
+}
+
+uint32_t qed_key_id_hash(const char *key_id) {
+    uint32_t hash = 2166136261u;
+    
+    while (*key_id) {
+        hash = (hash ^ (uint8_t)*key_id++) * 16777619u;
+    }
+    return hash;
+}
+
+// Index of a cached key, or -1
+static long qed_find_key(const qed_device_t *device, const char *key_id) {
+    size_t i;
+    
+    for (i = 0; i < device->key_count; i++) {
+        if (device->quantum_keys[i].in_use && 
+            strcmp(device->quantum_keys[i].key_id, key_id) == 0) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+static void qed_store_key(qed_device_t *device, const char *key_id,
+                          const uint8_t *key_data, size_t copy_len) {
+    qed_quantum_key_t *slot = &device->quantum_keys[device->key_count];
+    
+    strncpy(slot->key_id, key_id, QED_MAX_KEY_ID_LENGTH - 1);
+    slot->key_id[QED_MAX_KEY_ID_LENGTH - 1] = '\0';
+    memcpy(slot->key_data, key_data, copy_len);
+    slot->id_hash = qed_key_id_hash(slot->key_id);
+    slot->in_use = true;
+    device->key_count++;
+}
+
+qed_result_t qed_generate_quantum_key(qed_device_t *device, const char *key_id, 
+                                      uint8_t *key_out, size_t key_length) {
+    size_t i;
+    unsigned char final_hash[SHA256_DIGEST_LENGTH];
+    long found;
+    
+    if (!device || !key_id || !key_out || key_length == 0) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (!device->initialized) {
         return QED_ERROR_HARDWARE;
     }
     
-    // Store the key
-    size_t key_index = device->key_count;
-    strncpy(device->quantum_keys[key_index].key_id, key_id, QED_MAX_KEY_ID_LENGTH - 1);
-    device->quantum_keys[key_index].key_id[QED_MAX_KEY_ID_LENGTH - 1] = '\0';
+    QED_PROBE1(key__start, key_length);
+    
+    // Check if key already exists
+    QED_STAGE_BEGIN(lookup_start);
+    found = qed_find_key(device, key_id);
+    QED_STAGE_END(QED_STAGE_KEY_LOOKUP, lookup_start, 0);
+    QED_STATS_KEY_LOOKUP(found >= 0);
+    if (found >= 0) {
+        // Key exists, return it
+        memcpy(key_out, device->quantum_keys[found].key_data, 
+               key_length > QED_KEY_LENGTH ? QED_KEY_LENGTH : key_length);
+        QED_PROBE3(key__done, device->quantum_keys[found].id_hash, 1, QED_SUCCESS);
+        return QED_SUCCESS;
+    }
     
+    // Check if we can add more keys
+    if (device->key_count >= QED_MAX_KEYS) {
+        QED_PROBE3(key__done, 0, 0, QED_ERROR_KEY_LIMIT_REACHED);
+        return QED_ERROR_KEY_LIMIT_REACHED;
+    }
+    
+    QED_OP_BEGIN(derive_start);
+    
+    qed_result_t result = qed_derive_key(&device->hardware_sig, key_length, final_hash);
+    if (result != QED_SUCCESS) {
+        QED_PROBE3(key__done, 0, 0, result);
+        return result;
+    }
+    
+    // Store the key
     size_t copy_len = key_length > QED_KEY_LENGTH ? QED_KEY_LENGTH : key_length;
-    memcpy(device->quantum_keys[key_index].key_data, final_hash, copy_len);
-    device->quantum_keys[key_index].in_use = true;
-    device->key_count++;
+    qed_store_key(device, key_id, final_hash, copy_len);
+    QED_PROBE3(key__done, device->quantum_keys[device->key_count - 1].id_hash, 0, QED_SUCCESS);
     
     // Copy to output
     memcpy(key_out, final_hash, copy_len);
-    
-    // Secure cleanup
-    qed_secure_zero(raw_key, key_length * 2);
-    qed_secure_zero(hash_input, sizeof(hash_input));
     qed_secure_zero(final_hash, sizeof(final_hash));
-    free(raw_key);
+    
+    QED_OP_END(QED_OP_KEY_DERIVE, derive_start, copy_len);
     
     // Print key generated message (first 16 chars for security)
     printf("🔑 Generated Quantum Key [%s]: ", key_id);
@@ -282,26 +347,133 @@ qed_result_t qed_generate_quantum_key(qed_device_t *device, const char *key_id,
     return QED_SUCCESS;
 }
 
-qed_result_t qed_init(qed_device_t *device) {
-    qed_result_t result;
+typedef struct {
+    const qed_hardware_sig_t *hw_sig;
+    uint8_t *keys;
+    qed_result_t *results;
+} qed_prewarm_batch_t;
+
+static void qed_prewarm_worker(void *ctx, size_t index) {
+    qed_prewarm_batch_t *batch = ctx;
+    unsigned char final_hash[SHA256_DIGEST_LENGTH];
     
-    if (!device) {
+    QED_OP_BEGIN(derive_start);
+    batch->results[index] = qed_derive_key(batch->hw_sig, QED_KEY_LENGTH, final_hash);
+    memcpy(batch->keys + index * QED_KEY_LENGTH, final_hash, QED_KEY_LENGTH);
+    qed_secure_zero(final_hash, sizeof(final_hash));
+    QED_OP_END(QED_OP_KEY_DERIVE, derive_start, QED_KEY_LENGTH);
+}
+
+qed_result_t qed_prewarm_keys(qed_device_t *device, const char *const *key_ids, size_t count) {
+    qed_prewarm_batch_t batch;
+    const char **pending = NULL;
+    size_t pending_count = 0, cached = 0;
+    qed_result_t result = QED_SUCCESS;
+    size_t i, j;
+    
+    if (!device || (!key_ids && count > 0)) {
         return QED_ERROR_INVALID_INPUT;
     }
     
-    // Initialize device structure
-    memset(device, 0, sizeof(qed_device_t));
+    if (!device->initialized) {
+        return QED_ERROR_HARDWARE;
+    }
     
-    // Detect CPU frequency
-    result = qed_detect_cpu_frequency(&device->hardware_sig.cpu_frequency);
-    if (result != QED_SUCCESS) {
-        return result;
+    pending = malloc((count ? count : 1) * sizeof(char *));
+    if (!pending) {
+        return QED_ERROR_MEMORY;
     }
     
-    // Detect RAM signature
-    result = qed_detect_ram_signature(&device->hardware_sig);
-    if (result != QED_SUCCESS) {
-        return result;
+    // Skip keys already cached and repeats within the list
+    for (i = 0; i < count; i++) {
+        if (!key_ids[i]) {
+            free(pending);
+            return QED_ERROR_INVALID_INPUT;
+        }
+        if (qed_find_key(device, key_ids[i]) >= 0) {
+            cached++;
+            continue;
+        }
+        for (j = 0; j < pending_count; j++) {
+            if (strncmp(pending[j], key_ids[i], QED_MAX_KEY_ID_LENGTH - 1) == 0) {
+                break;
+            }
+        }
+        if (j == pending_count) {
+            pending[pending_count++] = key_ids[i];
+        }
+    }
+    
+    // All or nothing, so a failed call leaves the store unchanged
+    if (pending_count > QED_MAX_KEYS - device->key_count) {
+        free(pending);
+        return QED_ERROR_KEY_LIMIT_REACHED;
+    }
+    
+    batch.hw_sig = &device->hardware_sig;
+    batch.keys = malloc((pending_count ? pending_count : 1) * QED_KEY_LENGTH);
+    batch.results = calloc(pending_count ? pending_count : 1, sizeof(qed_result_t));
+    if (!batch.keys || !batch.results) {
+        free(batch.keys);
+        free(batch.results);
+        free(pending);
+        return QED_ERROR_MEMORY;
+    }
+    
+    // Derive in parallel, then insert the whole batch from this thread
+    qed_parallel_for(pending_count, qed_prewarm_worker, &batch);
+    
+    for (i = 0; i < pending_count; i++) {
+        if (batch.results[i] != QED_SUCCESS) {
+            result = batch.results[i];
+            break;
+        }
+    }
+    
+    if (result == QED_SUCCESS) {
+        for (i = 0; i < pending_count; i++) {
+            qed_store_key(device, pending[i], batch.keys + i * QED_KEY_LENGTH, QED_KEY_LENGTH);
+        }
+        printf("🔑 Pre-warmed %zu quantum keys (%zu already cached)\n", pending_count, cached);
+    }
+    
+    qed_secure_zero(batch.keys, (pending_count ? pending_count : 1) * QED_KEY_LENGTH);
+    free(batch.keys);
+    free(batch.results);
+    free(pending);
+    return result;
+}
+
+static qed_result_t qed_setup_device(qed_device_t *device, const qed_hardware_sig_t *profile) {
+    qed_result_t result;
+    
+    // Initialize device structure
+    memset(device, 0, sizeof(qed_device_t));
+    
+    QED_STAGE_BEGIN(stage_start);
+    
+    if (profile) {
+        // Only the measured figures are taken; everything else is derived
+        // from them exactly as for detected hardware
+        device->hardware_sig.cpu_frequency = profile->cpu_frequency;
+        device->hardware_sig.ram_total = profile->ram_total;
+        device->hardware_sig.ram_available = profile->ram_available;
+        result = qed_hash_ram_signature(&device->hardware_sig);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+    } else {
+        // Detect CPU frequency
+        result = qed_detect_cpu_frequency(&device->hardware_sig.cpu_frequency);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        
+        // Detect RAM signature
+        result = qed_detect_ram_signature(&device->hardware_sig);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
     }
     
     // Measure quantum noise
@@ -310,9 +482,17 @@ qed_result_t qed_init(qed_device_t *device) {
         return result;
     }
     
+    // AES-256-GCM where the CPU accelerates AES, ChaCha20-Poly1305 elsewhere
+    device->cipher = qed_detect_cipher();
+    
     device->initialized = true;
     global_device = device;
     
+    // Workers start on the first parallel loop
+    qed_pool_acquire();
+    
+    QED_STAGE_END(QED_STAGE_HARDWARE_INIT, stage_start, 0);
+    
     printf("🔒 Quantum Encryption Device Initialized\n");
     printf("⚡ CPU Frequency: %.2f Hz\n", device->hardware_sig.cpu_frequency);
     printf("🌌 Quantum Noise Signature: %.12s...\n", device->hardware_sig.quantum_noise);
@@ -320,6 +500,47 @@ qed_result_t qed_init(qed_device_t *device) {
     return QED_SUCCESS;
 }
 
+// Sets up the device from the running machine, or from profile when given
+static qed_result_t qed_init_device(qed_device_t *device, const qed_hardware_sig_t *profile) {
+    qed_result_t result;
+    
+    QED_PROBE(init__start);
+    result = qed_setup_device(device, profile);
+    QED_PROBE1(init__done, result);
+    return result;
+}
+
+qed_result_t qed_init(qed_device_t *device) {
+    const char *profile_name = getenv("QED_HARDWARE_PROFILE");
+    qed_hardware_sig_t profile;
+    qed_result_t result;
+    
+    if (!device) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (!profile_name || !*profile_name) {
+        return qed_init_device(device, NULL);
+    }
+    
+    result = qed_load_hardware_profile(profile_name, &profile);
+    if (result != QED_SUCCESS) {
+        printf("❌ Cannot load hardware profile '%s': %s\n", profile_name,
+               qed_get_error_string(result));
+        return result;
+    }
+    printf("🧪 Hardware profile: %s\n", profile_name);
+    return qed_init_device(device, &profile);
+}
+
+qed_result_t qed_init_with_profile(qed_device_t *device, const qed_hardware_sig_t *profile) {
+    if (!device || !qed_hardware_profile_valid(profile)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    return qed_init_device(device, profile);
+}
+
 qed_result_t qed_cleanup(qed_device_t *device) {
     if (!device) {
         return QED_ERROR_INVALID_INPUT;
@@ -328,6 +549,10 @@ qed_result_t qed_cleanup(qed_device_t *device) {
     // Securely wipe all keys
     qed_quantum_wipe_all(device);
     
+    if (device->initialized) {
+        qed_pool_release();
+    }
+    
     // Zero out the entire structure
     qed_secure_zero(device, sizeof(qed_device_t));
     
@@ -350,6 +575,8 @@ qed_result_t qed_quantum_wipe(qed_device_t *device, const char *key_id) {
             strcmp(device->quantum_keys[i].key_id, key_id) == 0) {
             
             // Securely wipe the key
+            qed_mac_state_free(device->quantum_keys[i].mac_state);
+            qed_subkey_state_free(device->quantum_keys[i].subkey_state);
             qed_secure_zero(&device->quantum_keys[i], sizeof(qed_quantum_key_t));
             device->quantum_keys[i].in_use = false;
             
@@ -370,6 +597,8 @@ qed_result_t qed_quantum_wipe_all(qed_device_t *device) {
     
     for (i = 0; i < QED_MAX_KEYS; i++) {
         if (device->quantum_keys[i].in_use) {
+            qed_mac_state_free(device->quantum_keys[i].mac_state);
+            qed_subkey_state_free(device->quantum_keys[i].subkey_state);
             qed_secure_zero(&device->quantum_keys[i], sizeof(qed_quantum_key_t));
             device->quantum_keys[i].in_use = false;
         }
@@ -382,6 +611,8 @@ qed_result_t qed_quantum_wipe_all(qed_device_t *device) {
 }
 
 void qed_print_hardware_info(const qed_hardware_sig_t *hw_sig) {
+    char features[128];
+    
     if (!hw_sig) {
         return;
     }
@@ -392,4 +623,9 @@ void qed_print_hardware_info(const qed_hardware_sig_t *hw_sig) {
     printf("  RAM Available: %lu bytes\n", hw_sig->ram_available);
     printf("  RAM Signature: %u\n", hw_sig->ram_signature);
     printf("  Quantum Noise: %.32s...\n", hw_sig->quantum_noise);
+    printf("  Hash Engine: %s\n", qed_get_hash_engine());
+    
+    qed_cpu_features(features, sizeof(features));
+    printf("  CPU Features: %s\n", features);
+    printf("  Cipher Backend: %s\n", qed_cipher_name(qed_detect_cipher()));
 }
\ No newline at end of file
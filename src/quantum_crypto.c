@@ -16,14 +16,14 @@
 #include <openssl/sha.h>
 #include <openssl/rand.h>
 #include <openssl/kdf.h>
+#include <openssl/crypto.h>
 #include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
 
-qed_result_t qed_generate_quantum_signature(const qed_hardware_sig_t *hw_sig,
+static qed_result_t qed_quantum_signature(const qed_hardware_sig_t *hw_sig,
                                           const uint8_t *data, size_t data_len,
                                           uint8_t *signature) {
     EVP_MD_CTX *ctx = NULL;
-    unsigned char *combined_data = NULL;
-    size_t combined_len;
     size_t noise_len;
     unsigned int sig_len = 0;
     
@@ -31,39 +31,51 @@ qed_result_t qed_generate_quantum_signature(const qed_hardware_sig_t *hw_sig,
         return QED_ERROR_INVALID_INPUT;
     }
     
+    QED_STAGE_BEGIN(stage_start);
+    
     noise_len = strlen(hw_sig->quantum_noise);
-    combined_len = data_len + noise_len;
     
-    combined_data = malloc(combined_len);
-    if (!combined_data) {
-        return QED_ERROR_MEMORY;
+    // Small messages are hashed in place with the noise as a suffix
+    if (data_len <= QED_SMALL_MESSAGE_MAX) {
+        qed_sha256_job_t job = { data, data_len, (const uint8_t *)hw_sig->quantum_noise,
+                                 noise_len, signature };
+        qed_sha256_message(&job);
+        QED_STAGE_END(QED_STAGE_MAC, stage_start, data_len);
+        return QED_SUCCESS;
     }
     
-    // Combine data with quantum noise
-    memcpy(combined_data, data, data_len);
-    memcpy(combined_data + data_len, hw_sig->quantum_noise, noise_len);
-    
-    // Generate SHA256 signature
+    // SHA-256(data || quantum noise), hashed in place rather than from a
+    // combined copy of the data
     ctx = EVP_MD_CTX_new();
     if (!ctx) {
-        free(combined_data);
         return QED_ERROR_ENCRYPTION;
     }
     
     if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1 ||
-        EVP_DigestUpdate(ctx, combined_data, combined_len) != 1 ||
+        EVP_DigestUpdate(ctx, data, data_len) != 1 ||
+        EVP_DigestUpdate(ctx, hw_sig->quantum_noise, noise_len) != 1 ||
         EVP_DigestFinal_ex(ctx, signature, &sig_len) != 1) {
         EVP_MD_CTX_free(ctx);
-        free(combined_data);
         return QED_ERROR_ENCRYPTION;
     }
     
     EVP_MD_CTX_free(ctx);
-    free(combined_data);
     
+    QED_STAGE_END(QED_STAGE_MAC, stage_start, data_len);
     return QED_SUCCESS;
 }
 
+qed_result_t qed_generate_quantum_signature(const qed_hardware_sig_t *hw_sig,
+                                          const uint8_t *data, size_t data_len,
+                                          uint8_t *signature) {
+    qed_result_t result;
+    
+    QED_PROBE1(sign__start, data_len);
+    result = qed_quantum_signature(hw_sig, data, data_len, signature);
+    QED_PROBE2(sign__done, result, data_len);
+    return result;
+}
+
 qed_result_t qed_verify_quantum_signature(const qed_hardware_sig_t *hw_sig,
                                         const uint8_t *data, size_t data_len,
                                         const uint8_t *signature) {
@@ -88,134 +100,407 @@ qed_result_t qed_verify_quantum_signature(const qed_hardware_sig_t *hw_sig,
     return QED_SUCCESS;
 }
 
-qed_result_t qed_quantum_encrypt(qed_device_t *device, const char *key_id,
-                                const uint8_t *plaintext, size_t plaintext_len,
-                                uint8_t **ciphertext, size_t *ciphertext_len) {
+qed_result_t qed_generate_quantum_signatures(const qed_hardware_sig_t *hw_sig,
+                                           const uint8_t *const *data, const size_t *data_len,
+                                           size_t count, uint8_t *signatures) {
+    qed_sha256_job_t jobs[QED_SIGNATURE_BATCH];
+    qed_result_t result = QED_SUCCESS;
+    size_t noise_len, done, window, i;
+    uint64_t total = 0;
+    
+    if (!hw_sig || !data || !data_len || (!signatures && count > 0)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!data[i] || data_len[i] == 0) {
+            return QED_ERROR_INVALID_INPUT;
+        }
+        total += data_len[i];
+    }
+    
+    QED_STAGE_BEGIN(stage_start);
+    
+    // Same digest as qed_generate_quantum_signature(): SHA-256(data || noise)
+    noise_len = strlen(hw_sig->quantum_noise);
+    for (done = 0; result == QED_SUCCESS && done < count; done += window) {
+        window = count - done < QED_SIGNATURE_BATCH ? count - done : QED_SIGNATURE_BATCH;
+        for (i = 0; i < window; i++) {
+            jobs[i].data = data[done + i];
+            jobs[i].length = data_len[done + i];
+            jobs[i].suffix = (const uint8_t *)hw_sig->quantum_noise;
+            jobs[i].suffix_length = noise_len;
+            jobs[i].digest = signatures + (done + i) * QED_SIGNATURE_LENGTH;
+        }
+        result = qed_sha256_batch(jobs, window);
+    }
+    
+    QED_STAGE_END(QED_STAGE_MAC, stage_start, total);
+    return result;
+}
+
+qed_result_t qed_verify_quantum_signatures(const qed_hardware_sig_t *hw_sig,
+                                         const uint8_t *const *data, const size_t *data_len,
+                                         size_t count, const uint8_t *signatures,
+                                         qed_result_t *results) {
+    uint8_t computed[QED_SIGNATURE_BATCH * QED_SIGNATURE_LENGTH];
+    qed_result_t result = QED_SUCCESS;
+    size_t done, window, i;
+    
+    if (!signatures && count > 0) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    for (done = 0; done < count; done += window) {
+        window = count - done < QED_SIGNATURE_BATCH ? count - done : QED_SIGNATURE_BATCH;
+        
+        qed_result_t batch_result = qed_generate_quantum_signatures(hw_sig, data + done,
+                                                                  data_len + done, window,
+                                                                  computed);
+        if (batch_result != QED_SUCCESS) {
+            qed_secure_zero(computed, sizeof(computed));
+            return batch_result;
+        }
+        
+        for (i = 0; i < window; i++) {
+            bool match = CRYPTO_memcmp(computed + i * QED_SIGNATURE_LENGTH,
+                                       signatures + (done + i) * QED_SIGNATURE_LENGTH,
+                                       QED_SIGNATURE_LENGTH) == 0;
+            if (results) {
+                results[done + i] = match ? QED_SUCCESS : QED_ERROR_SIGNATURE_MISMATCH;
+            }
+            if (!match) {
+                result = QED_ERROR_SIGNATURE_MISMATCH;
+            }
+        }
+    }
+    
+    qed_secure_zero(computed, sizeof(computed));
+    return result;
+}
+
+// Versioned buffer: header || [salt] || sealed record over the (optionally
+// compressed) plaintext
+static qed_result_t qed_quantum_encrypt_v2(qed_device_t *device, const char *key_id,
+                                           const uint8_t *plaintext, size_t plaintext_len,
+                                           uint8_t **ciphertext, size_t *ciphertext_len) {
     uint8_t quantum_key[QED_KEY_LENGTH];
-    uint8_t signature[QED_SIGNATURE_LENGTH];
-    EVP_CIPHER_CTX *ctx = NULL;
-    uint8_t iv[16]; // AES block size
-    uint8_t *encrypted = NULL;
-    uint8_t *signature_data = NULL;
-    size_t signature_data_len;
-    int len, final_len;
+    uint8_t salt[QED_SUBKEY_SALT_LENGTH];
+    size_t header_len = device->subkeys ? sizeof(salt) + QED_BUFFER_HEADER_SIZE :
+                                          QED_BUFFER_HEADER_SIZE;
+    const qed_mac_state_t *mac = NULL;
+    uint8_t *compressed = NULL;
+    uint8_t *output = NULL;
+    const uint8_t *payload = plaintext;
+    size_t payload_len = plaintext_len;
+    size_t compressed_len, record_len, output_size;
+    qed_compression_t used = QED_COMPRESSION_NONE;
     qed_result_t result;
     
-    if (!device || !key_id || !plaintext || !ciphertext || !ciphertext_len || 
-        plaintext_len == 0) {
-        return QED_ERROR_INVALID_INPUT;
+    QED_OP_BEGIN(op_start);
+    
+    if (device->subkeys) {
+        result = qed_cipher_iv(salt);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
     }
     
-    // Generate quantum key
-    result = qed_generate_quantum_key(device, key_id, quantum_key, QED_KEY_LENGTH);
+    result = qed_file_key(device, key_id, device->subkeys ? salt : NULL, quantum_key);
     if (result != QED_SUCCESS) {
         return result;
     }
     
-    // Generate random IV
-    if (RAND_bytes(iv, sizeof(iv)) != 1) {
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_ENCRYPTION;
+    if (device->mac == QED_MAC_HMAC_SHA256) {
+        result = qed_get_mac_state(device, key_id, &mac);
+        if (result != QED_SUCCESS) {
+            qed_secure_zero(quantum_key, sizeof(quantum_key));
+            return result;
+        }
     }
     
-    // Allocate memory for encrypted data (with padding)
-    encrypted = malloc(plaintext_len + 16); // AES block size padding
-    if (!encrypted) {
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_MEMORY;
+    if (device->compression != QED_COMPRESSION_NONE) {
+        size_t bound = qed_compress_bound(plaintext_len);
+        compressed = qed_mem_alloc(bound);
+        if (!compressed) {
+            qed_secure_zero(quantum_key, sizeof(quantum_key));
+            return QED_ERROR_MEMORY;
+        }
+        
+        result = qed_compress_payload((qed_compression_t)device->compression,
+                                      device->compression_level, plaintext, plaintext_len,
+                                      compressed, bound, &compressed_len, &used);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+        
+        if (used != QED_COMPRESSION_NONE) {
+            payload = compressed;
+            payload_len = compressed_len;
+        }
     }
     
-    // Initialize encryption context
-    ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        free(encrypted);
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_ENCRYPTION;
+    output_size = header_len + payload_len + QED_RECORD_OVERHEAD;
+    output = qed_mem_alloc(output_size);
+    if (!output) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
     }
     
-    // Set up AES-256-CBC encryption
-    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, quantum_key, iv) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(encrypted);
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_ENCRYPTION;
+    memset(output, 0, QED_BUFFER_HEADER_SIZE);
+    memcpy(output, QED_BUFFER_MAGIC, 4);
+    output[4] = device->cipher;
+    output[5] = device->mac;
+    output[6] = (uint8_t)used;
+    if (device->subkeys) {
+        output[7] = QED_BUFFER_FLAG_SUBKEY;
+        memcpy(output + QED_BUFFER_HEADER_SIZE, salt, sizeof(salt));
     }
+    qed_put_le64(output + 8, plaintext_len);
     
-    // Encrypt the data
-    if (EVP_EncryptUpdate(ctx, encrypted, &len, plaintext, plaintext_len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(encrypted);
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_ENCRYPTION;
+    result = qed_seal_record(&device->hardware_sig, quantum_key, mac, device->cipher,
+                             output, header_len, payload, payload_len,
+                             output + header_len, &record_len);
+    if (result != QED_SUCCESS) {
+        qed_mem_free(output, output_size);
+        goto cleanup;
     }
     
-    int encrypted_len = len;
+    // The caller owns the buffer from here on
+    qed_mem_disown(output_size);
+    *ciphertext = output;
+    *ciphertext_len = header_len + record_len;
+    QED_OP_END(QED_OP_ENCRYPT, op_start, plaintext_len);
     
-    // Finalize encryption
-    if (EVP_EncryptFinal_ex(ctx, encrypted + len, &final_len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(encrypted);
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_ENCRYPTION;
+cleanup:
+    if (compressed) {
+        qed_secure_zero(compressed, qed_compress_bound(plaintext_len));
+        qed_mem_free(compressed, qed_compress_bound(plaintext_len));
+    }
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    return result;
+}
+
+static qed_result_t qed_quantum_decrypt_v2(qed_device_t *device, const char *key_id,
+                                           const uint8_t *ciphertext, size_t ciphertext_len,
+                                           uint8_t **plaintext, size_t *plaintext_len) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    const qed_mac_state_t *mac = NULL;
+    size_t header_len = qed_buffer_header_len(ciphertext);
+    const uint8_t *record = ciphertext + header_len;
+    size_t record_len = ciphertext_len - header_len;
+    size_t payload_cap = record_len - QED_SIGNATURE_LENGTH - QED_IV_LENGTH;
+    uint8_t compression = ciphertext[6];
+    uint64_t expected_len = qed_get_le64(ciphertext + 8);
+    uint8_t *payload = NULL;
+    uint8_t *output = NULL;
+    size_t payload_len;
+    qed_result_t result;
+    
+    if (header_len == 0 || ciphertext_len < header_len + QED_RECORD_OVERHEAD ||
+        !qed_cipher_valid(ciphertext[4]) || ciphertext[5] > QED_MAC_HMAC_SHA256 ||
+        compression > QED_COMPRESSION_ZLIB || expected_len > SIZE_MAX) {
+        return QED_ERROR_INVALID_INPUT;
     }
     
-    encrypted_len += final_len;
-    EVP_CIPHER_CTX_free(ctx);
+    QED_OP_BEGIN(op_start);
     
-    // Prepare data for signature (encrypted data + quantum key)
-    signature_data_len = encrypted_len + QED_KEY_LENGTH;
-    signature_data = malloc(signature_data_len);
-    if (!signature_data) {
-        free(encrypted);
+    // A salt after the header selects the per-file subkey
+    result = qed_file_key(device, key_id, header_len > QED_BUFFER_HEADER_SIZE ?
+                          ciphertext + QED_BUFFER_HEADER_SIZE : NULL, quantum_key);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    if (ciphertext[5] == QED_MAC_HMAC_SHA256) {
+        result = qed_get_mac_state(device, key_id, &mac);
+        if (result != QED_SUCCESS) {
+            qed_secure_zero(quantum_key, sizeof(quantum_key));
+            return result;
+        }
+    }
+    
+    payload = qed_mem_alloc(payload_cap);
+    if (!payload) {
         qed_secure_zero(quantum_key, sizeof(quantum_key));
         return QED_ERROR_MEMORY;
     }
     
-    memcpy(signature_data, encrypted, encrypted_len);
-    memcpy(signature_data + encrypted_len, quantum_key, QED_KEY_LENGTH);
+    result = qed_open_record(&device->hardware_sig, quantum_key, mac, ciphertext[4],
+                             ciphertext, header_len, record, record_len,
+                             payload, &payload_len);
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
     
-    // Generate quantum signature
-    result = qed_generate_quantum_signature(&device->hardware_sig, 
-                                          signature_data, signature_data_len,
-                                          signature);
+    if (compression == QED_COMPRESSION_NONE) {
+        if (payload_len != expected_len) {
+            result = QED_ERROR_DECRYPTION;
+            goto cleanup;
+        }
+        output = payload;
+        payload = NULL;
+        qed_mem_disown(payload_cap);
+    } else {
+        output = qed_mem_alloc((size_t)expected_len);
+        if (!output) {
+            result = QED_ERROR_MEMORY;
+            goto cleanup;
+        }
+        result = qed_decompress_payload((qed_compression_t)compression, payload, payload_len,
+                                        output, (size_t)expected_len);
+        if (result != QED_SUCCESS) {
+            qed_mem_free(output, (size_t)expected_len);
+            output = NULL;
+            goto cleanup;
+        }
+        qed_mem_disown((size_t)expected_len);
+    }
     
-    // Clean up signature data
-    qed_secure_zero(signature_data, signature_data_len);
-    free(signature_data);
-    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    // The caller owns the buffer from here on
+    *plaintext = output;
+    *plaintext_len = (size_t)expected_len;
+    QED_OP_END(QED_OP_DECRYPT, op_start, expected_len);
     
+cleanup:
+    if (payload) {
+        qed_secure_zero(payload, payload_cap);
+        qed_mem_free(payload, payload_cap);
+    }
+    return result;
+}
+
+static qed_result_t qed_quantum_encrypt_buffer(qed_device_t *device, const char *key_id,
+                                               const uint8_t *plaintext, size_t plaintext_len,
+                                               uint8_t **ciphertext, size_t *ciphertext_len) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    EVP_CIPHER_CTX *ctx = NULL;
+    uint8_t *output = NULL;
+    uint8_t *iv, *encrypted;
+    size_t output_size;
+    int len, final_len;
+    qed_result_t result;
+    
+    if (!device || !key_id || !plaintext || !ciphertext || !ciphertext_len || 
+        plaintext_len == 0) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_ENCRYPT);
+    
+    if (qed_small_encrypt_eligible(device, plaintext_len)) {
+        // The output buffer is the only allocation
+        output_size = QED_CIPHERTEXT_MAX(plaintext_len);
+        *ciphertext = qed_mem_alloc(output_size);
+        if (!*ciphertext) {
+            return QED_ERROR_MEMORY;
+        }
+        result = qed_small_encrypt(device, key_id, plaintext, plaintext_len,
+                                   *ciphertext, ciphertext_len);
+        if (result != QED_SUCCESS) {
+            qed_mem_free(*ciphertext, output_size);
+            *ciphertext = NULL;
+        } else {
+            qed_mem_disown(output_size);
+        }
+        return result;
+    }
+    
+    // Other ciphers and optional stages need the versioned format to
+    // record their settings
+    if (device->cipher != QED_CIPHER_AES_256_CBC || device->subkeys ||
+        device->compression != QED_COMPRESSION_NONE || device->mac != QED_MAC_QUANTUM) {
+        return qed_quantum_encrypt_v2(device, key_id, plaintext, plaintext_len,
+                                      ciphertext, ciphertext_len);
+    }
+    
+    QED_OP_BEGIN(op_start);
+    
+    // Generate quantum key
+    result = qed_generate_quantum_key(device, key_id, quantum_key, QED_KEY_LENGTH);
     if (result != QED_SUCCESS) {
-        free(encrypted);
         return result;
     }
     
-    // Allocate final ciphertext (signature + IV + encrypted data)
-    *ciphertext_len = QED_SIGNATURE_LENGTH + sizeof(iv) + encrypted_len;
-    *ciphertext = malloc(*ciphertext_len);
-    if (!*ciphertext) {
-        free(encrypted);
+    // signature || IV || encrypted data, encrypted straight into place so
+    // the only buffer is the one returned (with room for AES padding)
+    output_size = QED_SIGNATURE_LENGTH + 16 + plaintext_len + 16;
+    output = qed_mem_alloc(output_size);
+    if (!output) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
         return QED_ERROR_MEMORY;
     }
+    iv = output + QED_SIGNATURE_LENGTH;
+    encrypted = iv + 16;
     
-    // Combine signature, IV, and encrypted data
-    memcpy(*ciphertext, signature, QED_SIGNATURE_LENGTH);
-    memcpy(*ciphertext + QED_SIGNATURE_LENGTH, iv, sizeof(iv));
-    memcpy(*ciphertext + QED_SIGNATURE_LENGTH + sizeof(iv), encrypted, encrypted_len);
+    // Generate random IV
+    if (RAND_bytes(iv, 16) != 1) {
+        result = QED_ERROR_ENCRYPTION;
+        goto cleanup;
+    }
     
-    free(encrypted);
-    return QED_SUCCESS;
+    // AES-256-CBC over the whole buffer
+    QED_STAGE_BEGIN(cipher_start);
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx ||
+        EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, quantum_key, iv) != 1 ||
+        EVP_EncryptUpdate(ctx, encrypted, &len, plaintext, (int)plaintext_len) != 1 ||
+        EVP_EncryptFinal_ex(ctx, encrypted + len, &final_len) != 1) {
+        result = QED_ERROR_ENCRYPTION;
+        goto cleanup;
+    }
+    QED_STAGE_END(QED_STAGE_CIPHER, cipher_start, plaintext_len);
+    
+    // Quantum signature over encrypted data || quantum key, hashed in place
+    {
+        const uint8_t *parts[2] = { encrypted, quantum_key };
+        size_t lengths[2] = { (size_t)(len + final_len), QED_KEY_LENGTH };
+        
+        result = qed_signature_parts(&device->hardware_sig, parts, lengths, 2, output);
+    }
+    if (result != QED_SUCCESS) {
+        goto cleanup;
+    }
+    
+    // The caller owns the buffer from here on
+    qed_mem_disown(output_size);
+    *ciphertext = output;
+    *ciphertext_len = QED_SIGNATURE_LENGTH + 16 + (size_t)(len + final_len);
+    output = NULL;
+    QED_OP_END(QED_OP_ENCRYPT, op_start, plaintext_len);
+    
+cleanup:
+    EVP_CIPHER_CTX_free(ctx);
+    if (output) {
+        qed_secure_zero(output, output_size);
+        qed_mem_free(output, output_size);
+    }
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    return result;
 }
 
-qed_result_t qed_quantum_decrypt(qed_device_t *device, const char *key_id,
-                                const uint8_t *ciphertext, size_t ciphertext_len,
-                                uint8_t **plaintext, size_t *plaintext_len) {
+qed_result_t qed_quantum_encrypt(qed_device_t *device, const char *key_id,
+                                const uint8_t *plaintext, size_t plaintext_len,
+                                uint8_t **ciphertext, size_t *ciphertext_len) {
+    qed_result_t result;
+    
+    QED_PROBE1(encrypt__start, plaintext_len);
+    result = qed_quantum_encrypt_buffer(device, key_id, plaintext, plaintext_len,
+                                        ciphertext, ciphertext_len);
+    QED_PROBE3(encrypt__done, result, plaintext_len,
+               result == QED_SUCCESS ? *ciphertext_len : 0);
+    return result;
+}
+
+static qed_result_t qed_quantum_decrypt_buffer(qed_device_t *device, const char *key_id,
+                                               const uint8_t *ciphertext, size_t ciphertext_len,
+                                               uint8_t **plaintext, size_t *plaintext_len) {
     uint8_t quantum_key[QED_KEY_LENGTH];
     uint8_t signature[QED_SIGNATURE_LENGTH];
     uint8_t iv[16];
     const uint8_t *encrypted_data;
-    size_t encrypted_len;
-    uint8_t *signature_data = NULL;
-    size_t signature_data_len;
+    size_t encrypted_len, decrypted_size;
     uint8_t *decrypted = NULL;
     EVP_CIPHER_CTX *ctx = NULL;
     int len, final_len;
@@ -226,8 +511,41 @@ qed_result_t qed_quantum_decrypt(qed_device_t *device, const char *key_id,
         return QED_ERROR_INVALID_INPUT;
     }
     
-    // Extract signature
-    memcpy(signature, ciphertext, QED_SIGNATURE_LENGTH);
+    QED_MEM_SCOPE(QED_OP_DECRYPT);
+    
+    if (qed_small_decrypt_eligible(ciphertext, ciphertext_len)) {
+        // The output buffer is the only allocation
+        decrypted_size = ciphertext_len - QED_SIGNATURE_LENGTH - sizeof(iv);
+        if (decrypted_size == 0) {
+            decrypted_size = 1;
+        }
+        decrypted = qed_mem_alloc(decrypted_size);
+        if (!decrypted) {
+            return QED_ERROR_MEMORY;
+        }
+        result = qed_small_decrypt(device, key_id, ciphertext, ciphertext_len,
+                                   decrypted, decrypted_size, plaintext_len);
+        if (result != QED_SUCCESS) {
+            qed_mem_free(decrypted, decrypted_size);
+            return result;
+        }
+        qed_mem_disown(decrypted_size);
+        *plaintext = decrypted;
+        return QED_SUCCESS;
+    }
+    
+    if (ciphertext_len >= QED_BUFFER_HEADER_SIZE + QED_RECORD_OVERHEAD &&
+        memcmp(ciphertext, QED_BUFFER_MAGIC, 4) == 0) {
+        result = qed_quantum_decrypt_v2(device, key_id, ciphertext, ciphertext_len,
+                                        plaintext, plaintext_len);
+        // A legacy buffer whose signature happens to start with the magic
+        // fails here and is retried in the original format below
+        if (result != QED_ERROR_SIGNATURE_MISMATCH && result != QED_ERROR_INVALID_INPUT) {
+            return result;
+        }
+    }
+    
+    QED_OP_BEGIN(op_start);
     
     // Extract IV
     memcpy(iv, ciphertext + QED_SIGNATURE_LENGTH, sizeof(iv));
@@ -242,24 +560,19 @@ qed_result_t qed_quantum_decrypt(qed_device_t *device, const char *key_id,
         return result;
     }
     
-    // Prepare data for signature verification (encrypted data + quantum key)
-    signature_data_len = encrypted_len + QED_KEY_LENGTH;
-    signature_data = malloc(signature_data_len);
-    if (!signature_data) {
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_MEMORY;
+    // Verify the quantum signature over encrypted data || quantum key,
+    // hashed in place rather than from a copy of the data
+    {
+        const uint8_t *parts[2] = { encrypted_data, quantum_key };
+        size_t lengths[2] = { encrypted_len, QED_KEY_LENGTH };
+        
+        result = qed_signature_parts(&device->hardware_sig, parts, lengths, 2, signature);
     }
-    
-    memcpy(signature_data, encrypted_data, encrypted_len);
-    memcpy(signature_data + encrypted_len, quantum_key, QED_KEY_LENGTH);
-    
-    // Verify quantum signature
-    result = qed_verify_quantum_signature(&device->hardware_sig,
-                                        signature_data, signature_data_len,
-                                        signature);
-    
-    qed_secure_zero(signature_data, signature_data_len);
-    free(signature_data);
+    if (result == QED_SUCCESS &&
+        CRYPTO_memcmp(signature, ciphertext, QED_SIGNATURE_LENGTH) != 0) {
+        result = QED_ERROR_SIGNATURE_MISMATCH;
+    }
+    qed_secure_zero(signature, sizeof(signature));
     
     if (result != QED_SUCCESS) {
         qed_secure_zero(quantum_key, sizeof(quantum_key));
@@ -268,56 +581,53 @@ qed_result_t qed_quantum_decrypt(qed_device_t *device, const char *key_id,
     }
     
     // Allocate memory for decrypted data
-    decrypted = malloc(encrypted_len + 16); // Extra space for padding
+    decrypted_size = encrypted_len + 16; // Extra space for padding
+    decrypted = qed_mem_alloc(decrypted_size);
     if (!decrypted) {
         qed_secure_zero(quantum_key, sizeof(quantum_key));
         return QED_ERROR_MEMORY;
     }
     
-    // Initialize decryption context
+    // AES-256-CBC decryption
+    QED_STAGE_BEGIN(cipher_start);
     ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        free(decrypted);
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_DECRYPTION;
-    }
-    
-    // Set up AES-256-CBC decryption
-    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, quantum_key, iv) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(decrypted);
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_DECRYPTION;
-    }
-    
-    // Decrypt the data
-    if (EVP_DecryptUpdate(ctx, decrypted, &len, encrypted_data, encrypted_len) != 1) {
+    if (!ctx ||
+        EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, quantum_key, iv) != 1 ||
+        EVP_DecryptUpdate(ctx, decrypted, &len, encrypted_data, (int)encrypted_len) != 1 ||
+        EVP_DecryptFinal_ex(ctx, decrypted + len, &final_len) != 1) {
         EVP_CIPHER_CTX_free(ctx);
-        free(decrypted);
+        qed_secure_zero(decrypted, decrypted_size);
+        qed_mem_free(decrypted, decrypted_size);
         qed_secure_zero(quantum_key, sizeof(quantum_key));
         return QED_ERROR_DECRYPTION;
     }
     
-    int decrypted_len = len;
-    
-    // Finalize decryption
-    if (EVP_DecryptFinal_ex(ctx, decrypted + len, &final_len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(decrypted);
-        qed_secure_zero(quantum_key, sizeof(quantum_key));
-        return QED_ERROR_DECRYPTION;
-    }
-    
-    decrypted_len += final_len;
     EVP_CIPHER_CTX_free(ctx);
+    QED_STAGE_END(QED_STAGE_CIPHER, cipher_start, encrypted_len);
     qed_secure_zero(quantum_key, sizeof(quantum_key));
     
+    // The caller owns the buffer from here on
+    qed_mem_disown(decrypted_size);
     *plaintext = decrypted;
-    *plaintext_len = decrypted_len;
+    *plaintext_len = (size_t)(len + final_len);
     
+    QED_OP_END(QED_OP_DECRYPT, op_start, *plaintext_len);
     return QED_SUCCESS;
 }
 
+qed_result_t qed_quantum_decrypt(qed_device_t *device, const char *key_id,
+                                const uint8_t *ciphertext, size_t ciphertext_len,
+                                uint8_t **plaintext, size_t *plaintext_len) {
+    qed_result_t result;
+    
+    QED_PROBE1(decrypt__start, ciphertext_len);
+    result = qed_quantum_decrypt_buffer(device, key_id, ciphertext, ciphertext_len,
+                                        plaintext, plaintext_len);
+    QED_PROBE3(decrypt__done, result, ciphertext_len,
+               result == QED_SUCCESS ? *plaintext_len : 0);
+    return result;
+}
+
 qed_result_t qed_create_quantum_channel(qed_device_t *device, 
                                        const char *partner_device_id,
                                        uint8_t *channel_key, size_t key_length) {
@@ -342,4 +652,185 @@ qed_result_t qed_create_quantum_channel(qed_device_t *device,
     }
     
     return QED_SUCCESS;
-}
\ No newline at end of file
+}
+
+static qed_result_t qed_signature_digest(const qed_hardware_sig_t *hw_sig,
+                                         const uint8_t *const *parts, const size_t *lengths,
+                                         size_t count, size_t total, uint8_t *signature) {
+    EVP_MD_CTX *ctx;
+    unsigned int sig_len = 0;
+    size_t i;
+    int ok;
+    
+    QED_STAGE_BEGIN(stage_start);
+    
+    // Small records (header, IV, ciphertext and key included) skip the EVP
+    // context allocation
+    if (total <= QED_SMALL_MESSAGE_MAX + QED_BUFFER_HEADER_SIZE + QED_RECORD_OVERHEAD +
+                 QED_KEY_LENGTH) {
+        qed_sha256_ctx_t sha;
+        qed_sha256_init(&sha);
+        for (i = 0; i < count; i++) {
+            qed_sha256_update(&sha, parts[i], lengths[i]);
+        }
+        qed_sha256_update(&sha, hw_sig->quantum_noise, strlen(hw_sig->quantum_noise));
+        qed_sha256_final(&sha, signature);
+        QED_STAGE_END(QED_STAGE_MAC, stage_start, total);
+        return QED_SUCCESS;
+    }
+    
+    ctx = EVP_MD_CTX_new();
+    if (!ctx) {
+        return QED_ERROR_ENCRYPTION;
+    }
+    
+    ok = EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) == 1;
+    for (i = 0; ok && i < count; i++) {
+        ok = EVP_DigestUpdate(ctx, parts[i], lengths[i]) == 1;
+    }
+    ok = ok && EVP_DigestUpdate(ctx, hw_sig->quantum_noise,
+                                strlen(hw_sig->quantum_noise)) == 1;
+    ok = ok && EVP_DigestFinal_ex(ctx, signature, &sig_len) == 1;
+    
+    EVP_MD_CTX_free(ctx);
+    
+    if (!ok) {
+        return QED_ERROR_ENCRYPTION;
+    }
+    
+    QED_STAGE_END(QED_STAGE_MAC, stage_start, total);
+    return QED_SUCCESS;
+}
+
+// Quantum signature over several buffers, equivalent to signing their
+// concatenation with qed_generate_quantum_signature()
+qed_result_t qed_signature_parts(const qed_hardware_sig_t *hw_sig,
+                                 const uint8_t *const *parts, const size_t *lengths,
+                                 size_t count, uint8_t *signature) {
+    size_t total = 0;
+    size_t i;
+    qed_result_t result;
+    
+    for (i = 0; i < count; i++) {
+        total += lengths[i];
+    }
+    
+    QED_PROBE1(sign__start, total);
+    result = qed_signature_digest(hw_sig, parts, lengths, count, total, signature);
+    QED_PROBE2(sign__done, result, total);
+    return result;
+}
+
+// Signs associated data followed by IV || ciphertext
+static qed_result_t qed_record_signature(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                                         const qed_mac_state_t *mac,
+                                         const uint8_t *aad, size_t aad_len,
+                                         const uint8_t *body, size_t body_len,
+                                         uint8_t *signature) {
+    const uint8_t *parts[3] = { aad, body, key };
+    size_t lengths[3] = { aad_len, body_len, QED_KEY_LENGTH };
+    
+    // The MAC key already binds the key and the hardware
+    if (mac) {
+        return qed_mac_parts(mac, parts, lengths, 2, signature);
+    }
+    return qed_signature_parts(hw_sig, parts, lengths, 3, signature);
+}
+
+qed_result_t qed_seal_record(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                             const qed_mac_state_t *mac, uint8_t cipher,
+                             const uint8_t *aad, size_t aad_len,
+                             const uint8_t *plain, size_t plain_len,
+                             uint8_t *record, size_t *record_len) {
+    uint8_t *iv = record + QED_SIGNATURE_LENGTH;
+    uint8_t *encrypted = iv + QED_IV_LENGTH;
+    size_t encrypted_len;
+    qed_result_t result;
+    
+    if (!hw_sig || !key || !record || !record_len || (!plain && plain_len > 0) ||
+        plain_len > INT32_MAX) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    result = qed_cipher_iv(iv);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    QED_STAGE_BEGIN(cipher_start);
+    result = qed_cipher_encrypt(cipher, key, iv, aad, aad_len, plain, plain_len,
+                                encrypted, &encrypted_len);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    QED_STAGE_END(QED_STAGE_CIPHER, cipher_start, plain_len);
+    
+    result = qed_record_signature(hw_sig, key, mac, aad, aad_len, iv,
+                                  QED_IV_LENGTH + encrypted_len, record);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    *record_len = QED_SIGNATURE_LENGTH + QED_IV_LENGTH + encrypted_len;
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_verify_record(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                               const qed_mac_state_t *mac,
+                               const uint8_t *aad, size_t aad_len,
+                               const uint8_t *record, size_t record_len) {
+    uint8_t computed_signature[QED_SIGNATURE_LENGTH];
+    qed_result_t result;
+    
+    if (!hw_sig || !key || !record ||
+        record_len < QED_SIGNATURE_LENGTH + QED_IV_LENGTH + 16 ||
+        record_len - QED_SIGNATURE_LENGTH - QED_IV_LENGTH > INT32_MAX) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    result = qed_record_signature(hw_sig, key, mac, aad, aad_len, record + QED_SIGNATURE_LENGTH,
+                                  record_len - QED_SIGNATURE_LENGTH, computed_signature);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    if (CRYPTO_memcmp(computed_signature, record, QED_SIGNATURE_LENGTH) != 0) {
+        qed_secure_zero(computed_signature, sizeof(computed_signature));
+        return QED_ERROR_SIGNATURE_MISMATCH;
+    }
+    qed_secure_zero(computed_signature, sizeof(computed_signature));
+    
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_open_record(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                             const qed_mac_state_t *mac, uint8_t cipher,
+                             const uint8_t *aad, size_t aad_len,
+                             const uint8_t *record, size_t record_len,
+                             uint8_t *plain, size_t *plain_len) {
+    const uint8_t *iv = record + QED_SIGNATURE_LENGTH;
+    const uint8_t *encrypted = iv + QED_IV_LENGTH;
+    size_t encrypted_len;
+    qed_result_t result;
+    
+    if (!plain || !plain_len) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    result = qed_verify_record(hw_sig, key, mac, aad, aad_len, record, record_len);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    encrypted_len = record_len - QED_SIGNATURE_LENGTH - QED_IV_LENGTH;
+    
+    QED_STAGE_BEGIN(cipher_start);
+    result = qed_cipher_decrypt(cipher, key, iv, aad, aad_len, encrypted, encrypted_len,
+                                plain, plain_len);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    QED_STAGE_END(QED_STAGE_CIPHER, cipher_start, encrypted_len);
+    
+    return QED_SUCCESS;
+}
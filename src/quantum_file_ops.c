@@ -11,83 +11,192 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
 
-static qed_result_t qed_read_file(const char *filepath, uint8_t **data, size_t *size) {
+// Mapped inputs are prefetched this far; MADV_SEQUENTIAL keeps the kernel's
+// readahead ahead of the cipher after that
+#define QED_INPUT_PREFETCH (32 * 1024 * 1024)
+
+// A whole input file, either mapped or read into a working buffer
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    uint8_t *buffer;
+    void *mapping;
+} qed_input_t;
+
+static qed_result_t qed_read_file(const qed_device_t *device, const char *filepath,
+                                  qed_input_t *input) {
     FILE *file;
     struct stat st;
+    int fd;
     
-    if (!filepath || !data || !size) {
+    if (!filepath || !input) {
         return QED_ERROR_INVALID_INPUT;
     }
     
+    memset(input, 0, sizeof(qed_input_t));
+    QED_STAGE_BEGIN(stage_start);
+    QED_PROBE(file__read__start);
+    
+    fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return QED_ERROR_FILE_IO;
+    }
+    
     // Get file size
-    if (stat(filepath, &st) != 0) {
+    if (fstat(fd, &st) != 0) {
+        close(fd);
         return QED_ERROR_FILE_IO;
     }
     
-    *size = st.st_size;
-    if (*size == 0) {
-        *data = NULL;
+    input->size = st.st_size;
+    if (input->size == 0) {
+        close(fd);
         return QED_SUCCESS;
     }
     
+    if (device->mmap_input) {
+        void *mapping = mmap(NULL, input->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        
+        // Anything that cannot be mapped is read instead
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, input->size, MADV_SEQUENTIAL);
+            madvise(mapping, input->size < QED_INPUT_PREFETCH ? input->size : QED_INPUT_PREFETCH,
+                    MADV_WILLNEED);
+            close(fd);
+            input->mapping = mapping;
+            input->data = mapping;
+            QED_STAGE_END(QED_STAGE_FILE_READ, stage_start, input->size);
+            QED_PROBE1(file__read__done, input->size);
+            return QED_SUCCESS;
+        }
+    }
+    
     // Allocate memory for file data
-    *data = malloc(*size);
-    if (!*data) {
+    input->buffer = qed_buffer_alloc(device, input->size);
+    if (!input->buffer) {
+        close(fd);
         return QED_ERROR_MEMORY;
     }
     
-    // Open and read file
-    file = fopen(filepath, "rb");
+    file = fdopen(fd, "rb");
     if (!file) {
-        free(*data);
-        *data = NULL;
+        close(fd);
+        qed_buffer_free(input->buffer, input->size);
+        input->buffer = NULL;
         return QED_ERROR_FILE_IO;
     }
     
-    size_t bytes_read = fread(*data, 1, *size, file);
+    size_t bytes_read = fread(input->buffer, 1, input->size, file);
     fclose(file);
     
-    if (bytes_read != *size) {
-        free(*data);
-        *data = NULL;
+    if (bytes_read != input->size) {
+        qed_buffer_free(input->buffer, input->size);
+        input->buffer = NULL;
         return QED_ERROR_FILE_IO;
     }
     
+    input->data = input->buffer;
+    QED_STAGE_END(QED_STAGE_FILE_READ, stage_start, input->size);
+    QED_PROBE1(file__read__done, input->size);
     return QED_SUCCESS;
 }
 
-static qed_result_t qed_write_file(const char *filepath, const uint8_t *data, size_t size) {
-    FILE *file;
+static void qed_release_input(qed_input_t *input) {
+    if (input->mapping) {
+        munmap(input->mapping, input->size);
+    }
+    if (input->buffer) {
+        qed_secure_zero(input->buffer, input->size);
+        qed_buffer_free(input->buffer, input->size);
+    }
+    memset(input, 0, sizeof(qed_input_t));
+}
+
+// Replaces filepath atomically; a failed write leaves the old file intact
+static qed_result_t qed_write_file(const qed_device_t *device, const char *filepath,
+                                   const uint8_t *data, size_t size) {
+    qed_output_t output;
+    qed_result_t result;
     
-    if (!filepath || !data) {
+    if (!filepath || (!data && size > 0)) {
         return QED_ERROR_INVALID_INPUT;
     }
     
-    file = fopen(filepath, "wb");
-    if (!file) {
-        return QED_ERROR_FILE_IO;
+    QED_STAGE_BEGIN(stage_start);
+    QED_PROBE(file__write__start);
+    
+    result = qed_output_open(&output, device, filepath, size);
+    if (result != QED_SUCCESS) {
+        return result;
     }
     
-    size_t bytes_written = fwrite(data, 1, size, file);
-    fclose(file);
+    result = qed_output_write(&output, data, size);
+    if (result == QED_SUCCESS) {
+        result = qed_output_commit(&output);
+    } else {
+        qed_output_abort(&output);
+    }
+    if (result != QED_SUCCESS) {
+        return result;
+    }
     
-    if (bytes_written != size) {
-        return QED_ERROR_FILE_IO;
+    QED_STAGE_END(QED_STAGE_FILE_WRITE, stage_start, size);
+    QED_PROBE1(file__write__done, size);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_pread_full(int fd, void *buffer, size_t length, uint64_t offset) {
+    uint8_t *p = buffer;
+    
+    while (length > 0) {
+        ssize_t n = pread(fd, p, length, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return QED_ERROR_FILE_IO;
+        }
+        p += n;
+        length -= (size_t)n;
+        offset += (uint64_t)n;
     }
     
     return QED_SUCCESS;
 }
 
-static bool qed_file_exists(const char *filepath) {
+qed_result_t qed_pwrite_full(int fd, const void *buffer, size_t length, uint64_t offset) {
+    const uint8_t *p = buffer;
+    
+    while (length > 0) {
+        ssize_t n = pwrite(fd, p, length, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return QED_ERROR_FILE_IO;
+        }
+        p += n;
+        length -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    
+    return QED_SUCCESS;
+}
+
+bool qed_file_exists(const char *filepath) {
     struct stat st;
     return (stat(filepath, &st) == 0);
 }
 
-static bool qed_paths_are_same(const char *path1, const char *path2) {
+bool qed_paths_are_same(const char *path1, const char *path2) {
     char *real_path1, *real_path2;
     bool same = false;
     
@@ -104,17 +213,51 @@ static bool qed_paths_are_same(const char *path1, const char *path2) {
     return same;
 }
 
+// Working memory a whole-file operation holds at once: the input unless it
+// is mapped, the output, and for compressed data the buffer on the other
+// side of the compressor (its size is in the header when decrypting)
+static uint64_t qed_file_footprint(const qed_device_t *device, const char *path,
+                                   uint64_t size, bool decrypt) {
+    uint8_t header[QED_BUFFER_HEADER_SIZE];
+    uint64_t footprint = device->mmap_input ? 0 : size;
+    int fd;
+    
+    if (!decrypt) {
+        footprint += QED_CIPHERTEXT_MAX(size);
+        if (device->compression != QED_COMPRESSION_NONE) {
+            footprint += qed_compress_bound((size_t)size);
+        }
+        return footprint;
+    }
+    
+    footprint += size;
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        if (size >= sizeof(header) &&
+            qed_pread_full(fd, header, sizeof(header), 0) == QED_SUCCESS &&
+            memcmp(header, QED_BUFFER_MAGIC, 4) == 0 && header[6] != QED_COMPRESSION_NONE) {
+            footprint += qed_get_le64(header + 8);
+        }
+        close(fd);
+    }
+    return footprint;
+}
+
 qed_result_t qed_encrypt_file(qed_device_t *device, const char *key_id,
                              const char *input_path, const char *output_path) {
-    uint8_t *file_data = NULL;
+    qed_input_t input;
     uint8_t *encrypted_data = NULL;
     size_t file_size, encrypted_size;
+    struct stat st;
     qed_result_t result;
     
     if (!device || !key_id || !input_path || !output_path) {
         return QED_ERROR_INVALID_INPUT;
     }
     
+    QED_MEM_SCOPE(QED_OP_FILE_ENCRYPT);
+    QED_OP_BEGIN(op_start);
+    
     // Check if input file exists
     if (!qed_file_exists(input_path)) {
         printf("❌ Error: Input file '%s' does not exist.\n", input_path);
@@ -132,16 +275,42 @@ qed_result_t qed_encrypt_file(qed_device_t *device, const char *key_id,
         printf("⚠️  Warning: Output file '%s' already exists and will be overwritten.\n", output_path);
     }
     
+    // Only the chunked format can leave holes out
+    if (device->sparse) {
+        return qed_encrypt_file_chunked(device, key_id, input_path, output_path, 0);
+    }
+    
+    // Over the memory budget the file is streamed through the chunked
+    // format rather than held whole
+    if (device->memory_budget && stat(input_path, &st) == 0) {
+        uint64_t footprint = qed_file_footprint(device, input_path, (uint64_t)st.st_size, false);
+        
+        if (footprint > device->memory_budget) {
+            printf("📦 Whole-file encryption needs %.1f MB, over the %.1f MB memory budget; "
+                   "using the chunked format.\n",
+                   footprint / 1048576.0, device->memory_budget / 1048576.0);
+            result = qed_encrypt_file_chunked(device, key_id, input_path, output_path, 0);
+            if (result != QED_SUCCESS) {
+                printf("❌ File encryption failed: %s\n", qed_get_error_string(result));
+                return result;
+            }
+            printf("🔒 File encrypted successfully: %s\n", output_path);
+            return QED_SUCCESS;
+        }
+    }
+    
     // Read input file
-    result = qed_read_file(input_path, &file_data, &file_size);
+    result = qed_read_file(device, input_path, &input);
     if (result != QED_SUCCESS) {
         printf("❌ File encryption failed: %s\n", qed_get_error_string(result));
         return result;
     }
     
+    file_size = input.size;
+    
     // Handle empty files
     if (file_size == 0) {
-        result = qed_write_file(output_path, NULL, 0);
+        result = qed_write_file(device, output_path, NULL, 0);
         if (result == QED_SUCCESS) {
             printf("🔒 File encrypted successfully: %s\n", output_path);
         } else {
@@ -151,45 +320,50 @@ qed_result_t qed_encrypt_file(qed_device_t *device, const char *key_id,
     }
     
     // Encrypt file data
-    result = qed_quantum_encrypt(device, key_id, file_data, file_size, 
+    result = qed_quantum_encrypt(device, key_id, input.data, file_size,
                                 &encrypted_data, &encrypted_size);
     
     // Clean up file data
-    qed_secure_zero(file_data, file_size);
-    free(file_data);
+    qed_release_input(&input);
     
     if (result != QED_SUCCESS) {
         printf("❌ File encryption failed: %s\n", qed_get_error_string(result));
         return result;
     }
+    qed_mem_adopt(encrypted_size);
     
     // Write encrypted data to output file
-    result = qed_write_file(output_path, encrypted_data, encrypted_size);
+    result = qed_write_file(device, output_path, encrypted_data, encrypted_size);
     
     // Clean up encrypted data
     qed_secure_zero(encrypted_data, encrypted_size);
-    free(encrypted_data);
+    qed_mem_free(encrypted_data, encrypted_size);
     
     if (result != QED_SUCCESS) {
         printf("❌ File encryption failed: %s\n", qed_get_error_string(result));
         return result;
     }
     
+    QED_OP_END(QED_OP_FILE_ENCRYPT, op_start, file_size);
     printf("🔒 File encrypted successfully: %s\n", output_path);
     return QED_SUCCESS;
 }
 
 qed_result_t qed_decrypt_file(qed_device_t *device, const char *key_id,
                              const char *input_path, const char *output_path) {
-    uint8_t *encrypted_data = NULL;
+    qed_input_t input;
     uint8_t *decrypted_data = NULL;
-    size_t encrypted_size, decrypted_size;
+    size_t decrypted_size;
+    struct stat st;
     qed_result_t result;
     
     if (!device || !key_id || !input_path || !output_path) {
         return QED_ERROR_INVALID_INPUT;
     }
     
+    QED_MEM_SCOPE(QED_OP_FILE_DECRYPT);
+    QED_OP_BEGIN(op_start);
+    
     // Check if input file exists
     if (!qed_file_exists(input_path)) {
         printf("❌ Error: Input file '%s' does not exist.\n", input_path);
@@ -207,27 +381,50 @@ qed_result_t qed_decrypt_file(qed_device_t *device, const char *key_id,
         printf("⚠️  Warning: Output file '%s' already exists and will be overwritten.\n", output_path);
     }
     
+    // Seekable chunked files are verified and decrypted chunk by chunk
+    if (qed_is_chunked_file(input_path)) {
+        result = qed_decrypt_file_chunked(device, key_id, input_path, output_path);
+        if (result != QED_SUCCESS) {
+            printf("❌ File decryption failed: %s\n", qed_get_error_string(result));
+            return result;
+        }
+        printf("📨 File decrypted successfully: %s\n", output_path);
+        return QED_SUCCESS;
+    }
+    
+    // The whole-file format cannot be decrypted piecewise, so a file over
+    // the memory budget fails before anything is read
+    if (device->memory_budget && stat(input_path, &st) == 0) {
+        uint64_t footprint = qed_file_footprint(device, input_path, (uint64_t)st.st_size, true);
+        
+        if (footprint > device->memory_budget) {
+            printf("❌ File decryption failed: needs %.1f MB, over the %.1f MB memory budget.\n",
+                   footprint / 1048576.0, device->memory_budget / 1048576.0);
+            printf("   Files encrypted with --chunked decrypt in bounded memory.\n");
+            return QED_ERROR_MEMORY;
+        }
+    }
+    
     // Read encrypted file
-    result = qed_read_file(input_path, &encrypted_data, &encrypted_size);
+    result = qed_read_file(device, input_path, &input);
     if (result != QED_SUCCESS) {
         printf("❌ File decryption failed: %s\n", qed_get_error_string(result));
         return result;
     }
     
     // Check minimum file size for encrypted data
-    if (encrypted_size < QED_SIGNATURE_LENGTH + 16) { // signature + IV minimum
+    if (input.size < QED_SIGNATURE_LENGTH + 16) { // signature + IV minimum
         printf("❌ File decryption failed: Input file too small to be encrypted (missing signature)\n");
-        free(encrypted_data);
+        qed_release_input(&input);
         return QED_ERROR_INVALID_INPUT;
     }
     
     // Decrypt file data
-    result = qed_quantum_decrypt(device, key_id, encrypted_data, encrypted_size,
+    result = qed_quantum_decrypt(device, key_id, input.data, input.size,
                                 &decrypted_data, &decrypted_size);
     
     // Clean up encrypted data
-    qed_secure_zero(encrypted_data, encrypted_size);
-    free(encrypted_data);
+    qed_release_input(&input);
     
     if (result != QED_SUCCESS) {
         printf("❌ File decryption failed: %s\n", qed_get_error_string(result));
@@ -239,19 +436,126 @@ qed_result_t qed_decrypt_file(qed_device_t *device, const char *key_id,
         }
         return result;
     }
+    qed_mem_adopt(decrypted_size);
     
     // Write decrypted data to output file
-    result = qed_write_file(output_path, decrypted_data, decrypted_size);
+    result = qed_write_file(device, output_path, decrypted_data, decrypted_size);
     
     // Clean up decrypted data
     qed_secure_zero(decrypted_data, decrypted_size);
-    free(decrypted_data);
+    qed_mem_free(decrypted_data, decrypted_size);
     
     if (result != QED_SUCCESS) {
         printf("❌ File decryption failed: %s\n", qed_get_error_string(result));
         return result;
     }
     
+    QED_OP_END(QED_OP_FILE_DECRYPT, op_start, decrypted_size);
     printf("📨 File decrypted successfully: %s\n", output_path);
     return QED_SUCCESS;
-}
\ No newline at end of file
+}
+
+qed_result_t qed_rekey_file(qed_device_t *device, const char *old_key_id,
+                            const char *new_key_id, const char *input_path,
+                            const char *output_path) {
+    qed_input_t input;
+    uint8_t *decrypted_data = NULL;
+    uint8_t *encrypted_data = NULL;
+    size_t decrypted_size = 0, encrypted_size = 0;
+    struct stat st;
+    qed_result_t result;
+    
+    if (!device || !old_key_id || !new_key_id || !input_path || !output_path) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_FILE_REKEY);
+    QED_OP_BEGIN(op_start);
+    
+    if (stat(input_path, &st) != 0) {
+        printf("❌ Error: Input file '%s' does not exist.\n", input_path);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    if (qed_paths_are_same(input_path, output_path)) {
+        printf("❌ Error: Output file cannot be the same as input file.\n");
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (qed_is_chunked_file(input_path)) {
+        result = qed_rekey_file_chunked(device, old_key_id, new_key_id, input_path,
+                                        output_path);
+        if (result != QED_SUCCESS) {
+            printf("❌ File re-keying failed: %s\n", qed_get_error_string(result));
+            return result;
+        }
+        printf("🔑 File re-keyed successfully: %s\n", output_path);
+        return QED_SUCCESS;
+    }
+    
+    // A whole-file input is held as ciphertext, plaintext and new
+    // ciphertext at once
+    if (device->memory_budget) {
+        uint64_t footprint = qed_file_footprint(device, input_path, (uint64_t)st.st_size, true) +
+            QED_CIPHERTEXT_MAX((uint64_t)st.st_size);
+        
+        if (footprint > device->memory_budget) {
+            printf("❌ File re-keying failed: needs %.1f MB, over the %.1f MB memory budget.\n",
+                   footprint / 1048576.0, device->memory_budget / 1048576.0);
+            return QED_ERROR_MEMORY;
+        }
+    }
+    
+    result = qed_read_file(device, input_path, &input);
+    if (result != QED_SUCCESS) {
+        printf("❌ File re-keying failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    // An empty file is the encryption of an empty file under any key
+    if (input.size == 0) {
+        result = qed_write_file(device, output_path, NULL, 0);
+        if (result == QED_SUCCESS) {
+            printf("🔑 File re-keyed successfully: %s\n", output_path);
+        } else {
+            printf("❌ File re-keying failed: %s\n", qed_get_error_string(result));
+        }
+        return result;
+    }
+    
+    result = qed_quantum_decrypt(device, old_key_id, input.data, input.size,
+                                 &decrypted_data, &decrypted_size);
+    qed_release_input(&input);
+    
+    if (result == QED_SUCCESS) {
+        qed_mem_adopt(decrypted_size);
+        result = qed_quantum_encrypt(device, new_key_id, decrypted_data, decrypted_size,
+                                     &encrypted_data, &encrypted_size);
+        qed_secure_zero(decrypted_data, decrypted_size);
+        qed_mem_free(decrypted_data, decrypted_size);
+    }
+    
+    if (result == QED_SUCCESS) {
+        qed_mem_adopt(encrypted_size);
+        result = qed_write_file(device, output_path, encrypted_data, encrypted_size);
+        qed_mem_free(encrypted_data, encrypted_size);
+    }
+    
+    if (result != QED_SUCCESS) {
+        printf("❌ File re-keying failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    QED_OP_END(QED_OP_FILE_REKEY, op_start, decrypted_size);
+    printf("🔑 File re-keyed successfully: %s\n", output_path);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_set_mmap_input(qed_device_t *device, bool enabled) {
+    if (!device) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    device->mmap_input = enabled;
+    return QED_SUCCESS;
+}
@@ -0,0 +1,606 @@
+/*
+ * Quantum Encryption Device (QED) - Incremental Re-encryption
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Incremental mode keeps an uncompressed chunked file, whose records all
+ * sit at fixed offsets, next to a signed manifest "<output>.qmf":
+ *
+ *   header   48 bytes   "QEDM", version, chunk size, plaintext size,
+ *                       file id of the encrypted file, chunk count
+ *   digests  N x 32     SHA-256(key || chunk number || chunk plaintext)
+ *   signature 32 bytes  quantum signature over header, digests and key
+ *
+ * A re-run hashes the new plaintext and reseals only chunks whose digest
+ * changed, plus the chunks whose "final" marker moves when the size
+ * changes. The manifest is removed before the encrypted file is touched
+ * and rewritten last, so an interrupted run falls back to a full rewrite.
+ *
+ * Every run takes the next generation of the file. Resealed chunks sign
+ * the new one and kept chunks keep theirs, as listed by the file's sealed
+ * generation table, so a record spliced in from an earlier version of the
+ * file fails to verify (see QED_CHUNKED_FLAG_GENERATIONS).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#define QED_MANIFEST_MAGIC "QEDM"
+#define QED_MANIFEST_VERSION 1
+#define QED_MANIFEST_HEADER_SIZE 48
+#define QED_MANIFEST_SUFFIX ".qmf"
+#define QED_DIGEST_LENGTH 32
+
+// Plaintext held in flight by one batch
+#define QED_INCREMENTAL_BATCH_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+    const qed_hardware_sig_t *hw_sig;
+    const uint8_t *key;
+    const qed_mac_state_t *mac;
+    uint8_t cipher;
+    const uint8_t *header;
+    size_t chunk_size;
+    uint64_t chunk_count;
+    uint64_t first_index;
+    const uint8_t *old_digests;
+    uint64_t old_count;
+    uint8_t *digests;
+    uint8_t *plain;
+    size_t *plain_lens;
+    uint8_t *records;
+    size_t *record_lens;
+    bool *changed;
+    qed_result_t *results;
+    uint32_t generation;
+    const uint32_t *old_generations;
+    uint32_t *generations;
+} qed_incremental_batch_t;
+
+static qed_result_t qed_chunk_digest(const uint8_t *key, uint64_t index,
+                                     const uint8_t *plain, size_t plain_len,
+                                     uint8_t *digest) {
+    uint8_t index_le[8];
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    int ok;
+    
+    if (!ctx) {
+        return QED_ERROR_MEMORY;
+    }
+    
+    qed_put_le64(index_le, index);
+    ok = EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) == 1 &&
+         EVP_DigestUpdate(ctx, key, QED_KEY_LENGTH) == 1 &&
+         EVP_DigestUpdate(ctx, index_le, sizeof(index_le)) == 1 &&
+         EVP_DigestUpdate(ctx, plain, plain_len) == 1 &&
+         EVP_DigestFinal_ex(ctx, digest, NULL) == 1;
+    EVP_MD_CTX_free(ctx);
+    
+    return ok ? QED_SUCCESS : QED_ERROR_ENCRYPTION;
+}
+
+static uint64_t qed_incremental_record_offset(size_t chunk_size, uint64_t index) {
+    return QED_CHUNKED_HEADER_SIZE + index * (chunk_size + QED_RECORD_OVERHEAD);
+}
+
+// Hashes one chunk and reseals it if it differs from the previous run
+static void qed_incremental_worker(void *ctx, size_t slot) {
+    qed_incremental_batch_t *batch = ctx;
+    uint64_t index = batch->first_index + slot;
+    const uint8_t *plain = batch->plain + slot * batch->chunk_size;
+    size_t plain_len = batch->plain_lens[slot];
+    uint8_t *digest = batch->digests + index * QED_DIGEST_LENGTH;
+    uint8_t aad[QED_CHUNKED_AAD_SIZE];
+    bool final = index + 1 == batch->chunk_count;
+    size_t aad_len;
+    
+    batch->results[slot] = qed_chunk_digest(batch->key, index, plain, plain_len, digest);
+    if (batch->results[slot] != QED_SUCCESS) {
+        return;
+    }
+    
+    batch->changed[slot] = index >= batch->old_count ||
+        final != (index + 1 == batch->old_count) ||
+        CRYPTO_memcmp(digest, batch->old_digests + index * QED_DIGEST_LENGTH,
+                      QED_DIGEST_LENGTH) != 0;
+    
+    if (!batch->changed[slot]) {
+        batch->generations[index] = batch->old_generations[index];
+        return;
+    }
+    
+    batch->generations[index] = batch->generation;
+    aad_len = qed_chunked_aad(batch->header, index, (uint32_t)plain_len, final,
+                              batch->generation, aad);
+    batch->results[slot] = qed_seal_record(batch->hw_sig, batch->key, batch->mac, batch->cipher,
+                                           aad, aad_len,
+                                           plain, plain_len,
+                                           batch->records + slot * (batch->chunk_size + QED_RECORD_OVERHEAD),
+                                           &batch->record_lens[slot]);
+}
+
+static char* qed_manifest_path(const char *output_path) {
+    size_t len = strlen(output_path);
+    char *path = malloc(len + sizeof(QED_MANIFEST_SUFFIX));
+    
+    if (path) {
+        memcpy(path, output_path, len);
+        memcpy(path + len, QED_MANIFEST_SUFFIX, sizeof(QED_MANIFEST_SUFFIX));
+    }
+    return path;
+}
+
+// Loads and verifies the manifest of a previous run against the encrypted
+// file's header; returns the digests or NULL if a full rewrite is needed
+static uint8_t* qed_manifest_load(const qed_device_t *device, const uint8_t *key,
+                                  const char *manifest_path,
+                                  const qed_chunked_reader_t *reader) {
+    uint8_t header[QED_MANIFEST_HEADER_SIZE];
+    uint8_t signature[QED_SIGNATURE_LENGTH];
+    uint8_t computed[QED_SIGNATURE_LENGTH];
+    uint8_t *digests = NULL;
+    size_t digests_len;
+    FILE *file;
+    
+    file = fopen(manifest_path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, QED_MANIFEST_MAGIC, 4) != 0 ||
+        header[4] != QED_MANIFEST_VERSION ||
+        qed_get_le32(header + 8) != reader->chunk_size ||
+        qed_get_le64(header + 16) != reader->plaintext_size ||
+        memcmp(header + 24, reader->header + 24, 16) != 0 ||
+        qed_get_le64(header + 40) != reader->chunk_count) {
+        fclose(file);
+        return NULL;
+    }
+    
+    digests_len = (size_t)reader->chunk_count * QED_DIGEST_LENGTH;
+    digests = qed_mem_alloc(digests_len);
+    if (!digests ||
+        fread(digests, 1, digests_len, file) != digests_len ||
+        fread(signature, 1, sizeof(signature), file) != sizeof(signature)) {
+        qed_mem_free(digests, digests_len);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    
+    {
+        const uint8_t *parts[3] = { header, digests, key };
+        size_t lengths[3] = { sizeof(header), digests_len, QED_KEY_LENGTH };
+        
+        if (qed_signature_parts(&device->hardware_sig, parts, lengths, 3, computed) != QED_SUCCESS ||
+            CRYPTO_memcmp(computed, signature, sizeof(signature)) != 0) {
+            qed_mem_free(digests, digests_len);
+            return NULL;
+        }
+    }
+    
+    return digests;
+}
+
+static qed_result_t qed_manifest_store(const qed_device_t *device, const uint8_t *key,
+                                       const char *manifest_path, const uint8_t *file_header,
+                                       uint64_t chunk_count, const uint8_t *digests) {
+    uint8_t header[QED_MANIFEST_HEADER_SIZE];
+    uint8_t signature[QED_SIGNATURE_LENGTH];
+    size_t digests_len = (size_t)chunk_count * QED_DIGEST_LENGTH;
+    size_t tmp_len = strlen(manifest_path) + 5;
+    char *tmp_path;
+    FILE *file;
+    qed_result_t result;
+    
+    memset(header, 0, sizeof(header));
+    memcpy(header, QED_MANIFEST_MAGIC, 4);
+    header[4] = QED_MANIFEST_VERSION;
+    memcpy(header + 8, file_header + 8, 4);    // chunk size
+    memcpy(header + 16, file_header + 16, 8);  // plaintext size
+    memcpy(header + 24, file_header + 24, 16); // file id
+    qed_put_le64(header + 40, chunk_count);
+    
+    {
+        const uint8_t *parts[3] = { header, digests, key };
+        size_t lengths[3] = { sizeof(header), digests_len, QED_KEY_LENGTH };
+        
+        result = qed_signature_parts(&device->hardware_sig, parts, lengths, 3, signature);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+    }
+    
+    tmp_path = malloc(tmp_len);
+    if (!tmp_path) {
+        return QED_ERROR_MEMORY;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", manifest_path);
+    
+    file = fopen(tmp_path, "wb");
+    if (!file) {
+        free(tmp_path);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+        fwrite(digests, 1, digests_len, file) != digests_len ||
+        fwrite(signature, 1, sizeof(signature), file) != sizeof(signature) ||
+        fclose(file) != 0 ||
+        rename(tmp_path, manifest_path) != 0) {
+        unlink(tmp_path);
+        free(tmp_path);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    free(tmp_path);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_encrypt_file_incremental(qed_device_t *device, const char *key_id,
+                                         const char *input_path, const char *output_path,
+                                         size_t chunk_size, qed_incremental_stats_t *stats) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    uint8_t record_key[QED_KEY_LENGTH];
+    uint8_t header[QED_CHUNKED_HEADER_SIZE];
+    uint8_t footer[QED_CHUNKED_FOOTER_SIZE];
+    qed_incremental_batch_t batch;
+    qed_incremental_stats_t totals;
+    qed_chunked_reader_t reader;
+    uint8_t *old_digests = NULL;
+    uint32_t *old_generations = NULL;
+    uint8_t *index = NULL;
+    uint8_t *table = NULL, *table_record = NULL;
+    size_t table_len = 0, table_record_len = 0;
+    char *manifest_path = NULL;
+    uint64_t plaintext_size, chunk_count = 0, old_count = 0, records_end, index_offset, i;
+    size_t batch_size = 0, slot;
+    FILE *input = NULL;
+    int fd = -1;
+    struct stat st;
+    qed_result_t result;
+    
+    if (!device || !key_id || !input_path || !output_path) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (stat(input_path, &st) != 0) {
+        printf("❌ Error: Input file '%s' does not exist.\n", input_path);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    if (qed_paths_are_same(input_path, output_path)) {
+        printf("❌ Error: Output file cannot be the same as input file.\n");
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    manifest_path = qed_manifest_path(output_path);
+    if (!manifest_path) {
+        return QED_ERROR_MEMORY;
+    }
+    
+    QED_MEM_SCOPE(QED_OP_FILE_ENCRYPT);
+    QED_OP_BEGIN(op_start);
+    
+    result = qed_generate_quantum_key(device, key_id, quantum_key, QED_KEY_LENGTH);
+    if (result != QED_SUCCESS) {
+        free(manifest_path);
+        printf("❌ File encryption failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    memset(&batch, 0, sizeof(batch));
+    memset(&totals, 0, sizeof(totals));
+    
+    // Reuse the previous output if it is an uncompressed chunked file from
+    // an earlier run, with a matching, verified manifest and generation table
+    if (qed_chunked_open(output_path, &reader) == QED_SUCCESS) {
+        if (reader.header[4] == QED_CHUNKED_VERSION &&
+            (reader.header[7] & QED_CHUNKED_FLAG_GENERATIONS) &&
+            qed_get_le32(reader.header + 40) < UINT32_MAX &&
+            reader.compression == QED_COMPRESSION_NONE && reader.mac == device->mac &&
+            reader.cipher == device->cipher &&
+            ((reader.header[7] & QED_CHUNKED_FLAG_SUBKEY) != 0) == device->subkeys &&
+            (chunk_size == 0 || chunk_size == reader.chunk_size)) {
+            old_digests = qed_manifest_load(device, quantum_key, manifest_path, &reader);
+        }
+        if (old_digests) {
+            const qed_mac_state_t *old_mac = NULL;
+            
+            result = qed_chunked_file_key(device, key_id, &reader, record_key);
+            if (result == QED_SUCCESS) {
+                result = qed_chunked_mac_state(device, key_id, &reader, &old_mac);
+            }
+            if (result == QED_SUCCESS) {
+                result = qed_chunked_load_map(&reader, &device->hardware_sig, record_key,
+                                              old_mac);
+            }
+            if (result != QED_SUCCESS) {
+                qed_mem_free(old_digests, (size_t)reader.chunk_count * QED_DIGEST_LENGTH);
+                old_digests = NULL;
+            }
+        }
+        if (old_digests) {
+            memcpy(header, reader.header, sizeof(header));
+            chunk_size = reader.chunk_size;
+            old_count = reader.chunk_count;
+            old_generations = reader.generations;
+            reader.generations = NULL;
+        }
+        qed_chunked_close(&reader);
+    }
+    
+    if (chunk_size == 0) {
+        chunk_size = QED_CHUNK_SIZE_DEFAULT;
+    }
+    
+    if (chunk_size < QED_CHUNK_SIZE_MIN || chunk_size > QED_CHUNK_SIZE_MAX ||
+        chunk_size % 16 != 0) {
+        printf("❌ Error: Chunk size must be a multiple of 16 between %d and %d bytes.\n",
+               QED_CHUNK_SIZE_MIN, QED_CHUNK_SIZE_MAX);
+        result = QED_ERROR_INVALID_INPUT;
+        goto cleanup;
+    }
+    
+    if (!old_digests) {
+        memset(header, 0, sizeof(header));
+        memcpy(header, QED_CHUNKED_MAGIC, 4);
+        header[4] = QED_CHUNKED_VERSION;
+        header[5] = device->cipher;
+        header[6] = device->mac;
+        header[7] = QED_CHUNKED_FLAG_GENERATIONS |
+                    (device->subkeys ? QED_CHUNKED_FLAG_SUBKEY : 0);
+        qed_put_le32(header + 8, (uint32_t)chunk_size);
+        if (RAND_bytes(header + 24, 16) != 1) {
+            result = QED_ERROR_ENCRYPTION;
+            goto cleanup;
+        }
+    }
+    
+    plaintext_size = (uint64_t)st.st_size;
+    chunk_count = (plaintext_size + chunk_size - 1) / chunk_size;
+    qed_put_le64(header + 16, plaintext_size);
+    qed_put_le32(header + 40, old_digests ? qed_get_le32(header + 40) + 1 : 1);
+    
+    // The generation table is one record
+    if (chunk_count > (UINT32_MAX - QED_RECORD_OVERHEAD - 32) / 4) {
+        result = QED_ERROR_INVALID_INPUT;
+        goto cleanup;
+    }
+    
+    // Chunks use the file's subkey; the manifest stays under the device key
+    memcpy(record_key, quantum_key, sizeof(record_key));
+    if (header[7] & QED_CHUNKED_FLAG_SUBKEY) {
+        result = qed_file_key(device, key_id, header + 24, record_key);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+    }
+    
+    batch_size = 2 * qed_parallel_workers();
+    if (batch_size > QED_INCREMENTAL_BATCH_BYTES / chunk_size) {
+        batch_size = QED_INCREMENTAL_BATCH_BYTES / chunk_size;
+    }
+    // Under a memory budget each slot holds a plaintext chunk and its record
+    if (device->memory_budget &&
+        batch_size > device->memory_budget / (2 * chunk_size + QED_RECORD_OVERHEAD)) {
+        batch_size = (size_t)(device->memory_budget / (2 * chunk_size + QED_RECORD_OVERHEAD));
+    }
+    if (batch_size == 0) {
+        batch_size = 1;
+    }
+    
+    batch.hw_sig = &device->hardware_sig;
+    batch.key = record_key;
+    batch.cipher = device->cipher;
+    batch.header = header;
+    if (device->mac == QED_MAC_HMAC_SHA256) {
+        result = qed_get_mac_state(device, key_id, &batch.mac);
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+    }
+    batch.chunk_size = chunk_size;
+    batch.chunk_count = chunk_count;
+    batch.old_digests = old_digests;
+    batch.old_count = old_count;
+    batch.generation = qed_get_le32(header + 40);
+    batch.old_generations = old_generations;
+    batch.generations = qed_mem_alloc(chunk_count * sizeof(uint32_t));
+    batch.digests = qed_mem_alloc(chunk_count * QED_DIGEST_LENGTH);
+    batch.plain = qed_buffer_alloc(device, batch_size * chunk_size);
+    batch.plain_lens = calloc(batch_size, sizeof(size_t));
+    batch.records = qed_buffer_alloc(device, batch_size * (chunk_size + QED_RECORD_OVERHEAD));
+    batch.record_lens = calloc(batch_size, sizeof(size_t));
+    batch.changed = calloc(batch_size, sizeof(bool));
+    batch.results = calloc(batch_size, sizeof(qed_result_t));
+    index = qed_mem_alloc(chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE);
+    
+    if (!batch.digests || !batch.plain || !batch.plain_lens || !batch.records ||
+        !batch.record_lens || !batch.changed || !batch.results || !batch.generations || !index) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    // From here on the old manifest no longer describes the file
+    unlink(manifest_path);
+    
+    input = fopen(input_path, "rb");
+    fd = open(output_path, O_RDWR | O_CREAT | (old_digests ? 0 : O_TRUNC), 0644);
+    if (!input || fd < 0) {
+        result = QED_ERROR_FILE_IO;
+        goto cleanup;
+    }
+    
+    for (i = 0; i < chunk_count; i += batch_size) {
+        size_t count = chunk_count - i < batch_size ? (size_t)(chunk_count - i) : batch_size;
+        
+        QED_STAGE_BEGIN(read_start);
+        QED_PROBE(file__read__start);
+        for (slot = 0; slot < count; slot++) {
+            uint64_t chunk = i + slot;
+            size_t plain_len = (size_t)(chunk + 1 < chunk_count ?
+                chunk_size : plaintext_size - chunk * chunk_size);
+            
+            if (fread(batch.plain + slot * chunk_size, 1, plain_len, input) != plain_len) {
+                result = QED_ERROR_FILE_IO;
+                goto cleanup;
+            }
+            batch.plain_lens[slot] = plain_len;
+        }
+        QED_STAGE_END(QED_STAGE_FILE_READ, read_start, (uint64_t)count * chunk_size);
+        QED_PROBE1(file__read__done, (uint64_t)count * chunk_size);
+        
+        batch.first_index = i;
+        qed_parallel_for(count, qed_incremental_worker, &batch);
+        
+        for (slot = 0; slot < count; slot++) {
+            uint64_t chunk = i + slot;
+            uint64_t offset = qed_incremental_record_offset(chunk_size, chunk);
+            uint8_t *entry = index + chunk * QED_CHUNKED_INDEX_ENTRY_SIZE;
+            size_t record_len = qed_record_length(device->cipher, batch.plain_lens[slot]);
+            
+            if (batch.results[slot] != QED_SUCCESS) {
+                result = batch.results[slot];
+                goto cleanup;
+            }
+            
+            if (batch.changed[slot]) {
+                QED_STAGE_BEGIN(write_start);
+                QED_PROBE(file__write__start);
+                result = qed_pwrite_full(fd, batch.records + slot * (chunk_size + QED_RECORD_OVERHEAD),
+                                         batch.record_lens[slot], offset);
+                if (result != QED_SUCCESS) {
+                    goto cleanup;
+                }
+                QED_STAGE_END(QED_STAGE_FILE_WRITE, write_start, batch.record_lens[slot]);
+                QED_PROBE1(file__write__done, batch.record_lens[slot]);
+                totals.chunks_rewritten++;
+                totals.bytes_written += batch.record_lens[slot];
+            }
+            
+            qed_put_le64(entry, offset);
+            qed_put_le32(entry + 8, (uint32_t)record_len);
+            qed_put_le32(entry + 12, (uint32_t)batch.plain_lens[slot]);
+        }
+    }
+    
+    // Header, generation table, index and footer always reflect the new size
+    records_end = chunk_count ?
+        qed_incremental_record_offset(chunk_size, chunk_count - 1) +
+        qed_record_length(device->cipher, (size_t)(plaintext_size - (chunk_count - 1) * chunk_size)) :
+        QED_CHUNKED_HEADER_SIZE;
+    
+    table_len = 4 + (size_t)chunk_count * 4;
+    table_record_len = qed_record_length(device->cipher, table_len);
+    table = qed_mem_alloc(table_len);
+    table_record = qed_mem_alloc(table_record_len + 16);
+    if (!table || !table_record) {
+        result = QED_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    qed_put_le32(table, batch.generation);
+    for (i = 0; i < chunk_count; i++) {
+        qed_put_le32(table + 4 + i * 4, batch.generations[i]);
+    }
+    
+    {
+        uint8_t aad[QED_CHUNKED_AAD_SIZE];
+        size_t aad_len = qed_chunked_aad(header, QED_CHUNKED_MAP_INDEX,
+                                         (uint32_t)table_record_len, true, 0, aad);
+        size_t sealed_len;
+        
+        result = qed_seal_record(&device->hardware_sig, record_key, batch.mac, device->cipher,
+                                 aad, aad_len, table, table_len, table_record, &sealed_len);
+        if (result == QED_SUCCESS && sealed_len != table_record_len) {
+            result = QED_ERROR_ENCRYPTION;
+        }
+        if (result != QED_SUCCESS) {
+            goto cleanup;
+        }
+    }
+    index_offset = records_end + table_record_len;
+    
+    memset(footer, 0, sizeof(footer));
+    qed_put_le64(footer, index_offset);
+    qed_put_le64(footer + 8, chunk_count);
+    memcpy(footer + 16, QED_CHUNKED_INDEX_MAGIC, 4);
+    qed_put_le32(footer + 20, (uint32_t)table_record_len);
+    
+    if (qed_pwrite_full(fd, header, sizeof(header), 0) != QED_SUCCESS ||
+        qed_pwrite_full(fd, table_record, table_record_len, records_end) != QED_SUCCESS ||
+        qed_pwrite_full(fd, index, chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE,
+                        index_offset) != QED_SUCCESS ||
+        qed_pwrite_full(fd, footer, sizeof(footer),
+                        index_offset + chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE) != QED_SUCCESS ||
+        ftruncate(fd, (off_t)(index_offset + chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE +
+                              sizeof(footer))) != 0 ||
+        fsync(fd) != 0) {
+        result = QED_ERROR_FILE_IO;
+        goto cleanup;
+    }
+    totals.bytes_written += sizeof(header) + table_record_len +
+                            chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE + sizeof(footer);
+    totals.chunks_total = chunk_count;
+    
+    result = qed_manifest_store(device, quantum_key, manifest_path, header, chunk_count,
+                                batch.digests);
+
+cleanup:
+    if (input) {
+        fclose(input);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (batch.plain) {
+        qed_secure_zero(batch.plain, batch_size * chunk_size);
+        qed_buffer_free(batch.plain, batch_size * chunk_size);
+    }
+    qed_mem_free(batch.digests, chunk_count * QED_DIGEST_LENGTH);
+    free(batch.plain_lens);
+    qed_buffer_free(batch.records, batch_size * (chunk_size + QED_RECORD_OVERHEAD));
+    free(batch.record_lens);
+    free(batch.changed);
+    free(batch.results);
+    qed_mem_free(index, chunk_count * QED_CHUNKED_INDEX_ENTRY_SIZE);
+    qed_mem_free(old_digests, old_count * QED_DIGEST_LENGTH);
+    qed_mem_free(old_generations, old_count * sizeof(uint32_t));
+    qed_mem_free(batch.generations, chunk_count * sizeof(uint32_t));
+    qed_mem_free(table, table_len);
+    qed_mem_free(table_record, table_record_len + 16);
+    free(manifest_path);
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    qed_secure_zero(record_key, sizeof(record_key));
+    
+    if (result != QED_SUCCESS) {
+        printf("❌ File encryption failed: %s\n", qed_get_error_string(result));
+        return result;
+    }
+    
+    if (stats) {
+        *stats = totals;
+    }
+    
+    QED_OP_END(QED_OP_FILE_ENCRYPT, op_start, plaintext_size);
+    printf("🔒 File encrypted incrementally: %s (%lu of %lu chunks rewritten)\n",
+           output_path, totals.chunks_rewritten, totals.chunks_total);
+    return QED_SUCCESS;
+}
@@ -0,0 +1,512 @@
+/*
+ * Quantum Encryption Device (QED) - Internal Definitions
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+#ifndef QUANTUM_INTERNAL_H
+#define QUANTUM_INTERNAL_H
+
+#include <string.h>
+#include <openssl/evp.h>
+#include "../include/quantum_encryption.h"
+
+/*
+ * Little-endian field helpers for on-disk headers
+ */
+static inline void qed_put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline void qed_put_le64(uint8_t *p, uint64_t v) {
+    qed_put_le32(p, (uint32_t)v);
+    qed_put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint32_t qed_get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t qed_get_le64(const uint8_t *p) {
+    return (uint64_t)qed_get_le32(p) | ((uint64_t)qed_get_le32(p + 4) << 32);
+}
+
+/*
+ * Keyed MAC (quantum_mac.c). The state holds the HMAC pad states for one
+ * key and may be shared by threads; per-message work uses a thread-local
+ * digest context.
+ */
+typedef struct qed_mac_state qed_mac_state_t;
+
+qed_mac_state_t* qed_mac_state_new(const qed_hardware_sig_t *hw_sig, const uint8_t *key);
+void qed_mac_state_free(qed_mac_state_t *state);
+
+// Cached state for a device key, created on first use
+qed_result_t qed_get_mac_state(qed_device_t *device, const char *key_id,
+                               const qed_mac_state_t **state);
+
+qed_result_t qed_mac_parts(const qed_mac_state_t *state,
+                           const uint8_t *const *parts, const size_t *lengths,
+                           size_t count, uint8_t *mac);
+
+// Streaming form: begin, EVP_DigestUpdate() the message, finish
+qed_result_t qed_mac_begin(const qed_mac_state_t *state, EVP_MD_CTX *ctx);
+qed_result_t qed_mac_finish(const qed_mac_state_t *state, EVP_MD_CTX *ctx, uint8_t *mac);
+
+/*
+ * Per-file subkeys (quantum_subkey.c). The state holds the HKDF pad states
+ * for one key and may be shared by threads; deriving a subkey allocates
+ * nothing.
+ */
+typedef struct qed_subkey_state qed_subkey_state_t;
+
+qed_subkey_state_t* qed_subkey_state_new(const qed_hardware_sig_t *hw_sig, const uint8_t *key);
+void qed_subkey_state_free(qed_subkey_state_t *state);
+
+// Cached state for a device key, created on first use
+qed_result_t qed_get_subkey_state(qed_device_t *device, const char *key_id,
+                                  const qed_subkey_state_t **state);
+
+void qed_subkey_derive(const qed_subkey_state_t *state, const uint8_t *salt, uint8_t *subkey);
+
+// The key a file is sealed with: the device key, or its subkey for salt
+qed_result_t qed_file_key(qed_device_t *device, const char *key_id, const uint8_t *salt,
+                          uint8_t *key);
+
+/*
+ * Sealed records: signature || IV || ciphertext
+ *
+ * The ciphertext is AES-256-CBC or an AEAD backend's output followed by its
+ * tag. The signature covers the caller's associated data, the IV, the
+ * ciphertext and the key, so a record cannot be moved to another position
+ * or file without detection when the associated data names that position.
+ * With a MAC state the signature is instead the keyed MAC of the associated
+ * data, IV and ciphertext.
+ */
+#define QED_IV_LENGTH 16
+#define QED_AEAD_TAG_LENGTH 16
+#define QED_RECORD_OVERHEAD (QED_SIGNATURE_LENGTH + QED_IV_LENGTH + 16)
+
+// Record length for an uncompressed payload: CBC padding always adds a
+// block, the AEAD backends add their tag
+static inline size_t qed_record_length(uint8_t cipher, size_t plain_len) {
+    return cipher == QED_CIPHER_AES_256_CBC ?
+        QED_RECORD_OVERHEAD + (plain_len & ~(size_t)15) : QED_RECORD_OVERHEAD + plain_len;
+}
+
+// Cipher backends (quantum_cipher.c); out and plain need in_len + 16 bytes
+bool qed_cipher_valid(uint8_t cipher);
+void qed_cpu_features(char *buffer, size_t size);
+qed_result_t qed_cipher_iv(uint8_t *iv);
+
+qed_result_t qed_cipher_encrypt(uint8_t cipher, const uint8_t *key, const uint8_t *iv,
+                                const uint8_t *aad, size_t aad_len,
+                                const uint8_t *plain, size_t plain_len,
+                                uint8_t *out, size_t *out_len);
+
+qed_result_t qed_cipher_decrypt(uint8_t cipher, const uint8_t *key, const uint8_t *iv,
+                                const uint8_t *aad, size_t aad_len,
+                                const uint8_t *in, size_t in_len,
+                                uint8_t *plain, size_t *plain_len);
+
+/*
+ * Batched SHA-256 (quantum_sha256.c): digest = SHA-256(data || suffix) for
+ * each job, spread over SIMD lanes when the CPU allows. Fails as a whole if
+ * the engine does; no digest is meaningful then.
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    const uint8_t *suffix;
+    size_t suffix_length;
+    uint8_t *digest;
+} qed_sha256_job_t;
+
+qed_result_t qed_sha256_batch(qed_sha256_job_t *jobs, size_t count);
+void qed_sha256_message(const qed_sha256_job_t *job);
+
+// Heap-free streaming SHA-256 on the single-stream engine
+typedef void (*qed_sha256_compress_fn)(uint32_t *state, const uint8_t *block);
+
+typedef struct {
+    uint32_t state[8];
+    uint8_t buffer[64];
+    size_t buffered;
+    uint64_t length;
+    qed_sha256_compress_fn compress;
+} qed_sha256_ctx_t;
+
+void qed_sha256_init(qed_sha256_ctx_t *ctx);
+void qed_sha256_update(qed_sha256_ctx_t *ctx, const void *data, size_t length);
+void qed_sha256_final(qed_sha256_ctx_t *ctx, uint8_t *digest);
+
+// Jobs handed to qed_sha256_batch() per call by the batch signature API
+#define QED_SIGNATURE_BATCH 64
+
+/*
+ * Small-message path (quantum_small.c): messages of up to
+ * QED_SMALL_MESSAGE_MAX bytes without compression are sealed and opened
+ * without heap allocations, writing straight into the caller's output.
+ * Build with -DQED_SMALL_MESSAGE_MAX=n to move the cutoff (0 disables it).
+ * Encryption needs QED_CIPHERTEXT_MAX(plaintext_len) bytes of output and
+ * decryption needs ciphertext_len - 48. The _into() functions take the
+ * same path at any size when the caller supplies the output.
+ */
+#ifndef QED_SMALL_MESSAGE_MAX
+#define QED_SMALL_MESSAGE_MAX 4096
+#endif
+
+bool qed_small_encrypt_eligible(const qed_device_t *device, size_t plaintext_len);
+bool qed_small_decrypt_eligible(const uint8_t *ciphertext, size_t ciphertext_len);
+
+qed_result_t qed_small_encrypt(qed_device_t *device, const char *key_id,
+                               const uint8_t *plaintext, size_t plaintext_len,
+                               uint8_t *ciphertext, size_t *ciphertext_len);
+
+qed_result_t qed_small_decrypt(qed_device_t *device, const char *key_id,
+                               const uint8_t *ciphertext, size_t ciphertext_len,
+                               uint8_t *plaintext, size_t capacity, size_t *plaintext_len);
+
+// Quantum signature over the concatenation of several buffers
+qed_result_t qed_signature_parts(const qed_hardware_sig_t *hw_sig,
+                                 const uint8_t *const *parts, const size_t *lengths,
+                                 size_t count, uint8_t *signature);
+
+qed_result_t qed_seal_record(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                             const qed_mac_state_t *mac, uint8_t cipher,
+                             const uint8_t *aad, size_t aad_len,
+                             const uint8_t *plain, size_t plain_len,
+                             uint8_t *record, size_t *record_len);
+
+// Checks a record's signature without decrypting it
+qed_result_t qed_verify_record(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                               const qed_mac_state_t *mac,
+                               const uint8_t *aad, size_t aad_len,
+                               const uint8_t *record, size_t record_len);
+
+// The plaintext buffer must hold the record's ciphertext length
+qed_result_t qed_open_record(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                             const qed_mac_state_t *mac, uint8_t cipher,
+                             const uint8_t *aad, size_t aad_len,
+                             const uint8_t *record, size_t record_len,
+                             uint8_t *plain, size_t *plain_len);
+
+/*
+ * Versioned buffer format produced by qed_quantum_encrypt() whenever an
+ * optional stage or a cipher other than AES-256-CBC is enabled:
+ *
+ *   "QED" 0x02, cipher, mac, compression, flags, plaintext length (u64)
+ *
+ * then the subkey salt when QED_BUFFER_FLAG_SUBKEY is set, and a sealed
+ * record whose signature covers the header and salt. Buffers without this
+ * header are the original signature || IV || ciphertext form.
+ */
+#define QED_BUFFER_MAGIC "QED\x02"
+#define QED_BUFFER_HEADER_SIZE 16
+#define QED_BUFFER_FLAG_SUBKEY 0x01
+
+// Header length including the salt, or 0 for unknown flags
+static inline size_t qed_buffer_header_len(const uint8_t *header) {
+    if (header[7] & ~QED_BUFFER_FLAG_SUBKEY) {
+        return 0;
+    }
+    return (header[7] & QED_BUFFER_FLAG_SUBKEY) ?
+        QED_BUFFER_HEADER_SIZE + QED_SUBKEY_SALT_LENGTH : QED_BUFFER_HEADER_SIZE;
+}
+
+// Compression (quantum_compress.c)
+double qed_estimate_entropy(const uint8_t *data, size_t length);
+size_t qed_compress_bound(size_t length);
+
+// Compresses unless the data looks incompressible or does not shrink, in
+// which case *used is QED_COMPRESSION_NONE and the caller stores it raw
+qed_result_t qed_compress_payload(qed_compression_t compression, int level,
+                                  const uint8_t *input, size_t input_len,
+                                  uint8_t *output, size_t output_cap, size_t *output_len,
+                                  qed_compression_t *used);
+
+qed_result_t qed_decompress_payload(qed_compression_t compression,
+                                    const uint8_t *input, size_t input_len,
+                                    uint8_t *output, size_t expected_len);
+
+// Parallel loops on the shared work-stealing pool (quantum_pool.c)
+typedef void (*qed_parallel_fn)(void *ctx, size_t index);
+
+size_t qed_parallel_workers(void);
+void qed_parallel_for(size_t count, qed_parallel_fn fn, void *ctx);
+
+// Same with at most workers threads (0 means the pool size); loops nested
+// inside it run inline
+void qed_parallel_for_workers(size_t count, size_t workers, qed_parallel_fn fn, void *ctx);
+
+// Pool lifetime: qed_init() acquires, qed_cleanup() releases and the last
+// release stops the workers. Configuring stops them too; the next loop
+// restarts them. Neither may be called from inside a loop.
+void qed_pool_acquire(void);
+void qed_pool_release(void);
+void qed_pool_configure(size_t workers, bool pin);
+
+// Sets ram_signature from ram_total and ram_available (quantum_core.c)
+qed_result_t qed_hash_ram_signature(qed_hardware_sig_t *hw_sig);
+
+// Hardware profiles (quantum_profile.c): a positive finite frequency and
+// at most ram_total bytes available
+bool qed_hardware_profile_valid(const qed_hardware_sig_t *profile);
+
+// File helpers (quantum_file_ops.c)
+qed_result_t qed_pread_full(int fd, void *buffer, size_t length, uint64_t offset);
+qed_result_t qed_pwrite_full(int fd, const void *buffer, size_t length, uint64_t offset);
+bool qed_file_exists(const char *filepath);
+bool qed_paths_are_same(const char *path1, const char *path2);
+
+// Large working buffers (quantum_memory.c); free with the allocated size
+void* qed_buffer_alloc(const qed_device_t *device, size_t size);
+void qed_buffer_free(void *buffer, size_t size);
+
+/*
+ * Working memory accounting (quantum_memory.c). qed_mem_alloc() is malloc()
+ * charged to the operation running on this thread; qed_mem_free() takes the
+ * charged size back. A buffer handed to the caller is disowned before the
+ * public function returns, and adopted again by a library caller that keeps
+ * it, so every charge is matched by the code that frees it.
+ *
+ * QED_MEM_SCOPE(op) charges the rest of the enclosing block to op unless an
+ * outer operation is already running; pool loops carry it to their workers.
+ */
+#define QED_MEM_NO_OP QED_OP_COUNT
+
+void* qed_mem_alloc(size_t size);
+void qed_mem_free(void *buffer, size_t size);
+void qed_mem_adopt(size_t size);
+void qed_mem_disown(size_t size);
+
+int qed_mem_current_op(void);
+int qed_mem_switch(int op);
+int qed_mem_enter(int op);
+void qed_mem_leave(int previous);
+
+static inline void qed_mem_scope_exit(int *previous) {
+    qed_mem_leave(*previous);
+}
+
+#define QED_MEM_SCOPE(op) \
+    int qed_mem_scope __attribute__((cleanup(qed_mem_scope_exit))) = qed_mem_enter(op)
+
+// Atomic output files (quantum_output.c). Data goes to a temporary file
+// that qed_output_commit() fsyncs and renames over path; on any failure
+// qed_output_abort() removes it. size_hint (0 if unknown) is reserved up
+// front. path must stay valid until commit or abort.
+typedef struct {
+    int fd;
+    const char *path;
+    char *temp_path;
+    uint8_t *block;
+    size_t staged;
+    uint64_t written;
+    uint64_t flushed;
+    uint64_t released;
+    uint64_t reserved;
+    bool direct;
+    bool stamped;
+    uint32_t mode;
+    int64_t mtime;
+} qed_output_t;
+
+qed_result_t qed_output_open(qed_output_t *out, const qed_device_t *device, const char *path,
+                             uint64_t size_hint);
+qed_result_t qed_output_write(qed_output_t *out, const void *data, size_t length);
+// Leaves length bytes unwritten, a hole in the file unless the size was
+// reserved up front
+qed_result_t qed_output_skip(qed_output_t *out, uint64_t length);
+// Permission bits and modification time (seconds) to give the file; set on
+// the temporary file by qed_output_commit() after the last write and before
+// the rename
+void qed_output_stamp(qed_output_t *out, uint32_t mode, int64_t mtime);
+qed_result_t qed_output_commit(qed_output_t *out);
+void qed_output_abort(qed_output_t *out);
+
+// Chunked files (quantum_chunked.c)
+#define QED_CHUNKED_MAGIC "QEDS"
+#define QED_CHUNKED_INDEX_MAGIC "QEDI"
+#define QED_CHUNKED_VERSION 2
+#define QED_CHUNKED_HEADER_SIZE 48
+#define QED_CHUNKED_FOOTER_SIZE 24
+#define QED_CHUNKED_INDEX_ENTRY_SIZE 16
+#define QED_CHUNKED_AAD_SIZE (QED_CHUNKED_HEADER_SIZE + 13)
+
+// Header flag: chunks are sealed with the subkey salted by the file id
+#define QED_CHUNKED_FLAG_SUBKEY 0x01
+// Header flag: chunks lying in holes of the source have no record; a sealed
+// hole map just before the index lists them, its length in the footer's
+// last four bytes
+#define QED_CHUNKED_FLAG_SPARSE 0x02
+// Header flag: the header's bytes 40..43 hold a generation, bumped by each
+// incremental run, and a sealed generation table just before the index
+// gives the one each chunk was sealed in; its length is in the footer's
+// last four bytes. Never combined with QED_CHUNKED_FLAG_SPARSE.
+#define QED_CHUNKED_FLAG_GENERATIONS 0x04
+
+// Chunk number the hole map or generation table record is sealed under
+#define QED_CHUNKED_MAP_INDEX UINT64_MAX
+
+// Largest record one chunk can produce: a compressed chunk's method byte
+// may push an AEAD record one byte past chunk_size + QED_RECORD_OVERHEAD
+#define QED_CHUNKED_RECORD_MAX(chunk_size) ((size_t)(chunk_size) + QED_RECORD_OVERHEAD + 16)
+
+typedef struct {
+    int fd;
+    uint8_t header[QED_CHUNKED_HEADER_SIZE];
+    uint32_t chunk_size;
+    uint8_t cipher;
+    uint8_t mac;
+    uint8_t compression;
+    uint64_t plaintext_size;
+    uint64_t chunk_count;
+    uint64_t index_offset;
+    uint32_t map_len;                   // hole map or generation table record
+    uint64_t *holes;
+    size_t hole_runs;
+    uint32_t *generations;              // one per chunk
+} qed_chunked_reader_t;
+
+// Builds the associated data signed with a chunk sealed in the given
+// generation (0 unless the header has QED_CHUNKED_FLAG_GENERATIONS);
+// returns its length
+size_t qed_chunked_aad(const uint8_t *header, uint64_t index, uint32_t plain_len,
+                       bool final, uint32_t generation, uint8_t *aad);
+
+qed_result_t qed_chunked_open(const char *path, qed_chunked_reader_t *reader);
+void qed_chunked_close(qed_chunked_reader_t *reader);
+
+// MAC state matching the file's signature mode (NULL for quantum signatures)
+qed_result_t qed_chunked_mac_state(qed_device_t *device, const char *key_id,
+                                   const qed_chunked_reader_t *reader,
+                                   const qed_mac_state_t **mac);
+
+// Key the file's chunks are sealed with
+qed_result_t qed_chunked_file_key(qed_device_t *device, const char *key_id,
+                                  const qed_chunked_reader_t *reader, uint8_t *key);
+
+// Loads and verifies a sparse file's hole map or an incremental file's
+// generation table (a no-op for other files); must precede reading chunks
+qed_result_t qed_chunked_load_map(qed_chunked_reader_t *reader,
+                                  const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                                  const qed_mac_state_t *mac);
+
+// Whether the loaded hole map covers the chunk
+bool qed_chunked_is_hole(const qed_chunked_reader_t *reader, uint64_t index);
+
+// Reads one chunk's record after checking its index entry, and builds the
+// associated data its signature covers. The record buffer must hold
+// QED_CHUNKED_RECORD_MAX(chunk_size) bytes, the AAD QED_CHUNKED_AAD_SIZE.
+qed_result_t qed_chunked_fetch_record(qed_chunked_reader_t *reader, uint64_t index,
+                                      uint8_t *record, size_t *record_len,
+                                      uint8_t *aad, size_t *aad_len);
+
+// Reads, verifies and decrypts one chunk; a hole chunk reads as zeros. The
+// record and plaintext buffers must hold QED_CHUNKED_RECORD_MAX(chunk_size)
+// bytes.
+qed_result_t qed_chunked_read_chunk(qed_chunked_reader_t *reader,
+                                    const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                                    const qed_mac_state_t *mac, uint64_t index,
+                                    uint8_t *record, uint8_t *plain,
+                                    size_t *plain_len);
+
+qed_result_t qed_decrypt_file_chunked(qed_device_t *device, const char *key_id,
+                                      const char *input_path, const char *output_path);
+
+// Streams a chunked file into a new one under new_key_id (qed_rekey_file())
+qed_result_t qed_rekey_file_chunked(qed_device_t *device, const char *old_key_id,
+                                    const char *new_key_id, const char *input_path,
+                                    const char *output_path);
+
+/*
+ * Stage instrumentation
+ *
+ * QED_STAGE_BEGIN() only reads the clock while statistics or tracing are
+ * enabled, so a disabled build pays a single predictable branch per stage.
+ * Define QED_NO_STATS to compile the instrumentation out entirely.
+ */
+#define QED_STATS_FLAG_COUNTERS 0x1
+#define QED_STATS_FLAG_TRACE    0x2
+
+extern int qed_stats_active;
+
+uint64_t qed_stats_now_ns(void);
+void qed_stats_record(qed_stage_t stage, uint64_t start_ns, uint64_t bytes);
+void qed_stats_key_lookup(bool hit);
+void qed_latency_record(qed_op_t op, uint64_t start_ns, uint64_t bytes);
+
+// Trace ring buffer (quantum_trace.c)
+void qed_trace_record(const char *name, const char *category,
+                      uint64_t start_ns, uint64_t end_ns, uint64_t bytes);
+
+#ifdef QED_NO_STATS
+#define QED_STAGE_BEGIN(var) uint64_t var = 0
+#define QED_STAGE_END(stage, var, bytes) do { (void)(var); } while (0)
+#define QED_STATS_KEY_LOOKUP(hit) do { } while (0)
+#define QED_OP_BEGIN(var) uint64_t var = 0
+#define QED_OP_END(op, var, bytes) do { (void)(var); } while (0)
+#else
+#define QED_STAGE_BEGIN(var) \
+    uint64_t var = __builtin_expect(qed_stats_active, 0) ? qed_stats_now_ns() : 0
+#define QED_STAGE_END(stage, var, bytes) do { \
+    if (__builtin_expect((var) != 0, 0)) { \
+        qed_stats_record((stage), (var), (bytes)); \
+    } \
+} while (0)
+#define QED_STATS_KEY_LOOKUP(hit) do { \
+    if (__builtin_expect(qed_stats_active, 0)) { \
+        qed_stats_key_lookup(hit); \
+    } \
+} while (0)
+#define QED_OP_BEGIN(var) QED_STAGE_BEGIN(var)
+#define QED_OP_END(op, var, bytes) do { \
+    if (__builtin_expect((var) != 0, 0)) { \
+        qed_latency_record((op), (var), (bytes)); \
+    } \
+} while (0)
+#endif
+
+/*
+ * USDT probes
+ *
+ * Static probe points for perf and bpftrace under the "qed" provider (see
+ * tools/bpftrace). An untraced probe is a single nop: its arguments are
+ * values the code already holds, never computed for the probe. Key-ID
+ * hashes are computed once, when a key enters the cache, and carried by the
+ * key probes; operations on the same thread that follow are attributed to
+ * that key. Without <sys/sdt.h>, or with QED_NO_USDT defined, the probes
+ * compile to nothing.
+ */
+#if !defined(QED_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define QED_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef QED_HAVE_USDT
+#define QED_PROBE(name) DTRACE_PROBE(qed, name)
+#define QED_PROBE1(name, a) DTRACE_PROBE1(qed, name, a)
+#define QED_PROBE2(name, a, b) DTRACE_PROBE2(qed, name, a, b)
+#define QED_PROBE3(name, a, b, c) DTRACE_PROBE3(qed, name, a, b, c)
+#else
+#define QED_PROBE(name) do { } while (0)
+#define QED_PROBE1(name, a) do { } while (0)
+#define QED_PROBE2(name, a, b) do { } while (0)
+#define QED_PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+// FNV-1a of a key ID, as carried by the key probes
+uint32_t qed_key_id_hash(const char *key_id);
+
+#endif // QUANTUM_INTERNAL_H
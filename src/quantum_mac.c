@@ -0,0 +1,283 @@
+/*
+ * Quantum Encryption Device (QED) - Keyed MAC Signatures
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * HMAC-SHA-256 keyed by SHA-256("QED-HMAC" || key || quantum noise), so a
+ * signature is still bound to both the key and this hardware. Unlike the
+ * original signature, where the noise is a suffix of every message, the
+ * key is absorbed up front: the ipad and opad compressions are done once
+ * per key and each message starts from a copy of those states.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#define QED_MAC_BLOCK_SIZE 64
+#define QED_MAC_LABEL "QED-HMAC"
+
+struct qed_mac_state {
+    EVP_MD_CTX *inner;
+    EVP_MD_CTX *outer;
+};
+
+// One reusable digest context per thread for cloning the pad states into
+static pthread_key_t mac_scratch_key;
+static pthread_once_t mac_scratch_once = PTHREAD_ONCE_INIT;
+
+static void qed_mac_scratch_free(void *ctx) {
+    EVP_MD_CTX_free(ctx);
+}
+
+static void qed_mac_scratch_init(void) {
+    pthread_key_create(&mac_scratch_key, qed_mac_scratch_free);
+}
+
+static EVP_MD_CTX* qed_mac_scratch(void) {
+    EVP_MD_CTX *ctx;
+    
+    pthread_once(&mac_scratch_once, qed_mac_scratch_init);
+    ctx = pthread_getspecific(mac_scratch_key);
+    if (!ctx) {
+        ctx = EVP_MD_CTX_new();
+        if (ctx && pthread_setspecific(mac_scratch_key, ctx) != 0) {
+            EVP_MD_CTX_free(ctx);
+            ctx = NULL;
+        }
+    }
+    return ctx;
+}
+
+qed_result_t qed_set_mac(qed_device_t *device, qed_mac_t mac) {
+    if (!device) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (mac != QED_MAC_QUANTUM && mac != QED_MAC_HMAC_SHA256) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    device->mac = (uint8_t)mac;
+    return QED_SUCCESS;
+}
+
+qed_mac_state_t* qed_mac_state_new(const qed_hardware_sig_t *hw_sig, const uint8_t *key) {
+    uint8_t material[sizeof(QED_MAC_LABEL) - 1 + QED_KEY_LENGTH + QED_QUANTUM_NOISE_LENGTH];
+    uint8_t mac_key[QED_SIGNATURE_LENGTH];
+    uint8_t pad[QED_MAC_BLOCK_SIZE];
+    size_t noise_len, material_len = 0;
+    qed_mac_state_t *state;
+    int ok;
+    size_t i;
+    
+    if (!hw_sig || !key) {
+        return NULL;
+    }
+    
+    state = calloc(1, sizeof(qed_mac_state_t));
+    if (!state) {
+        return NULL;
+    }
+    
+    noise_len = strnlen(hw_sig->quantum_noise, QED_QUANTUM_NOISE_LENGTH);
+    memcpy(material, QED_MAC_LABEL, sizeof(QED_MAC_LABEL) - 1);
+    material_len += sizeof(QED_MAC_LABEL) - 1;
+    memcpy(material + material_len, key, QED_KEY_LENGTH);
+    material_len += QED_KEY_LENGTH;
+    memcpy(material + material_len, hw_sig->quantum_noise, noise_len);
+    material_len += noise_len;
+    
+    state->inner = EVP_MD_CTX_new();
+    state->outer = EVP_MD_CTX_new();
+    ok = state->inner && state->outer &&
+         EVP_Digest(material, material_len, mac_key, NULL, EVP_sha256(), NULL) == 1;
+    
+    if (ok) {
+        memset(pad, 0x36, sizeof(pad));
+        for (i = 0; i < sizeof(mac_key); i++) {
+            pad[i] ^= mac_key[i];
+        }
+        ok = EVP_DigestInit_ex(state->inner, EVP_sha256(), NULL) == 1 &&
+             EVP_DigestUpdate(state->inner, pad, sizeof(pad)) == 1;
+    }
+    
+    if (ok) {
+        memset(pad, 0x5c, sizeof(pad));
+        for (i = 0; i < sizeof(mac_key); i++) {
+            pad[i] ^= mac_key[i];
+        }
+        ok = EVP_DigestInit_ex(state->outer, EVP_sha256(), NULL) == 1 &&
+             EVP_DigestUpdate(state->outer, pad, sizeof(pad)) == 1;
+    }
+    
+    qed_secure_zero(material, sizeof(material));
+    qed_secure_zero(mac_key, sizeof(mac_key));
+    qed_secure_zero(pad, sizeof(pad));
+    
+    if (!ok) {
+        qed_mac_state_free(state);
+        return NULL;
+    }
+    
+    return state;
+}
+
+void qed_mac_state_free(qed_mac_state_t *state) {
+    if (!state) {
+        return;
+    }
+    
+    // EVP_MD_CTX_free() cleanses the digest state
+    EVP_MD_CTX_free(state->inner);
+    EVP_MD_CTX_free(state->outer);
+    free(state);
+}
+
+qed_result_t qed_mac_begin(const qed_mac_state_t *state, EVP_MD_CTX *ctx) {
+    if (!state || !ctx || EVP_MD_CTX_copy_ex(ctx, state->inner) != 1) {
+        return QED_ERROR_ENCRYPTION;
+    }
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_mac_finish(const qed_mac_state_t *state, EVP_MD_CTX *ctx, uint8_t *mac) {
+    uint8_t inner_hash[QED_SIGNATURE_LENGTH];
+    int ok;
+    
+    ok = EVP_DigestFinal_ex(ctx, inner_hash, NULL) == 1 &&
+         EVP_MD_CTX_copy_ex(ctx, state->outer) == 1 &&
+         EVP_DigestUpdate(ctx, inner_hash, sizeof(inner_hash)) == 1 &&
+         EVP_DigestFinal_ex(ctx, mac, NULL) == 1;
+    qed_secure_zero(inner_hash, sizeof(inner_hash));
+    
+    return ok ? QED_SUCCESS : QED_ERROR_ENCRYPTION;
+}
+
+qed_result_t qed_mac_parts(const qed_mac_state_t *state,
+                           const uint8_t *const *parts, const size_t *lengths,
+                           size_t count, uint8_t *mac) {
+    EVP_MD_CTX *ctx = qed_mac_scratch();
+    size_t total = 0;
+    size_t i;
+    qed_result_t result;
+    
+    if (!ctx) {
+        return QED_ERROR_MEMORY;
+    }
+    
+    QED_STAGE_BEGIN(stage_start);
+    
+    result = qed_mac_begin(state, ctx);
+    for (i = 0; result == QED_SUCCESS && i < count; i++) {
+        if (lengths[i] > 0 && EVP_DigestUpdate(ctx, parts[i], lengths[i]) != 1) {
+            result = QED_ERROR_ENCRYPTION;
+        }
+        total += lengths[i];
+    }
+    
+    if (result == QED_SUCCESS) {
+        result = qed_mac_finish(state, ctx, mac);
+    }
+    
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    QED_STAGE_END(QED_STAGE_MAC, stage_start, total);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_get_mac_state(qed_device_t *device, const char *key_id,
+                               const qed_mac_state_t **state) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    qed_quantum_key_t *slot = NULL;
+    qed_result_t result;
+    size_t i;
+    
+    if (!device || !key_id || !state) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    // Makes sure the key exists in the device cache
+    result = qed_generate_quantum_key(device, key_id, quantum_key, QED_KEY_LENGTH);
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    for (i = 0; i < device->key_count; i++) {
+        if (device->quantum_keys[i].in_use &&
+            strcmp(device->quantum_keys[i].key_id, key_id) == 0) {
+            slot = &device->quantum_keys[i];
+            break;
+        }
+    }
+    
+    if (!slot) {
+        return QED_ERROR_KEY_NOT_FOUND;
+    }
+    
+    if (!slot->mac_state) {
+        slot->mac_state = qed_mac_state_new(&device->hardware_sig, slot->key_data);
+        if (!slot->mac_state) {
+            return QED_ERROR_MEMORY;
+        }
+    }
+    
+    *state = slot->mac_state;
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_generate_keyed_signature(qed_device_t *device, const char *key_id,
+                                         const uint8_t *data, size_t data_len,
+                                         uint8_t *signature) {
+    const qed_mac_state_t *state;
+    qed_result_t result;
+    
+    if (!device || !key_id || (!data && data_len > 0) || !signature) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    result = qed_get_mac_state(device, key_id, &state);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    return qed_mac_parts(state, &data, &data_len, 1, signature);
+}
+
+qed_result_t qed_verify_keyed_signature(qed_device_t *device, const char *key_id,
+                                       const uint8_t *data, size_t data_len,
+                                       const uint8_t *signature) {
+    uint8_t computed_signature[QED_SIGNATURE_LENGTH];
+    qed_result_t result;
+    
+    if (!signature) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    result = qed_generate_keyed_signature(device, key_id, data, data_len, computed_signature);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    if (CRYPTO_memcmp(signature, computed_signature, QED_SIGNATURE_LENGTH) != 0) {
+        qed_secure_zero(computed_signature, sizeof(computed_signature));
+        return QED_ERROR_SIGNATURE_MISMATCH;
+    }
+    
+    qed_secure_zero(computed_signature, sizeof(computed_signature));
+    return QED_SUCCESS;
+}
@@ -0,0 +1,292 @@
+/*
+ * Quantum Encryption Device (QED) - Large Working Buffers
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Buffers of 2 MiB and more (whole-file reads, chunk batches) are mapped
+ * directly instead of taken from malloc, starting on a 2 MiB boundary so
+ * the kernel can back them with huge pages and cut TLB misses while the
+ * cipher streams through them:
+ *
+ *   QED_HUGE_PAGES_NONE         no request (the THP "always" policy may
+ *                               still apply)
+ *   QED_HUGE_PAGES_TRANSPARENT  madvise(MADV_HUGEPAGE); needs transparent
+ *                               huge pages in "madvise" or "always" mode
+ *   QED_HUGE_PAGES_EXPLICIT     MAP_HUGETLB from the reserved pool
+ *                               (vm.nr_hugepages), falling back to
+ *                               transparent huge pages when it is empty
+ *
+ * Smaller buffers come from malloc in every mode. Whether a buffer was
+ * mapped depends only on its size, so freeing needs no bookkeeping.
+ *
+ * Working buffers, and every other buffer that grows with the data, are
+ * also counted: bytes held now, the most ever held and allocations made,
+ * per operation type and for the library as a whole. The operation is a
+ * thread-local set by QED_MEM_SCOPE(); counters are relaxed atomics, so
+ * the cost is a few uncontended adds per buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#define QED_HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+typedef struct {
+    uint64_t current;
+    uint64_t peak;
+    uint64_t allocations;
+} qed_mem_counter_t;
+
+// One counter per operation, one for memory outside any, and the total
+static qed_mem_counter_t mem_ops[QED_OP_COUNT + 1];
+static qed_mem_counter_t mem_total;
+static __thread int mem_op = QED_MEM_NO_OP;
+
+static const char* mem_units[] = {"B", "KB", "MB", "GB", "TB"};
+
+static void qed_mem_raise_peak(uint64_t *peak, uint64_t value) {
+    uint64_t seen = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    
+    while (value > seen &&
+           !__atomic_compare_exchange_n(peak, &seen, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // seen was refreshed by the failed exchange
+    }
+}
+
+static void qed_mem_charge(qed_mem_counter_t *counter, size_t size, bool allocation) {
+    qed_mem_raise_peak(&counter->peak,
+                       __atomic_add_fetch(&counter->current, size, __ATOMIC_RELAXED));
+    if (allocation) {
+        __atomic_add_fetch(&counter->allocations, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void qed_mem_count(size_t size, bool allocation) {
+    qed_mem_charge(&mem_ops[mem_op], size, allocation);
+    qed_mem_charge(&mem_total, size, allocation);
+}
+
+static void qed_mem_uncount(size_t size) {
+    __atomic_sub_fetch(&mem_ops[mem_op].current, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&mem_total.current, size, __ATOMIC_RELAXED);
+}
+
+void* qed_mem_alloc(size_t size) {
+    void *buffer = malloc(size ? size : 1);
+    
+    if (buffer) {
+        qed_mem_count(size, true);
+    }
+    return buffer;
+}
+
+void qed_mem_free(void *buffer, size_t size) {
+    if (buffer) {
+        free(buffer);
+        qed_mem_uncount(size);
+    }
+}
+
+void qed_mem_adopt(size_t size) {
+    qed_mem_count(size, false);
+}
+
+void qed_mem_disown(size_t size) {
+    qed_mem_uncount(size);
+}
+
+int qed_mem_current_op(void) {
+    return mem_op;
+}
+
+// Charges this thread to op, whatever ran before; returns the previous op
+int qed_mem_switch(int op) {
+    int previous = mem_op;
+    
+    if (op >= 0 && op <= QED_MEM_NO_OP) {
+        mem_op = op;
+    }
+    return previous;
+}
+
+int qed_mem_enter(int op) {
+    int previous = mem_op;
+    
+    if (previous == QED_MEM_NO_OP && op >= 0 && op <= QED_MEM_NO_OP) {
+        mem_op = op;
+    }
+    return previous;
+}
+
+void qed_mem_leave(int previous) {
+    mem_op = previous;
+}
+
+static size_t qed_buffer_mapped_size(size_t size) {
+    return (size + QED_HUGE_PAGE_SIZE - 1) & ~(QED_HUGE_PAGE_SIZE - 1);
+}
+
+void* qed_buffer_alloc(const qed_device_t *device, size_t size) {
+    uint8_t huge_pages = device ? device->huge_pages : QED_HUGE_PAGES_NONE;
+    uint8_t *map, *aligned;
+    size_t length, head;
+    
+    if (size < QED_HUGE_PAGE_SIZE) {
+        return qed_mem_alloc(size);
+    }
+    
+    length = qed_buffer_mapped_size(size);
+    if (length < size || length + QED_HUGE_PAGE_SIZE < length) {
+        return NULL;
+    }
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    if (huge_pages == QED_HUGE_PAGES_EXPLICIT) {
+        map = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+        if (map != MAP_FAILED) {
+            qed_mem_count(size, true);
+            return map;
+        }
+    }
+#endif
+
+    // Over-map by one huge page and trim both ends to a 2 MiB boundary
+    map = mmap(NULL, length + QED_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    
+    head = (QED_HUGE_PAGE_SIZE - (uintptr_t)map % QED_HUGE_PAGE_SIZE) % QED_HUGE_PAGE_SIZE;
+    aligned = map + head;
+    if (head > 0) {
+        munmap(map, head);
+    }
+    munmap(aligned + length, QED_HUGE_PAGE_SIZE - head);
+
+#ifdef MADV_HUGEPAGE
+    if (huge_pages != QED_HUGE_PAGES_NONE) {
+        madvise(aligned, length, MADV_HUGEPAGE);
+    }
+#endif
+
+    qed_mem_count(size, true);
+    return aligned;
+}
+
+void qed_buffer_free(void *buffer, size_t size) {
+    if (!buffer) {
+        return;
+    }
+    
+    if (size < QED_HUGE_PAGE_SIZE) {
+        qed_mem_free(buffer, size);
+    } else {
+        munmap(buffer, qed_buffer_mapped_size(size));
+        qed_mem_uncount(size);
+    }
+}
+
+qed_result_t qed_set_huge_pages(qed_device_t *device, qed_huge_pages_t huge_pages) {
+    if (!device || huge_pages > QED_HUGE_PAGES_EXPLICIT) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    device->huge_pages = (uint8_t)huge_pages;
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_set_memory_budget(qed_device_t *device, uint64_t bytes) {
+    if (!device) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    device->memory_budget = bytes;
+    return QED_SUCCESS;
+}
+
+static void qed_mem_read(const qed_mem_counter_t *counter, qed_memory_usage_t *usage) {
+    usage->current_bytes = __atomic_load_n(&counter->current, __ATOMIC_RELAXED);
+    usage->peak_bytes = __atomic_load_n(&counter->peak, __ATOMIC_RELAXED);
+    usage->allocations = __atomic_load_n(&counter->allocations, __ATOMIC_RELAXED);
+}
+
+qed_result_t qed_get_memory_stats(qed_memory_stats_t *stats) {
+    int i;
+    
+    if (!stats) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    for (i = 0; i < QED_OP_COUNT; i++) {
+        qed_mem_read(&mem_ops[i], &stats->ops[i]);
+    }
+    qed_mem_read(&mem_total, &stats->total);
+    return QED_SUCCESS;
+}
+
+static void qed_mem_reset(qed_mem_counter_t *counter) {
+    __atomic_store_n(&counter->peak, __atomic_load_n(&counter->current, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&counter->allocations, 0, __ATOMIC_RELAXED);
+}
+
+void qed_reset_memory_stats(void) {
+    int i;
+    
+    // Best effort, like qed_reset_stats(): a racing update may survive
+    for (i = 0; i <= QED_OP_COUNT; i++) {
+        qed_mem_reset(&mem_ops[i]);
+    }
+    qed_mem_reset(&mem_total);
+}
+
+// Formats bytes with a binary unit, e.g. "12.5 MB"
+static void qed_mem_format(uint64_t bytes, char *buffer, size_t size) {
+    double value = (double)bytes;
+    size_t unit = 0;
+    
+    while (value >= 1024 && unit + 1 < sizeof(mem_units) / sizeof(mem_units[0])) {
+        value /= 1024;
+        unit++;
+    }
+    snprintf(buffer, size, unit ? "%.1f %s" : "%.0f %s", value, mem_units[unit]);
+}
+
+static void qed_mem_print_row(const char *name, const qed_memory_usage_t *usage) {
+    char current[32], peak[32];
+    
+    qed_mem_format(usage->current_bytes, current, sizeof(current));
+    qed_mem_format(usage->peak_bytes, peak, sizeof(peak));
+    printf("  %-14s %12s %12s %12llu\n", name, current, peak,
+           (unsigned long long)usage->allocations);
+}
+
+void qed_print_memory_stats(const qed_memory_stats_t *stats) {
+    int i;
+    
+    if (!stats) {
+        return;
+    }
+    
+    printf("Working Memory:\n");
+    printf("  %-14s %12s %12s %12s\n", "Operation", "Current", "Peak", "Allocations");
+    for (i = 0; i < QED_OP_COUNT; i++) {
+        if (stats->ops[i].allocations > 0 || stats->ops[i].peak_bytes > 0) {
+            qed_mem_print_row(qed_get_op_name((qed_op_t)i), &stats->ops[i]);
+        }
+    }
+    qed_mem_print_row("total", &stats->total);
+}
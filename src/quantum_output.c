@@ -0,0 +1,317 @@
+/*
+ * Quantum Encryption Device (QED) - Atomic Output Files
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Output files are written to a temporary file next to the target and
+ * renamed over it only after an fsync, so the target always holds either
+ * the old contents or the complete new ones, and a failed run leaves
+ * nothing behind.
+ *
+ * When the final size is known up front it is reserved with fallocate(),
+ * which fails fast on a full disk and keeps the file contiguous. Data goes
+ * out in 1 MiB blocks from a page-aligned buffer. Buffered writes are
+ * flushed one 8 MiB window behind the cursor and dropped from the page
+ * cache with POSIX_FADV_DONTNEED, so a multi-gigabyte output does not
+ * evict other processes' hot pages; O_DIRECT (qed_set_direct_io()) skips
+ * the page cache altogether where the filesystem supports it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#define QED_OUTPUT_BLOCK_SIZE (1024 * 1024)
+#define QED_OUTPUT_ALIGNMENT 4096
+#define QED_OUTPUT_WINDOW_SIZE (8 * 1024 * 1024)
+
+static unsigned qed_output_sequence;
+
+// Writes back and drops the page cache from the last release up to end
+static void qed_output_release(qed_output_t *out, uint64_t end) {
+    if (out->direct || end <= out->released) {
+        return;
+    }
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(out->fd, (off_t)out->released, (off_t)(end - out->released),
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                    SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+    fdatasync(out->fd);
+#endif
+    posix_fadvise(out->fd, (off_t)out->released, (off_t)(end - out->released),
+                  POSIX_FADV_DONTNEED);
+    out->released = end;
+}
+
+static qed_result_t qed_output_put(qed_output_t *out, const uint8_t *data, size_t length) {
+    qed_result_t result;
+    
+    result = qed_pwrite_full(out->fd, data, length, out->written);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    out->written += length;
+    
+    // Start writeback of the current window and release the one before
+    // it, so the flush overlaps with producing the next window
+    if (!out->direct && out->written - out->flushed >= QED_OUTPUT_WINDOW_SIZE) {
+        qed_output_release(out, out->flushed);
+#ifdef SYNC_FILE_RANGE_WRITE
+        sync_file_range(out->fd, (off_t)out->flushed, (off_t)(out->written - out->flushed),
+                        SYNC_FILE_RANGE_WRITE);
+#endif
+        out->flushed = out->written;
+    }
+    
+    return QED_SUCCESS;
+}
+
+// Continues through the page cache; O_DIRECT needs aligned offsets and
+// lengths
+static void qed_output_buffered(qed_output_t *out) {
+    if (out->direct) {
+        fcntl(out->fd, F_SETFL, fcntl(out->fd, F_GETFL) & ~O_DIRECT);
+        out->direct = false;
+        out->released = out->written;
+        out->flushed = out->written;
+    }
+}
+
+qed_result_t qed_output_open(qed_output_t *out, const qed_device_t *device, const char *path,
+                             uint64_t size_hint) {
+    struct stat st;
+    unsigned attempt;
+    
+    if (!out || !device || !path) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    memset(out, 0, sizeof(qed_output_t));
+    out->fd = -1;
+    out->path = path;
+    out->temp_path = malloc(strlen(path) + 32);
+    if (posix_memalign((void **)&out->block, QED_OUTPUT_ALIGNMENT, QED_OUTPUT_BLOCK_SIZE) != 0) {
+        out->block = NULL;
+    }
+    if (!out->temp_path || !out->block) {
+        qed_output_abort(out);
+        return QED_ERROR_MEMORY;
+    }
+    
+    for (attempt = 0; attempt < 16 && out->fd < 0; attempt++) {
+        sprintf(out->temp_path, "%s.%ld.%u.tmp", path, (long)getpid(),
+                __atomic_fetch_add(&qed_output_sequence, 1, __ATOMIC_RELAXED));
+        out->fd = open(out->temp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC |
+                       (device->direct_io ? O_DIRECT : 0), 0666);
+        if (out->fd < 0 && errno == EINVAL && device->direct_io) {
+            // The filesystem does not support O_DIRECT
+            out->fd = open(out->temp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        } else if (out->fd >= 0) {
+            out->direct = device->direct_io;
+        }
+        if (out->fd < 0 && errno != EEXIST) {
+            break;
+        }
+    }
+    
+    if (out->fd < 0) {
+        qed_output_abort(out);
+        return QED_ERROR_FILE_IO;
+    }
+    
+    // A replaced file keeps its permissions
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+        fchmod(out->fd, st.st_mode & 07777);
+    }
+    
+    if (size_hint > 0 && fallocate(out->fd, 0, 0, (off_t)size_hint) != 0 &&
+        (errno == ENOSPC || errno == EFBIG)) {
+        qed_output_abort(out);
+        return QED_ERROR_FILE_IO;
+    }
+    out->reserved = size_hint;
+    
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_output_write(qed_output_t *out, const void *data, size_t length) {
+    const uint8_t *p = data;
+    qed_result_t result;
+    
+    while (length > 0) {
+        size_t take;
+        
+        // Whole blocks bypass the staging buffer unless O_DIRECT needs the
+        // alignment
+        if (out->staged == 0 && !out->direct && length >= QED_OUTPUT_BLOCK_SIZE) {
+            take = length - length % QED_OUTPUT_BLOCK_SIZE;
+            result = qed_output_put(out, p, take);
+            if (result != QED_SUCCESS) {
+                return result;
+            }
+            p += take;
+            length -= take;
+            continue;
+        }
+        
+        take = QED_OUTPUT_BLOCK_SIZE - out->staged;
+        if (take > length) {
+            take = length;
+        }
+        memcpy(out->block + out->staged, p, take);
+        out->staged += take;
+        p += take;
+        length -= take;
+        
+        if (out->staged == QED_OUTPUT_BLOCK_SIZE) {
+            result = qed_output_put(out, out->block, out->staged);
+            if (result != QED_SUCCESS) {
+                return result;
+            }
+            out->staged = 0;
+        }
+    }
+    
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_output_skip(qed_output_t *out, uint64_t length) {
+    qed_result_t result = QED_SUCCESS;
+    
+    if (length == 0) {
+        return QED_SUCCESS;
+    }
+    
+    // Data after the hole rarely starts on a sector boundary
+    qed_output_buffered(out);
+    if (out->staged > 0) {
+        result = qed_output_put(out, out->block, out->staged);
+        out->staged = 0;
+    }
+    
+    // Nothing is written; commit's ftruncate() extends a file that ends in
+    // a hole
+    if (result == QED_SUCCESS) {
+        out->written += length;
+    }
+    return result;
+}
+
+// fsyncs the directory holding path so the rename itself is durable
+static void qed_output_sync_dir(const char *path) {
+    char *copy = strdup(path);
+    int fd;
+    
+    if (!copy) {
+        return;
+    }
+    fd = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(copy);
+}
+
+void qed_output_stamp(qed_output_t *out, uint32_t mode, int64_t mtime) {
+    out->stamped = true;
+    out->mode = mode & 07777;
+    out->mtime = mtime;
+}
+
+qed_result_t qed_output_commit(qed_output_t *out) {
+    qed_result_t result = QED_SUCCESS;
+    
+    if (out->staged > 0) {
+        // The tail is rarely a whole number of sectors, so it is written
+        // through the page cache
+        qed_output_buffered(out);
+        result = qed_output_put(out, out->block, out->staged);
+        out->staged = 0;
+    }
+    
+    if (result == QED_SUCCESS && out->reserved != out->written &&
+        ftruncate(out->fd, (off_t)out->written) != 0) {
+        result = QED_ERROR_FILE_IO;
+    }
+    if (result == QED_SUCCESS && out->stamped) {
+        struct timespec times[2];
+        
+        times[0].tv_sec = (time_t)out->mtime;
+        times[0].tv_nsec = 0;
+        times[1] = times[0];
+        if (fchmod(out->fd, (mode_t)out->mode) != 0 || futimens(out->fd, times) != 0) {
+            result = QED_ERROR_FILE_IO;
+        }
+    }
+    if (result == QED_SUCCESS && fsync(out->fd) != 0) {
+        result = QED_ERROR_FILE_IO;
+    }
+    if (result == QED_SUCCESS && out->written >= QED_OUTPUT_WINDOW_SIZE) {
+        qed_output_release(out, out->written);
+    }
+    if (close(out->fd) != 0 && result == QED_SUCCESS) {
+        result = QED_ERROR_FILE_IO;
+    }
+    out->fd = -1;
+    
+    if (result == QED_SUCCESS && rename(out->temp_path, out->path) != 0) {
+        result = QED_ERROR_FILE_IO;
+    }
+    if (result != QED_SUCCESS) {
+        qed_output_abort(out);
+        return result;
+    }
+    
+    qed_output_sync_dir(out->path);
+    free(out->temp_path);
+    out->temp_path = NULL;
+    qed_output_abort(out);
+    return QED_SUCCESS;
+}
+
+void qed_output_abort(qed_output_t *out) {
+    if (!out) {
+        return;
+    }
+    
+    if (out->fd >= 0) {
+        close(out->fd);
+        out->fd = -1;
+    }
+    if (out->temp_path) {
+        unlink(out->temp_path);
+        free(out->temp_path);
+        out->temp_path = NULL;
+    }
+    if (out->block) {
+        // The staging buffer may hold plaintext
+        qed_secure_zero(out->block, QED_OUTPUT_BLOCK_SIZE);
+        free(out->block);
+        out->block = NULL;
+    }
+}
+
+qed_result_t qed_set_direct_io(qed_device_t *device, bool enabled) {
+    if (!device) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    device->direct_io = enabled;
+    return QED_SUCCESS;
+}
@@ -0,0 +1,653 @@
+/*
+ * Quantum Encryption Device (QED) - Work-Stealing Thread Pool
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Every parallel loop in the library runs on one process-wide pool instead
+ * of threads spawned per call. qed_init() registers with the pool but the
+ * workers only start on the first loop; the last qed_cleanup() stops them.
+ *
+ * Each worker owns a deque of index ranges. A thread that takes a range
+ * splits it in half repeatedly, pushing the upper halves onto the bottom
+ * of its own deque, and runs the first item; it then pops its own deque
+ * from the bottom (most recently split, still warm in cache) while idle
+ * threads steal from the top, where the largest ranges are. Loops started
+ * from outside the pool use a shared deque instead.
+ *
+ * The thread that starts a loop helps run it and only takes items of that
+ * loop while waiting, so a loop started inside an item (a batch of files,
+ * each split into chunks) spreads over idle workers without ever running
+ * an unrelated item on top of the caller's stack.
+ *
+ * Workers can be pinned one per CPU. On machines with several NUMA nodes
+ * they are spread over the nodes round-robin and, when not pinned, kept
+ * within their node; each worker allocates its own deque after placement
+ * so first-touch puts it in local memory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "quantum_internal.h"
+
+#define QED_PARALLEL_MAX_THREADS 64
+#define QED_POOL_MAX_NODES 64
+#define QED_POOL_DEQUE_INITIAL 64
+
+typedef struct {
+    qed_parallel_fn fn;
+    void *ctx;
+    size_t remaining;           // items not finished yet
+    size_t active;              // threads inside one of its ranges
+    size_t limit;               // at most this many of them
+    int mem_op;                 // operation its memory is charged to
+} qed_pool_job_t;
+
+typedef struct {
+    qed_pool_job_t *job;
+    size_t begin;
+    size_t end;
+} qed_pool_range_t;
+
+// Ranges [head, tail); thieves take from head, the owner from tail
+typedef struct {
+    pthread_mutex_t lock;
+    qed_pool_range_t *ranges;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} qed_pool_deque_t;
+
+typedef struct {
+    qed_pool_deque_t deque;
+    pthread_t thread;
+    size_t index;
+    cpu_set_t cpus;             // where it may run, empty for anywhere
+} qed_pool_worker_t;
+
+// A loop wider than the pool, run on threads of its own
+typedef struct {
+    qed_parallel_fn fn;
+    void *ctx;
+    size_t count;
+    size_t next;
+    int mem_op;
+} qed_parallel_job_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        // work queued, loop finished or pool drained
+    qed_pool_worker_t *workers[QED_PARALLEL_MAX_THREADS];
+    size_t worker_count;
+    size_t ready;
+    size_t size;                // participants requested, 0 for one per CPU
+    bool pin;
+    bool started;
+    bool stopping;
+    size_t users;               // outermost loops in flight
+    size_t refs;                // initialized devices
+    unsigned generation;        // bumped whenever a sleeper should look again
+    unsigned sleepers;
+    qed_pool_deque_t shared;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .shared = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+
+// The worker this thread is, and how deep it is in nested loops
+static __thread qed_pool_worker_t *pool_self = NULL;
+static __thread unsigned pool_depth = 0;
+
+// Set while running an item of a loop with a thread limit, whose nested
+// loops then run inline to keep the total at that limit
+static __thread bool pool_serial = false;
+
+static void qed_pool_notify(void) {
+    __atomic_add_fetch(&pool.generation, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool.sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool.lock);
+        pthread_cond_broadcast(&pool.wake);
+        pthread_mutex_unlock(&pool.lock);
+    }
+}
+
+static bool qed_pool_claim(qed_pool_job_t *job) {
+    size_t active = __atomic_load_n(&job->active, __ATOMIC_RELAXED);
+    
+    do {
+        if (active >= job->limit) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&job->active, &active, active + 1, true,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    return true;
+}
+
+static bool qed_pool_push(qed_pool_deque_t *deque, qed_pool_range_t range) {
+    pthread_mutex_lock(&deque->lock);
+    
+    if (deque->tail == deque->capacity) {
+        size_t count = deque->tail - deque->head;
+        
+        if (deque->head > 0) {
+            memmove(deque->ranges, deque->ranges + deque->head, count * sizeof(qed_pool_range_t));
+        } else {
+            size_t capacity = deque->capacity ? deque->capacity * 2 : QED_POOL_DEQUE_INITIAL;
+            qed_pool_range_t *grown = realloc(deque->ranges, capacity * sizeof(qed_pool_range_t));
+            
+            if (!grown) {
+                pthread_mutex_unlock(&deque->lock);
+                return false;
+            }
+            deque->ranges = grown;
+            deque->capacity = capacity;
+        }
+        __atomic_store_n(&deque->head, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&deque->tail, count, __ATOMIC_RELAXED);
+    }
+    deque->ranges[deque->tail] = range;
+    __atomic_store_n(&deque->tail, deque->tail + 1, __ATOMIC_RELAXED);
+    
+    pthread_mutex_unlock(&deque->lock);
+    qed_pool_notify();
+    return true;
+}
+
+// Takes the first range of job (any job when NULL) that may get another
+// thread, scanning from the bottom for the owner and from the top for thieves
+static bool qed_pool_take(qed_pool_deque_t *deque, qed_pool_job_t *job, bool owner,
+                          qed_pool_range_t *range) {
+    size_t count, i;
+    
+    // Unlocked peek; a range pushed right after it bumps the generation,
+    // so the caller looks again before sleeping
+    if (__atomic_load_n(&deque->tail, __ATOMIC_RELAXED) ==
+        __atomic_load_n(&deque->head, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    
+    pthread_mutex_lock(&deque->lock);
+    count = deque->tail - deque->head;
+    for (i = 0; i < count; i++) {
+        size_t slot = owner ? deque->tail - 1 - i : deque->head + i;
+        qed_pool_range_t *candidate = &deque->ranges[slot];
+        
+        if ((job && candidate->job != job) || !qed_pool_claim(candidate->job)) {
+            continue;
+        }
+        
+        *range = *candidate;
+        if (slot == deque->head) {
+            __atomic_store_n(&deque->head, deque->head + 1, __ATOMIC_RELAXED);
+        } else {
+            memmove(candidate, candidate + 1, (deque->tail - slot - 1) * sizeof(qed_pool_range_t));
+            __atomic_store_n(&deque->tail, deque->tail - 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&deque->lock);
+        return true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return false;
+}
+
+static qed_pool_deque_t* qed_pool_home(void) {
+    return pool_self ? &pool_self->deque : &pool.shared;
+}
+
+// Own deque first, then the shared one, then the other workers from the
+// next one on so thieves do not all hit the same victim
+static bool qed_pool_find(qed_pool_job_t *job, qed_pool_range_t *range) {
+    size_t count = __atomic_load_n(&pool.ready, __ATOMIC_ACQUIRE);
+    size_t start = pool_self ? pool_self->index + 1 : 0;
+    size_t i;
+    
+    if (pool_self && qed_pool_take(&pool_self->deque, job, true, range)) {
+        return true;
+    }
+    if (qed_pool_take(&pool.shared, job, !pool_self, range)) {
+        return true;
+    }
+    for (i = 0; i < count; i++) {
+        qed_pool_worker_t *victim = pool.workers[(start + i) % count];
+        
+        if (victim != pool_self && qed_pool_take(&victim->deque, job, false, range)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs one claimed range: splits off upper halves for others, runs the
+// first item and releases the claim
+static void qed_pool_run(qed_pool_range_t range) {
+    qed_pool_job_t *job = range.job;
+    qed_pool_deque_t *home = qed_pool_home();
+    bool serial = pool_serial;
+    
+    while (range.end - range.begin > 1) {
+        size_t middle = range.begin + (range.end - range.begin) / 2;
+        qed_pool_range_t upper = { job, middle, range.end };
+        
+        if (!qed_pool_push(home, upper)) {
+            break;
+        }
+        range.end = middle;
+    }
+    
+    pool_serial = job->limit != SIZE_MAX;
+    pool_depth++;
+    int mem_op = qed_mem_switch(job->mem_op);
+    for (size_t index = range.begin; index < range.end; index++) {
+        job->fn(job->ctx, index);
+    }
+    qed_mem_leave(mem_op);
+    pool_depth--;
+    pool_serial = serial;
+    
+    __atomic_sub_fetch(&job->active, 1, __ATOMIC_RELEASE);
+    // The job may live on the starting thread's stack; do not touch it once
+    // its last item is counted
+    if (__atomic_sub_fetch(&job->remaining, range.end - range.begin, __ATOMIC_ACQ_REL) == 0) {
+        qed_pool_notify();
+    }
+}
+
+// Sleeps until the generation moves past seen, or until the loop with
+// remaining items is done (waiters) or the pool stops (workers)
+static void qed_pool_sleep(unsigned seen, const size_t *remaining) {
+    pthread_mutex_lock(&pool.lock);
+    __atomic_add_fetch(&pool.sleepers, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&pool.generation, __ATOMIC_SEQ_CST) == seen &&
+           !(remaining && __atomic_load_n(remaining, __ATOMIC_ACQUIRE) == 0) &&
+           !(!remaining && pool.stopping)) {
+        pthread_cond_wait(&pool.wake, &pool.lock);
+    }
+    __atomic_sub_fetch(&pool.sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// Reads a CPU list such as "0-3,8-11" into set
+static void qed_pool_parse_cpulist(const char *path, cpu_set_t *set) {
+    char line[4096];
+    char *p;
+    FILE *file;
+    
+    CPU_ZERO(set);
+    file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+    if (fgets(line, sizeof(line), file)) {
+        for (p = line; *p && *p != '\n'; ) {
+            long first = strtol(p, &p, 10), last = first;
+            
+            if (*p == '-') {
+                last = strtol(p + 1, &p, 10);
+            }
+            for (; first <= last && first < CPU_SETSIZE; first++) {
+                if (first >= 0) {
+                    CPU_SET((int)first, set);
+                }
+            }
+            if (*p != ',') {
+                break;
+            }
+            p++;
+        }
+    }
+    fclose(file);
+}
+
+// Gives each worker one CPU (when pinning) or its node's CPUs (when there
+// is more than one node), taking CPUs from the nodes in turn
+static void qed_pool_place(size_t count, bool pin) {
+    cpu_set_t node_cpus[QED_POOL_MAX_NODES];
+    size_t next[QED_POOL_MAX_NODES] = {0};
+    int order[CPU_SETSIZE];
+    int order_node[CPU_SETSIZE];
+    size_t order_count = 0;
+    cpu_set_t allowed;
+    int nodes = 0, node, cpu;
+    size_t i;
+    
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+    }
+    
+    for (node = 0; node < QED_POOL_MAX_NODES; node++) {
+        char path[64];
+        
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        qed_pool_parse_cpulist(path, &node_cpus[node]);
+        CPU_AND(&node_cpus[node], &node_cpus[node], &allowed);
+        if (CPU_COUNT(&node_cpus[node]) == 0) {
+            break;
+        }
+        nodes++;
+    }
+    if (nodes == 0) {
+        node_cpus[0] = allowed;
+        nodes = 1;
+    }
+    if (!pin && nodes == 1) {
+        return;
+    }
+    
+    // Interleave the nodes: the first CPU of each node, then the second, ...
+    for (;;) {
+        size_t before = order_count;
+        
+        for (node = 0; node < nodes; node++) {
+            for (cpu = (int)next[node]; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &node_cpus[node])) {
+                    order[order_count] = cpu;
+                    order_node[order_count++] = node;
+                    break;
+                }
+            }
+            next[node] = (size_t)cpu + 1;
+        }
+        if (order_count == before) {
+            break;
+        }
+    }
+    if (order_count == 0) {
+        return;
+    }
+    
+    // The first slot is left to the thread that starts the loops
+    for (i = 0; i < count; i++) {
+        size_t slot = (i + 1) % order_count;
+        
+        if (pin) {
+            CPU_SET(order[slot], &pool.workers[i]->cpus);
+        } else {
+            pool.workers[i]->cpus = node_cpus[order_node[slot]];
+        }
+    }
+}
+
+static void* qed_pool_worker_main(void *arg) {
+    qed_pool_worker_t *worker = arg;
+    qed_pool_range_t range;
+    
+    pool_self = worker;
+    
+    for (;;) {
+        unsigned seen = __atomic_load_n(&pool.generation, __ATOMIC_SEQ_CST);
+        
+        if (qed_pool_find(NULL, &range)) {
+            qed_pool_run(range);
+            continue;
+        }
+        if (__atomic_load_n(&pool.stopping, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        qed_pool_sleep(seen, NULL);
+    }
+    
+    pool_self = NULL;
+    return NULL;
+}
+
+static size_t qed_pool_online_cpus(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    if (cpus < 1) {
+        return 1;
+    }
+    return cpus > QED_PARALLEL_MAX_THREADS ? QED_PARALLEL_MAX_THREADS : (size_t)cpus;
+}
+
+size_t qed_parallel_workers(void) {
+    size_t size = __atomic_load_n(&pool.size, __ATOMIC_RELAXED);
+    
+    return size ? size : qed_pool_online_cpus();
+}
+
+// Starts the workers; called with pool.lock held
+static void qed_pool_start(void) {
+    size_t count = qed_parallel_workers() - 1;
+    size_t i;
+    
+    pool.started = true;
+    
+    // The threads that start loops take part in them, so one fewer worker
+    for (i = 0; i < count; i++) {
+        qed_pool_worker_t *worker = calloc(1, sizeof(qed_pool_worker_t));
+        
+        if (!worker) {
+            break;
+        }
+        pthread_mutex_init(&worker->deque.lock, NULL);
+        CPU_ZERO(&worker->cpus);
+        worker->index = i;
+        pool.workers[i] = worker;
+    }
+    count = i;
+    qed_pool_place(count, pool.pin);
+    
+    for (i = 0; i < count; i++) {
+        qed_pool_worker_t *worker = pool.workers[i];
+        pthread_attr_t attr;
+        
+        pthread_attr_init(&attr);
+        if (CPU_COUNT(&worker->cpus) > 0) {
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &worker->cpus);
+        }
+        
+        // Workers are published before they run so thieves see a stable
+        // array; a worker that fails to start is simply not counted
+        if (pthread_create(&worker->thread, &attr, qed_pool_worker_main, worker) != 0) {
+            pthread_attr_destroy(&attr);
+            break;
+        }
+        pthread_attr_destroy(&attr);
+        pool.worker_count++;
+        __atomic_store_n(&pool.ready, pool.worker_count, __ATOMIC_RELEASE);
+    }
+    
+    for (i = pool.worker_count; i < count; i++) {
+        pthread_mutex_destroy(&pool.workers[i]->deque.lock);
+        free(pool.workers[i]);
+        pool.workers[i] = NULL;
+    }
+}
+
+// Stops the workers once no loop is running; never call from inside a loop
+static void qed_pool_stop(void) {
+    size_t count, i;
+    
+    pthread_mutex_lock(&pool.lock);
+    while (pool.users > 0 || pool.stopping) {
+        pthread_cond_wait(&pool.wake, &pool.lock);
+    }
+    if (!pool.started) {
+        pthread_mutex_unlock(&pool.lock);
+        return;
+    }
+    __atomic_store_n(&pool.stopping, true, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool.wake);
+    count = pool.worker_count;
+    pthread_mutex_unlock(&pool.lock);
+    
+    for (i = 0; i < count; i++) {
+        pthread_join(pool.workers[i]->thread, NULL);
+    }
+    
+    pthread_mutex_lock(&pool.lock);
+    __atomic_store_n(&pool.ready, 0, __ATOMIC_RELEASE);
+    for (i = 0; i < count; i++) {
+        pthread_mutex_destroy(&pool.workers[i]->deque.lock);
+        free(pool.workers[i]->deque.ranges);
+        free(pool.workers[i]);
+        pool.workers[i] = NULL;
+    }
+    pool.worker_count = 0;
+    pool.started = false;
+    __atomic_store_n(&pool.stopping, false, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+void qed_pool_acquire(void) {
+    pthread_mutex_lock(&pool.lock);
+    pool.refs++;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+void qed_pool_release(void) {
+    bool last;
+    
+    pthread_mutex_lock(&pool.lock);
+    if (pool.refs > 0) {
+        pool.refs--;
+    }
+    last = pool.refs == 0;
+    pthread_mutex_unlock(&pool.lock);
+    
+    if (last) {
+        qed_pool_stop();
+    }
+}
+
+void qed_pool_configure(size_t workers, bool pin) {
+    if (workers > QED_PARALLEL_MAX_THREADS) {
+        workers = QED_PARALLEL_MAX_THREADS;
+    }
+    
+    // The new size takes effect when the next loop restarts the workers
+    qed_pool_stop();
+    pthread_mutex_lock(&pool.lock);
+    __atomic_store_n(&pool.size, workers, __ATOMIC_RELAXED);
+    pool.pin = pin;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void* qed_parallel_dedicated(void *arg) {
+    qed_parallel_job_t *job = arg;
+    bool serial = pool_serial;
+    size_t index;
+    int mem_op;
+    
+    pool_serial = true;
+    pool_depth++;
+    mem_op = qed_mem_switch(job->mem_op);
+    while ((index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+        job->fn(job->ctx, index);
+    }
+    qed_mem_leave(mem_op);
+    pool_depth--;
+    pool_serial = serial;
+    return NULL;
+}
+
+static void qed_parallel_spawn(size_t count, size_t workers, qed_parallel_fn fn, void *ctx) {
+    pthread_t threads[QED_PARALLEL_MAX_THREADS];
+    qed_parallel_job_t job = { fn, ctx, count, 0, qed_mem_current_op() };
+    size_t started = 0;
+    size_t i;
+    
+    for (i = 1; i < workers; i++) {
+        if (pthread_create(&threads[started], NULL, qed_parallel_dedicated, &job) != 0) {
+            break;
+        }
+        started++;
+    }
+    qed_parallel_dedicated(&job);
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+void qed_parallel_for(size_t count, qed_parallel_fn fn, void *ctx) {
+    qed_parallel_for_workers(count, 0, fn, ctx);
+}
+
+void qed_parallel_for_workers(size_t count, size_t workers, qed_parallel_fn fn, void *ctx) {
+    qed_pool_job_t job = { fn, ctx, count, 0, workers ? workers : SIZE_MAX,
+                           qed_mem_current_op() };
+    qed_pool_range_t range = { &job, 0, count };
+    bool outermost = !pool_self && pool_depth == 0;
+    
+    if (count == 0 || !fn) {
+        return;
+    }
+    
+    if (workers > QED_PARALLEL_MAX_THREADS) {
+        workers = QED_PARALLEL_MAX_THREADS;
+    }
+    
+    // Inline when there is nobody to share with
+    if (pool_serial || count == 1 || workers == 1 || qed_parallel_workers() == 1) {
+        bool serial = pool_serial;
+        size_t index;
+        
+        pool_serial = pool_serial || workers != 0;
+        for (index = 0; index < count; index++) {
+            fn(ctx, index);
+        }
+        pool_serial = serial;
+        return;
+    }
+    
+    // Explicitly wider than the pool (I/O-bound batches): dedicated threads
+    if (workers > qed_parallel_workers()) {
+        qed_parallel_spawn(count, workers > count ? count : workers, fn, ctx);
+        return;
+    }
+    
+    if (outermost) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.stopping) {
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        }
+        if (!pool.started) {
+            qed_pool_start();
+        }
+        pool.users++;
+        pthread_mutex_unlock(&pool.lock);
+    }
+    
+    // The starting thread is one of the participants
+    qed_pool_claim(&job);
+    qed_pool_run(range);
+    
+    while (__atomic_load_n(&job.remaining, __ATOMIC_ACQUIRE) > 0) {
+        unsigned seen = __atomic_load_n(&pool.generation, __ATOMIC_SEQ_CST);
+        
+        if (qed_pool_find(&job, &range)) {
+            qed_pool_run(range);
+            continue;
+        }
+        qed_pool_sleep(seen, &job.remaining);
+    }
+    
+    if (outermost) {
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.users == 0) {
+            pthread_cond_broadcast(&pool.wake);
+        }
+        pthread_mutex_unlock(&pool.lock);
+    }
+}
+
+qed_result_t qed_set_concurrency(qed_device_t *device, size_t threads, bool pin) {
+    if (!device || threads > QED_PARALLEL_MAX_THREADS) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    qed_pool_configure(threads, pin);
+    return QED_SUCCESS;
+}
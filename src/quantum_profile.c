@@ -0,0 +1,187 @@
+/*
+ * Quantum Encryption Device (QED) - Hardware Profiles
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Keys follow from the CPU frequency and from total and free RAM, so they
+ * move between hosts and even between runs on one host as free memory
+ * changes. A profile pins those three figures. Profile files hold one
+ * "field = value" pair per line, with '#' starting a comment:
+ *
+ *   cpu_frequency = 2400000000
+ *   ram_total = 17179869184
+ *   ram_available = 8589934592
+ *
+ * The frequency is written with full double precision so a saved profile
+ * reproduces the machine it was taken from exactly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#define QED_GIB (1024ULL * 1024 * 1024)
+
+typedef struct {
+    const char *name;
+    double cpu_frequency;
+    uint64_t ram_total;
+    uint64_t ram_available;
+} qed_profile_entry_t;
+
+static const qed_profile_entry_t qed_profiles[] = {
+    // Detection's own fallback frequency; the default for benchmarks
+    {"reference",   2.4e9,   16 * QED_GIB,  8 * QED_GIB},
+    {"laptop",      1.8e9,    8 * QED_GIB,  3 * QED_GIB},
+    {"workstation", 3.6e9,   64 * QED_GIB, 48 * QED_GIB},
+    {"server",      2.9e9,  512 * QED_GIB, 384 * QED_GIB},
+    {"ci",          2.0e9,    7 * QED_GIB,  5 * QED_GIB}
+};
+
+#define QED_PROFILE_COUNT (sizeof(qed_profiles) / sizeof(qed_profiles[0]))
+
+bool qed_hardware_profile_valid(const qed_hardware_sig_t *profile) {
+    return profile && isfinite(profile->cpu_frequency) && profile->cpu_frequency > 0 &&
+           profile->ram_total > 0 && profile->ram_available <= profile->ram_total;
+}
+
+const char* qed_hardware_profile_name(size_t index) {
+    return index < QED_PROFILE_COUNT ? qed_profiles[index].name : NULL;
+}
+
+static char* qed_profile_trim(char *text) {
+    char *end;
+    
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+static qed_result_t qed_parse_profile(FILE *fp, qed_hardware_sig_t *profile) {
+    bool have_frequency = false, have_total = false, have_available = false;
+    char line[256];
+    
+    while (fgets(line, sizeof(line), fp)) {
+        char *comment = strchr(line, '#');
+        char *equals, *field, *value, *end;
+        
+        if (comment) {
+            *comment = '\0';
+        }
+        field = qed_profile_trim(line);
+        if (*field == '\0') {
+            continue;
+        }
+        
+        equals = strchr(field, '=');
+        if (!equals) {
+            return QED_ERROR_INVALID_INPUT;
+        }
+        *equals = '\0';
+        field = qed_profile_trim(field);
+        value = qed_profile_trim(equals + 1);
+        if (*value == '\0') {
+            return QED_ERROR_INVALID_INPUT;
+        }
+        
+        if (strcmp(field, "cpu_frequency") == 0) {
+            profile->cpu_frequency = strtod(value, &end);
+            have_frequency = true;
+        } else if (strcmp(field, "ram_total") == 0 && *value != '-') {
+            profile->ram_total = strtoull(value, &end, 10);
+            have_total = true;
+        } else if (strcmp(field, "ram_available") == 0 && *value != '-') {
+            profile->ram_available = strtoull(value, &end, 10);
+            have_available = true;
+        } else {
+            return QED_ERROR_INVALID_INPUT;
+        }
+        if (*end != '\0') {
+            return QED_ERROR_INVALID_INPUT;
+        }
+    }
+    
+    if (ferror(fp)) {
+        return QED_ERROR_FILE_IO;
+    }
+    if (!have_frequency || !have_total || !have_available ||
+        !qed_hardware_profile_valid(profile)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_load_hardware_profile(const char *name_or_path, qed_hardware_sig_t *profile) {
+    qed_result_t result;
+    FILE *fp;
+    size_t i;
+    
+    if (!name_or_path || !profile) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    memset(profile, 0, sizeof(qed_hardware_sig_t));
+    
+    for (i = 0; i < QED_PROFILE_COUNT; i++) {
+        if (strcmp(name_or_path, qed_profiles[i].name) == 0) {
+            profile->cpu_frequency = qed_profiles[i].cpu_frequency;
+            profile->ram_total = qed_profiles[i].ram_total;
+            profile->ram_available = qed_profiles[i].ram_available;
+            return QED_SUCCESS;
+        }
+    }
+    
+    fp = fopen(name_or_path, "r");
+    if (!fp) {
+        return QED_ERROR_FILE_IO;
+    }
+    result = qed_parse_profile(fp, profile);
+    fclose(fp);
+    
+    if (result != QED_SUCCESS) {
+        memset(profile, 0, sizeof(qed_hardware_sig_t));
+    }
+    return result;
+}
+
+qed_result_t qed_save_hardware_profile(const qed_hardware_sig_t *profile, const char *path) {
+    FILE *fp;
+    int written;
+    
+    if (!qed_hardware_profile_valid(profile) || !path) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    fp = fopen(path, "w");
+    if (!fp) {
+        return QED_ERROR_FILE_IO;
+    }
+    
+    written = fprintf(fp, "# QED hardware profile\n"
+                      "cpu_frequency = %.17g\n"
+                      "ram_total = %llu\n"
+                      "ram_available = %llu\n",
+                      profile->cpu_frequency,
+                      (unsigned long long)profile->ram_total,
+                      (unsigned long long)profile->ram_available);
+    
+    if (fclose(fp) != 0 || written < 0) {
+        return QED_ERROR_FILE_IO;
+    }
+    return QED_SUCCESS;
+}
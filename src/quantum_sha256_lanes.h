@@ -0,0 +1,113 @@
+/*
+ * Quantum Encryption Device (QED) - Multi-Buffer SHA-256 Lanes
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Template for one SIMD width, included by quantum_sha256.c once per
+ * instruction set with these defined:
+ *
+ *   QED_MB_LANES   messages hashed side by side (4, 8 or 16)
+ *   QED_MB_NAME    name of the generated group function
+ *   QED_MB_TARGET  GCC target attribute for the instruction set
+ *
+ * Each vector element holds one message's copy of a SHA-256 working
+ * variable, so the compiler turns the round function into packed 32-bit
+ * adds, shifts and logic ops of the requested width.
+ */
+
+#define QED_MB_CAT2(a, b) a##b
+#define QED_MB_CAT(a, b) QED_MB_CAT2(a, b)
+#define QED_MB_VEC QED_MB_CAT(QED_MB_NAME, _vec_t)
+
+typedef uint32_t QED_MB_VEC __attribute__((vector_size(QED_MB_LANES * 4)));
+
+#define QED_MB_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+__attribute__((target(QED_MB_TARGET)))
+static qed_result_t QED_MB_NAME(qed_sha256_job_t *const *jobs, size_t used) {
+    uint32_t words[16][QED_MB_LANES] __attribute__((aligned(64)));
+    uint32_t lanes[8][QED_MB_LANES] __attribute__((aligned(64)));
+    uint8_t block[QED_SHA256_BLOCK_SIZE];
+    uint64_t blocks[QED_MB_LANES];
+    uint64_t max_blocks = 0, b;
+    QED_MB_VEC state[8], w[16];
+    QED_MB_VEC a, bb, c, d, e, f, g, h, t1, t2;
+    size_t lane, i;
+    
+    for (lane = 0; lane < QED_MB_LANES; lane++) {
+        blocks[lane] = lane < used ? qed_sha256_blocks(jobs[lane]) : 0;
+        if (blocks[lane] > max_blocks) {
+            max_blocks = blocks[lane];
+        }
+    }
+    
+    for (i = 0; i < 8; i++) {
+        for (lane = 0; lane < QED_MB_LANES; lane++) {
+            lanes[i][lane] = qed_sha256_iv[i];
+        }
+        memcpy(&state[i], lanes[i], sizeof(QED_MB_VEC));
+    }
+    
+    for (b = 0; b < max_blocks; b++) {
+        // Transpose: word i of every lane's block goes into vector i
+        for (lane = 0; lane < QED_MB_LANES; lane++) {
+            if (b < blocks[lane]) {
+                qed_sha256_fill_block(jobs[lane], b, block);
+            } else {
+                memset(block, 0, sizeof(block));
+            }
+            for (i = 0; i < 16; i++) {
+                words[i][lane] = qed_sha256_load_be32(block + 4 * i);
+            }
+        }
+        for (i = 0; i < 16; i++) {
+            memcpy(&w[i], words[i], sizeof(QED_MB_VEC));
+        }
+        
+        a = state[0]; bb = state[1]; c = state[2]; d = state[3];
+        e = state[4]; f = state[5]; g = state[6]; h = state[7];
+        
+        for (i = 0; i < 64; i++) {
+            if (i >= 16) {
+                QED_MB_VEC w15 = w[(i - 15) & 15];
+                QED_MB_VEC w2 = w[(i - 2) & 15];
+                w[i & 15] += (QED_MB_ROTR(w2, 17) ^ QED_MB_ROTR(w2, 19) ^ (w2 >> 10)) +
+                             w[(i - 7) & 15] +
+                             (QED_MB_ROTR(w15, 7) ^ QED_MB_ROTR(w15, 18) ^ (w15 >> 3));
+            }
+            t1 = h + (QED_MB_ROTR(e, 6) ^ QED_MB_ROTR(e, 11) ^ QED_MB_ROTR(e, 25)) +
+                 ((e & f) ^ (~e & g)) + qed_sha256_k[i] + w[i & 15];
+            t2 = (QED_MB_ROTR(a, 2) ^ QED_MB_ROTR(a, 13) ^ QED_MB_ROTR(a, 22)) +
+                 ((a & bb) ^ (a & c) ^ (bb & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = bb; bb = a; a = t1 + t2;
+        }
+        
+        state[0] += a; state[1] += bb; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        
+        // Lanes whose message ended with this block are read out now; their
+        // state keeps absorbing zero blocks until the longest lane finishes
+        for (lane = 0; lane < used; lane++) {
+            if (blocks[lane] == b + 1) {
+                for (i = 0; i < 8; i++) {
+                    memcpy(lanes[i], &state[i], sizeof(QED_MB_VEC));
+                    qed_sha256_store_be32(jobs[lane]->digest + 4 * i, lanes[i][lane]);
+                }
+            }
+        }
+    }
+    
+    return QED_SUCCESS;
+}
+
+#undef QED_MB_ROTR
+#undef QED_MB_VEC
+#undef QED_MB_CAT
+#undef QED_MB_CAT2
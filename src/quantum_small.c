@@ -0,0 +1,364 @@
+/*
+ * Quantum Encryption Device (QED) - Small-Message Fast Path
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * For payloads of a few hundred bytes the allocator costs more than AES.
+ * Messages up to QED_SMALL_MESSAGE_MAX bytes without compression are
+ * handled here without any heap traffic:
+ *
+ *   - the record is written straight into the output buffer
+ *   - the signature is hashed with the heap-free SHA-256 stream, taking
+ *     the key and noise as further parts instead of a combined copy
+ *   - the cipher runs on the per-thread contexts and IV pool kept by
+ *     quantum_cipher.c
+ *
+ * AES-256-CBC produces the original format; the AEAD backends and per-file
+ * subkeys produce the versioned buffer with the cipher and salt recorded in
+ * its header.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+// Signature of the original format: SHA-256(ciphertext || key || noise)
+static qed_result_t qed_small_signature(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                                        const uint8_t *encrypted, size_t encrypted_len,
+                                        uint8_t *signature) {
+    const uint8_t *parts[2] = { encrypted, key };
+    size_t lengths[2] = { encrypted_len, QED_KEY_LENGTH };
+    
+    return qed_signature_parts(hw_sig, parts, lengths, 2, signature);
+}
+
+bool qed_small_encrypt_eligible(const qed_device_t *device, size_t plaintext_len) {
+    return plaintext_len <= QED_SMALL_MESSAGE_MAX && device->compression == QED_COMPRESSION_NONE;
+}
+
+// Length of an uncompressed result: the versioned header and salt when the
+// settings need them, then signature, IV and the tag or CBC padding
+static size_t qed_in_place_ciphertext_len(const qed_device_t *device, size_t plaintext_len) {
+    size_t header_len = 0;
+    
+    if (device->cipher != QED_CIPHER_AES_256_CBC || device->subkeys ||
+        device->mac != QED_MAC_QUANTUM) {
+        header_len = device->subkeys ? QED_BUFFER_HEADER_SIZE + QED_SUBKEY_SALT_LENGTH :
+                                       QED_BUFFER_HEADER_SIZE;
+    }
+    return header_len + QED_SIGNATURE_LENGTH + QED_IV_LENGTH +
+           (device->cipher == QED_CIPHER_AES_256_CBC ? (plaintext_len / 16 + 1) * 16 :
+                                                       plaintext_len + QED_AEAD_TAG_LENGTH);
+}
+
+// Anything but a compressed buffer decrypts straight into its output
+static bool qed_in_place_decrypt_eligible(const uint8_t *ciphertext, size_t ciphertext_len) {
+    if (ciphertext_len < QED_SIGNATURE_LENGTH + QED_IV_LENGTH) {
+        return false;
+    }
+    
+    if (ciphertext_len >= QED_BUFFER_HEADER_SIZE + QED_RECORD_OVERHEAD &&
+        memcmp(ciphertext, QED_BUFFER_MAGIC, 4) == 0) {
+        size_t header_len = qed_buffer_header_len(ciphertext);
+        return header_len != 0 && ciphertext_len >= header_len + QED_RECORD_OVERHEAD &&
+               qed_cipher_valid(ciphertext[4]) && ciphertext[5] <= QED_MAC_HMAC_SHA256 &&
+               ciphertext[6] == QED_COMPRESSION_NONE;
+    }
+    
+    return true;
+}
+
+bool qed_small_decrypt_eligible(const uint8_t *ciphertext, size_t ciphertext_len) {
+    return qed_in_place_decrypt_eligible(ciphertext, ciphertext_len) &&
+           ciphertext_len - QED_SIGNATURE_LENGTH - QED_IV_LENGTH <= QED_SMALL_MESSAGE_MAX;
+}
+
+qed_result_t qed_small_encrypt(qed_device_t *device, const char *key_id,
+                               const uint8_t *plaintext, size_t plaintext_len,
+                               uint8_t *ciphertext, size_t *ciphertext_len) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    uint8_t *iv = ciphertext + QED_SIGNATURE_LENGTH;
+    uint8_t *encrypted = iv + QED_IV_LENGTH;
+    uint8_t *salt = ciphertext + QED_BUFFER_HEADER_SIZE;
+    size_t encrypted_len, header_len = QED_BUFFER_HEADER_SIZE;
+    const qed_mac_state_t *mac = NULL;
+    qed_result_t result;
+    
+    QED_OP_BEGIN(op_start);
+    
+    if (device->cipher != QED_CIPHER_AES_256_CBC || device->subkeys ||
+        device->mac != QED_MAC_QUANTUM) {
+        if (device->mac == QED_MAC_HMAC_SHA256) {
+            result = qed_get_mac_state(device, key_id, &mac);
+            if (result != QED_SUCCESS) {
+                return result;
+            }
+        }
+        
+        memset(ciphertext, 0, QED_BUFFER_HEADER_SIZE);
+        memcpy(ciphertext, QED_BUFFER_MAGIC, 4);
+        ciphertext[4] = device->cipher;
+        ciphertext[5] = device->mac;
+        ciphertext[6] = QED_COMPRESSION_NONE;
+        qed_put_le64(ciphertext + 8, plaintext_len);
+        
+        if (device->subkeys) {
+            ciphertext[7] = QED_BUFFER_FLAG_SUBKEY;
+            header_len += QED_SUBKEY_SALT_LENGTH;
+            result = qed_cipher_iv(salt);
+            if (result != QED_SUCCESS) {
+                return result;
+            }
+        }
+        
+        result = qed_file_key(device, key_id, device->subkeys ? salt : NULL, quantum_key);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        
+        result = qed_seal_record(&device->hardware_sig, quantum_key, mac, device->cipher,
+                                 ciphertext, header_len, plaintext, plaintext_len,
+                                 ciphertext + header_len, &encrypted_len);
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        
+        *ciphertext_len = header_len + encrypted_len;
+        QED_OP_END(QED_OP_ENCRYPT, op_start, plaintext_len);
+        return QED_SUCCESS;
+    }
+    
+    result = qed_generate_quantum_key(device, key_id, quantum_key, QED_KEY_LENGTH);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    result = qed_cipher_iv(iv);
+    if (result != QED_SUCCESS) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        return result;
+    }
+    
+    QED_STAGE_BEGIN(cipher_start);
+    result = qed_cipher_encrypt(QED_CIPHER_AES_256_CBC, quantum_key, iv, NULL, 0,
+                                plaintext, plaintext_len, encrypted, &encrypted_len);
+    if (result != QED_SUCCESS) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        return result;
+    }
+    QED_STAGE_END(QED_STAGE_CIPHER, cipher_start, plaintext_len);
+    
+    result = qed_small_signature(&device->hardware_sig, quantum_key, encrypted, encrypted_len,
+                                 ciphertext);
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    *ciphertext_len = QED_SIGNATURE_LENGTH + QED_IV_LENGTH + encrypted_len;
+    
+    QED_OP_END(QED_OP_ENCRYPT, op_start, plaintext_len);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_small_decrypt(qed_device_t *device, const char *key_id,
+                               const uint8_t *ciphertext, size_t ciphertext_len,
+                               uint8_t *plaintext, size_t capacity, size_t *plaintext_len) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    uint8_t signature[QED_SIGNATURE_LENGTH];
+    const uint8_t *iv = ciphertext + QED_SIGNATURE_LENGTH;
+    const uint8_t *encrypted = iv + QED_IV_LENGTH;
+    size_t encrypted_len = ciphertext_len - QED_SIGNATURE_LENGTH - QED_IV_LENGTH;
+    qed_result_t result;
+    
+    QED_OP_BEGIN(op_start);
+    
+    result = qed_generate_quantum_key(device, key_id, quantum_key, QED_KEY_LENGTH);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    if (ciphertext_len >= QED_BUFFER_HEADER_SIZE + QED_RECORD_OVERHEAD &&
+        memcmp(ciphertext, QED_BUFFER_MAGIC, 4) == 0) {
+        size_t header_len = qed_buffer_header_len(ciphertext);
+        uint8_t file_key[QED_KEY_LENGTH];
+        const qed_mac_state_t *mac = NULL;
+        
+        // Eligibility already checked the header length
+        result = qed_file_key(device, key_id, header_len > QED_BUFFER_HEADER_SIZE ?
+                              ciphertext + QED_BUFFER_HEADER_SIZE : NULL, file_key);
+        if (result == QED_SUCCESS && ciphertext[5] == QED_MAC_HMAC_SHA256) {
+            result = qed_get_mac_state(device, key_id, &mac);
+        }
+        if (result == QED_SUCCESS) {
+            result = qed_open_record(&device->hardware_sig, file_key, mac, ciphertext[4],
+                                     ciphertext, header_len, ciphertext + header_len,
+                                     ciphertext_len - header_len, plaintext, plaintext_len);
+        }
+        qed_secure_zero(file_key, sizeof(file_key));
+        if (result == QED_SUCCESS && *plaintext_len != qed_get_le64(ciphertext + 8)) {
+            result = QED_ERROR_DECRYPTION;
+        }
+        
+        // A legacy buffer whose signature happens to start with the magic
+        // fails to open and is retried in the original format below
+        if (result != QED_ERROR_SIGNATURE_MISMATCH && result != QED_ERROR_INVALID_INPUT) {
+            qed_secure_zero(quantum_key, sizeof(quantum_key));
+            if (result != QED_SUCCESS) {
+                return result;
+            }
+            QED_OP_END(QED_OP_DECRYPT, op_start, *plaintext_len);
+            return QED_SUCCESS;
+        }
+        
+        // The output was sized for the record, which is shorter than the
+        // original format; report the size needed as _into() does
+        if (capacity < encrypted_len) {
+            qed_secure_zero(quantum_key, sizeof(quantum_key));
+            *plaintext_len = encrypted_len;
+            return QED_ERROR_INVALID_INPUT;
+        }
+    }
+    
+    result = qed_small_signature(&device->hardware_sig, quantum_key, encrypted, encrypted_len,
+                                 signature);
+    if (result != QED_SUCCESS) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        return result;
+    }
+    
+    if (CRYPTO_memcmp(signature, ciphertext, QED_SIGNATURE_LENGTH) != 0) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        qed_secure_zero(signature, sizeof(signature));
+        printf("❌ Quantum signature mismatch - tampering detected!\n");
+        return QED_ERROR_SIGNATURE_MISMATCH;
+    }
+    qed_secure_zero(signature, sizeof(signature));
+    
+    QED_STAGE_BEGIN(cipher_start);
+    result = qed_cipher_decrypt(QED_CIPHER_AES_256_CBC, quantum_key, iv, NULL, 0,
+                                encrypted, encrypted_len, plaintext, plaintext_len);
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    QED_STAGE_END(QED_STAGE_CIPHER, cipher_start, encrypted_len);
+    
+    QED_OP_END(QED_OP_DECRYPT, op_start, *plaintext_len);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_quantum_encrypt_into(qed_device_t *device, const char *key_id,
+                                     const uint8_t *plaintext, size_t plaintext_len,
+                                     uint8_t *ciphertext, size_t capacity,
+                                     size_t *ciphertext_len) {
+    uint8_t *allocated = NULL;
+    size_t allocated_len = 0;
+    qed_result_t result;
+    
+    if (!device || !key_id || !plaintext || !ciphertext_len || plaintext_len == 0) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    // The caller's buffer is already there, so any size is written in
+    // place, and needs exactly the size of the result
+    if (device->compression == QED_COMPRESSION_NONE) {
+        size_t needed = qed_in_place_ciphertext_len(device, plaintext_len);
+        
+        if (!ciphertext || capacity < needed) {
+            *ciphertext_len = needed;
+            return QED_ERROR_INVALID_INPUT;
+        }
+        QED_PROBE1(encrypt__start, plaintext_len);
+        result = qed_small_encrypt(device, key_id, plaintext, plaintext_len,
+                                   ciphertext, ciphertext_len);
+        QED_PROBE3(encrypt__done, result, plaintext_len,
+                   result == QED_SUCCESS ? *ciphertext_len : 0);
+        return result;
+    }
+    
+    if (!ciphertext || capacity < QED_CIPHERTEXT_MAX(plaintext_len)) {
+        *ciphertext_len = QED_CIPHERTEXT_MAX(plaintext_len);
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    // Compression keeps its allocating path
+    result = qed_quantum_encrypt(device, key_id, plaintext, plaintext_len,
+                                 &allocated, &allocated_len);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    memcpy(ciphertext, allocated, allocated_len);
+    *ciphertext_len = allocated_len;
+    free(allocated);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_quantum_decrypt_into(qed_device_t *device, const char *key_id,
+                                     const uint8_t *ciphertext, size_t ciphertext_len,
+                                     uint8_t *plaintext, size_t capacity,
+                                     size_t *plaintext_len) {
+    uint8_t *allocated = NULL;
+    size_t allocated_len = 0;
+    qed_result_t result;
+    
+    if (!device || !key_id || !ciphertext || !plaintext_len ||
+        ciphertext_len < QED_SIGNATURE_LENGTH + QED_IV_LENGTH) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (qed_in_place_decrypt_eligible(ciphertext, ciphertext_len)) {
+        // AEAD records decrypt to exactly their payload; CBC needs room for
+        // the padding it strips
+        size_t needed = ciphertext_len - QED_SIGNATURE_LENGTH - QED_IV_LENGTH;
+        
+        if (ciphertext_len >= QED_BUFFER_HEADER_SIZE + QED_RECORD_OVERHEAD &&
+            memcmp(ciphertext, QED_BUFFER_MAGIC, 4) == 0) {
+            needed -= qed_buffer_header_len(ciphertext);
+            if (ciphertext[4] != QED_CIPHER_AES_256_CBC) {
+                needed -= QED_AEAD_TAG_LENGTH;
+            }
+        }
+        
+        if (!plaintext || capacity < needed) {
+            *plaintext_len = needed;
+            return QED_ERROR_INVALID_INPUT;
+        }
+        QED_PROBE1(decrypt__start, ciphertext_len);
+        result = qed_small_decrypt(device, key_id, ciphertext, ciphertext_len,
+                                   plaintext, capacity, plaintext_len);
+        QED_PROBE3(decrypt__done, result, ciphertext_len,
+                   result == QED_SUCCESS ? *plaintext_len : 0);
+        return result;
+    }
+    
+    result = qed_quantum_decrypt(device, key_id, ciphertext, ciphertext_len,
+                                 &allocated, &allocated_len);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    if (!plaintext || capacity < allocated_len) {
+        qed_secure_zero(allocated, allocated_len);
+        free(allocated);
+        *plaintext_len = allocated_len;
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    memcpy(plaintext, allocated, allocated_len);
+    *plaintext_len = allocated_len;
+    qed_secure_zero(allocated, allocated_len);
+    free(allocated);
+    return QED_SUCCESS;
+}
@@ -0,0 +1,378 @@
+/*
+ * Quantum Encryption Device (QED) - Performance Statistics
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "quantum_internal.h"
+
+// Counters owned by a single thread. Only the owning thread writes them, so
+// updates are plain relaxed load/store pairs; readers aggregate all blocks.
+typedef struct qed_thread_stats {
+    uint64_t calls[QED_STAGE_COUNT];
+    uint64_t total_ns[QED_STAGE_COUNT];
+    uint64_t bytes[QED_STAGE_COUNT];
+    uint64_t key_hits;
+    uint64_t key_misses;
+    struct qed_thread_stats *next;
+} qed_thread_stats_t;
+
+/*
+ * Log-linear latency histograms in the style of HdrHistogram: values below
+ * 2 * QED_HIST_SUB_BUCKETS nanoseconds are exact, larger values keep five
+ * significant bits (about 3% relative error) across the full 64-bit range.
+ */
+#define QED_HIST_SUB_BITS 5
+#define QED_HIST_SUB_BUCKETS (1 << QED_HIST_SUB_BITS)
+// The exact range takes two groups and each bit above it one more
+#define QED_HIST_BUCKETS ((64 - QED_HIST_SUB_BITS + 1) * QED_HIST_SUB_BUCKETS)
+
+typedef struct {
+    uint64_t counts[QED_HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max_ns;
+} qed_histogram_t;
+
+int qed_stats_active = 0;
+
+static qed_histogram_t histograms[QED_OP_COUNT];
+
+// Blocks are pushed once per thread and never freed, so totals survive
+// thread exit and readers can walk the list without locking.
+static qed_thread_stats_t *stats_head = NULL;
+static __thread qed_thread_stats_t *thread_stats = NULL;
+
+static const char* stage_names[QED_STAGE_COUNT] = {
+    "hardware init",                   // QED_STAGE_HARDWARE_INIT
+    "key lookup",                      // QED_STAGE_KEY_LOOKUP
+    "resonance",                       // QED_STAGE_RESONANCE
+    "cipher",                          // QED_STAGE_CIPHER
+    "mac",                             // QED_STAGE_MAC
+    "file read",                       // QED_STAGE_FILE_READ
+    "file write",                      // QED_STAGE_FILE_WRITE
+    "secure wipe",                     // QED_STAGE_SECURE_WIPE
+    "compress"                         // QED_STAGE_COMPRESS
+};
+
+static const char* op_names[QED_OP_COUNT] = {
+    "encrypt",                         // QED_OP_ENCRYPT
+    "decrypt",                         // QED_OP_DECRYPT
+    "key derive",                      // QED_OP_KEY_DERIVE
+    "file encrypt",                    // QED_OP_FILE_ENCRYPT
+    "file decrypt",                    // QED_OP_FILE_DECRYPT
+    "file verify",                     // QED_OP_FILE_VERIFY
+    "file rekey"                       // QED_OP_FILE_REKEY
+};
+
+static qed_thread_stats_t* qed_stats_thread_block(void) {
+    qed_thread_stats_t *block = thread_stats;
+    
+    if (block) {
+        return block;
+    }
+    
+    block = calloc(1, sizeof(qed_thread_stats_t));
+    if (!block) {
+        return NULL;
+    }
+    
+    // Lock-free push onto the global list
+    block->next = __atomic_load_n(&stats_head, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&stats_head, &block->next, block, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        // block->next was refreshed by the failed exchange
+    }
+    
+    thread_stats = block;
+    return block;
+}
+
+static inline void qed_stats_add(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value,
+                     __ATOMIC_RELAXED);
+}
+
+uint64_t qed_stats_now_ns(void) {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    // Never return 0, it marks a disabled measurement
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec + 1;
+}
+
+void qed_stats_record(qed_stage_t stage, uint64_t start_ns, uint64_t bytes) {
+    qed_thread_stats_t *block;
+    uint64_t now = qed_stats_now_ns();
+    int active = __atomic_load_n(&qed_stats_active, __ATOMIC_RELAXED);
+    
+    if (stage >= QED_STAGE_COUNT) {
+        return;
+    }
+    
+    if (active & QED_STATS_FLAG_TRACE) {
+        qed_trace_record(stage_names[stage], "stage", start_ns, now, bytes);
+    }
+    
+    if (!(active & QED_STATS_FLAG_COUNTERS)) {
+        return;
+    }
+    
+    block = qed_stats_thread_block();
+    if (!block) {
+        return;
+    }
+    
+    qed_stats_add(&block->calls[stage], 1);
+    qed_stats_add(&block->total_ns[stage], now > start_ns ? now - start_ns : 0);
+    qed_stats_add(&block->bytes[stage], bytes);
+}
+
+void qed_stats_key_lookup(bool hit) {
+    qed_thread_stats_t *block;
+    
+    if (!(__atomic_load_n(&qed_stats_active, __ATOMIC_RELAXED) & QED_STATS_FLAG_COUNTERS)) {
+        return;
+    }
+    
+    block = qed_stats_thread_block();
+    if (!block) {
+        return;
+    }
+    
+    qed_stats_add(hit ? &block->key_hits : &block->key_misses, 1);
+}
+
+static inline size_t qed_hist_index(uint64_t value) {
+    int msb, shift;
+    
+    if (value < 2 * QED_HIST_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+    
+    msb = 63 - __builtin_clzll(value);
+    shift = msb - QED_HIST_SUB_BITS;
+    return (size_t)(shift + 1) * QED_HIST_SUB_BUCKETS +
+           (size_t)((value >> shift) - QED_HIST_SUB_BUCKETS);
+}
+
+// Highest value that maps to the given bucket
+static inline uint64_t qed_hist_value(size_t index) {
+    int shift;
+    uint64_t sub;
+    
+    if (index < 2 * QED_HIST_SUB_BUCKETS) {
+        return index;
+    }
+    
+    shift = (int)(index / QED_HIST_SUB_BUCKETS) - 1;
+    sub = index % QED_HIST_SUB_BUCKETS + QED_HIST_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+void qed_latency_record(qed_op_t op, uint64_t start_ns, uint64_t bytes) {
+    qed_histogram_t *hist;
+    uint64_t now = qed_stats_now_ns();
+    uint64_t elapsed = now > start_ns ? now - start_ns : 0;
+    uint64_t max_ns;
+    int active = __atomic_load_n(&qed_stats_active, __ATOMIC_RELAXED);
+    
+    if (op >= QED_OP_COUNT) {
+        return;
+    }
+    
+    if (active & QED_STATS_FLAG_TRACE) {
+        qed_trace_record(op_names[op], "op", start_ns, now, bytes);
+    }
+    
+    if (!(active & QED_STATS_FLAG_COUNTERS)) {
+        return;
+    }
+    
+    hist = &histograms[op];
+    __atomic_fetch_add(&hist->counts[qed_hist_index(elapsed)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->total, 1, __ATOMIC_RELAXED);
+    
+    max_ns = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+    while (elapsed > max_ns &&
+           !__atomic_compare_exchange_n(&hist->max_ns, &max_ns, elapsed, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // max_ns was refreshed by the failed exchange
+    }
+}
+
+void qed_enable_stats(bool enabled) {
+    if (enabled) {
+        __atomic_fetch_or(&qed_stats_active, QED_STATS_FLAG_COUNTERS, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_and(&qed_stats_active, ~QED_STATS_FLAG_COUNTERS, __ATOMIC_RELAXED);
+    }
+}
+
+bool qed_stats_enabled(void) {
+    return (__atomic_load_n(&qed_stats_active, __ATOMIC_RELAXED) & QED_STATS_FLAG_COUNTERS) != 0;
+}
+
+qed_result_t qed_get_stats(qed_stats_t *stats) {
+    qed_thread_stats_t *block;
+    int i;
+    
+    if (!stats) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    memset(stats, 0, sizeof(qed_stats_t));
+    
+    for (block = __atomic_load_n(&stats_head, __ATOMIC_ACQUIRE); block; block = block->next) {
+        for (i = 0; i < QED_STAGE_COUNT; i++) {
+            stats->stages[i].calls += __atomic_load_n(&block->calls[i], __ATOMIC_RELAXED);
+            stats->stages[i].total_ns += __atomic_load_n(&block->total_ns[i], __ATOMIC_RELAXED);
+            stats->stages[i].bytes += __atomic_load_n(&block->bytes[i], __ATOMIC_RELAXED);
+        }
+        stats->key_hits += __atomic_load_n(&block->key_hits, __ATOMIC_RELAXED);
+        stats->key_misses += __atomic_load_n(&block->key_misses, __ATOMIC_RELAXED);
+    }
+    
+    return QED_SUCCESS;
+}
+
+void qed_reset_stats(void) {
+    qed_thread_stats_t *block;
+    int i;
+    
+    // Best effort: an update racing with the reset may survive it
+    for (block = __atomic_load_n(&stats_head, __ATOMIC_ACQUIRE); block; block = block->next) {
+        for (i = 0; i < QED_STAGE_COUNT; i++) {
+            __atomic_store_n(&block->calls[i], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&block->total_ns[i], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&block->bytes[i], 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&block->key_hits, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&block->key_misses, 0, __ATOMIC_RELAXED);
+    }
+    
+    for (i = 0; i < QED_OP_COUNT; i++) {
+        size_t j;
+        for (j = 0; j < QED_HIST_BUCKETS; j++) {
+            __atomic_store_n(&histograms[i].counts[j], 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&histograms[i].total, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&histograms[i].max_ns, 0, __ATOMIC_RELAXED);
+    }
+}
+
+const char* qed_get_stage_name(qed_stage_t stage) {
+    if (stage >= QED_STAGE_COUNT) {
+        return "unknown";
+    }
+    return stage_names[stage];
+}
+
+void qed_print_stats(const qed_stats_t *stats, double elapsed_seconds) {
+    uint64_t total_ns = 0;
+    int i;
+    
+    if (!stats) {
+        return;
+    }
+    
+    for (i = 0; i < QED_STAGE_COUNT; i++) {
+        total_ns += stats->stages[i].total_ns;
+    }
+    
+    printf("Performance Statistics:\n");
+    printf("  %-14s %10s %12s %10s %14s %12s\n",
+           "Stage", "Calls", "Total ms", "Share", "Bytes", "MB/s");
+    
+    for (i = 0; i < QED_STAGE_COUNT; i++) {
+        const qed_stage_stats_t *stage = &stats->stages[i];
+        double ms = stage->total_ns / 1e6;
+        double share = total_ns ? 100.0 * stage->total_ns / total_ns : 0.0;
+        double rate = stage->total_ns ? (stage->bytes / 1e6) / (stage->total_ns / 1e9) : 0.0;
+        
+        printf("  %-14s %10lu %12.3f %9.1f%% %14lu %12.2f\n",
+               stage_names[i], stage->calls, ms, share, stage->bytes, rate);
+    }
+    
+    printf("  Key lookups: %lu hits, %lu misses\n", stats->key_hits, stats->key_misses);
+    
+    if (elapsed_seconds > 0) {
+        uint64_t processed = stats->stages[QED_STAGE_CIPHER].bytes;
+        printf("  Wall time: %.3f s, throughput: %.2f MB/s\n",
+               elapsed_seconds, (processed / 1e6) / elapsed_seconds);
+    }
+}
+
+const char* qed_get_op_name(qed_op_t op) {
+    if (op >= QED_OP_COUNT) {
+        return "unknown";
+    }
+    return op_names[op];
+}
+
+uint64_t qed_get_latency_count(qed_op_t op) {
+    if (op >= QED_OP_COUNT) {
+        return 0;
+    }
+    return __atomic_load_n(&histograms[op].total, __ATOMIC_RELAXED);
+}
+
+uint64_t qed_get_latency_percentile(qed_op_t op, double percentile) {
+    const qed_histogram_t *hist;
+    uint64_t total, target, seen = 0;
+    size_t i;
+    
+    if (op >= QED_OP_COUNT || percentile < 0.0 || percentile > 100.0) {
+        return 0;
+    }
+    
+    hist = &histograms[op];
+    total = __atomic_load_n(&hist->total, __ATOMIC_RELAXED);
+    if (total == 0) {
+        return 0;
+    }
+    
+    // Rank of the requested percentile, rounded up and at least 1
+    target = (uint64_t)(percentile / 100.0 * total + 0.999999);
+    if (target == 0) {
+        target = 1;
+    }
+    
+    for (i = 0; i < QED_HIST_BUCKETS; i++) {
+        seen += __atomic_load_n(&hist->counts[i], __ATOMIC_RELAXED);
+        if (seen >= target) {
+            uint64_t value = qed_hist_value(i);
+            uint64_t max_ns = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+            return value < max_ns ? value : max_ns;
+        }
+    }
+    
+    return __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+}
+
+void qed_print_latency_report(void) {
+    int i;
+    
+    printf("Latency Percentiles (us):\n");
+    printf("  %-14s %10s %10s %10s %10s %10s\n",
+           "Operation", "Count", "p50", "p99", "p99.9", "max");
+    
+    for (i = 0; i < QED_OP_COUNT; i++) {
+        uint64_t count = qed_get_latency_count((qed_op_t)i);
+        if (count == 0) {
+            continue;
+        }
+        printf("  %-14s %10lu %10.2f %10.2f %10.2f %10.2f\n", op_names[i], count,
+               qed_get_latency_percentile((qed_op_t)i, 50.0) / 1e3,
+               qed_get_latency_percentile((qed_op_t)i, 99.0) / 1e3,
+               qed_get_latency_percentile((qed_op_t)i, 99.9) / 1e3,
+               __atomic_load_n(&histograms[i].max_ns, __ATOMIC_RELAXED) / 1e3);
+    }
+}
@@ -0,0 +1,653 @@
+/*
+ * Quantum Encryption Device (QED) - Encrypted Streams
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * Each direction of a stream is a sequence of records:
+ *
+ *   type (u8), cipher (u8), reserved (u16), body length (u32), body
+ *
+ * Each end sends a HELLO as soon as it opens: a random salt and its record
+ * size, in the clear. Nothing else is sent or accepted until the peer's
+ * HELLO has arrived. Ordering the two HELLO records (header and body) by
+ * salt gives the ends their roles, and the traffic keys are
+ *
+ *   HMAC-SHA-256(key, "QED stream c2s" || lower HELLO || higher HELLO)
+ *   HMAC-SHA-256(key, "QED stream s2c" || lower HELLO || higher HELLO)
+ *
+ * for the lower-salt end's writes and the other end's. Every later record
+ * (DATA, REKEY, CLOSE) is sealed with the AEAD cipher named in its writer's
+ * HELLO, its header as associated data and its sequence number under the
+ * current key as the nonce. After rekey_bytes of data the writer sends an
+ * empty REKEY record and both sides replace the key with
+ * HMAC-SHA-256(key, "QED stream rekey"), restarting the sequence, so old
+ * traffic stays safe if a later key leaks. CLOSE marks the end; a stream
+ * that ends without it has been truncated.
+ *
+ * Both salts key both directions, so records recorded from an earlier
+ * stream do not open under a fresh salt, and the two directions never
+ * share a key or a nonce. A HELLO carrying the reader's own salt is
+ * rejected, since echoing an end's own records back to it would otherwise
+ * pass them off as the peer's.
+ *
+ * Sealed records go into fixed-stride slots of up to 1 MiB in total and
+ * leave in one writev() per write call (or per full batch). Reads fill a
+ * buffer with whatever the fd has ready and decrypt each DATA record
+ * straight into the caller's buffer when it fits, staging it only when the
+ * caller asks for less than a record.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#define QED_STREAM_HEADER_SIZE 8
+#define QED_STREAM_TAG_LENGTH 16
+#define QED_STREAM_SALT_LENGTH 16
+#define QED_STREAM_HELLO_SIZE (QED_STREAM_SALT_LENGTH + 4)
+#define QED_STREAM_BATCH_BYTES (1024 * 1024)
+#define QED_STREAM_BATCH_MAX 64
+#define QED_STREAM_READ_AHEAD (64 * 1024)
+#define QED_STREAM_HELLO_RECORD (QED_STREAM_HEADER_SIZE + QED_STREAM_HELLO_SIZE)
+#define QED_STREAM_C2S_INFO "QED stream c2s"
+#define QED_STREAM_S2C_INFO "QED stream s2c"
+#define QED_STREAM_REKEY_INFO "QED stream rekey"
+
+enum {
+    QED_STREAM_HELLO = 1,
+    QED_STREAM_DATA = 2,
+    QED_STREAM_REKEY = 3,
+    QED_STREAM_CLOSE = 4
+};
+
+// Key state of one direction
+typedef struct {
+    uint8_t key[QED_KEY_LENGTH];
+    uint64_t sequence;
+    uint64_t bytes;
+} qed_stream_key_t;
+
+struct qed_stream {
+    int fd;
+    uint8_t base_key[QED_KEY_LENGTH];
+    uint8_t hello[QED_STREAM_HELLO_RECORD];
+    size_t record_size;
+    uint64_t rekey_bytes;
+    
+    // Write side: sealed records staged in slots of slot_size bytes
+    qed_stream_key_t tx;
+    uint8_t tx_cipher;
+    bool tx_failed;
+    uint8_t *slots;
+    size_t slot_size;
+    size_t slot_count;
+    size_t staged;
+    struct iovec *iov;
+    
+    // Read side: received bytes [in_start, in_end), and the rest of a
+    // record the caller did not have room for in [plain_start, plain_end)
+    qed_stream_key_t rx;
+    uint8_t rx_cipher;
+    size_t rx_record_size;
+    bool rx_started;
+    bool rx_closed;
+    bool rx_failed;
+    uint8_t *in;
+    size_t in_capacity;
+    size_t in_start;
+    size_t in_end;
+    uint8_t *plain;
+    size_t plain_start;
+    size_t plain_end;
+};
+
+static void qed_stream_hmac(const uint8_t *key, const uint8_t *message, size_t length,
+                            uint8_t *out) {
+    unsigned int out_len = QED_KEY_LENGTH;
+    
+    HMAC(EVP_sha256(), key, QED_KEY_LENGTH, message, length, out, &out_len);
+}
+
+// Traffic key for one direction, from both HELLO records in salt order
+static void qed_stream_traffic_key(const uint8_t *base_key, const char *info,
+                                   const uint8_t *lower, const uint8_t *higher,
+                                   qed_stream_key_t *direction) {
+    uint8_t message[sizeof(QED_STREAM_C2S_INFO) - 1 + 2 * QED_STREAM_HELLO_RECORD];
+    size_t info_len = strlen(info);
+    
+    memcpy(message, info, info_len);
+    memcpy(message + info_len, lower, QED_STREAM_HELLO_RECORD);
+    memcpy(message + info_len + QED_STREAM_HELLO_RECORD, higher, QED_STREAM_HELLO_RECORD);
+    qed_stream_hmac(base_key, message, info_len + 2 * QED_STREAM_HELLO_RECORD, direction->key);
+    direction->sequence = 0;
+    direction->bytes = 0;
+    qed_secure_zero(message, sizeof(message));
+}
+
+static void qed_stream_ratchet(qed_stream_key_t *direction) {
+    uint8_t next[QED_KEY_LENGTH];
+    
+    qed_stream_hmac(direction->key, (const uint8_t *)QED_STREAM_REKEY_INFO,
+                    sizeof(QED_STREAM_REKEY_INFO) - 1, next);
+    memcpy(direction->key, next, sizeof(next));
+    qed_secure_zero(next, sizeof(next));
+    direction->sequence = 0;
+    direction->bytes = 0;
+}
+
+// 96-bit nonce: four zero bytes and the little-endian sequence number
+static void qed_stream_nonce(uint64_t sequence, uint8_t *iv) {
+    memset(iv, 0, QED_IV_LENGTH);
+    qed_put_le64(iv + 4, sequence);
+}
+
+// Waits until fd is ready, for descriptors in non-blocking mode
+static qed_result_t qed_stream_wait(int fd, short events) {
+    struct pollfd pfd = { fd, events, 0 };
+    
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+        return QED_ERROR_FILE_IO;
+    }
+    return QED_SUCCESS;
+}
+
+static qed_result_t qed_stream_flush(qed_stream_t *stream) {
+    struct iovec *iov = stream->iov;
+    int count = (int)stream->staged;
+    
+    while (count > 0) {
+        ssize_t n = writev(stream->fd, iov, count);
+        
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+                qed_stream_wait(stream->fd, POLLOUT) == QED_SUCCESS) {
+                continue;
+            }
+            // Part of a record may have gone out; the stream cannot resume
+            stream->tx_failed = true;
+            return QED_ERROR_FILE_IO;
+        }
+        
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    
+    stream->staged = 0;
+    return QED_SUCCESS;
+}
+
+// Seals one record into the next slot, sending the batch first if full
+static qed_result_t qed_stream_seal(qed_stream_t *stream, uint8_t type,
+                                    const uint8_t *data, size_t length) {
+    uint8_t iv[QED_IV_LENGTH];
+    uint8_t *record;
+    size_t body_len;
+    qed_result_t result;
+    
+    if (stream->staged == stream->slot_count) {
+        result = qed_stream_flush(stream);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+    }
+    
+    record = stream->slots + stream->staged * stream->slot_size;
+    record[0] = type;
+    record[1] = stream->tx_cipher;
+    record[2] = 0;
+    record[3] = 0;
+    qed_put_le32(record + 4, (uint32_t)(length + QED_STREAM_TAG_LENGTH));
+    
+    qed_stream_nonce(stream->tx.sequence, iv);
+    result = qed_cipher_encrypt(stream->tx_cipher, stream->tx.key, iv,
+                                record, QED_STREAM_HEADER_SIZE, data, length,
+                                record + QED_STREAM_HEADER_SIZE, &body_len);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    stream->iov[stream->staged].iov_base = record;
+    stream->iov[stream->staged].iov_len = QED_STREAM_HEADER_SIZE + body_len;
+    stream->staged++;
+    stream->tx.sequence++;
+    stream->tx.bytes += length;
+    return QED_SUCCESS;
+}
+
+// Sends the HELLO record; the keys wait for the peer's
+static qed_result_t qed_stream_hello(qed_stream_t *stream) {
+    uint8_t *record = stream->hello;
+    
+    record[0] = QED_STREAM_HELLO;
+    record[1] = stream->tx_cipher;
+    record[2] = 0;
+    record[3] = 0;
+    qed_put_le32(record + 4, QED_STREAM_HELLO_SIZE);
+    if (RAND_bytes(record + QED_STREAM_HEADER_SIZE, QED_STREAM_SALT_LENGTH) != 1) {
+        return QED_ERROR_ENCRYPTION;
+    }
+    qed_put_le32(record + QED_STREAM_HEADER_SIZE + QED_STREAM_SALT_LENGTH,
+                 (uint32_t)stream->record_size);
+    
+    memcpy(stream->slots, record, QED_STREAM_HELLO_RECORD);
+    stream->iov[0].iov_base = stream->slots;
+    stream->iov[0].iov_len = QED_STREAM_HELLO_RECORD;
+    stream->staged = 1;
+    return qed_stream_flush(stream);
+}
+
+qed_result_t qed_stream_open(qed_device_t *device, int fd, const uint8_t *key,
+                             size_t record_size, uint64_t rekey_bytes, qed_stream_t **stream) {
+    qed_stream_t *created;
+    qed_result_t result;
+    
+    if (!device || fd < 0 || !key || !stream || record_size > QED_STREAM_RECORD_MAX) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    created = calloc(1, sizeof(qed_stream_t));
+    if (!created) {
+        return QED_ERROR_MEMORY;
+    }
+    
+    created->fd = fd;
+    memcpy(created->base_key, key, QED_KEY_LENGTH);
+    created->record_size = record_size ? record_size : QED_STREAM_RECORD_DEFAULT;
+    created->rekey_bytes = rekey_bytes ? rekey_bytes : QED_STREAM_REKEY_DEFAULT;
+    
+    // Records need an AEAD; a device left on CBC streams with the backend
+    // this CPU runs fastest
+    created->tx_cipher = device->cipher == QED_CIPHER_AES_256_CBC ?
+        (uint8_t)qed_detect_cipher() : device->cipher;
+    
+    created->slot_size = QED_STREAM_HEADER_SIZE + created->record_size + QED_STREAM_TAG_LENGTH;
+    created->slot_count = QED_STREAM_BATCH_BYTES / created->slot_size;
+    if (created->slot_count < 2) {
+        created->slot_count = 2;
+    } else if (created->slot_count > QED_STREAM_BATCH_MAX) {
+        created->slot_count = QED_STREAM_BATCH_MAX;
+    }
+    created->slots = malloc(created->slot_count * created->slot_size);
+    created->iov = calloc(created->slot_count, sizeof(struct iovec));
+    
+    // Enough for a HELLO until the peer's record size is known
+    created->in_capacity = QED_STREAM_READ_AHEAD;
+    created->in = malloc(created->in_capacity);
+    
+    result = created->slots && created->iov && created->in ? QED_SUCCESS : QED_ERROR_MEMORY;
+    
+    // Both HELLOs go out before either end waits for the other's
+    if (result == QED_SUCCESS) {
+        result = qed_stream_hello(created);
+    }
+    if (result != QED_SUCCESS) {
+        free(created->slots);
+        free(created->iov);
+        free(created->in);
+        qed_secure_zero(created, sizeof(qed_stream_t));
+        free(created);
+        return result;
+    }
+    
+    *stream = created;
+    return QED_SUCCESS;
+}
+
+// Buffers at least need bytes from in_start; fewer only at end of input
+static qed_result_t qed_stream_fill(qed_stream_t *stream, size_t need) {
+    while (stream->in_end - stream->in_start < need) {
+        ssize_t n;
+        
+        if (stream->in_start + need > stream->in_capacity) {
+            memmove(stream->in, stream->in + stream->in_start, stream->in_end - stream->in_start);
+            stream->in_end -= stream->in_start;
+            stream->in_start = 0;
+        }
+        
+        n = read(stream->fd, stream->in + stream->in_end, stream->in_capacity - stream->in_end);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+                qed_stream_wait(stream->fd, POLLIN) == QED_SUCCESS) {
+                continue;
+            }
+            return QED_ERROR_FILE_IO;
+        }
+        if (n == 0) {
+            break;
+        }
+        stream->in_end += (size_t)n;
+    }
+    return QED_SUCCESS;
+}
+
+// Takes the next whole record off the input. *end is set, with no record,
+// when the input ends before a HELLO.
+static qed_result_t qed_stream_next(qed_stream_t *stream, const uint8_t **record,
+                                    size_t *body_len, bool *end) {
+    const uint8_t *header;
+    size_t length, limit;
+    qed_result_t result;
+    
+    *end = false;
+    result = qed_stream_fill(stream, QED_STREAM_HEADER_SIZE);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    if (stream->in_end - stream->in_start < QED_STREAM_HEADER_SIZE) {
+        if (stream->in_end == stream->in_start && !stream->rx_started) {
+            *end = true;
+            return QED_SUCCESS;
+        }
+        return QED_ERROR_DECRYPTION;
+    }
+    
+    header = stream->in + stream->in_start;
+    length = qed_get_le32(header + 4);
+    switch (header[0]) {
+        case QED_STREAM_HELLO:
+            limit = stream->rx_started ? 0 : QED_STREAM_HELLO_SIZE;
+            break;
+        case QED_STREAM_DATA:
+            limit = stream->rx_started ? stream->rx_record_size + QED_STREAM_TAG_LENGTH : 0;
+            break;
+        case QED_STREAM_REKEY:
+        case QED_STREAM_CLOSE:
+            limit = stream->rx_started ? QED_STREAM_TAG_LENGTH : 0;
+            break;
+        default:
+            limit = 0;
+            break;
+    }
+    if (limit == 0 || length > limit ||
+        (header[0] == QED_STREAM_HELLO ? length != limit : length < QED_STREAM_TAG_LENGTH)) {
+        return QED_ERROR_DECRYPTION;
+    }
+    
+    result = qed_stream_fill(stream, QED_STREAM_HEADER_SIZE + length);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    if (stream->in_end - stream->in_start < QED_STREAM_HEADER_SIZE + length) {
+        return QED_ERROR_DECRYPTION;
+    }
+    
+    *record = stream->in + stream->in_start;
+    *body_len = length;
+    stream->in_start += QED_STREAM_HEADER_SIZE + length;
+    return QED_SUCCESS;
+}
+
+// Keys both directions from the peer's HELLO and sizes the buffers for its
+// records
+static qed_result_t qed_stream_accept_hello(qed_stream_t *stream, const uint8_t *record) {
+    size_t record_size = qed_get_le32(record + QED_STREAM_HEADER_SIZE + QED_STREAM_SALT_LENGTH);
+    size_t capacity = QED_STREAM_HEADER_SIZE + record_size + QED_STREAM_TAG_LENGTH +
+                      QED_STREAM_READ_AHEAD;
+    size_t offset = (size_t)(record - stream->in);
+    const uint8_t *lower, *higher;
+    uint8_t *grown;
+    int order = memcmp(record + QED_STREAM_HEADER_SIZE, stream->hello + QED_STREAM_HEADER_SIZE,
+                       QED_STREAM_SALT_LENGTH);
+    
+    // Our own salt coming back is a reflection, not a peer
+    if (order == 0 || record_size == 0 || record_size > QED_STREAM_RECORD_MAX ||
+        record[1] == QED_CIPHER_AES_256_CBC || !qed_cipher_valid(record[1])) {
+        return QED_ERROR_DECRYPTION;
+    }
+    
+    stream->plain = malloc(record_size);
+    if (!stream->plain) {
+        return QED_ERROR_MEMORY;
+    }
+    if (capacity > stream->in_capacity) {
+        grown = realloc(stream->in, capacity);
+        if (!grown) {
+            return QED_ERROR_MEMORY;
+        }
+        stream->in = grown;
+        stream->in_capacity = capacity;
+        record = grown + offset;
+    }
+    
+    stream->rx_cipher = record[1];
+    stream->rx_record_size = record_size;
+    lower = order > 0 ? stream->hello : record;
+    higher = order > 0 ? record : stream->hello;
+    qed_stream_traffic_key(stream->base_key, order > 0 ? QED_STREAM_C2S_INFO : QED_STREAM_S2C_INFO,
+                           lower, higher, &stream->tx);
+    qed_stream_traffic_key(stream->base_key, order > 0 ? QED_STREAM_S2C_INFO : QED_STREAM_C2S_INFO,
+                           lower, higher, &stream->rx);
+    stream->rx_started = true;
+    return QED_SUCCESS;
+}
+
+// Takes the peer's HELLO off the input before the first write
+static qed_result_t qed_stream_await_hello(qed_stream_t *stream) {
+    const uint8_t *record;
+    size_t body_len;
+    qed_result_t result;
+    bool end;
+    
+    if (stream->rx_failed) {
+        return QED_ERROR_DECRYPTION;
+    }
+    result = qed_stream_next(stream, &record, &body_len, &end);
+    if (result == QED_SUCCESS) {
+        result = end ? QED_ERROR_DECRYPTION : qed_stream_accept_hello(stream, record);
+    }
+    if (result != QED_SUCCESS) {
+        stream->rx_failed = true;
+    }
+    return result;
+}
+
+qed_result_t qed_stream_write(qed_stream_t *stream, const void *data, size_t length) {
+    const uint8_t *p = data;
+    qed_result_t result;
+    
+    if (!stream || (!data && length > 0)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    if (stream->tx_failed) {
+        return QED_ERROR_FILE_IO;
+    }
+    
+    if (!stream->rx_started) {
+        result = qed_stream_await_hello(stream);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+    }
+    
+    while (length > 0) {
+        size_t take = length < stream->record_size ? length : stream->record_size;
+        
+        if (stream->tx.bytes >= stream->rekey_bytes) {
+            result = qed_stream_seal(stream, QED_STREAM_REKEY, NULL, 0);
+            if (result != QED_SUCCESS) {
+                return result;
+            }
+            qed_stream_ratchet(&stream->tx);
+        }
+        
+        result = qed_stream_seal(stream, QED_STREAM_DATA, p, take);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        p += take;
+        length -= take;
+    }
+    
+    return qed_stream_flush(stream);
+}
+
+static qed_result_t qed_stream_unseal(qed_stream_t *stream, const uint8_t *record,
+                                      size_t body_len, uint8_t *plain, size_t *plain_len) {
+    uint8_t iv[QED_IV_LENGTH];
+    uint8_t none[1];
+    qed_result_t result;
+    
+    qed_stream_nonce(stream->rx.sequence, iv);
+    result = qed_cipher_decrypt(stream->rx_cipher, stream->rx.key, iv,
+                                record, QED_STREAM_HEADER_SIZE,
+                                record + QED_STREAM_HEADER_SIZE, body_len,
+                                plain ? plain : none, plain_len);
+    if (result != QED_SUCCESS) {
+        return QED_ERROR_DECRYPTION;
+    }
+    stream->rx.sequence++;
+    return QED_SUCCESS;
+}
+
+static qed_result_t qed_stream_receive(qed_stream_t *stream, uint8_t *buffer, size_t capacity,
+                                       size_t *received) {
+    const uint8_t *record;
+    size_t body_len, plain_len;
+    qed_result_t result;
+    bool end;
+    
+    for (;;) {
+        result = qed_stream_next(stream, &record, &body_len, &end);
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+        if (end) {
+            stream->rx_closed = true;
+            return QED_SUCCESS;
+        }
+        
+        switch (record[0]) {
+            case QED_STREAM_HELLO:
+                result = qed_stream_accept_hello(stream, record);
+                break;
+            case QED_STREAM_REKEY:
+                result = qed_stream_unseal(stream, record, body_len, NULL, &plain_len);
+                if (result == QED_SUCCESS) {
+                    qed_stream_ratchet(&stream->rx);
+                }
+                break;
+            case QED_STREAM_CLOSE:
+                result = qed_stream_unseal(stream, record, body_len, NULL, &plain_len);
+                stream->rx_closed = result == QED_SUCCESS;
+                return result;
+            default:
+                // Straight into the caller's buffer when the record fits
+                if (body_len - QED_STREAM_TAG_LENGTH <= capacity) {
+                    return qed_stream_unseal(stream, record, body_len, buffer, received);
+                }
+                result = qed_stream_unseal(stream, record, body_len, stream->plain, &plain_len);
+                if (result != QED_SUCCESS) {
+                    return result;
+                }
+                memcpy(buffer, stream->plain, capacity);
+                stream->plain_start = capacity;
+                stream->plain_end = plain_len;
+                *received = capacity;
+                return QED_SUCCESS;
+        }
+        if (result != QED_SUCCESS) {
+            return result;
+        }
+    }
+}
+
+qed_result_t qed_stream_read(qed_stream_t *stream, void *buffer, size_t capacity,
+                             size_t *received) {
+    qed_result_t result;
+    
+    if (!stream || !received || (!buffer && capacity > 0)) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    *received = 0;
+    if (stream->rx_failed) {
+        return QED_ERROR_DECRYPTION;
+    }
+    if (capacity == 0) {
+        return QED_SUCCESS;
+    }
+    
+    if (stream->plain_start < stream->plain_end) {
+        size_t take = stream->plain_end - stream->plain_start;
+        
+        if (take > capacity) {
+            take = capacity;
+        }
+        memcpy(buffer, stream->plain + stream->plain_start, take);
+        stream->plain_start += take;
+        if (stream->plain_start == stream->plain_end) {
+            qed_secure_zero(stream->plain, stream->plain_end);
+            stream->plain_start = stream->plain_end = 0;
+        }
+        *received = take;
+        return QED_SUCCESS;
+    }
+    
+    // An empty DATA record carries nothing to return; wait for the next
+    while (!stream->rx_closed && *received == 0) {
+        result = qed_stream_receive(stream, buffer, capacity, received);
+        if (result != QED_SUCCESS) {
+            // A failed record leaves the input at an unknown position
+            stream->rx_failed = true;
+            *received = 0;
+            return result;
+        }
+    }
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_stream_close(qed_stream_t *stream) {
+    qed_result_t result = QED_SUCCESS;
+    
+    if (!stream) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (stream->rx_started && !stream->tx_failed) {
+        result = qed_stream_seal(stream, QED_STREAM_CLOSE, NULL, 0);
+        if (result == QED_SUCCESS) {
+            result = qed_stream_flush(stream);
+        }
+    }
+    
+    qed_secure_zero(stream->slots, stream->slot_count * stream->slot_size);
+    if (stream->plain) {
+        qed_secure_zero(stream->plain, stream->rx_record_size);
+    }
+    free(stream->slots);
+    free(stream->iov);
+    free(stream->in);
+    free(stream->plain);
+    qed_secure_zero(stream, sizeof(qed_stream_t));
+    free(stream);
+    
+    return result;
+}
@@ -0,0 +1,193 @@
+/*
+ * Quantum Encryption Device (QED) - Per-File Subkeys
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+/*
+ * HKDF-SHA-256 (RFC 5869) with the device key as input keying material:
+ *
+ *   PRK    = HMAC("QED-HKDF", key || quantum noise)       once per key
+ *   subkey = HMAC(PRK, "QED subkey" || salt || 0x01)     once per file
+ *
+ * The extract step and the PRK's ipad/opad compressions are done once and
+ * cached with the key, so each file costs two SHA-256 compressions on the
+ * heap-free single-stream engine and no allocation. Subkeys are never
+ * stored; the salt travels in the file header and the subkey is derived
+ * again on decryption.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+#define QED_SUBKEY_BLOCK_SIZE 64
+#define QED_SUBKEY_EXTRACT_SALT "QED-HKDF"
+#define QED_SUBKEY_INFO "QED subkey"
+
+struct qed_subkey_state {
+    qed_sha256_ctx_t inner;
+    qed_sha256_ctx_t outer;
+};
+
+// Absorbs key ^ pad into a fresh context (key is at most one block)
+static void qed_subkey_pad(qed_sha256_ctx_t *ctx, const uint8_t *key, size_t key_len,
+                           uint8_t pad_byte) {
+    uint8_t pad[QED_SUBKEY_BLOCK_SIZE];
+    size_t i;
+    
+    memset(pad, pad_byte, sizeof(pad));
+    for (i = 0; i < key_len; i++) {
+        pad[i] ^= key[i];
+    }
+    qed_sha256_init(ctx);
+    qed_sha256_update(ctx, pad, sizeof(pad));
+    qed_secure_zero(pad, sizeof(pad));
+}
+
+static void qed_subkey_hmac_finish(qed_sha256_ctx_t *inner, const qed_sha256_ctx_t *outer_pad,
+                                   uint8_t *mac) {
+    qed_sha256_ctx_t outer = *outer_pad;
+    uint8_t inner_hash[QED_SIGNATURE_LENGTH];
+    
+    qed_sha256_final(inner, inner_hash);
+    qed_sha256_update(&outer, inner_hash, sizeof(inner_hash));
+    qed_sha256_final(&outer, mac);
+    qed_secure_zero(inner_hash, sizeof(inner_hash));
+}
+
+qed_subkey_state_t* qed_subkey_state_new(const qed_hardware_sig_t *hw_sig, const uint8_t *key) {
+    qed_sha256_ctx_t inner, outer;
+    uint8_t prk[QED_SIGNATURE_LENGTH];
+    qed_subkey_state_t *state;
+    
+    if (!hw_sig || !key) {
+        return NULL;
+    }
+    
+    state = calloc(1, sizeof(qed_subkey_state_t));
+    if (!state) {
+        return NULL;
+    }
+    
+    // Extract
+    qed_subkey_pad(&inner, (const uint8_t *)QED_SUBKEY_EXTRACT_SALT,
+                   sizeof(QED_SUBKEY_EXTRACT_SALT) - 1, 0x36);
+    qed_subkey_pad(&outer, (const uint8_t *)QED_SUBKEY_EXTRACT_SALT,
+                   sizeof(QED_SUBKEY_EXTRACT_SALT) - 1, 0x5c);
+    qed_sha256_update(&inner, key, QED_KEY_LENGTH);
+    qed_sha256_update(&inner, hw_sig->quantum_noise,
+                      strnlen(hw_sig->quantum_noise, QED_QUANTUM_NOISE_LENGTH));
+    qed_subkey_hmac_finish(&inner, &outer, prk);
+    qed_secure_zero(&outer, sizeof(outer));
+    
+    // Pad states for the expand step
+    qed_subkey_pad(&state->inner, prk, sizeof(prk), 0x36);
+    qed_subkey_pad(&state->outer, prk, sizeof(prk), 0x5c);
+    qed_secure_zero(prk, sizeof(prk));
+    
+    return state;
+}
+
+void qed_subkey_state_free(qed_subkey_state_t *state) {
+    if (!state) {
+        return;
+    }
+    
+    qed_secure_zero(state, sizeof(*state));
+    free(state);
+}
+
+void qed_subkey_derive(const qed_subkey_state_t *state, const uint8_t *salt, uint8_t *subkey) {
+    static const uint8_t counter = 0x01;
+    qed_sha256_ctx_t inner = state->inner;
+    
+    // Expand: one output block covers the 32-byte key
+    qed_sha256_update(&inner, QED_SUBKEY_INFO, sizeof(QED_SUBKEY_INFO) - 1);
+    qed_sha256_update(&inner, salt, QED_SUBKEY_SALT_LENGTH);
+    qed_sha256_update(&inner, &counter, 1);
+    qed_subkey_hmac_finish(&inner, &state->outer, subkey);
+}
+
+qed_result_t qed_get_subkey_state(qed_device_t *device, const char *key_id,
+                                  const qed_subkey_state_t **state) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    qed_quantum_key_t *slot = NULL;
+    qed_result_t result;
+    size_t i;
+    
+    if (!device || !key_id || !state) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    // Makes sure the key exists in the device cache
+    result = qed_generate_quantum_key(device, key_id, quantum_key, QED_KEY_LENGTH);
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    for (i = 0; i < device->key_count; i++) {
+        if (device->quantum_keys[i].in_use &&
+            strcmp(device->quantum_keys[i].key_id, key_id) == 0) {
+            slot = &device->quantum_keys[i];
+            break;
+        }
+    }
+    
+    if (!slot) {
+        return QED_ERROR_KEY_NOT_FOUND;
+    }
+    
+    if (!slot->subkey_state) {
+        slot->subkey_state = qed_subkey_state_new(&device->hardware_sig, slot->key_data);
+        if (!slot->subkey_state) {
+            return QED_ERROR_MEMORY;
+        }
+    }
+    
+    *state = slot->subkey_state;
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_file_key(qed_device_t *device, const char *key_id, const uint8_t *salt,
+                          uint8_t *key) {
+    const qed_subkey_state_t *state;
+    qed_result_t result;
+    
+    if (!salt) {
+        return qed_generate_quantum_key(device, key_id, key, QED_KEY_LENGTH);
+    }
+    
+    result = qed_get_subkey_state(device, key_id, &state);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    qed_subkey_derive(state, salt, key);
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_set_subkeys(qed_device_t *device, bool enabled) {
+    if (!device) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    device->subkeys = enabled;
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_derive_subkey(qed_device_t *device, const char *key_id,
+                               const uint8_t *salt, uint8_t *subkey) {
+    if (!device || !key_id || !salt || !subkey) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    return qed_file_key(device, key_id, salt, subkey);
+}
@@ -0,0 +1,170 @@
+/*
+ * Quantum Encryption Device (QED) - Trace Export
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include "quantum_internal.h"
+
+#define QED_TRACE_DEFAULT_EVENTS 65536
+
+/*
+ * Each slot holds one completed span (begin timestamp plus duration), which
+ * Chrome renders exactly like a matching B/E pair but cannot be torn apart
+ * when the ring wraps. A slot's sequence number is published last so the
+ * dump can skip slots that are still being written.
+ */
+typedef struct {
+    uint64_t sequence;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t bytes;
+    const char *name;
+    const char *category;
+    uint32_t thread_id;
+} qed_trace_event_t;
+
+static qed_trace_event_t *trace_events = NULL;
+static size_t trace_capacity = 0;
+static uint64_t trace_next = 0;
+// Threads inside qed_trace_record(), which may still hold the buffer
+static uint32_t trace_writers = 0;
+static __thread uint32_t trace_thread_id = 0;
+
+static uint32_t qed_trace_thread_id(void) {
+    if (trace_thread_id == 0) {
+        trace_thread_id = (uint32_t)syscall(SYS_gettid);
+    }
+    return trace_thread_id;
+}
+
+void qed_trace_record(const char *name, const char *category,
+                      uint64_t start_ns, uint64_t end_ns, uint64_t bytes) {
+    qed_trace_event_t *events;
+    qed_trace_event_t *event;
+    uint64_t sequence;
+    
+    __atomic_fetch_add(&trace_writers, 1, __ATOMIC_SEQ_CST);
+    events = __atomic_load_n(&trace_events, __ATOMIC_SEQ_CST);
+    if (!events) {
+        __atomic_fetch_sub(&trace_writers, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    
+    sequence = __atomic_fetch_add(&trace_next, 1, __ATOMIC_RELAXED);
+    event = &events[sequence % trace_capacity];
+    
+    __atomic_store_n(&event->sequence, 0, __ATOMIC_RELAXED);
+    event->start_ns = start_ns;
+    event->end_ns = end_ns;
+    event->bytes = bytes;
+    event->name = name;
+    event->category = category;
+    event->thread_id = qed_trace_thread_id();
+    __atomic_store_n(&event->sequence, sequence + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&trace_writers, 1, __ATOMIC_RELEASE);
+}
+
+qed_result_t qed_trace_start(size_t max_events) {
+    qed_trace_event_t *events;
+    
+    if (max_events == 0) {
+        max_events = QED_TRACE_DEFAULT_EVENTS;
+    }
+    
+    // Restarting discards the previous buffer, once no writer that loaded
+    // it before it was withdrawn is still filling a slot
+    qed_trace_stop();
+    events = __atomic_exchange_n(&trace_events, NULL, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&trace_writers, __ATOMIC_ACQUIRE) != 0) {
+        sched_yield();
+    }
+    free(events);
+    
+    events = calloc(max_events, sizeof(qed_trace_event_t));
+    if (!events) {
+        return QED_ERROR_MEMORY;
+    }
+    
+    trace_capacity = max_events;
+    __atomic_store_n(&trace_next, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&trace_events, events, __ATOMIC_RELEASE);
+    __atomic_fetch_or(&qed_stats_active, QED_STATS_FLAG_TRACE, __ATOMIC_RELEASE);
+    
+    return QED_SUCCESS;
+}
+
+void qed_trace_stop(void) {
+    // Events already in flight still land in the buffer, which is kept for
+    // qed_trace_dump() until the next qed_trace_start()
+    __atomic_fetch_and(&qed_stats_active, ~QED_STATS_FLAG_TRACE, __ATOMIC_RELEASE);
+}
+
+qed_result_t qed_trace_dump(const char *path) {
+    FILE *file;
+    uint64_t next, first, sequence;
+    uint64_t base_ns = 0;
+    bool first_event = true;
+    int pid = (int)getpid();
+    
+    if (!path) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    if (!trace_events) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    file = fopen(path, "w");
+    if (!file) {
+        return QED_ERROR_FILE_IO;
+    }
+    
+    next = __atomic_load_n(&trace_next, __ATOMIC_ACQUIRE);
+    first = next > trace_capacity ? next - trace_capacity : 0;
+    
+    // Timestamps are rebased onto the oldest surviving event
+    for (sequence = first; sequence < next; sequence++) {
+        const qed_trace_event_t *event = &trace_events[sequence % trace_capacity];
+        if (__atomic_load_n(&event->sequence, __ATOMIC_ACQUIRE) == sequence + 1 &&
+            (base_ns == 0 || event->start_ns < base_ns)) {
+            base_ns = event->start_ns;
+        }
+    }
+    
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    
+    for (sequence = first; sequence < next; sequence++) {
+        const qed_trace_event_t *event = &trace_events[sequence % trace_capacity];
+        
+        if (__atomic_load_n(&event->sequence, __ATOMIC_ACQUIRE) != sequence + 1) {
+            continue;
+        }
+        
+        fprintf(file,
+                "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"bytes\":%lu}}",
+                first_event ? "" : ",\n", event->name, event->category, pid,
+                event->thread_id, (event->start_ns - base_ns) / 1e3,
+                (event->end_ns - event->start_ns) / 1e3, event->bytes);
+        first_event = false;
+    }
+    
+    fprintf(file, "\n]}\n");
+    
+    if (fclose(file) != 0) {
+        return QED_ERROR_FILE_IO;
+    }
+    
+    return QED_SUCCESS;
+}
@@ -0,0 +1,316 @@
+/*
+ * Quantum Encryption Device (QED) - Integrity Verification
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#include "../include/quantum_encryption.h"
+#include "quantum_internal.h"
+
+// Read size for streaming whole-file signatures
+#define QED_VERIFY_BLOCK_SIZE (256 * 1024)
+
+typedef struct {
+    const qed_hardware_sig_t *hw_sig;
+    const uint8_t *key;
+    const qed_mac_state_t *mac;
+    const qed_subkey_state_t *subkey;
+    const char *const *paths;
+    qed_verify_result_t *results;
+} qed_verify_batch_t;
+
+static double qed_verify_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Whole-file formats sign everything after the signature:
+ *
+ *   original   signature(32) IV(16) ciphertext    SHA-256(ciphertext || key || noise)
+ *   versioned  header(16) [salt(16)] signature(32) IV(16) ciphertext
+ *                                                 SHA-256(header || IV || ciphertext || key || noise)
+ *                                                 or HMAC(header || IV || ciphertext)
+ *
+ * A salted file's header covers the salt and its key is the per-file subkey.
+ * Both digests are fed from the same pass over the file.
+ */
+static qed_result_t qed_verify_whole_file(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                                          const qed_mac_state_t *mac,
+                                          const qed_subkey_state_t *subkey, int fd, uint64_t size,
+                                          uint8_t *buffer, uint64_t *bytes) {
+    uint8_t head[QED_BUFFER_HEADER_SIZE + QED_SUBKEY_SALT_LENGTH + QED_SIGNATURE_LENGTH];
+    uint8_t file_key[QED_KEY_LENGTH];
+    uint8_t digest_v1[QED_SIGNATURE_LENGTH];
+    uint8_t digest_v2[QED_SIGNATURE_LENGTH];
+    size_t noise_len = strlen(hw_sig->quantum_noise);
+    size_t header_len = 0;
+    EVP_MD_CTX *ctx_v1 = NULL;
+    EVP_MD_CTX *ctx_v2 = NULL;
+    uint64_t offset = sizeof(head);
+    bool versioned, keyed;
+    int ok;
+    qed_result_t result;
+    
+    if (size < QED_SIGNATURE_LENGTH + QED_IV_LENGTH + 16) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    result = qed_pread_full(fd, head, sizeof(head), 0);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    if (memcmp(head, QED_BUFFER_MAGIC, 4) == 0) {
+        header_len = qed_buffer_header_len(head);
+    }
+    versioned = header_len != 0 && size >= header_len + QED_RECORD_OVERHEAD;
+    keyed = versioned && head[5] == QED_MAC_HMAC_SHA256;
+    
+    memcpy(file_key, key, sizeof(file_key));
+    if (versioned && header_len > QED_BUFFER_HEADER_SIZE) {
+        qed_subkey_derive(subkey, head + QED_BUFFER_HEADER_SIZE, file_key);
+    }
+    
+    ctx_v1 = EVP_MD_CTX_new();
+    ctx_v2 = versioned ? EVP_MD_CTX_new() : NULL;
+    ok = ctx_v1 && (!versioned || ctx_v2) &&
+         EVP_DigestInit_ex(ctx_v1, EVP_sha256(), NULL) == 1 &&
+         EVP_DigestUpdate(ctx_v1, head + QED_SIGNATURE_LENGTH + QED_IV_LENGTH,
+                          sizeof(head) - QED_SIGNATURE_LENGTH - QED_IV_LENGTH) == 1;
+    if (ok && versioned) {
+        // The versioned signature covers the header and the IV
+        ok = (keyed ? qed_mac_begin(mac, ctx_v2) == QED_SUCCESS :
+                      EVP_DigestInit_ex(ctx_v2, EVP_sha256(), NULL) == 1) &&
+             EVP_DigestUpdate(ctx_v2, head, header_len) == 1 &&
+             EVP_DigestUpdate(ctx_v2, head + header_len + QED_SIGNATURE_LENGTH,
+                              sizeof(head) - header_len - QED_SIGNATURE_LENGTH) == 1;
+    }
+    
+    QED_STAGE_BEGIN(stage_start);
+    while (ok && offset < size) {
+        size_t block = size - offset < QED_VERIFY_BLOCK_SIZE ?
+            (size_t)(size - offset) : QED_VERIFY_BLOCK_SIZE;
+        
+        result = qed_pread_full(fd, buffer, block, offset);
+        if (result != QED_SUCCESS) {
+            EVP_MD_CTX_free(ctx_v1);
+            EVP_MD_CTX_free(ctx_v2);
+            qed_secure_zero(file_key, sizeof(file_key));
+            return result;
+        }
+        
+        ok = EVP_DigestUpdate(ctx_v1, buffer, block) == 1 &&
+             (!versioned || EVP_DigestUpdate(ctx_v2, buffer, block) == 1);
+        offset += block;
+    }
+    
+    ok = ok &&
+         EVP_DigestUpdate(ctx_v1, key, QED_KEY_LENGTH) == 1 &&
+         EVP_DigestUpdate(ctx_v1, hw_sig->quantum_noise, noise_len) == 1 &&
+         EVP_DigestFinal_ex(ctx_v1, digest_v1, NULL) == 1;
+    if (ok && keyed) {
+        ok = qed_mac_finish(mac, ctx_v2, digest_v2) == QED_SUCCESS;
+    } else if (ok && versioned) {
+        ok = EVP_DigestUpdate(ctx_v2, file_key, QED_KEY_LENGTH) == 1 &&
+             EVP_DigestUpdate(ctx_v2, hw_sig->quantum_noise, noise_len) == 1 &&
+             EVP_DigestFinal_ex(ctx_v2, digest_v2, NULL) == 1;
+    }
+    QED_STAGE_END(QED_STAGE_MAC, stage_start, size);
+    
+    EVP_MD_CTX_free(ctx_v1);
+    EVP_MD_CTX_free(ctx_v2);
+    qed_secure_zero(file_key, sizeof(file_key));
+    
+    if (!ok) {
+        return QED_ERROR_ENCRYPTION;
+    }
+    
+    *bytes = size;
+    
+    if (versioned && CRYPTO_memcmp(digest_v2, head + header_len,
+                                   QED_SIGNATURE_LENGTH) == 0) {
+        return QED_SUCCESS;
+    }
+    
+    if (CRYPTO_memcmp(digest_v1, head, QED_SIGNATURE_LENGTH) == 0) {
+        return QED_SUCCESS;
+    }
+    
+    return QED_ERROR_SIGNATURE_MISMATCH;
+}
+
+static qed_result_t qed_verify_chunked_file(const qed_hardware_sig_t *hw_sig, const uint8_t *key,
+                                            const qed_mac_state_t *mac,
+                                            const qed_subkey_state_t *subkey, const char *path,
+                                            uint64_t *bytes) {
+    qed_chunked_reader_t reader;
+    uint8_t file_key[QED_KEY_LENGTH];
+    uint8_t aad[QED_CHUNKED_AAD_SIZE];
+    uint8_t *record;
+    size_t record_len, aad_len;
+    uint64_t i;
+    qed_result_t result;
+    
+    result = qed_chunked_open(path, &reader);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    record = qed_mem_alloc(QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    if (!record) {
+        qed_chunked_close(&reader);
+        return QED_ERROR_MEMORY;
+    }
+    
+    memcpy(file_key, key, sizeof(file_key));
+    if (reader.header[7] & QED_CHUNKED_FLAG_SUBKEY) {
+        qed_subkey_derive(subkey, reader.header + 24, file_key);
+    }
+    
+    result = qed_chunked_load_map(&reader, hw_sig, file_key,
+                                  reader.mac == QED_MAC_HMAC_SHA256 ? mac : NULL);
+    if (result == QED_SUCCESS) {
+        *bytes += reader.map_len;
+    }
+    
+    for (i = 0; i < reader.chunk_count && result == QED_SUCCESS; i++) {
+        if (qed_chunked_is_hole(&reader, i)) {
+            continue;
+        }
+        
+        result = qed_chunked_fetch_record(&reader, i, record, &record_len, aad, &aad_len);
+        if (result != QED_SUCCESS) {
+            break;
+        }
+        
+        result = qed_verify_record(hw_sig, file_key, reader.mac == QED_MAC_HMAC_SHA256 ? mac : NULL,
+                                   aad, aad_len, record, record_len);
+        if (result != QED_SUCCESS) {
+            break;
+        }
+        *bytes += record_len;
+    }
+    
+    qed_secure_zero(file_key, sizeof(file_key));
+    qed_mem_free(record, QED_CHUNKED_RECORD_MAX(reader.chunk_size));
+    qed_chunked_close(&reader);
+    return result;
+}
+
+static void qed_verify_worker(void *ctx, size_t index) {
+    qed_verify_batch_t *batch = ctx;
+    qed_verify_result_t *entry = &batch->results[index];
+    const char *path = batch->paths[index];
+    double start = qed_verify_now();
+    uint8_t *buffer;
+    struct stat st;
+    int fd;
+    
+    QED_MEM_SCOPE(QED_OP_FILE_VERIFY);
+    QED_OP_BEGIN(op_start);
+    
+    entry->bytes = 0;
+    
+    if (qed_is_chunked_file(path)) {
+        entry->result = qed_verify_chunked_file(batch->hw_sig, batch->key, batch->mac,
+                                                batch->subkey, path, &entry->bytes);
+    } else {
+        fd = open(path, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            entry->result = QED_ERROR_FILE_IO;
+            if (fd >= 0) {
+                close(fd);
+            }
+        } else {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            buffer = qed_mem_alloc(QED_VERIFY_BLOCK_SIZE);
+            entry->result = buffer ?
+                qed_verify_whole_file(batch->hw_sig, batch->key, batch->mac, batch->subkey,
+                                      fd, (uint64_t)st.st_size, buffer, &entry->bytes) :
+                QED_ERROR_MEMORY;
+            qed_mem_free(buffer, QED_VERIFY_BLOCK_SIZE);
+            close(fd);
+        }
+    }
+    
+    entry->seconds = qed_verify_now() - start;
+    QED_OP_END(QED_OP_FILE_VERIFY, op_start, entry->bytes);
+}
+
+qed_result_t qed_verify_files(qed_device_t *device, const char *key_id,
+                             const char *const *paths, size_t count,
+                             qed_verify_result_t *results) {
+    uint8_t quantum_key[QED_KEY_LENGTH];
+    qed_verify_batch_t batch;
+    qed_result_t result;
+    size_t i;
+    
+    if (!device || !key_id || !paths || !results) {
+        return QED_ERROR_INVALID_INPUT;
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!paths[i]) {
+            return QED_ERROR_INVALID_INPUT;
+        }
+    }
+    
+    // Workers share one derived key and only read the hardware signature
+    result = qed_generate_quantum_key(device, key_id, quantum_key, QED_KEY_LENGTH);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    // Files may use either signature mode, so the keyed state is always ready
+    result = qed_get_mac_state(device, key_id, &batch.mac);
+    if (result != QED_SUCCESS) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        return result;
+    }
+    
+    // Likewise salted files need the subkey state
+    result = qed_get_subkey_state(device, key_id, &batch.subkey);
+    if (result != QED_SUCCESS) {
+        qed_secure_zero(quantum_key, sizeof(quantum_key));
+        return result;
+    }
+    
+    batch.hw_sig = &device->hardware_sig;
+    batch.key = quantum_key;
+    batch.paths = paths;
+    batch.results = results;
+    
+    // Files are claimed one at a time, so each worker holds a single read
+    // buffer no matter how many files are queued
+    qed_parallel_for(count, qed_verify_worker, &batch);
+    
+    qed_secure_zero(quantum_key, sizeof(quantum_key));
+    return QED_SUCCESS;
+}
+
+qed_result_t qed_verify_file(qed_device_t *device, const char *key_id, const char *path) {
+    qed_verify_result_t entry;
+    qed_result_t result;
+    
+    result = qed_verify_files(device, key_id, &path, 1, &entry);
+    if (result != QED_SUCCESS) {
+        return result;
+    }
+    
+    return entry.result;
+}
@@ -0,0 +1,1121 @@
+/*
+ * Quantum Encryption Device (QED) - Format Tests
+ *
+ * Hardware-Dependent Cryptographic System Based on Physical Resonance
+ * Copyright (C) 2025 Americo Simoes. All rights reserved.
+ *
+ * This software is proprietary and confidential. Unauthorized copying,
+ * distribution, or modification is strictly prohibited.
+ */
+
+// Round trips through every format, then flipped bits, spliced records and
+// truncations that each must be rejected. Library output goes to stdout;
+// results go to stderr, and the exit status is the number of failures.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include "../include/quantum_encryption.h"
+#include "../src/quantum_internal.h"
+
+#define TEST_KEY "test"
+#define TEST_CHUNK_SIZE 4096
+
+static char test_dir[] = "/tmp/qed-test-XXXXXX";
+static int test_failures = 0;
+
+#define TEST_CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "  ❌ %s:%d: ", __func__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        test_failures++; \
+    } \
+} while (0)
+
+static void test_fill(uint8_t *data, size_t length, unsigned seed) {
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        data[i] = (uint8_t)((i * 131 + seed * 17 + (i >> 7)) ^ (i >> 13));
+    }
+}
+
+static int test_write(const char *path, const void *data, size_t length) {
+    FILE *file = fopen(path, "wb");
+    size_t written;
+
+    if (!file) {
+        return -1;
+    }
+    written = length ? fwrite(data, 1, length, file) : 0;
+    return fclose(file) == 0 && written == length ? 0 : -1;
+}
+
+// Whole file in a malloc'd buffer, or NULL
+static uint8_t* test_read(const char *path, size_t *length) {
+    struct stat st;
+    uint8_t *data;
+    FILE *file;
+
+    if (stat(path, &st) != 0 || !(file = fopen(path, "rb"))) {
+        return NULL;
+    }
+    data = malloc(st.st_size ? (size_t)st.st_size : 1);
+    if (data && fread(data, 1, (size_t)st.st_size, file) != (size_t)st.st_size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *length = (size_t)st.st_size;
+    return data;
+}
+
+static bool test_same(const char *path, const uint8_t *expected, size_t length) {
+    size_t actual_len;
+    uint8_t *actual = test_read(path, &actual_len);
+    bool same = actual && actual_len == length && memcmp(actual, expected, length) == 0;
+
+    free(actual);
+    return same;
+}
+
+static int test_copy(const char *from, const char *to) {
+    size_t length;
+    uint8_t *data = test_read(from, &length);
+    int status = data ? test_write(to, data, length) : -1;
+
+    free(data);
+    return status;
+}
+
+// Copies from into to with the byte at offset (from the end if negative)
+// flipped
+static int test_flip(const char *from, const char *to, long offset) {
+    size_t length;
+    uint8_t *data = test_read(from, &length);
+    int status = -1;
+
+    if (data && length > 0) {
+        size_t at = offset < 0 ? length - (size_t)(-offset) : (size_t)offset;
+        if (at < length) {
+            data[at] ^= 0x01;
+            status = test_write(to, data, length);
+        }
+    }
+    free(data);
+    return status;
+}
+
+// Copies from into to without its last cut bytes
+static int test_truncate(const char *from, const char *to, size_t cut) {
+    size_t length;
+    uint8_t *data = test_read(from, &length);
+    int status = data && length >= cut ? test_write(to, data, length - cut) : -1;
+
+    free(data);
+    return status;
+}
+
+// Overwrites length bytes of to at offset with the same bytes of from
+static int test_splice(const char *from, const char *to, uint64_t offset, size_t length) {
+    size_t from_len, to_len;
+    uint8_t *source = test_read(from, &from_len);
+    uint8_t *target = test_read(to, &to_len);
+    int status = -1;
+
+    if (source && target && offset + length <= from_len && offset + length <= to_len) {
+        memcpy(target + offset, source + offset, length);
+        status = test_write(to, target, to_len);
+    }
+    free(source);
+    free(target);
+    return status;
+}
+
+// Offset and length of a chunk's record, from the chunked file's index
+static bool test_chunk_record(const char *path, uint64_t chunk, uint64_t *offset,
+                              uint32_t *length) {
+    size_t file_len;
+    uint8_t *data = test_read(path, &file_len);
+    bool found = false;
+
+    if (data && file_len >= QED_CHUNKED_HEADER_SIZE + QED_CHUNKED_FOOTER_SIZE) {
+        const uint8_t *footer = data + file_len - QED_CHUNKED_FOOTER_SIZE;
+        uint64_t index_offset = qed_get_le64(footer);
+
+        if (chunk < qed_get_le64(footer + 8) &&
+            index_offset + (chunk + 1) * QED_CHUNKED_INDEX_ENTRY_SIZE <= file_len) {
+            const uint8_t *entry = data + index_offset + chunk * QED_CHUNKED_INDEX_ENTRY_SIZE;
+            *offset = qed_get_le64(entry);
+            *length = qed_get_le32(entry + 8);
+            found = true;
+        }
+    }
+    free(data);
+    return found;
+}
+
+// Copies from into to with the header's plaintext size moved by delta
+static int test_resize_header(const char *from, const char *to, int64_t delta) {
+    size_t length;
+    uint8_t *data = test_read(from, &length);
+    int status = -1;
+
+    if (data && length >= QED_CHUNKED_HEADER_SIZE) {
+        qed_put_le64(data + 16, qed_get_le64(data + 16) + (uint64_t)delta);
+        status = test_write(to, data, length);
+    }
+    free(data);
+    return status;
+}
+
+// Each damaged copy of a whole-file ciphertext must fail to decrypt. The
+// original format signs its ciphertext but not the IV at bytes 32..47.
+static void test_file_tampering(qed_device_t *device, const char *sealed, bool original) {
+    const long flips[] = {0, 20, 40, 60, -1};
+    const char *damaged = "damaged";
+    const char *opened = "damaged.out";
+    size_t i;
+
+    for (i = 0; i < sizeof(flips) / sizeof(flips[0]); i++) {
+        if (original && flips[i] == 40) {
+            continue;
+        }
+        unlink(opened);
+        TEST_CHECK(test_flip(sealed, damaged, flips[i]) == 0, "cannot flip byte %ld", flips[i]);
+        TEST_CHECK(qed_decrypt_file(device, TEST_KEY, damaged, opened) != QED_SUCCESS,
+                   "%s with byte %ld flipped decrypted", sealed, flips[i]);
+        TEST_CHECK(access(opened, F_OK) != 0, "failed decryption left %s behind", opened);
+    }
+    TEST_CHECK(test_truncate(sealed, damaged, 1) == 0, "cannot truncate");
+    TEST_CHECK(qed_decrypt_file(device, TEST_KEY, damaged, opened) != QED_SUCCESS,
+               "%s without its last byte decrypted", sealed);
+    TEST_CHECK(access(opened, F_OK) != 0, "failed decryption left %s behind", opened);
+}
+
+static void test_buffers(qed_device_t *device) {
+    const qed_cipher_t ciphers[] = {QED_CIPHER_AES_256_CBC, QED_CIPHER_AES_256_GCM,
+                                    QED_CIPHER_CHACHA20_POLY1305};
+    const qed_mac_t macs[] = {QED_MAC_QUANTUM, QED_MAC_HMAC_SHA256};
+    const size_t sizes[] = {1, 15, 16, 100, 4096, 5000, 70000};
+    uint8_t *plaintext = malloc(70000);
+    uint8_t *sealed_into = malloc(QED_CIPHERTEXT_MAX(70000));
+    uint8_t *opened_into = malloc(QED_CIPHERTEXT_MAX(70000));
+    size_t c, m, s, option;
+
+    if (!plaintext || !sealed_into || !opened_into) {
+        TEST_CHECK(false, "out of memory");
+        goto cleanup;
+    }
+    test_fill(plaintext, 70000, 1);
+
+    for (c = 0; c < 3; c++) {
+        for (m = 0; m < 2; m++) {
+            // Plain, compressed, then with per-buffer subkeys
+            for (option = 0; option < 3; option++) {
+                qed_set_cipher(device, ciphers[c]);
+                qed_set_mac(device, macs[m]);
+                qed_set_compression(device, option == 1 ? QED_COMPRESSION_ZLIB :
+                                    QED_COMPRESSION_NONE, 0);
+                qed_set_subkeys(device, option == 2);
+
+                for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                    uint8_t *sealed = NULL, *opened = NULL;
+                    size_t sealed_len = 0, opened_len = 0, into_len = 0, i;
+                    qed_result_t result;
+
+                    result = qed_quantum_encrypt(device, TEST_KEY, plaintext, sizes[s],
+                                                 &sealed, &sealed_len);
+                    TEST_CHECK(result == QED_SUCCESS, "encrypt %s/%zu/%zu B: %s",
+                               qed_cipher_name(ciphers[c]), m, sizes[s],
+                               qed_get_error_string(result));
+                    if (result != QED_SUCCESS) {
+                        continue;
+                    }
+
+                    result = qed_quantum_decrypt(device, TEST_KEY, sealed, sealed_len,
+                                                 &opened, &opened_len);
+                    TEST_CHECK(result == QED_SUCCESS && opened_len == sizes[s] &&
+                               memcmp(opened, plaintext, sizes[s]) == 0,
+                               "round trip %s/%zu/%zu/%zu B", qed_cipher_name(ciphers[c]),
+                               m, option, sizes[s]);
+                    free(opened);
+
+                    // The in-place calls read what the allocating ones wrote
+                    result = qed_quantum_decrypt_into(device, TEST_KEY, sealed, sealed_len,
+                                                      opened_into, QED_CIPHERTEXT_MAX(70000),
+                                                      &into_len);
+                    TEST_CHECK(result == QED_SUCCESS && into_len == sizes[s] &&
+                               memcmp(opened_into, plaintext, sizes[s]) == 0,
+                               "decrypt_into %s/%zu/%zu/%zu B", qed_cipher_name(ciphers[c]),
+                               m, option, sizes[s]);
+
+                    // Any flipped bit or missing byte must be caught, but
+                    // the original format leaves its IV unsigned
+                    for (i = 0; i < sealed_len; i += sealed_len / 7 + 1) {
+                        if (c == 0 && m == 0 && option == 0 && i >= QED_SIGNATURE_LENGTH &&
+                            i < QED_SIGNATURE_LENGTH + QED_IV_LENGTH) {
+                            continue;
+                        }
+                        sealed[i] ^= 0x80;
+                        opened = NULL;
+                        TEST_CHECK(qed_quantum_decrypt(device, TEST_KEY, sealed, sealed_len,
+                                                       &opened, &opened_len) != QED_SUCCESS,
+                                   "%s/%zu/%zu/%zu B decrypted with byte %zu flipped",
+                                   qed_cipher_name(ciphers[c]), m, option, sizes[s], i);
+                        TEST_CHECK(qed_quantum_decrypt_into(device, TEST_KEY, sealed,
+                                                            sealed_len, opened_into,
+                                                            QED_CIPHERTEXT_MAX(70000),
+                                                            &into_len) != QED_SUCCESS,
+                                   "decrypt_into accepted byte %zu flipped", i);
+                        free(opened);
+                        sealed[i] ^= 0x80;
+                    }
+                    opened = NULL;
+                    TEST_CHECK(qed_quantum_decrypt(device, TEST_KEY, sealed, sealed_len - 1,
+                                                   &opened, &opened_len) != QED_SUCCESS,
+                               "%s/%zu/%zu/%zu B decrypted truncated",
+                               qed_cipher_name(ciphers[c]), m, option, sizes[s]);
+                    free(opened);
+
+                    result = qed_quantum_encrypt_into(device, TEST_KEY, plaintext, sizes[s],
+                                                      sealed_into, QED_CIPHERTEXT_MAX(70000),
+                                                      &into_len);
+                    TEST_CHECK(result == QED_SUCCESS, "encrypt_into %zu B", sizes[s]);
+                    if (result == QED_SUCCESS) {
+                        opened = NULL;
+                        result = qed_quantum_decrypt(device, TEST_KEY, sealed_into, into_len,
+                                                     &opened, &opened_len);
+                        TEST_CHECK(result == QED_SUCCESS && opened_len == sizes[s] &&
+                                   memcmp(opened, plaintext, sizes[s]) == 0,
+                                   "encrypt_into round trip %zu B", sizes[s]);
+                        free(opened);
+                    }
+                    free(sealed);
+                }
+            }
+        }
+    }
+
+cleanup:
+    qed_set_compression(device, QED_COMPRESSION_NONE, 0);
+    qed_set_subkeys(device, false);
+    qed_set_mac(device, QED_MAC_QUANTUM);
+    qed_set_cipher(device, qed_detect_cipher());
+    free(plaintext);
+    free(sealed_into);
+    free(opened_into);
+}
+
+// Every engine the CPU has must agree with SHA-256(data || noise) from
+// OpenSSL, message by message
+static void test_signatures(qed_device_t *device) {
+    const char *const engines[] = {"avx512", "sha-ni", "avx2", "sse4.1", "openssl"};
+    const qed_hardware_sig_t *hw_sig = &device->hardware_sig;
+    enum { COUNT = 70 };
+    const uint8_t *messages[COUNT];
+    size_t lengths[COUNT];
+    uint8_t *data = malloc(COUNT * 1100);
+    uint8_t expected[COUNT][QED_SIGNATURE_LENGTH];
+    uint8_t signatures[COUNT * QED_SIGNATURE_LENGTH];
+    qed_result_t results[COUNT];
+    size_t e, i;
+
+    if (!data) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    test_fill(data, COUNT * 1100, 2);
+
+    // Lengths around every block boundary, mixed in one batch
+    for (i = 0; i < COUNT; i++) {
+        EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+        unsigned int digest_len;
+
+        messages[i] = data + i * 1100;
+        lengths[i] = (i * 61 + i / 3) % 1100 + 1;
+        EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+        EVP_DigestUpdate(ctx, messages[i], lengths[i]);
+        EVP_DigestUpdate(ctx, hw_sig->quantum_noise, strlen(hw_sig->quantum_noise));
+        EVP_DigestFinal_ex(ctx, expected[i], &digest_len);
+        EVP_MD_CTX_free(ctx);
+
+        TEST_CHECK(qed_generate_quantum_signature(hw_sig, messages[i], lengths[i],
+                                                  signatures) == QED_SUCCESS &&
+                   memcmp(signatures, expected[i], QED_SIGNATURE_LENGTH) == 0,
+                   "single signature of %zu B differs", lengths[i]);
+    }
+
+    for (e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        if (qed_set_hash_engine(engines[e]) != QED_SUCCESS) {
+            fprintf(stderr, "  (hash engine %s not supported here)\n", engines[e]);
+            continue;
+        }
+
+        TEST_CHECK(qed_generate_quantum_signatures(hw_sig, messages, lengths, COUNT,
+                                                   signatures) == QED_SUCCESS,
+                   "%s: batch failed", engines[e]);
+        for (i = 0; i < COUNT; i++) {
+            TEST_CHECK(memcmp(signatures + i * QED_SIGNATURE_LENGTH, expected[i],
+                              QED_SIGNATURE_LENGTH) == 0,
+                       "%s: signature of %zu B differs from scalar", engines[e], lengths[i]);
+        }
+
+        // One altered message fails alone
+        data[5 * 1100] ^= 0x01;
+        TEST_CHECK(qed_verify_quantum_signatures(hw_sig, messages, lengths, COUNT, signatures,
+                                                 results) == QED_ERROR_SIGNATURE_MISMATCH,
+                   "%s: altered batch verified", engines[e]);
+        for (i = 0; i < COUNT; i++) {
+            TEST_CHECK((results[i] == QED_SUCCESS) == (i != 5),
+                       "%s: message %zu reported %s", engines[e], i,
+                       qed_get_error_string(results[i]));
+        }
+        data[5 * 1100] ^= 0x01;
+    }
+
+    qed_set_hash_engine(NULL);
+    free(data);
+}
+
+static void test_whole_files(qed_device_t *device) {
+    const size_t sizes[] = {1, 3000, 200000};
+    uint8_t *plaintext = malloc(200000);
+    const char *input = "whole.in";
+    const char *sealed = "whole.qed";
+    const char *opened = "whole.out";
+    size_t s;
+    int version;
+
+    if (!plaintext) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    test_fill(plaintext, 200000, 3);
+
+    // The original CBC format, then the versioned one
+    for (version = 1; version <= 2; version++) {
+        qed_set_cipher(device, version == 1 ? QED_CIPHER_AES_256_CBC : QED_CIPHER_AES_256_GCM);
+        qed_set_mmap_input(device, version == 2);
+
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            test_write(input, plaintext, sizes[s]);
+            unlink(opened);
+            TEST_CHECK(qed_encrypt_file(device, TEST_KEY, input, sealed) == QED_SUCCESS &&
+                       qed_decrypt_file(device, TEST_KEY, sealed, opened) == QED_SUCCESS &&
+                       test_same(opened, plaintext, sizes[s]),
+                       "v%d round trip of %zu B", version, sizes[s]);
+            unlink(opened);
+            test_file_tampering(device, sealed, version == 1);
+        }
+    }
+
+    qed_set_mmap_input(device, false);
+    qed_set_cipher(device, qed_detect_cipher());
+    free(plaintext);
+}
+
+// Decrypt, verify and a range read of all size bytes must each reject it
+static void test_chunked_rejected(qed_device_t *device, const char *path, size_t size,
+                                  const char *what) {
+    uint8_t *buffer = malloc(size);
+
+    TEST_CHECK(qed_decrypt_file(device, TEST_KEY, path, "rejected.out") != QED_SUCCESS,
+               "%s: decrypted", what);
+    TEST_CHECK(qed_verify_file(device, TEST_KEY, path) != QED_SUCCESS, "%s: verified", what);
+    TEST_CHECK(!buffer || qed_decrypt_range(device, TEST_KEY, path, 0, size, buffer) != QED_SUCCESS,
+               "%s: range read", what);
+    free(buffer);
+}
+
+static void test_chunked(qed_device_t *device) {
+    const size_t size = 10 * TEST_CHUNK_SIZE + 1234;
+    const uint64_t ranges[][2] = {{0, 1}, {100, 5000}, {TEST_CHUNK_SIZE - 1, 2},
+                                  {size - 1234, 1234}, {0, size}};
+    uint8_t *plaintext = malloc(size), *range = malloc(size);
+    const char *input = "chunked.in";
+    const char *sealed = "chunked.qed";
+    const char *opened = "chunked.out";
+    const char *damaged = "chunked.bad";
+    uint64_t offset0, offset1, offset9, offset10;
+    uint32_t length0, length1, length9, length10;
+    size_t r;
+    int option;
+
+    if (!plaintext || !range) {
+        TEST_CHECK(false, "out of memory");
+        goto cleanup;
+    }
+    test_fill(plaintext, size, 4);
+    test_write(input, plaintext, size);
+
+    // Plain, compressed, then with per-file subkeys and HMAC
+    for (option = 0; option < 3; option++) {
+        qed_set_compression(device, option == 1 ? QED_COMPRESSION_ZLIB : QED_COMPRESSION_NONE, 0);
+        qed_set_subkeys(device, option == 2);
+        qed_set_mac(device, option == 2 ? QED_MAC_HMAC_SHA256 : QED_MAC_QUANTUM);
+
+        TEST_CHECK(qed_encrypt_file_chunked(device, TEST_KEY, input, sealed,
+                                            TEST_CHUNK_SIZE) == QED_SUCCESS &&
+                   qed_decrypt_file(device, TEST_KEY, sealed, opened) == QED_SUCCESS &&
+                   test_same(opened, plaintext, size), "round trip, option %d", option);
+        TEST_CHECK(qed_verify_file(device, TEST_KEY, sealed) == QED_SUCCESS,
+                   "verify, option %d", option);
+
+        for (r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+            TEST_CHECK(qed_decrypt_range(device, TEST_KEY, sealed, ranges[r][0],
+                                         (size_t)ranges[r][1], range) == QED_SUCCESS &&
+                       memcmp(range, plaintext + ranges[r][0], (size_t)ranges[r][1]) == 0,
+                       "range %lu:%lu, option %d", (unsigned long)ranges[r][0],
+                       (unsigned long)ranges[r][1], option);
+        }
+        TEST_CHECK(qed_decrypt_range(device, TEST_KEY, sealed, size - 10, 11, range) !=
+                   QED_SUCCESS, "range past the end");
+
+        if (!test_chunk_record(sealed, 0, &offset0, &length0) ||
+            !test_chunk_record(sealed, 1, &offset1, &length1) ||
+            !test_chunk_record(sealed, 9, &offset9, &length9) ||
+            !test_chunk_record(sealed, 10, &offset10, &length10)) {
+            TEST_CHECK(false, "cannot read the index");
+            continue;
+        }
+
+        test_flip(sealed, damaged, (long)(offset1 + length1 / 2));
+        test_chunked_rejected(device, damaged, size, "flipped record byte");
+        test_flip(sealed, damaged, 5);
+        test_chunked_rejected(device, damaged, size, "flipped header byte");
+        test_flip(sealed, damaged, -(long)(QED_CHUNKED_FOOTER_SIZE + 3));
+        test_chunked_rejected(device, damaged, size, "flipped index byte");
+        test_truncate(sealed, damaged, 1);
+        test_chunked_rejected(device, damaged, size, "truncated");
+        test_resize_header(sealed, damaged, -1);
+        test_chunked_rejected(device, damaged, size, "shrunk size field");
+
+        // Records moved to another chunk's place
+        if (length0 == length1) {
+            size_t file_len;
+            uint8_t *data = test_read(sealed, &file_len);
+            uint8_t *swap = malloc(length0);
+
+            memcpy(swap, data + offset0, length0);
+            memmove(data + offset0, data + offset1, length0);
+            memcpy(data + offset1, swap, length0);
+            test_write(damaged, data, file_len);
+            test_chunked_rejected(device, damaged, size, "swapped records");
+            free(swap);
+            free(data);
+        }
+
+        // A record from another encryption of the same input, at its own index
+        test_copy(sealed, damaged);
+        TEST_CHECK(qed_encrypt_file_chunked(device, TEST_KEY, input, opened,
+                                            TEST_CHUNK_SIZE) == QED_SUCCESS, "second encryption");
+        test_splice(opened, damaged, offset1, length1);
+        test_chunked_rejected(device, damaged, size, "record spliced from another file");
+
+        // Dropping the last chunk: a shorter file whose new last record
+        // was not sealed as final
+        {
+            size_t file_len;
+            uint8_t *data = test_read(sealed, &file_len);
+            uint8_t *shorter = malloc(file_len);
+            uint64_t index_offset = qed_get_le64(data + file_len - QED_CHUNKED_FOOTER_SIZE);
+            size_t kept = (size_t)(offset9 + length9);
+
+            memcpy(shorter, data, kept);
+            memcpy(shorter + kept, data + index_offset, 10 * QED_CHUNKED_INDEX_ENTRY_SIZE);
+            memcpy(shorter + kept + 10 * QED_CHUNKED_INDEX_ENTRY_SIZE,
+                   data + file_len - QED_CHUNKED_FOOTER_SIZE, QED_CHUNKED_FOOTER_SIZE);
+            qed_put_le64(shorter + 16, 10 * TEST_CHUNK_SIZE);
+            qed_put_le64(shorter + kept + 10 * QED_CHUNKED_INDEX_ENTRY_SIZE, kept);
+            qed_put_le64(shorter + kept + 10 * QED_CHUNKED_INDEX_ENTRY_SIZE + 8, 10);
+            test_write(damaged, shorter, kept + 10 * QED_CHUNKED_INDEX_ENTRY_SIZE +
+                       QED_CHUNKED_FOOTER_SIZE);
+            test_chunked_rejected(device, damaged, size, "dropped last chunk");
+            free(shorter);
+            free(data);
+        }
+    }
+
+cleanup:
+    qed_set_compression(device, QED_COMPRESSION_NONE, 0);
+    qed_set_subkeys(device, false);
+    qed_set_mac(device, QED_MAC_QUANTUM);
+    free(plaintext);
+    free(range);
+}
+
+static void test_sparse(qed_device_t *device) {
+    const size_t size = 3000000;
+    uint8_t *plaintext = calloc(1, size), *range = malloc(size);
+    const char *input = "sparse.in";
+    const char *sealed = "sparse.qed";
+    const char *opened = "sparse.out";
+    const char *damaged = "sparse.bad";
+    uint64_t last_offset;
+    uint32_t last_length;
+    int fd;
+
+    if (!plaintext || !range) {
+        TEST_CHECK(false, "out of memory");
+        goto cleanup;
+    }
+
+    // Data, a hole, data, then a trailing hole
+    test_fill(plaintext + 100000, 300000, 5);
+    test_fill(plaintext + 1500000, 200000, 6);
+    fd = open(input, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 || pwrite(fd, plaintext + 100000, 300000, 100000) != 300000 ||
+        pwrite(fd, plaintext + 1500000, 200000, 1500000) != 200000 ||
+        ftruncate(fd, (off_t)size) != 0) {
+        TEST_CHECK(false, "cannot write the sparse input");
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    qed_set_sparse(device, true);
+    TEST_CHECK(qed_encrypt_file_chunked(device, TEST_KEY, input, sealed, 65536) == QED_SUCCESS &&
+               qed_decrypt_file(device, TEST_KEY, sealed, opened) == QED_SUCCESS &&
+               test_same(opened, plaintext, size), "sparse round trip");
+    TEST_CHECK(qed_verify_file(device, TEST_KEY, sealed) == QED_SUCCESS, "sparse verify");
+    TEST_CHECK(qed_decrypt_range(device, TEST_KEY, sealed, 50000, 2000000, range) == QED_SUCCESS &&
+               memcmp(range, plaintext + 50000, 2000000) == 0, "range across holes");
+    qed_set_sparse(device, false);
+
+    // The size must hold even though no record covers the trailing hole
+    test_resize_header(sealed, damaged, -1000);
+    test_chunked_rejected(device, damaged, size, "sparse size shrunk");
+    test_resize_header(sealed, damaged, 10000);
+    test_chunked_rejected(device, damaged, size, "sparse size grown");
+
+    // The hole map is the last record before the index
+    if (test_chunk_record(sealed, 25, &last_offset, &last_length)) {
+        test_flip(sealed, damaged, (long)(last_offset + last_length + 3));
+        test_chunked_rejected(device, damaged, size, "flipped hole map");
+    } else {
+        TEST_CHECK(false, "cannot read the index");
+    }
+    test_flip(sealed, damaged, 7);
+    test_chunked_rejected(device, damaged, size, "sparse flag cleared");
+
+cleanup:
+    qed_set_sparse(device, false);
+    free(plaintext);
+    free(range);
+}
+
+static void test_incremental(qed_device_t *device) {
+    const size_t size = 8 * TEST_CHUNK_SIZE + 100;
+    uint8_t *plaintext = malloc(size + TEST_CHUNK_SIZE);
+    const char *input = "incremental.in";
+    const char *sealed = "incremental.qed";
+    const char *opened = "incremental.out";
+    const char *damaged = "incremental.bad";
+    const char *previous = "incremental.v1";
+    qed_incremental_stats_t stats;
+    uint64_t offset;
+    uint32_t length;
+
+    if (!plaintext) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    test_fill(plaintext, size + TEST_CHUNK_SIZE, 7);
+    test_write(input, plaintext, size);
+
+    TEST_CHECK(qed_encrypt_file_incremental(device, TEST_KEY, input, sealed, TEST_CHUNK_SIZE,
+                                            &stats) == QED_SUCCESS &&
+               stats.chunks_rewritten == 9, "first run");
+    test_copy(sealed, previous);
+
+    // One changed chunk is all a rerun rewrites
+    memset(plaintext + 3 * TEST_CHUNK_SIZE + 10, 0x5a, 7);
+    test_write(input, plaintext, size);
+    TEST_CHECK(qed_encrypt_file_incremental(device, TEST_KEY, input, sealed, TEST_CHUNK_SIZE,
+                                            &stats) == QED_SUCCESS &&
+               stats.chunks_rewritten == 1, "rerun rewrote %lu chunks",
+               (unsigned long)stats.chunks_rewritten);
+    TEST_CHECK(qed_decrypt_file(device, TEST_KEY, sealed, opened) == QED_SUCCESS &&
+               test_same(opened, plaintext, size), "round trip after one change");
+
+    // The changed chunk's record from the first run sits at the same offset
+    // and index, but was sealed in an older generation
+    if (test_chunk_record(sealed, 3, &offset, &length)) {
+        test_copy(sealed, damaged);
+        test_splice(previous, damaged, offset, length);
+        test_chunked_rejected(device, damaged, size, "record spliced from the previous run");
+    } else {
+        TEST_CHECK(false, "cannot read the index");
+    }
+
+    // Growing moves the final marker and adds a chunk
+    test_write(input, plaintext, size + TEST_CHUNK_SIZE);
+    TEST_CHECK(qed_encrypt_file_incremental(device, TEST_KEY, input, sealed, TEST_CHUNK_SIZE,
+                                            &stats) == QED_SUCCESS &&
+               qed_decrypt_file(device, TEST_KEY, sealed, opened) == QED_SUCCESS &&
+               test_same(opened, plaintext, size + TEST_CHUNK_SIZE), "round trip after growth");
+    TEST_CHECK(qed_verify_file(device, TEST_KEY, sealed) == QED_SUCCESS, "verify");
+
+    test_copy(sealed, damaged);
+    test_flip(sealed, damaged, QED_CHUNKED_HEADER_SIZE + 100);
+    test_chunked_rejected(device, damaged, size, "flipped record byte");
+
+    free(plaintext);
+}
+
+// Re-keying changes IVs and salts but not key material: key IDs do not
+// enter derivation, so the output still opens under the old ID
+static void test_rekey(qed_device_t *device) {
+    const size_t size = 5 * TEST_CHUNK_SIZE + 77;
+    uint8_t *plaintext = malloc(size);
+    const char *input = "rekey.in";
+    const char *sealed = "rekey.qed";
+    const char *rekeyed = "rekey2.qed";
+    const char *opened = "rekey.out";
+    const char *damaged = "rekey.bad";
+    int chunked;
+
+    if (!plaintext) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    test_fill(plaintext, size, 8);
+    test_write(input, plaintext, size);
+
+    for (chunked = 0; chunked <= 1; chunked++) {
+        qed_result_t result = chunked ?
+            qed_encrypt_file_chunked(device, TEST_KEY, input, sealed, TEST_CHUNK_SIZE) :
+            qed_encrypt_file(device, TEST_KEY, input, sealed);
+
+        TEST_CHECK(result == QED_SUCCESS &&
+                   qed_rekey_file(device, TEST_KEY, "test-next", sealed, rekeyed) == QED_SUCCESS &&
+                   qed_decrypt_file(device, "test-next", rekeyed, opened) == QED_SUCCESS &&
+                   test_same(opened, plaintext, size), "rekey round trip, chunked %d", chunked);
+        TEST_CHECK(qed_decrypt_file(device, TEST_KEY, rekeyed, opened) == QED_SUCCESS,
+                   "re-keyed file no longer opens under the old ID, chunked %d", chunked);
+
+        test_flip(sealed, damaged, QED_CHUNKED_HEADER_SIZE + 50);
+        TEST_CHECK(qed_rekey_file(device, TEST_KEY, "test-next", damaged, rekeyed) !=
+                   QED_SUCCESS, "damaged input re-keyed, chunked %d", chunked);
+        TEST_CHECK(qed_decrypt_file(device, "test-next", rekeyed, opened) == QED_SUCCESS &&
+                   test_same(opened, plaintext, size),
+                   "failed rekey replaced the earlier output, chunked %d", chunked);
+    }
+
+    free(plaintext);
+}
+
+static void test_archives(qed_device_t *device) {
+    const size_t sizes[] = {0, 10, 100000};
+    const struct timespec stamp[2] = {{1000000000, 0}, {1000000000, 0}};
+    char member[64];
+    uint8_t *plaintext = malloc(100000);
+    struct stat st;
+    const char *archive = "tree.qar";
+    const char *damaged = "tree.bad";
+    const char *extracted = "extracted";
+    size_t s;
+
+    if (!plaintext) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    test_fill(plaintext, 100000, 9);
+
+    mkdir("tree", 0700);
+    mkdir("tree/sub", 0700);
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        snprintf(member, sizeof(member), "tree/sub/file%zu", s);
+        test_write(member, plaintext, sizes[s]);
+    }
+    chmod("tree/sub/file2", 0640);
+    utimensat(AT_FDCWD, "tree/sub/file2", stamp, 0);
+
+    TEST_CHECK(qed_archive_pack(device, TEST_KEY, "tree", archive) == QED_SUCCESS &&
+               qed_archive_unpack(device, TEST_KEY, archive, "unpacked") == QED_SUCCESS,
+               "pack and unpack");
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        snprintf(member, sizeof(member), "unpacked/sub/file%zu", s);
+        TEST_CHECK(test_same(member, plaintext, sizes[s]), "unpacked file%zu", s);
+    }
+    TEST_CHECK(qed_archive_extract(device, TEST_KEY, archive, "sub/file2", extracted) ==
+               QED_SUCCESS && test_same(extracted, plaintext, 100000), "extract one entry");
+    TEST_CHECK(stat(extracted, &st) == 0 && (st.st_mode & 07777) == 0640 &&
+               st.st_mtime == stamp[1].tv_sec, "extracted entry lost its mode or mtime");
+
+    // A failed extraction leaves the file it would have replaced alone
+    test_flip(archive, damaged, 40000);
+    test_write(extracted, "kept", 4);
+    TEST_CHECK(qed_archive_extract(device, TEST_KEY, damaged, "sub/file2", extracted) !=
+               QED_SUCCESS && test_same(extracted, (const uint8_t *)"kept", 4),
+               "failed extraction replaced its target");
+
+    TEST_CHECK(qed_archive_unpack(device, TEST_KEY, damaged, "unpacked2") !=
+               QED_SUCCESS, "archive with a flipped byte unpacked");
+    test_flip(archive, damaged, -5);
+    TEST_CHECK(qed_archive_unpack(device, TEST_KEY, damaged, "unpacked3") !=
+               QED_SUCCESS, "archive with a flipped trailer unpacked");
+    test_truncate(archive, damaged, 1);
+    TEST_CHECK(qed_archive_unpack(device, TEST_KEY, damaged, "unpacked4") !=
+               QED_SUCCESS, "truncated archive unpacked");
+
+    free(plaintext);
+}
+
+// Appends what is ready on fd to wire
+static size_t test_drain(int fd, uint8_t *wire, size_t length, size_t capacity) {
+    ssize_t n;
+
+    while (length < capacity &&
+           (n = recv(fd, wire + length, capacity - length, MSG_DONTWAIT)) > 0) {
+        length += (size_t)n;
+    }
+    return length;
+}
+
+// Reads stream until it ends or fails; the result of the last read
+static qed_result_t test_stream_read(qed_stream_t *stream, uint8_t *buffer, size_t capacity,
+                                     size_t *total) {
+    qed_result_t result;
+    size_t got;
+
+    *total = 0;
+    do {
+        result = qed_stream_read(stream, buffer + *total, capacity - *total, &got);
+        *total += result == QED_SUCCESS ? got : 0;
+    } while (result == QED_SUCCESS && got > 0);
+    return result;
+}
+
+// The test sits between a writer and a reader on two socket pairs, so it
+// can pass their bytes on altered, cut short, replayed or sent back
+static void test_streams(qed_device_t *device) {
+    uint8_t key[QED_KEY_LENGTH];
+    uint8_t message[3000], wire[8192], hello[64], received[4000];
+    size_t wire_len = 0, hello_len, total;
+    qed_stream_t *writer, *reader;
+    int writer_fds[2], reader_fds[2];
+    int variant;
+
+    test_fill(message, sizeof(message), 10);
+    qed_generate_quantum_key(device, TEST_KEY, key, sizeof(key));
+
+    // 0: intact, 1: a flipped payload byte, 2: cut before the close record,
+    // 3: the last writer's bytes replayed to a reader with a new salt
+    for (variant = 0; variant < 4; variant++) {
+        qed_result_t result = QED_ERROR_FILE_IO;
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, reader_fds) != 0) {
+            TEST_CHECK(false, "socketpair");
+            return;
+        }
+        if (qed_stream_open(device, reader_fds[0], key, 1024, 0, &reader) != QED_SUCCESS) {
+            TEST_CHECK(false, "stream open");
+            close(reader_fds[0]);
+            close(reader_fds[1]);
+            continue;
+        }
+        hello_len = test_drain(reader_fds[1], hello, 0, sizeof(hello));
+
+        // The reader's salt reaches the writer before it may write
+        if (variant < 3 && socketpair(AF_UNIX, SOCK_STREAM, 0, writer_fds) == 0) {
+            TEST_CHECK(write(writer_fds[1], hello, hello_len) == (ssize_t)hello_len &&
+                       qed_stream_open(device, writer_fds[0], key, 1024, 0, &writer) ==
+                       QED_SUCCESS &&
+                       qed_stream_write(writer, message, sizeof(message)) == QED_SUCCESS &&
+                       qed_stream_close(writer) == QED_SUCCESS, "stream write");
+            wire_len = test_drain(writer_fds[1], wire, 0, sizeof(wire));
+            close(writer_fds[0]);
+            close(writer_fds[1]);
+        }
+
+        if (variant == 1) {
+            wire[wire_len / 2] ^= 0x01;
+        }
+        if (variant == 2) {
+            wire_len -= 10;
+        }
+        if (write(reader_fds[1], wire, wire_len) == (ssize_t)wire_len &&
+            shutdown(reader_fds[1], SHUT_WR) == 0) {
+            result = test_stream_read(reader, received, sizeof(received), &total);
+        }
+        qed_stream_close(reader);
+        close(reader_fds[0]);
+        close(reader_fds[1]);
+
+        if (variant == 0) {
+            TEST_CHECK(result == QED_SUCCESS && total == sizeof(message) &&
+                       memcmp(received, message, sizeof(message)) == 0, "stream round trip");
+        } else {
+            TEST_CHECK(result != QED_SUCCESS, "stream variant %d read cleanly", variant);
+        }
+        if (variant == 1) {
+            wire[wire_len / 2] ^= 0x01;
+        }
+        if (variant == 2) {
+            wire_len += 10;
+        }
+    }
+
+    // A writer's own salt sent back to it is not a peer
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, writer_fds) == 0) {
+        if (qed_stream_open(device, writer_fds[0], key, 1024, 0, &writer) == QED_SUCCESS) {
+            hello_len = test_drain(writer_fds[1], hello, 0, sizeof(hello));
+            TEST_CHECK(write(writer_fds[1], hello, hello_len) == (ssize_t)hello_len &&
+                       qed_stream_write(writer, message, sizeof(message)) != QED_SUCCESS,
+                       "stream wrote after its own salt came back");
+            qed_stream_close(writer);
+        }
+        close(writer_fds[0]);
+        close(writer_fds[1]);
+    }
+
+    // Nor do its own records, behind a genuine peer's salt, read as the
+    // peer's: each direction has its own key
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, reader_fds) != 0 ||
+        socketpair(AF_UNIX, SOCK_STREAM, 0, writer_fds) != 0) {
+        TEST_CHECK(false, "socketpair");
+        return;
+    }
+    if (qed_stream_open(device, reader_fds[0], key, 1024, 0, &reader) == QED_SUCCESS) {
+        hello_len = test_drain(reader_fds[1], hello, 0, sizeof(hello));
+        if (write(writer_fds[1], hello, hello_len) == (ssize_t)hello_len &&
+            qed_stream_open(device, writer_fds[0], key, 1024, 0, &writer) == QED_SUCCESS) {
+            // Everything after the writer's HELLO, which is as long as the
+            // reader's
+            TEST_CHECK(qed_stream_write(writer, message, sizeof(message)) == QED_SUCCESS,
+                       "stream write before reflection");
+            wire_len = test_drain(writer_fds[1], wire, 0, sizeof(wire));
+            if (wire_len > hello_len &&
+                write(writer_fds[1], wire + hello_len, wire_len - hello_len) ==
+                (ssize_t)(wire_len - hello_len) && shutdown(writer_fds[1], SHUT_WR) == 0) {
+                TEST_CHECK(test_stream_read(writer, received, sizeof(received), &total) !=
+                           QED_SUCCESS, "stream read its own records as the peer's");
+            } else {
+                TEST_CHECK(false, "cannot reflect the writer's records");
+            }
+            qed_stream_close(writer);
+        }
+        qed_stream_close(reader);
+    }
+    close(writer_fds[0]);
+    close(writer_fds[1]);
+    close(reader_fds[0]);
+    close(reader_fds[1]);
+    qed_secure_zero(key, sizeof(key));
+}
+
+// Joins two managers: each side's nonce is held until the other side
+// starts its exchange, then both are answered
+typedef struct {
+    qed_channel_manager_t *managers[2];
+    const char *ids[2];
+    uint64_t tickets[2];
+    uint8_t nonces[2][QED_CHANNEL_NONCE_LENGTH];
+    bool waiting[2];
+} test_pair_t;
+
+static qed_result_t test_pair_exchange(void *ctx, qed_channel_manager_t *manager, uint64_t ticket,
+                                       const char *partner_id, const uint8_t *nonce) {
+    test_pair_t *pair = ctx;
+    int side = manager == pair->managers[1];
+
+    if (strcmp(partner_id, pair->ids[1 - side]) != 0) {
+        return QED_ERROR_KEY_NOT_FOUND;
+    }
+    pair->tickets[side] = ticket;
+    memcpy(pair->nonces[side], nonce, QED_CHANNEL_NONCE_LENGTH);
+    pair->waiting[side] = true;
+
+    if (pair->waiting[0] && pair->waiting[1]) {
+        pair->waiting[0] = pair->waiting[1] = false;
+        qed_channel_deliver(pair->managers[0], pair->tickets[0], QED_SUCCESS, pair->nonces[1]);
+        qed_channel_deliver(pair->managers[1], pair->tickets[1], QED_SUCCESS, pair->nonces[0]);
+    }
+    return QED_SUCCESS;
+}
+
+// Runs one exchange between "alice" on the first device and "bob" on the
+// second; keys receives the key each end derived
+static bool test_channel_pair(qed_device_t *devices[2], uint8_t keys[2][QED_KEY_LENGTH]) {
+    test_pair_t pair = {{NULL, NULL}, {"alice", "bob"}, {0, 0}, {{0}}, {false, false}};
+    qed_channel_transport_t transport = {test_pair_exchange, NULL, &pair};
+    bool ok = true;
+    int side;
+
+    for (side = 0; side < 2; side++) {
+        ok = qed_channel_manager_create(devices[side], pair.ids[side], &transport, NULL, NULL,
+                                        &pair.managers[side]) == QED_SUCCESS && ok;
+    }
+    for (side = 0; ok && side < 2; side++) {
+        ok = qed_channel_establish(pair.managers[side], pair.ids[1 - side]) == QED_SUCCESS;
+    }
+    for (side = 0; ok && side < 2; side++) {
+        ok = qed_channel_wait(pair.managers[side], 1000) == QED_SUCCESS &&
+             qed_channel_lookup(pair.managers[side], pair.ids[1 - side],
+                                keys[side]) == QED_SUCCESS;
+    }
+
+    for (side = 0; side < 2; side++) {
+        qed_channel_manager_destroy(pair.managers[side]);
+    }
+    return ok;
+}
+
+// Both ends of one exchange hold the same key when they share a hardware
+// profile, and different keys when they do not
+static void test_channels(qed_device_t *device) {
+    static const char *const profiles[3][2] = {
+        {NULL, NULL}, {"reference", "reference"}, {"laptop", "server"}
+    };
+    qed_device_t own[2];
+    qed_device_t *devices[2];
+    qed_hardware_sig_t profile;
+    uint8_t keys[2][QED_KEY_LENGTH];
+    uint8_t zero[QED_KEY_LENGTH] = {0};
+    bool ok, same;
+    size_t p;
+    int side;
+
+    memset(own, 0, sizeof(own));
+    for (p = 0; p < 3; p++) {
+        for (side = 0; side < 2; side++) {
+            devices[side] = device;
+            if (profiles[p][side]) {
+                devices[side] = &own[side];
+                TEST_CHECK(qed_load_hardware_profile(profiles[p][side], &profile) == QED_SUCCESS &&
+                           qed_init_with_profile(&own[side], &profile) == QED_SUCCESS,
+                           "initialise a %s device", profiles[p][side]);
+            }
+        }
+
+        ok = test_channel_pair(devices, keys);
+        TEST_CHECK(ok, "exchange %zu failed", p);
+        if (ok) {
+            same = memcmp(keys[0], keys[1], QED_KEY_LENGTH) == 0;
+            TEST_CHECK(memcmp(keys[0], zero, QED_KEY_LENGTH) != 0 && same == (p < 2), "%s",
+                       p < 2 ? "the two ends derived different keys" :
+                               "devices with different profiles agreed on a key");
+        }
+
+        for (side = 0; side < 2; side++) {
+            if (devices[side] != device) {
+                qed_cleanup(devices[side]);
+            }
+        }
+    }
+    qed_secure_zero(keys, sizeof(keys));
+}
+
+static void test_batches(qed_device_t *device) {
+    enum { JOBS = 6 };
+    qed_batch_job_t jobs[JOBS];
+    qed_batch_result_t results[JOBS];
+    char paths[JOBS][3][32];
+    uint8_t *plaintext = malloc(50000);
+    const char *verify_paths[JOBS];
+    qed_verify_result_t verified[JOBS];
+    size_t i;
+
+    if (!plaintext) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    test_fill(plaintext, 50000, 11);
+
+    for (i = 0; i < JOBS; i++) {
+        snprintf(paths[i][0], sizeof(paths[i][0]), "batch%zu.in", i);
+        snprintf(paths[i][1], sizeof(paths[i][1]), "batch%zu.qed", i);
+        snprintf(paths[i][2], sizeof(paths[i][2]), "batch%zu.out", i);
+        test_write(paths[i][0], plaintext, 1000 + i * 9000);
+        jobs[i] = (qed_batch_job_t){QED_BATCH_ENCRYPT, TEST_KEY, paths[i][0], paths[i][1], NULL};
+        verify_paths[i] = paths[i][1];
+    }
+    TEST_CHECK(qed_run_batch(device, jobs, JOBS, 3, TEST_CHUNK_SIZE, NULL, NULL,
+                             results) == QED_SUCCESS, "batch encrypt");
+
+    // Each file reports on its own
+    test_flip(paths[2][1], paths[2][1], QED_CHUNKED_HEADER_SIZE + 70);
+    TEST_CHECK(qed_verify_files(device, TEST_KEY, verify_paths, JOBS, verified) == QED_SUCCESS,
+               "batch verify");
+    for (i = 0; i < JOBS; i++) {
+        TEST_CHECK((verified[i].result == QED_SUCCESS) == (i != 2), "verify of file %zu: %s",
+                   i, qed_get_error_string(verified[i].result));
+        jobs[i] = (qed_batch_job_t){QED_BATCH_DECRYPT, TEST_KEY, paths[i][1], paths[i][2], NULL};
+    }
+
+    qed_run_batch(device, jobs, JOBS, 3, 0, NULL, NULL, results);
+    for (i = 0; i < JOBS; i++) {
+        TEST_CHECK(i == 2 ? results[i].result != QED_SUCCESS :
+                   results[i].result == QED_SUCCESS &&
+                   test_same(paths[i][2], plaintext, 1000 + i * 9000), "batch decrypt %zu", i);
+    }
+
+    free(plaintext);
+}
+
+static int test_remove(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+int main(void) {
+    static const struct {
+        const char *name;
+        void (*run)(qed_device_t *device);
+    } tests[] = {
+        {"buffers", test_buffers},
+        {"signatures", test_signatures},
+        {"whole files", test_whole_files},
+        {"chunked files", test_chunked},
+        {"sparse files", test_sparse},
+        {"incremental", test_incremental},
+        {"rekey", test_rekey},
+        {"archives", test_archives},
+        {"streams", test_streams},
+        {"channels", test_channels},
+        {"batches", test_batches}
+    };
+    qed_device_t device;
+    size_t i;
+
+    // The same keys on every host unless the caller names another profile
+    setenv("QED_HARDWARE_PROFILE", "reference", 0);
+
+    // Every test works in one scratch directory, removed at the end
+    if (!mkdtemp(test_dir) || chdir(test_dir) != 0) {
+        fprintf(stderr, "❌ Cannot create a test directory\n");
+        return 1;
+    }
+    if (qed_init(&device) != QED_SUCCESS) {
+        fprintf(stderr, "❌ Failed to initialize quantum device\n");
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = test_failures;
+
+        tests[i].run(&device);
+        fprintf(stderr, "%s %s\n", test_failures == before ? "✅" : "❌", tests[i].name);
+    }
+
+    qed_cleanup(&device);
+    if (chdir("/") == 0) {
+        nftw(test_dir, test_remove, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    if (test_failures) {
+        fprintf(stderr, "❌ %d check(s) failed\n", test_failures);
+    }
+    return test_failures ? 1 : 0;
+}